@@ -227,6 +227,94 @@ static uint8_t getMaxWidth(void) {
 	return w;
 }
 
+/*
+ * Glyph rendering
+ *
+ * Glyph rows are read as bit masks (bit i is pixel i of the row) and drawn
+ * as horizontal spans. With antialias, the pixels that are off but have a
+ * pixel on at one side and another one above or below (the steps of the
+ * diagonal strokes) are blended with the color.
+ */
+
+// Alpha for the steps of the diagonal strokes
+#define GLYPH_STEP_ALPHA 96
+
+// Read width bits (up to 64) of a glyph, MSB first, starting at bit
+static uint64_t glyph_bits(const uint8_t *data, uint32_t bit, int width) {
+	uint64_t row = 0;
+	int i;
+
+	for (i = 0; i < width; i++, bit++) {
+		if (data[bit >> 3] & (0x80 >> (bit & 7))) {
+			row |= (1ULL << i);
+		}
+	}
+
+	return row;
+}
+
+static void draw_glyph_row(int x, int y, uint64_t row, int color) {
+	int i = 0, len;
+
+	while (row) {
+		len = __builtin_ctzll(row);
+		row >>= len;
+		i += len;
+
+		len = (~row)?__builtin_ctzll(~row):64;
+		gdisplay_fill(x + i, y, x + i + len - 1, y, color);
+
+		row = (len < 64)?(row >> len):0;
+		i += len;
+	}
+}
+
+static void smooth_glyph_row(int x, int y, uint64_t above, uint64_t row, uint64_t below, int width, int color) {
+	uint64_t mask = (width < 64)?((1ULL << width) - 1):~0ULL;
+	uint64_t steps = ((row << 1) | (row >> 1)) & (above | below) & ~row & mask;
+	uint8_t alpha = GLYPH_STEP_ALPHA;
+	int i;
+
+	while (steps) {
+		i = __builtin_ctzll(steps);
+		gdisplay_blend_span(x + i, x + i, y, &alpha, color);
+		steps &= steps - 1;
+	}
+}
+
+// Draw a glyph of width x height pixels. Each row starts stride bits after the previous one.
+static void draw_glyph(int x, int y, const uint8_t *data, int width, int height, int stride, int color) {
+	uint64_t above = 0, row, below;
+	int j, c;
+
+	if ((width <= 0) || (height <= 0)) {
+		return;
+	}
+
+	if (width > 64) {
+		for (j = 0; j < height; j++) {
+			for (c = 0; c < width; c += 64) {
+				draw_glyph_row(x + c, y + j, glyph_bits(data, j * stride + c, ((width - c) < 64)?(width - c):64), color);
+			}
+		}
+
+		return;
+	}
+
+	row = glyph_bits(data, 0, width);
+	for (j = 0; j < height; j++) {
+		below = (j + 1 < height)?glyph_bits(data, (j + 1) * stride, width):0;
+
+		draw_glyph_row(x, y + j, row, color);
+		if (gdisplay_get_antialias()) {
+			smooth_glyph_row(x, y + j, above, row, below, width, color);
+		}
+
+		above = row;
+		row = below;
+	}
+}
+
 static int rotatePropChar(int x, int y, int offset, int color, int fill) {
 	uint8_t ch = 0;
 	double radian = gdisplay_get_rotation() * 0.0175;
@@ -264,9 +352,6 @@ static int rotatePropChar(int x, int y, int offset, int color, int fill) {
 }
 
 static int printProportionalChar(int x, int y, int color, int fill) {
-	uint8_t i, j, ch = 0;
-	uint16_t cx, cy;
-
 	gdisplay_begin();
 
 	// fill background if not transparent background
@@ -274,24 +359,11 @@ static int printProportionalChar(int x, int y, int color, int fill) {
 		gdisplay_rect_fill(x, y, fontChar.xDelta + 1, cfont.y_size, fill, fill);
 	}
 
-	// draw Glyph
-	uint8_t mask = 0x80;
-	for (j = 0; j < fontChar.height; j++) {
-		for (i = 0; i < fontChar.width; i++) {
-			if (((i + (j * fontChar.width)) % 8) == 0) {
-				mask = 0x80;
-				ch = cfont.font[fontChar.dataPtr++];
-			}
-
-			if ((ch & mask) != 0) {
-				cx = (uint16_t) (x + fontChar.xOffset + i);
-				cy = (uint16_t) (y + j + fontChar.adjYOffset);
-
-				gdisplay_set_pixel(cx, cy, color);
-			}
-			mask >>= 1;
-		}
-	}
+	// draw Glyph, bits are packed without padding at the end of the rows
+	draw_glyph(
+		x + fontChar.xOffset, y + fontChar.adjYOffset, &cfont.font[fontChar.dataPtr],
+		fontChar.width, fontChar.height, fontChar.width, color
+	);
 
 	gdisplay_end();
 
@@ -339,7 +411,7 @@ static int getCharPtr(uint8_t c) {
 
 static void printChar(uint8_t c, int x, int y, int color, int fill) {
 	uint8_t i, j, ch, fz, mask;
-	uint16_t k, temp, cx, cy;
+	uint16_t temp, cx, cy;
 
 	gdisplay_begin();
 
@@ -376,22 +448,8 @@ static void printChar(uint8_t c, int x, int y, int color, int fill) {
 			gdisplay_rect_fill(x, y, cfont.x_size, cfont.y_size, fill, fill);
 		}
 
-		for (j = 0; j < cfont.y_size; j++) {
-			for (k = 0; k < fz; k++) {
-				ch = cfont.font[temp + k];
-				mask = 0x80;
-				for (i = 0; i < 8; i++) {
-					if ((ch & mask) != 0) {
-						cx = (uint16_t) (x + i + (k * 8));
-						cy = (uint16_t) (y + j);
-
-						gdisplay_set_pixel(cx, cy, color);
-					}
-					mask >>= 1;
-				}
-			}
-			temp += (fz);
-		}
+		// draw Glyph, each row takes fz bytes
+		draw_glyph(x, y, &cfont.font[temp], fz * 8, cfont.y_size, fz * 8, color);
 	}
 
 	gdisplay_end();
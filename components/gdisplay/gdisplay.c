@@ -50,6 +50,7 @@
 #include <stdint.h>
 
 #include <gdisplay/gdisplay.h>
+#include <gdisplay/raster.h>
 
 #include <drivers/gpio.h>
 #include <drivers/power_bus.h>
@@ -64,6 +65,7 @@ static uint8_t transparent = 0;
 static uint16_t rotation = 0;
 static uint8_t orientation = 0;
 static uint8_t wrap = 0;
+static uint8_t antialias = 0;
 static uint8_t type = 0;
 static int offset = 0;
 
@@ -147,6 +149,26 @@ static void gdisplay_update() {
 }
 
 
+// Clip a rectangle to the display window. Returns 0 if nothing remains.
+static int gdisplay_clip(int *x0, int *y0, int *x1, int *y1) {
+	if (*x0 < dispWin.x1) *x0 = dispWin.x1;
+	if (*y0 < dispWin.y1) *y0 = dispWin.y1;
+	if (*x1 > dispWin.x2) *x1 = dispWin.x2;
+	if (*y1 > dispWin.y2) *y1 = dispWin.y2;
+
+	return ((*x0 <= *x1) && (*y0 <= *y1));
+}
+
+// Add a rectangle to the frame buffer bounding box and dirty tiles
+static void gdisplay_bb_update(int x0, int y0, int x1, int y1) {
+	if (x0 < bbx1) bbx1 = x0;
+	if (x1 > bbx2) bbx2 = x1;
+	if (y0 < bby1) bby1 = y0;
+	if (y1 > bby2) bby2 = y1;
+
+	gdisplay_ll_mark(x0, y0, x1, y1);
+}
+
 /*
  * Operation functions
  */
@@ -161,10 +183,7 @@ uint32_t gdisplay_get_bitmap_pixel(int x, int y, uint8_t *buff, int buffw, int b
 
 void gdisplay_set_bitmap(int x, int y, uint8_t *buff, int buffw, int buffh) {
 	// Update bound box
-	if (x < bbx1) bbx1 = x;
-	if (x + buffw - 1 > bbx2) bbx2 = x + buffw - 1;
-	if (y < bby1) bby1 = y;
-	if (y + buffh - 1 > bby2) bby2 = y + buffh - 1;
+	gdisplay_bb_update(x, y, x + buffw - 1, y + buffh - 1);
 
 	gdisplay_ll_set_bitmap(x, y, buffer?buffer:NULL, buff, buffw, buffh);
 }
@@ -181,10 +200,7 @@ driver_error_t *gdisplay_set_pixel(int x, int y, uint32_t color) {
 
 	// Update bound box, only if frame buffer is used
 	if (buffer) {
-		if (x < bbx1) bbx1 = x;
-		if (x > bbx2) bbx2 = x;
-		if (y < bby1) bby1 = y;
-		if (y > bby2) bby2 = y;
+		gdisplay_bb_update(x, y, x, y);
 	}
 
 	gdisplay_begin();
@@ -206,6 +222,73 @@ driver_error_t *gdisplay_get_pixel(int x, int y, uint32_t *color) {
 	return NULL;
 }
 
+/*
+ * Span functions
+ *
+ * Spans are clipped once, and the frame buffer bounding box is updated once
+ * per span instead of once per pixel. With a 16-bit frame buffer the pixels
+ * are written directly to the frame buffer.
+ */
+
+void gdisplay_fill(int x0, int y0, int x1, int y1, uint32_t color) {
+	gdisplay_caps_t *caps = gdisplay_ll_get_caps();
+	int x, y;
+
+	if (!gdisplay_clip(&x0, &y0, &x1, &y1)) {
+		return;
+	}
+
+	gdisplay_begin();
+
+	if (buffer) {
+		gdisplay_bb_update(x0, y0, x1, y1);
+	}
+
+	if (buffer && (caps->bytes_per_pixel == 2)) {
+		raster_fill((uint16_t *)buffer, caps->width, x0, y0, x1, y1, raster_pixel(color));
+	} else {
+		for(y = y0;y <= y1;y++) {
+			for(x = x0;x <= x1;x++) {
+				gdisplay_ll_set_pixel(x, y, color, buffer, -1, -1);
+			}
+		}
+	}
+
+	gdisplay_end();
+}
+
+void gdisplay_blend_span(int x0, int x1, int y, const uint8_t *alpha, uint32_t color) {
+	gdisplay_caps_t *caps = gdisplay_ll_get_caps();
+	int cx0 = x0, cx1 = x1;
+	int cy0 = y, cy1 = y;
+	int x;
+
+	if (!gdisplay_clip(&cx0, &cy0, &cx1, &cy1)) {
+		return;
+	}
+
+	alpha += cx0 - x0;
+
+	gdisplay_begin();
+
+	if (buffer) {
+		gdisplay_bb_update(cx0, y, cx1, y);
+	}
+
+	if (buffer && (caps->bytes_per_pixel == 2)) {
+		raster_blend_span((uint16_t *)buffer + y * caps->width, cx0, cx1, alpha, color);
+	} else {
+		// Pixels can't be read back, so they are on or off
+		for(x = cx0;x <= cx1;x++) {
+			if (alpha[x - cx0] >= 128) {
+				gdisplay_ll_set_pixel(x, y, color, buffer, -1, -1);
+			}
+		}
+	}
+
+	gdisplay_end();
+}
+
 const gdisplay_t *gdisplay_get(uint8_t chipset) {
 	const gdisplay_t *cdisplay;
 	int i = 0;
@@ -605,6 +688,14 @@ uint8_t gdisplay_get_wrap() {
 	return wrap;
 }
 
+void gdisplay_set_antialias(uint8_t nantialias) {
+	antialias = nantialias;
+}
+
+uint8_t gdisplay_get_antialias() {
+	return antialias;
+}
+
 int gdisplay_get_offset() {
 	return offset;
 }
@@ -798,6 +889,21 @@ driver_error_t *gdisplay_unlock() {
 	return NULL;
 }
 
+driver_error_t *gdisplay_stats(gdisplay_stats_t *stats, uint8_t reset) {
+	// Sanity checks
+	if (!init) {
+		return driver_error(GDISPLAY_DRIVER, GDISPLAY_ERR_IS_NOT_SETUP, "init display first");
+	}
+
+	gdisplay_ll_get_stats(stats);
+
+	if (reset) {
+		gdisplay_ll_reset_stats();
+	}
+
+	return NULL;
+}
+
 driver_error_t *gdisplay_touch_get(int *x, int *y, int *z) {
 	// Sanity checks
 	if (!init) {
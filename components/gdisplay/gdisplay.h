@@ -201,6 +201,8 @@ void gdisplay_end();
 
 driver_error_t *gdisplay_get_pixel(int x, int y, uint32_t *color);
 driver_error_t *gdisplay_set_pixel(int x, int y, uint32_t color);
+void gdisplay_fill(int x0, int y0, int x1, int y1, uint32_t color);
+void gdisplay_blend_span(int x0, int x1, int y, const uint8_t *alpha, uint32_t color);
 driver_error_t *gdisplay_set_font(uint8_t font, const char *file);
 driver_error_t *gdisplay_write_char(int x, int y, char c);
 driver_error_t *gdisplay_write(int x, int y, const char *str);
@@ -227,6 +229,8 @@ void gdisplay_set_transparency(uint8_t ntransparent);
 uint8_t gdisplay_get_transparency();
 void gdisplay_set_wrap(uint8_t nwrap);
 uint8_t gdisplay_get_wrap();
+void gdisplay_set_antialias(uint8_t nantialias);
+uint8_t gdisplay_get_antialias();
 int gdisplay_get_offset();
 void gdisplay_set_offset(int offset);
 uint16_t gdisplay_get_rotation();
@@ -247,6 +251,7 @@ driver_error_t *gdisplay_rgb_to_color(int r, int g, int b, uint32_t *color);
 driver_error_t *gdisplay_touch_get(int *x, int *y, int *z);
 driver_error_t *gdisplay_touch_get_raw(int *x, int *y, int *z);
 driver_error_t *gdisplay_touch_set_cal(int x, int y);
+driver_error_t *gdisplay_stats(gdisplay_stats_t *stats, uint8_t reset);
 
 driver_error_t *gdisplay_lock();
 driver_error_t *gdisplay_unlock();
@@ -62,12 +62,60 @@
  * Helper functions
  */
 
+// Blend a pixel with alpha, swapping x and y for steep lines
+static inline void gdisplay_line_plot(int x, int y, uint8_t alpha, int steep, uint32_t color) {
+	if (steep) {
+		gdisplay_blend_span(y, y, x, &alpha, color);
+	} else {
+		gdisplay_blend_span(x, x, y, &alpha, color);
+	}
+}
+
 /*
- * Operation functions
+ * Anti-aliased line (Xiaolin Wu's algorithm). y advances in 16.16 fixed point
+ * along the major axis, and each step is split between the 2 nearest pixels
+ * by the fractional part of y.
  */
-driver_error_t *gdisplay_hline(int x0, int y0, int w, uint32_t color) {
+static void gdisplay_line_aa(int x0, int y0, int x1, int y1, uint32_t color) {
+	int32_t gradient, y;
+	uint8_t frac;
 	int x;
 
+	int steep = 0;
+	if (abs(y1 - y0) > abs(x1 - x0))
+		steep = 1;
+	if (steep) {
+		swap(x0, y0);
+		swap(x1, y1);
+	}
+	if (x0 > x1) {
+		swap(x0, x1);
+		swap(y0, y1);
+	}
+
+	gradient = ((y1 - y0) * 65536) / (x1 - x0);
+	y = y0 * 65536;
+
+	gdisplay_begin();
+
+	for (x = x0; x <= x1; x++) {
+		frac = (y >> 8) & 0xff;
+
+		gdisplay_line_plot(x, y >> 16, 255 - frac, steep, color);
+		if (frac) {
+			gdisplay_line_plot(x, (y >> 16) + 1, frac, steep, color);
+		}
+
+		y += gradient;
+	}
+
+	gdisplay_end();
+}
+
+/*
+ * Operation functions
+ */
+driver_error_t *gdisplay_hline(int x0, int y0, int w, uint32_t color) {
 	if (w < 0) {
 		w = -1 * w;
 		x0 = x0 - w;
@@ -78,20 +126,12 @@ driver_error_t *gdisplay_hline(int x0, int y0, int w, uint32_t color) {
 		return driver_error(GDISPLAY_DRIVER, GDISPLAY_ERR_IS_NOT_SETUP, "init display first");
 	}
 
-	gdisplay_begin();
-
-	for (x = x0; x < x0 + w; x++) {
-		gdisplay_set_pixel(x,y0,color);
-	}
-
-	gdisplay_end();
+	gdisplay_fill(x0, y0, x0 + w - 1, y0, color);
 
 	return NULL;
 }
 
 driver_error_t *gdisplay_vline(int x0, int y0, int h, uint32_t color) {
-	int y;
-
 	// Sanity checks
 	if (!gdisplay_is_init()) {
 		return driver_error(GDISPLAY_DRIVER, GDISPLAY_ERR_IS_NOT_SETUP, "init display first");
@@ -102,13 +142,7 @@ driver_error_t *gdisplay_vline(int x0, int y0, int h, uint32_t color) {
 		y0 = y0 - h;
 	}
 
-	gdisplay_begin();
-
-	for (y = y0; y < y0 + h; y++) {
-		gdisplay_set_pixel(x0,y,color);
-	}
-
-	gdisplay_end();
+	gdisplay_fill(x0, y0, x0, y0 + h - 1, color);
 
 	return NULL;
 }
@@ -137,6 +171,12 @@ driver_error_t *gdisplay_line(int x0, int y0, int x1, int y1, uint32_t color) {
 		return NULL;
 	}
 
+	if (gdisplay_get_antialias()) {
+		gdisplay_line_aa(x0, y0, x1, y1, color);
+
+		return NULL;
+	}
+
 	int steep = 0;
 	if (abs(y1 - y0) > abs(x1 - x0))
 		steep = 1;
@@ -89,8 +89,6 @@ driver_error_t *gdisplay_rect(int x0, int y0, int w, int h, uint32_t color) {
 }
 
 driver_error_t *gdisplay_rect_fill(int x0, int y0, int w, int h, uint32_t color, uint32_t fill) {
-	int x, y;
-
 	// Sanity checks
 	if (!gdisplay_is_init()) {
 		return driver_error(GDISPLAY_DRIVER, GDISPLAY_ERR_IS_NOT_SETUP, "init display first");
@@ -115,11 +113,7 @@ driver_error_t *gdisplay_rect_fill(int x0, int y0, int w, int h, uint32_t color,
 	gdisplay_vline(x0 + w - 1, y0, h, color);
 
 	// Fill
-	for (y = y0 + 1; y < y0 + h - 1; y++) {
-		for (x = x0 + 1; x < x0 + w - 1; x++) {
-			gdisplay_set_pixel(x,y,fill);
-		}
-	}
+	gdisplay_fill(x0 + 1, y0 + 1, x0 + w - 2, y0 + h - 2, fill);
 
 	gdisplay_end();
 
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2015 - 2020, IBEROXARXA SERVICIOS INTEGRALES, S.L.
+ * Copyright (C) 2015 - 2020, Jaume Olivé Petrus (jolive@whitecatboard.org)
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *     * The WHITECAT logotype cannot be changed, you can remove it, but you
+ *       cannot change it in any way. The WHITECAT logotype is:
+ *
+ *          /\       /\
+ *         /  \_____/  \
+ *        /_____________\
+ *        W H I T E C A T
+ *
+ *     * Redistributions in binary form must retain all copyright notices printed
+ *       to any local or remote output device. This include any reference to
+ *       Lua RTOS, whitecatboard.org, Lua, and other copyright notices that may
+ *       appear in the future.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Lua RTOS, span based rasterization over a RGB565 frame buffer
+ *
+ */
+
+#include <stdint.h>
+
+#include <gdisplay/raster.h>
+
+// A pair of pixels, that can alias the frame buffer
+typedef uint32_t __attribute__((__may_alias__)) raster_pair_t;
+
+void raster_hspan(uint16_t *row, int x0, int x1, uint16_t pixel) {
+	uint16_t *p = row + x0;
+	uint32_t pair = ((uint32_t)pixel << 16) | pixel;
+	raster_pair_t *w;
+	int n = x1 - x0 + 1;
+
+	if (n <= 0) {
+		return;
+	}
+
+	// Align to a pair of pixels
+	if ((uintptr_t)p & 2) {
+		*p++ = pixel;
+		n--;
+	}
+
+	w = (raster_pair_t *)p;
+
+	while (n >= 8) {
+		w[0] = pair;
+		w[1] = pair;
+		w[2] = pair;
+		w[3] = pair;
+
+		w += 4;
+		n -= 8;
+	}
+
+	while (n >= 2) {
+		*w++ = pair;
+		n -= 2;
+	}
+
+	if (n) {
+		*(uint16_t *)w = pixel;
+	}
+}
+
+void raster_vspan(uint16_t *column, int stride, int y0, int y1, uint16_t pixel) {
+	uint16_t *p = column + y0 * stride;
+	int n = y1 - y0 + 1;
+
+	while (n-- > 0) {
+		*p = pixel;
+		p += stride;
+	}
+}
+
+void raster_fill(uint16_t *fb, int stride, int x0, int y0, int x1, int y1, uint16_t pixel) {
+	uint16_t *row = fb + y0 * stride;
+	int y;
+
+	if (x0 == x1) {
+		raster_vspan(fb + x0, stride, y0, y1, pixel);
+		return;
+	}
+
+	for(y = y0;y <= y1;y++) {
+		raster_hspan(row, x0, x1, pixel);
+		row += stride;
+	}
+}
+
+void raster_blend_span(uint16_t *row, int x0, int x1, const uint8_t *alpha, uint32_t color) {
+	uint16_t pixel = raster_pixel(color);
+	uint16_t *p = row + x0;
+	int n = x1 - x0 + 1;
+
+	while (n-- > 0) {
+		if (*alpha == 255) {
+			*p = pixel;
+		} else if (*alpha) {
+			*p = raster_blend(*p, color, *alpha);
+		}
+
+		p++;
+		alpha++;
+	}
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2015 - 2020, IBEROXARXA SERVICIOS INTEGRALES, S.L.
+ * Copyright (C) 2015 - 2020, Jaume Olivé Petrus (jolive@whitecatboard.org)
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *     * The WHITECAT logotype cannot be changed, you can remove it, but you
+ *       cannot change it in any way. The WHITECAT logotype is:
+ *
+ *          /\       /\
+ *         /  \_____/  \
+ *        /_____________\
+ *        W H I T E C A T
+ *
+ *     * Redistributions in binary form must retain all copyright notices printed
+ *       to any local or remote output device. This include any reference to
+ *       Lua RTOS, whitecatboard.org, Lua, and other copyright notices that may
+ *       appear in the future.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Lua RTOS, span based rasterization over a RGB565 frame buffer
+ *
+ * Pixels are stored in the frame buffer in the byte order used by the
+ * display, so spans are filled by copying the same 32-bit word (a pair of
+ * pixels), and blending must swap the bytes back before mixing colors.
+ *
+ */
+
+#ifndef GDISPLAY_RASTER_H_
+#define GDISPLAY_RASTER_H_
+
+#include <stdint.h>
+
+// Convert a RGB565 color to the frame buffer byte order
+static inline uint16_t raster_pixel(uint32_t color) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	return (uint16_t)(((color >> 8) & 0xff) | ((color & 0xff) << 8));
+#else
+	return (uint16_t)color;
+#endif
+}
+
+// Convert a frame buffer pixel to a RGB565 color
+static inline uint32_t raster_color(uint16_t pixel) {
+	return raster_pixel(pixel);
+}
+
+/*
+ * Mix a RGB565 color over a frame buffer pixel, with alpha from 0 (pixel
+ * unchanged) to 255 (color). The green component is moved to the upper half
+ * of a 32-bit word, so the 3 components are mixed with one multiplication.
+ */
+static inline uint16_t raster_blend(uint16_t pixel, uint32_t color, uint8_t alpha) {
+	uint32_t a = ((uint32_t)alpha + 4) >> 3;
+	uint32_t bg = raster_color(pixel);
+	uint32_t fg = color & 0xffff;
+
+	bg = (bg | (bg << 16)) & 0x07e0f81f;
+	fg = (fg | (fg << 16)) & 0x07e0f81f;
+
+	bg = (bg + (((fg - bg) * a) >> 5)) & 0x07e0f81f;
+
+	return raster_pixel((bg | (bg >> 16)) & 0xffff);
+}
+
+/**
+ * @brief Fill the pixels x0 .. x1 of a frame buffer row.
+ *
+ * @param row First pixel of the row.
+ * @param x0 First pixel to fill.
+ * @param x1 Last pixel to fill.
+ * @param pixel Pixel, in frame buffer byte order.
+ */
+void raster_hspan(uint16_t *row, int x0, int x1, uint16_t pixel);
+
+/**
+ * @brief Fill the pixels y0 .. y1 of a frame buffer column.
+ *
+ * @param column First pixel of the column.
+ * @param stride Pixels per row.
+ * @param y0 First pixel to fill.
+ * @param y1 Last pixel to fill.
+ * @param pixel Pixel, in frame buffer byte order.
+ */
+void raster_vspan(uint16_t *column, int stride, int y0, int y1, uint16_t pixel);
+
+/**
+ * @brief Fill a rectangle of a frame buffer. Coordinates are inclusive.
+ *
+ * @param fb Frame buffer.
+ * @param stride Pixels per row.
+ * @param pixel Pixel, in frame buffer byte order.
+ */
+void raster_fill(uint16_t *fb, int stride, int x0, int y0, int x1, int y1, uint16_t pixel);
+
+/**
+ * @brief Mix a RGB565 color over the pixels x0 .. x1 of a frame buffer row.
+ *
+ * @param row First pixel of the row.
+ * @param x0 First pixel to mix.
+ * @param x1 Last pixel to mix.
+ * @param alpha Alpha of each pixel, from 0 to 255. alpha[0] is for x0.
+ * @param color RGB565 color.
+ */
+void raster_blend_span(uint16_t *row, int x0, int x1, const uint8_t *alpha, uint32_t color);
+
+#endif /* GDISPLAY_RASTER_H_ */
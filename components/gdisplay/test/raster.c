@@ -0,0 +1,240 @@
+/*
+ * Copyright (C) 2015 - 2020, IBEROXARXA SERVICIOS INTEGRALES, S.L.
+ * Copyright (C) 2015 - 2020, Jaume Olivé Petrus (jolive@whitecatboard.org)
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *     * The WHITECAT logotype cannot be changed, you can remove it, but you
+ *       cannot change it in any way. The WHITECAT logotype is:
+ *
+ *          /\       /\
+ *         /  \_____/  \
+ *        /_____________\
+ *        W H I T E C A T
+ *
+ *     * Redistributions in binary form must retain all copyright notices printed
+ *       to any local or remote output device. This include any reference to
+ *       Lua RTOS, whitecatboard.org, Lua, and other copyright notices that may
+ *       appear in the future.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Lua RTOS, span based rasterization test cases
+ *
+ */
+
+#include "sdkconfig.h"
+
+#if CONFIG_LUA_RTOS_LUA_USE_GDISPLAY
+
+#include "unity.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <gdisplay/raster.h>
+
+// Frame buffer of a 160x128 display
+#define RASTER_TEST_WIDTH  160
+#define RASTER_TEST_HEIGHT 128
+
+// Rectangles drawn in the benchmark
+#define RASTER_TEST_RECTS 2000
+
+// Dirty box updated by the per pixel reference
+static int dirty_x0, dirty_y0, dirty_x1, dirty_y1;
+
+static int64_t raster_us(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static int64_t raster_rate(int64_t pixels, int64_t us) {
+    return pixels * 1000000 / ((us > 0)?us:1);
+}
+
+// Reference, one pixel at a time, checking bounds and updating the dirty
+// box, as primitives did before the spans
+static void __attribute__((noinline)) pixel_set(uint16_t *fb, int x, int y, uint32_t color) {
+    if ((x < 0) || (y < 0) || (x >= RASTER_TEST_WIDTH) || (y >= RASTER_TEST_HEIGHT)) {
+        return;
+    }
+
+    fb[y * RASTER_TEST_WIDTH + x] = raster_pixel(color);
+
+    if (x < dirty_x0) dirty_x0 = x;
+    if (y < dirty_y0) dirty_y0 = y;
+    if (x > dirty_x1) dirty_x1 = x;
+    if (y > dirty_y1) dirty_y1 = y;
+}
+
+static void pixel_fill(uint16_t *fb, int x0, int y0, int x1, int y1, uint32_t color) {
+    int x, y;
+
+    for (y = y0; y <= y1; y++) {
+        for (x = x0; x <= x1; x++) {
+            pixel_set(fb, x, y, color);
+        }
+    }
+}
+
+// Random rectangle, inside the frame buffer
+static void raster_rect(uint32_t *seed, int *x0, int *y0, int *x1, int *y1) {
+    *seed = *seed * 1103515245 + 12345;
+
+    *x0 = (*seed >> 4) % RASTER_TEST_WIDTH;
+    *y0 = (*seed >> 12) % RASTER_TEST_HEIGHT;
+    *x1 = *x0 + (*seed >> 20) % 64;
+    *y1 = *y0 + (*seed >> 26) % 32;
+
+    if (*x1 >= RASTER_TEST_WIDTH) *x1 = RASTER_TEST_WIDTH - 1;
+    if (*y1 >= RASTER_TEST_HEIGHT) *y1 = RASTER_TEST_HEIGHT - 1;
+}
+
+TEST_CASE("raster spans", "[gdisplay]") {
+    uint16_t row[72];
+    uint8_t alpha[64];
+    uint16_t *fb, *ref;
+    uint32_t seed = 1;
+    int x0, y0, x1, y1;
+    int i, o;
+
+    // Spans of every length and alignment
+    for (o = 0; o < 2; o++) {
+        for (x0 = 0; x0 < 32; x0++) {
+            for (x1 = x0 - 1; x1 < 64; x1++) {
+                memset(row, 0, sizeof(row));
+                raster_hspan(row + o, x0, x1, 0xabcd);
+
+                for (i = 0; i < 72; i++) {
+                    TEST_ASSERT((row[i] == 0xabcd) == ((i >= o + x0) && (i <= o + x1)));
+                }
+            }
+        }
+    }
+
+    // Filled rectangles, the same as one pixel at a time
+    fb = calloc(RASTER_TEST_WIDTH * RASTER_TEST_HEIGHT, sizeof(uint16_t));
+    ref = calloc(RASTER_TEST_WIDTH * RASTER_TEST_HEIGHT, sizeof(uint16_t));
+    TEST_ASSERT(fb != NULL);
+    TEST_ASSERT(ref != NULL);
+
+    for (i = 0; i < 200; i++) {
+        raster_rect(&seed, &x0, &y0, &x1, &y1);
+
+        raster_fill(fb, RASTER_TEST_WIDTH, x0, y0, x1, y1, raster_pixel(i * 331));
+        pixel_fill(ref, x0, y0, x1, y1, i * 331);
+    }
+
+    TEST_ASSERT(memcmp(fb, ref, RASTER_TEST_WIDTH * RASTER_TEST_HEIGHT * sizeof(uint16_t)) == 0);
+
+    free(fb);
+    free(ref);
+
+    // Blending, alpha 0 keeps the pixel and alpha 255 sets the color
+    for (i = 0; i < 64; i++) {
+        row[i] = raster_pixel(0x1234);
+        alpha[i] = (i & 1)?255:0;
+    }
+
+    raster_blend_span(row, 0, 63, alpha, 0xf800);
+
+    for (i = 0; i < 64; i++) {
+        TEST_ASSERT(raster_color(row[i]) == ((i & 1)?0xf800:0x1234));
+    }
+
+    // Half alpha, black over white is gray
+    row[0] = raster_pixel(0xffff);
+    alpha[0] = 128;
+    raster_blend_span(row, 0, 0, alpha, 0x0000);
+
+    TEST_ASSERT(((raster_color(row[0]) >> 11) >= 14) && ((raster_color(row[0]) >> 11) <= 17));
+}
+
+TEST_CASE("raster throughput", "[gdisplay][bench]") {
+    int64_t pixel_us, span_us, blend_us;
+    int64_t pixels = 0;
+    uint8_t alpha[64];
+    uint16_t *fb;
+    uint32_t seed;
+    int x0, y0, x1, y1, y;
+    int i;
+
+    fb = calloc(RASTER_TEST_WIDTH * RASTER_TEST_HEIGHT, sizeof(uint16_t));
+    TEST_ASSERT(fb != NULL);
+
+    for (i = 0; i < 64; i++) {
+        alpha[i] = i * 4;
+    }
+
+    // One pixel at a time
+    seed = 1;
+    dirty_x0 = dirty_y0 = RASTER_TEST_WIDTH;
+    dirty_x1 = dirty_y1 = -1;
+
+    pixel_us = raster_us();
+    for (i = 0; i < RASTER_TEST_RECTS; i++) {
+        raster_rect(&seed, &x0, &y0, &x1, &y1);
+        pixel_fill(fb, x0, y0, x1, y1, i);
+
+        pixels += (x1 - x0 + 1) * (y1 - y0 + 1);
+    }
+    pixel_us = raster_us() - pixel_us;
+
+    // Spans, same rectangles
+    seed = 1;
+
+    span_us = raster_us();
+    for (i = 0; i < RASTER_TEST_RECTS; i++) {
+        raster_rect(&seed, &x0, &y0, &x1, &y1);
+        raster_fill(fb, RASTER_TEST_WIDTH, x0, y0, x1, y1, raster_pixel(i));
+    }
+    span_us = raster_us() - span_us;
+
+    // Blended spans, as antialiased glyphs, same rectangles
+    seed = 1;
+
+    blend_us = raster_us();
+    for (i = 0; i < RASTER_TEST_RECTS; i++) {
+        raster_rect(&seed, &x0, &y0, &x1, &y1);
+        for (y = y0; y <= y1; y++) {
+            raster_blend_span(fb + y * RASTER_TEST_WIDTH, x0, x1, alpha, i);
+        }
+    }
+    blend_us = raster_us() - blend_us;
+
+    printf("raster: %d rects, %lld pixels\n", RASTER_TEST_RECTS, pixels);
+    printf("raster: per pixel %lld us, %lld pixels/s\n", pixel_us, raster_rate(pixels, pixel_us));
+    printf("raster: spans %lld us, %lld pixels/s\n", span_us, raster_rate(pixels, span_us));
+    printf("raster: blended spans %lld us, %lld pixels/s\n", blend_us, raster_rate(pixels, blend_us));
+
+    free(fb);
+}
+
+#endif
@@ -31,6 +31,8 @@
 #if CONFIG_LUA_RTOS_USE_HTTP_SERVER
 
 #include "preprocessor.h"
+#include "pagecache.h"
+#include "httptls.h"
 
 #include "lwip/err.h"
 #include "lwip/sockets.h"
@@ -46,30 +48,27 @@
 #include <pthread.h>
 #include <esp_wifi.h>
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
 #include <time.h>
 #include <stdio.h>
 #include <string.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/syslog.h>
 #include <sys/path.h>
 #include <sys/socket.h>
 #include <netdb.h>
 #include <linux/in6.h>
 
-#include <openssl/ssl.h>
-#include "mbedtls/platform.h"
-#include "mbedtls/net_sockets.h"
-#include "mbedtls/esp_debug.h"
-#include "mbedtls/ssl.h"
-#include "mbedtls/entropy.h"
-#include "mbedtls/ctr_drbg.h"
-#include "mbedtls/error.h"
-#include "mbedtls/certs.h"
-
 #define SERVER_ID      "lua-rtos-http-server/1.0"
 #define PROTOCOL       "HTTP/1.1"
 #define RFC1123FMT     "%a, %d %b %Y %H:%M:%S GMT"
 #define HTTP_BUFF_SIZE 1024
+#define HTTP_MAX_POST_SIZE 8192
+#define HTTP_FILE_BUFF_SIZE 4096
 #define CAPTIVE_SERVER_NAME	"config-esp32-settings"
 
 #include "lua.h"
@@ -91,7 +90,8 @@ extern int captivedns_running();
 static lua_callback_t* http_callback = NULL;
 
 static wifi_mode_t wifi_mode = WIFI_MODE_STA;
-static u8_t http_refcount = 0;
+static volatile int http_refcount = 0; // running server threads
+static volatile int http_workers = 0;  // running worker threads
 static u8_t volatile http_shutdown = 0;
 static u8_t volatile script_wants_reboot = 0;
 static u8_t http_captiverun = 0;
@@ -100,21 +100,35 @@ static char  ap_ip4addr_str[IP4ADDR_STRLEN_MAX];
 static int socket_server_normal = 0;
 static int socket_server_secure = 0;
 
+// Accepted connections waiting for a worker
+static xQueueHandle http_queue = NULL;
+
+// Lua pages share one Lua state and its globals, so they run one at a time
+static pthread_mutex_t http_lua_mtx = PTHREAD_MUTEX_INITIALIZER;
+
 typedef struct {
 	int port;
 	int *server; //socket
 	const int secure;
 	char *certificate;
 	char *private_key;
+	http_tls_context_t *ctx;
 } http_server_config;
 
-#define HTTP_Normal_initializer { CONFIG_LUA_RTOS_HTTP_SERVER_PORT, &socket_server_normal, 0, NULL, NULL }
-#define HTTP_Secure_initializer { CONFIG_LUA_RTOS_HTTP_SERVER_PORT_SSL, &socket_server_secure, 1, NULL, NULL } //cert and privkey need to be supplied from lua
+#define HTTP_Normal_initializer { CONFIG_LUA_RTOS_HTTP_SERVER_PORT, &socket_server_normal, 0, NULL, NULL, NULL }
+#define HTTP_Secure_initializer { CONFIG_LUA_RTOS_HTTP_SERVER_PORT_SSL, &socket_server_secure, 1, NULL, NULL, NULL } //cert and privkey need to be supplied from lua
+
+typedef struct {
+	http_server_config *config;
+	int socket;
+	struct sockaddr_storage client;
+	socklen_t client_len;
+} http_connection;
 
 typedef struct {
 	http_server_config *config;
 	int socket;
-	SSL *ssl;
+	http_tls_t *tls;
 	uint8_t headers_sent;
 	struct sockaddr_storage *client;
 	socklen_t client_len;
@@ -123,10 +137,18 @@ typedef struct {
 	char *data;
 	char *chunk_buffer;
 	char *printf_buffer;
+	uint8_t chunked;     // response body is sent in chunks
+	uint8_t keep_alive;  // connection stays open after the response
+	char *recv_buffer;   // bytes received and not yet consumed
+	int recv_pos;
+	int recv_len;
+	uint8_t cacheable;   // response may be stored by the client, and revalidated
+	uint8_t accept_gzip; // client accepts gzip content encoding
+	char if_none_match[64];
+	char if_modified_since[32];
 } http_request_handle;
 
-#define HTTP_Request_Normal_initializer { config, client, NULL, 0, &client_addr, client_addr_len, NULL, NULL, NULL, NULL, NULL };
-#define HTTP_Request_Secure_initializer { config, client, ssl,  0, &client_addr, client_addr_len, NULL, NULL, NULL, NULL, NULL };
+#define HTTP_Request_initializer { conn->config, conn->socket, tls, 0, &conn->client, conn->client_len, NULL, NULL, NULL, NULL, NULL, 0, 0, recv_buffer, 0, 0, 0, 0, "", "" };
 
 static http_server_config http_normal = HTTP_Normal_initializer;
 static http_server_config http_secure = HTTP_Secure_initializer;
@@ -151,6 +173,9 @@ char *get_mime_type(char *name) {
 	if (strcmp(ext, ".gif")  == 0) return "image/gif";
 	if (strcmp(ext, ".png")  == 0) return "image/png";
 	if (strcmp(ext, ".css")  == 0) return "text/css";
+	if (strcmp(ext, ".js")   == 0) return "application/javascript";
+	if (strcmp(ext, ".json") == 0) return "application/json";
+	if (strcmp(ext, ".ico")  == 0) return "image/x-icon";
 	if (strcmp(ext, ".au")   == 0) return "audio/basic";
 	if (strcmp(ext, ".wav")  == 0) return "audio/wav";
 	if (strcmp(ext, ".avi")  == 0) return "video/x-msvideo";
@@ -162,8 +187,22 @@ char *get_mime_type(char *name) {
 	return NULL;
 }
 
+// Write the whole buffer, as a short write would break the framing of the next responses
 static int request_write(http_request_handle *request, char *buffer, int length) {
-	return (request->config->secure) ? SSL_write(request->ssl, buffer, length) : send(request->socket, buffer, length, MSG_DONTWAIT);
+	int sent = 0;
+	int rc;
+
+	while (sent < length) {
+		rc = (request->config->secure) ? http_tls_write(request->tls, buffer + sent, length - sent) : send(request->socket, buffer + sent, length - sent, 0);
+		if (rc <= 0) {
+			request->keep_alive = 0;
+			return (sent > 0) ? sent : rc;
+		}
+
+		sent += rc;
+	}
+
+	return sent;
 }
 
 #define BUFFER_SIZE_INITIAL 256
@@ -204,81 +243,95 @@ static int do_printf(http_request_handle *request, const char *fmt, ...) {
 	return ret;
 }
 
-static char *do_gets(char *s, int size, http_request_handle *request) {
+// Make received bytes available in the request buffer.
+// Returns the number of available bytes, 0 if the connection was closed
+// or timed out, or -1 on error.
+static int request_fill(http_request_handle *request) {
+	int rc;
 
-	int socket = request->config->secure ? SSL_get_fd(request->ssl) : request->socket;
+	if (request->recv_pos < request->recv_len) {
+		return request->recv_len - request->recv_pos;
+	}
 
-	fd_set set;
-	FD_ZERO(&set); /* clear the set */
-	FD_SET(socket, &set); /* add our file descriptor to the set */
-	struct timeval timeout = {0L, 100L}; //wait up to 100ms
+	request->recv_pos = 0;
+	request->recv_len = 0;
 
-	int rc;
-	char *c = s;
-	while (c < (s + size - 1)) {
+	if (request->config->secure) {
+		rc = http_tls_read(request->tls, request->recv_buffer, HTTP_BUFF_SIZE);
+	} else {
+		rc = recv(request->socket, request->recv_buffer, HTTP_BUFF_SIZE, 0);
+	}
 
-		if (request->config->secure) {
-
-			//only do this once for secure (or if nothing pending)
-			if (c == s && 0 == SSL_pending(request->ssl)) {
-				// select supports setting a timeout
-				// so *only* if select tells us data
-				// is ready we read the data using recv
-				rc = select(socket+1, &set, NULL, NULL, &timeout);
-				if (rc == -1) {
-					syslog(LOG_DEBUG, "http: select failed\r");
-					return NULL;
-				}
-				else if (rc == 0 && !FD_ISSET(socket, &set)) {
-					//no data received or connection is closed
-					syslog(LOG_DEBUG, "http: no data received\r");
-					break;
-				}
-			}
+	if (rc > 0) {
+		request->recv_len = rc;
+	} else if (rc == 0) {
+		syslog(LOG_DEBUG, "http: no data received or connection is closed\r");
+	}
 
-			//see http://www.past5.com/tutorials/2014/02/21/openssl-and-select/
-			int ssl_error;
-			rc = SSL_read(request->ssl, c, 1);
+	return rc;
+}
 
-			//check SSL errors
-			switch(ssl_error = SSL_get_error(request->ssl,rc)) {
-				case SSL_ERROR_NONE:
-					//all good - we do our stuff with the newly read character below
-					break;
-				case SSL_ERROR_ZERO_RETURN:	 	//connection closed by client, clean up
-				case SSL_ERROR_WANT_READ:			//the operation did not complete, block the read
-				case SSL_ERROR_WANT_WRITE:		//the operation did not complete
-				case SSL_ERROR_SYSCALL:				//some I/O error occured (could be caused by false start in Chrome for instance), disconnect the client and clean up
-				default:											//some other error, clean up
-					return NULL;
-					break;
-			}
-		}
-		else
-			rc = recv(socket, c, 1, MSG_WAITALL);
+static char *do_gets(char *s, int size, http_request_handle *request) {
+	char *c = s;
+	char *start;
+	char *nl;
+	int rc;
 
-		if (rc>0) {
-			//syslog(LOG_DEBUG, "http: got %c\r", *c);
-			if (*c == '\n') {
-				c++;
-				break;
-			}
-			c++;
-		}
-		else if (rc==0) {
-			//no data received or connection is closed
-			syslog(LOG_DEBUG, "http: no data received or connection is closed\r");
+	while (c < (s + size - 1)) {
+		rc = request_fill(request);
+		if (rc == 0) {
 			break;
-		}
-		else {
+		} else if (rc < 0) {
 			syslog(LOG_DEBUG, "http: discarding half-received data\r");
 			return NULL; //discard half-received data
 		}
+
+		if (rc > (s + size - 1) - c) {
+			rc = (s + size - 1) - c;
+		}
+
+		// Copy up to the end of the line
+		start = request->recv_buffer + request->recv_pos;
+		nl = memchr(start, '\n', rc);
+		if (nl) {
+			rc = nl - start + 1;
+		}
+
+		memcpy(c, start, rc);
+		request->recv_pos += rc;
+		c += rc;
+
+		if (nl) {
+			break;
+		}
 	}
 	*c = 0;
 	return (c == s ? 0 : s);
 }
 
+// Read exactly size bytes, returns the number of bytes read
+static int do_read(char *s, int size, http_request_handle *request) {
+	int bytes = 0;
+	int rc;
+
+	while (bytes < size) {
+		rc = request_fill(request);
+		if (rc <= 0) {
+			break;
+		}
+
+		if (rc > size - bytes) {
+			rc = size - bytes;
+		}
+
+		memcpy(s + bytes, request->recv_buffer + request->recv_pos, rc);
+		request->recv_pos += rc;
+		bytes += rc;
+	}
+
+	return bytes;
+}
+
 void send_headers(http_request_handle *request, int status, char *title, char *extra, char *mime, int length) {
 	do_printf(request, "%s %d %s\r\n", PROTOCOL, status, title);
 	do_printf(request, "Server: %s\r\n", SERVER_ID);
@@ -291,13 +344,25 @@ void send_headers(http_request_handle *request, int status, char *title, char *e
 		do_printf(request, "Transfer-Encoding: chunked\r\n");
 	}
 
-	do_printf(request, "Connection: close\r\n");
+	if (request->keep_alive) {
+		do_printf(request, "Connection: keep-alive\r\n");
+		do_printf(request, "Keep-Alive: timeout=%d, max=%d\r\n", CONFIG_LUA_RTOS_HTTP_SERVER_IDLE_TIMEOUT, CONFIG_LUA_RTOS_HTTP_SERVER_KEEPALIVE_MAX);
+	} else {
+		do_printf(request, "Connection: close\r\n");
+	}
 
-	do_printf(request, "Cache-Control: no-cache, no-store, must-revalidate\r\n");
+	if (request->cacheable) {
+		do_printf(request, "Cache-Control: no-cache\r\n");
+	} else {
+		do_printf(request, "Cache-Control: no-cache, no-store, must-revalidate\r\n");
+	}
 	do_printf(request, "no-cache\r\n");
 	do_printf(request, "0\r\n");
 
 	do_printf(request, "\r\n");
+
+	request->headers_sent = 1;
+	request->chunked = (length < 0);
 }
 
 #define HTTP_STATUS_LEN     3
@@ -317,6 +382,11 @@ void send_error(http_request_handle *request, int status, char *title, char *ext
 			  strlen(HTTP_ERROR_LINE_4) -
 			  HTTP_ERROR_VARS_LEN;
 
+	// An error in the middle of a response leaves the client out of sync
+	if (request->headers_sent) {
+		request->keep_alive = 0;
+	}
+
 	send_headers(request, status, title, extra, "text/html", len);
 	do_printf(request, HTTP_ERROR_LINE_1, status, title);
 	do_printf(request, HTTP_ERROR_LINE_2, status, title);
@@ -463,7 +533,15 @@ static int http_execute_lua (lua_State *L) {
 		const char *path = luaL_checkstring( L, 3);
 
 		struct stat statbuf;
-		stat(path, &statbuf);
+		int cached = 0;
+
+		if (stat(path, &statbuf) == 0) {
+			// A cached compiled page still matching its source skips the
+			// preprocessing and parsing
+			lua_lock(L);
+			cached = (http_pagecache_load(L, path, statbuf.st_mtime, statbuf.st_size) == LUA_OK);
+			lua_unlock(L);
+		}
 
 		char ppath[PATH_MAX + 1];
 		strcpy(ppath, path);
@@ -471,11 +549,15 @@ static int http_execute_lua (lua_State *L) {
 		if (strlen(ppath) < PATH_MAX) {
 			strcat(ppath, "p");
 
-			// Store .lua file modified time
+			// Store .lua file modified time and size
 			time_t src_mtime = statbuf.st_mtime;
+			off_t src_size = statbuf.st_size;
+			int ret = LUA_OK;
 
 			// Get .luap file modified time
-			if (stat(ppath, &statbuf) == 0) {
+			if (cached) {
+				statbuf.st_mode = S_IFREG;
+			} else if (stat(ppath, &statbuf) == 0) {
 				if (src_mtime > statbuf.st_mtime) {
 					http_preprocess_lua_page(path,ppath);
 				}
@@ -490,7 +572,7 @@ static int http_execute_lua (lua_State *L) {
 				send_error(request, 500, "Internal Server Error", NULL, "Special file found where a regular precompiled file was expected.");
 			}
 			else {
-				if (heap_caps_get_free_size(MALLOC_CAP_DEFAULT) < statbuf.st_size*3) {
+				if (!cached && heap_caps_get_free_size(MALLOC_CAP_DEFAULT) < statbuf.st_size*3) {
 					//free heap might be too low to load the file, so call GC before trying to load
 					luaC_fullgc(L, 0);
 					lua_unlock(L);
@@ -501,14 +583,19 @@ static int http_execute_lua (lua_State *L) {
 					vTaskDelay(1 / portTICK_PERIOD_MS);
 				}
 
-				if (heap_caps_get_free_size(MALLOC_CAP_DEFAULT) < statbuf.st_size*3) {
+				if (!cached && heap_caps_get_free_size(MALLOC_CAP_DEFAULT) < statbuf.st_size*3) {
 					//free heap might still be too low to load the file, so call the emergency GC before trying to load
 					__garbage_collector();
 				}
 
-				lua_lock(L);
-				int ret = luaL_loadfile(L, ppath);
-				lua_unlock(L);
+				if (!cached) {
+					lua_lock(L);
+					ret = luaL_loadfile(L, ppath);
+					if (LUA_OK == ret) {
+						http_pagecache_store(L, path, src_mtime, src_size);
+					}
+					lua_unlock(L);
+				}
 
 				if (LUA_OK != ret) {
 					char* error = (char *)malloc(LUA_INTERPRETER_ERROR_LENGTH+1);
@@ -613,7 +700,11 @@ static int http_execute_lua (lua_State *L) {
 					free(buffer);
 
 					if (!request->config->secure) fsync(request->socket);
-					do_printf(request, "0\r\n\r\n");
+					if (!request->headers_sent) {
+						send_headers(request, 200, "OK", NULL, "text/html", 0);
+					} else if (request->chunked) {
+						do_printf(request, "0\r\n\r\n");
+					}
 				}
 
 				//free the heap again by calling GC
@@ -631,6 +722,160 @@ static int http_execute_lua (lua_State *L) {
 	return 0;
 }
 
+// Parse an HTTP date, in any of the RFC 1123, RFC 850 and asctime formats.
+// Returns -1 if the date is not valid.
+static time_t http_date(const char *date) {
+	static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+	const char *pos;
+	char mon[4];
+	int day, year, hour, min, sec, m, y, era, yoe, doy;
+	long days;
+
+	if ((pos = strchr(date, ','))) {
+		// Sun, 06 Nov 1994 08:49:37 GMT or Sunday, 06-Nov-94 08:49:37 GMT
+		if ((sscanf(pos + 1, " %d %3s %d %d:%d:%d", &day, mon, &year, &hour, &min, &sec) != 6) &&
+			(sscanf(pos + 1, " %d-%3s-%d %d:%d:%d", &day, mon, &year, &hour, &min, &sec) != 6)) {
+			return -1;
+		}
+	} else if (sscanf(date, "%*s %3s %d %d:%d:%d %d", mon, &day, &hour, &min, &sec, &year) != 6) {
+		// Sun Nov  6 08:49:37 1994
+		return -1;
+	}
+
+	if ((strlen(mon) != 3) || !(pos = strstr(months, mon)) || ((pos - months) % 3)) {
+		return -1;
+	}
+
+	if (year < 100) {
+		year += (year < 70)?2000:1900;
+	}
+
+	if ((year < 1970) || (day < 1) || (day > 31) || (hour > 23) || (min > 59) || (sec > 60) || (hour < 0) || (min < 0) || (sec < 0)) {
+		return -1;
+	}
+
+	// Days since the epoch, with years starting in March
+	m = (pos - months) / 3;
+	y = year - (m < 2);
+	era = y / 400;
+	yoe = y - era * 400;
+	doy = (153 * ((m + 10) % 12) + 2) / 5 + day - 1;
+	days = (long)era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+
+	return (time_t)days * 86400 + hour * 3600 + min * 60 + sec;
+}
+
+// Send a static file. path must have a size of HTTP_BUFF_SIZE, as it may
+// be changed to the name of the precompressed variant.
+static void send_static(http_request_handle *request, char *path, struct stat *statbuf) {
+	struct stat gzstat;
+	char extra[160];
+	char etag[32];
+	char lastmod[32] = "";
+	char *pos = extra;
+	char *mime;
+	char *data;
+	int gzip = 0;
+	int size = HTTP_FILE_BUFF_SIZE;
+	int len = strlen(path);
+	int plen = strlen(request->path);
+	int fd, rc;
+	off_t sent = 0;
+
+	if ((len > 3) && (strcmp(path + len - 3, ".gz") == 0) && ((plen < 3) || (strcmp(request->path + plen - 3, ".gz") != 0))) {
+		// Only the precompressed file exists, and there is nothing else to send
+		// to a client that can't decode it
+		if (!request->accept_gzip) {
+			send_error(request, 406, "Not Acceptable", NULL, "Only a gzip encoded variant is available.");
+			return;
+		}
+
+		// The mime type is the one of the original name
+		path[len - 3] = 0;
+		mime = get_mime_type(path);
+		path[len - 3] = '.';
+		gzip = 1;
+	} else {
+		mime = get_mime_type(path);
+
+		// Use the precompressed variant if there is one
+		if (request->accept_gzip && (len + 3 < HTTP_BUFF_SIZE)) {
+			strcpy(path + len, ".gz");
+			if ((stat(path, &gzstat) == 0) && S_ISREG(gzstat.st_mode)) {
+				statbuf = &gzstat;
+				gzip = 1;
+			} else {
+				path[len] = 0;
+			}
+		}
+	}
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		send_error(request, 403, "Forbidden", NULL, "Access denied.");
+		return;
+	}
+
+	// Validators, the client must revalidate before using its copy
+	snprintf(etag, sizeof(etag), "\"%lx-%lx\"", (unsigned long)statbuf->st_mtime, (unsigned long)statbuf->st_size);
+	pos += snprintf(pos, sizeof(extra) - (pos - extra), "ETag: %s", etag);
+
+	if (statbuf->st_mtime > 0) {
+		struct tm tm;
+		gmtime_r(&statbuf->st_mtime, &tm);
+		strftime(lastmod, sizeof(lastmod), RFC1123FMT, &tm);
+		pos += snprintf(pos, sizeof(extra) - (pos - extra), "\r\nLast-Modified: %s", lastmod);
+	}
+
+	if (gzip) {
+		pos += snprintf(pos, sizeof(extra) - (pos - extra), "\r\nContent-Encoding: gzip\r\nVary: Accept-Encoding");
+	}
+
+	request->cacheable = 1;
+
+	if (*request->if_none_match) {
+		if ((strcmp(request->if_none_match, "*") == 0) || strstr(request->if_none_match, etag)) {
+			close(fd);
+			send_headers(request, 304, "Not Modified", extra, NULL, 0);
+			return;
+		}
+	} else if (*lastmod && *request->if_modified_since && (statbuf->st_mtime <= http_date(request->if_modified_since))) {
+		close(fd);
+		send_headers(request, 304, "Not Modified", extra, NULL, 0);
+		return;
+	}
+
+	data = malloc(size);
+	if (!data) {
+		size = HTTP_BUFF_SIZE;
+		data = malloc(size);
+	}
+
+	if (!data) {
+		close(fd);
+		send_error(request, 500, "Internal Server Error", NULL, "Error allocating memory.");
+		return;
+	}
+
+	send_headers(request, 200, "OK", extra, mime, statbuf->st_size);
+
+	while ((rc = read(fd, data, size)) > 0) {
+		if (request_write(request, data, rc) != rc) {
+			break;
+		}
+
+		sent += rc;
+	}
+
+	// The length was announced, the connection can't be reused if it doesn't match
+	if (sent != statbuf->st_size) {
+		request->keep_alive = 0;
+	}
+
+	free(data);
+	close(fd);
+}
+
 void send_file(http_request_handle *request, char *path, struct stat *statbuf) {
 
 	FILE *file = fopen(path, "r");
@@ -639,6 +884,8 @@ void send_file(http_request_handle *request, char *path, struct stat *statbuf) {
 	} else if (is_lua(path)) {
 		fclose(file);
 
+		pthread_mutex_lock(&http_lua_mtx);
+
 		lua_State *L = luaS_callback_state(http_callback);
 		lua_pushcfunction(L, &http_execute_lua);  /* to call 'http_execute_lua' in protected mode */
 		lua_pushlightuserdata(L, (void*)request);
@@ -663,16 +910,11 @@ void send_file(http_request_handle *request, char *path, struct stat *statbuf) {
 			}
 		}
 		//NOTE: no need to "clean up" the stack here!
+
+		pthread_mutex_unlock(&http_lua_mtx);
 	} else {
-		char *data = calloc(1, HTTP_BUFF_SIZE);
-		if (data) {
-			int length = S_ISREG(statbuf->st_mode) ? statbuf->st_size : -1;
-			send_headers(request, 200, "OK", NULL, get_mime_type(path), length);
-			int read = 0;
-			while ((read = fread(data, 1, sizeof (data), file)) > 0) request_write(request, data, read);
-			free(data);
-		}
 		fclose(file);
+		send_static(request, path, statbuf);
 	}
 }
 
@@ -876,35 +1118,51 @@ static bool remote_matches_ap_subnet(http_request_handle *request) {
 	return false;
 }
 
+// Read a request from the connection and send the response.
+// Returns -1 if no request was received, 0 otherwise.
 static int process(http_request_handle *request) {
 	char *reqbuf;
 	char *databuf = NULL;
-	char *host = NULL;
 	char *protocol;
+	char *value;
+	char host[64] = "";
 	struct stat statbuf;
 	char *pathbuf;
+	int contentlength = -1;
+	int wants_close = 0;
+	int wants_keep_alive = 0;
 	int len;
 
 	// Allocate space for buffers
 	reqbuf = calloc(1, HTTP_BUFF_SIZE);
 	if (!reqbuf) {
+		request->keep_alive = 0;
 		send_error(request, 500, "Internal Server Error", NULL, "Error allocating memory.");
 		return 0;
 	}
 
 	pathbuf = calloc(1, HTTP_BUFF_SIZE);
 	if (!pathbuf) {
+		request->keep_alive = 0;
 		send_error(request, 500, "Internal Server Error", NULL, "Error allocating memory.");
 		free(reqbuf);
 		return 0;
 	}
 
-	if (!do_gets(reqbuf, HTTP_BUFF_SIZE, request) || 0 == strlen(reqbuf) ) {
-		send_error(request, 400, "Bad Request", NULL, "Got empty request buffer.");
-		free(reqbuf);
-		free(pathbuf);
-		return 0;
-	}
+	request->cacheable = 0;
+	request->accept_gzip = 0;
+	*request->if_none_match = 0;
+	*request->if_modified_since = 0;
+
+	// Get the request line, ignoring empty lines in front of it
+	do {
+		if (!do_gets(reqbuf, HTTP_BUFF_SIZE, request) || 0 == strlen(reqbuf) ) {
+			// Closed or idle connection, nothing to answer
+			free(reqbuf);
+			free(pathbuf);
+			return -1;
+		}
+	} while ((reqbuf[0] == '\r') || (reqbuf[0] == '\n'));
 
 	char *save_ptr = NULL;
 	request->method = strtok_r(reqbuf, " ", &save_ptr);
@@ -938,45 +1196,68 @@ static int process(http_request_handle *request) {
 		}
 	}
 
-	//only in AP mode we redirect arbitrary host names to our own host name
-	if (captivedns_running() && (wifi_mode == WIFI_MODE_AP || wifi_mode == WIFI_MODE_APSTA) && remote_matches_ap_subnet(request)) {
+	// Read the headers up to the empty line, requests without protocol don't have them
+	while (protocol && do_gets(pathbuf, HTTP_BUFF_SIZE, request)) {
+		if ((pathbuf[0] == '\r') || (pathbuf[0] == '\n')) {
+			break;
+		}
 
-		//find the Host: header and check if it matches our IP or captive server name
-		while (do_gets(pathbuf, HTTP_BUFF_SIZE, request) && strlen(pathbuf)>0 ) {
+		value = strchr(pathbuf, ':');
+		if (!value) {
+			continue;
+		}
 
-			//quick check if the first char matches, only then do strcasestr
-			if(pathbuf[0]=='h' || pathbuf[0]=='H') {
-				host = strcasestr(pathbuf, "Host:");
+		*value++ = 0;
+		while(*value==' ') value++; //skip any spaces after the colon
+		value[strcspn(value, "\r\n")] = 0;
+
+		if (strcasecmp(pathbuf, "Content-Length") == 0) {
+			contentlength = atoi(value);
+		} else if (strcasecmp(pathbuf, "Connection") == 0) {
+			if (strcasestr(value, "close")) {
+				wants_close = 1;
+			} else if (strcasestr(value, "keep-alive")) {
+				wants_keep_alive = 1;
+			}
+		} else if (strcasecmp(pathbuf, "Host") == 0) {
+			strlcpy(host, value, sizeof(host));
+		} else if (strcasecmp(pathbuf, "Accept-Encoding") == 0) {
+			request->accept_gzip = (strcasestr(value, "gzip") != NULL);
+		} else if (strcasecmp(pathbuf, "If-None-Match") == 0) {
+			strlcpy(request->if_none_match, value, sizeof(request->if_none_match));
+		} else if (strcasecmp(pathbuf, "If-Modified-Since") == 0) {
+			strlcpy(request->if_modified_since, value, sizeof(request->if_modified_since));
+		}
+	}
 
-				//check if the line begins with "Host:"
-				if (host==(char *)pathbuf) {
-					save_ptr = NULL;
-					host = strtok_r(host, ":", &save_ptr); //Host:
-					host = strtok_r(NULL, "\r", &save_ptr); //the actual host
-					while(*host==' ') host++; //skip any spaces after the colon
+	// HTTP/1.1 connections are persistent unless the client asks to close them,
+	// older clients must ask for it
+	if (protocol && (strncasecmp(protocol, "HTTP/1.1", 8) == 0)) {
+		request->keep_alive = request->keep_alive && !wants_close;
+	} else {
+		request->keep_alive = request->keep_alive && wants_keep_alive;
+	}
 
-					if (0 == strcasecmp(CAPTIVE_SERVER_NAME, host) ||
-							0 == strcasecmp(ap_ip4addr_str, host)) {
-						break; //done parsing headers
-					}
-					else {
-						//redirect
-						snprintf(pathbuf, HTTP_BUFF_SIZE, "Location: http://%s/", CAPTIVE_SERVER_NAME);
-						send_headers(request, 302, "Found", pathbuf, NULL, 0);
-						free(reqbuf);
-						free(pathbuf);
-						request->path = NULL;
-						request->data = NULL;
-						if (request->printf_buffer) {
-							free(request->printf_buffer);
-							request->printf_buffer = NULL;
-						}
-						return 0;
-					}
-				}
+	//only in AP mode we redirect arbitrary host names to our own host name
+	if (captivedns_running() && (wifi_mode == WIFI_MODE_AP || wifi_mode == WIFI_MODE_APSTA) && remote_matches_ap_subnet(request)) {
+		//check if the Host: header matches our IP or captive server name
+		if (*host && 0 != strcasecmp(CAPTIVE_SERVER_NAME, host) && 0 != strcasecmp(ap_ip4addr_str, host)) {
+			//redirect
+			if (contentlength != 0) {
+				request->keep_alive = 0; //the body is not read
 			}
-
-		} // while
+			snprintf(pathbuf, HTTP_BUFF_SIZE, "Location: http://%s/", CAPTIVE_SERVER_NAME);
+			send_headers(request, 302, "Found", pathbuf, NULL, 0);
+			free(reqbuf);
+			free(pathbuf);
+			request->path = NULL;
+			request->data = NULL;
+			if (request->printf_buffer) {
+				free(request->printf_buffer);
+				request->printf_buffer = NULL;
+			}
+			return 0;
+		}
 	} // AP mode
 
 	if (!request->method || !request->path) {
@@ -984,70 +1265,59 @@ static int process(http_request_handle *request) {
 		free(pathbuf);
 		request->path = NULL;
 		request->data = NULL;
+		request->keep_alive = 0;
 		return -1; //protocol may be omitted
 	}
 
 	if(strcasecmp(request->method, "POST") == 0) {
-		char *skip;
-		int contentlength = HTTP_BUFF_SIZE;
-		//skip headers to the actual request data
-		while (do_gets(pathbuf, HTTP_BUFF_SIZE, request) && strlen(pathbuf)>0 ) {
-			if (strlen(pathbuf)<3) {
-				skip = pathbuf;
-				while (*skip=='\r' || *skip=='\n') skip++;
-				if (strlen(skip)==0) {
-					break;
-				}
-			}
-			else {
-				//look for the content-length header to avoid
-				//a timeout later when reading the actual request data
-
-				//quick check if the first char matches, only then do strcasestr
-				if(pathbuf[0]=='c' || pathbuf[0]=='C') {
-					char *contentlen = strcasestr(pathbuf, "Content-Length:");
-
-					//check if the line begins with "Content-Length:"
-					if (contentlen==(char *)pathbuf) {
-						save_ptr = NULL;
-						contentlen = strtok_r(contentlen, ":", &save_ptr); //Content-Length:
-						contentlen = strtok_r(NULL, "\r", &save_ptr); //the actual content length
-						while(*contentlen==' ') contentlen++; //skip any spaces after the colon
-						contentlength = atoi(contentlen)+1;
-					}
-				}
-			}
-		} // while headers
-		//while empty lines
-		while (do_gets(pathbuf, contentlength, request) && strlen(pathbuf)>0 ) {
-			if (pathbuf && strlen(pathbuf)>0) {
-				skip = pathbuf;
-				while (*skip=='\r' || *skip=='\n') skip++;
-				if (strlen(skip)>0) {
-					break;
-				}
+		if (contentlength > HTTP_MAX_POST_SIZE) {
+			request->keep_alive = 0;
+			send_error(request, 413, "Payload Too Large", NULL, "Request data is too large.");
+			free(reqbuf);
+			free(pathbuf);
+			request->path = NULL;
+			request->data = NULL;
+			return 0;
+		}
+
+		if (contentlength < 0) {
+			// Without a length the data ends at the first new line, and the connection
+			// can't be reused
+			request->keep_alive = 0;
+			if (!do_gets(pathbuf, HTTP_BUFF_SIZE, request)) {
+				*pathbuf = 0;
 			}
-		} // while empty lines
+			contentlength = strlen(pathbuf);
+		} else {
+			*pathbuf = 0;
+		}
+
 		//preserve the data
-		if (pathbuf && strlen(pathbuf)>0 ) {
-			databuf = calloc(1, strlen(pathbuf)+1);
-			if (!databuf) {
-				send_error(request, 500, "Internal Server Error", NULL, "Error allocating POST data memory.");
-				free(reqbuf);
-				free(pathbuf);
-				request->path = NULL;
-				request->data = NULL;
-				return 0;
-			}
+		databuf = calloc(1, contentlength + 1);
+		if (!databuf) {
+			request->keep_alive = 0;
+			send_error(request, 500, "Internal Server Error", NULL, "Error allocating POST data memory.");
+			free(reqbuf);
+			free(pathbuf);
+			request->path = NULL;
+			request->data = NULL;
+			return 0;
+		}
+
+		if (*pathbuf) {
 			strcpy(databuf, pathbuf);
-			request->data = databuf;
-		} // while
+		} else if (do_read(databuf, contentlength, request) < contentlength) {
+			request->keep_alive = 0;
+		}
+
+		request->data = databuf;
+	} else if (contentlength > 0) {
+		// The body of other methods is not read
+		request->keep_alive = 0;
 	}
 
 	syslog(LOG_DEBUG, "http: %s %s %s\r", request->method, request->path, protocol ? protocol:"");
 
-	if (!request->config->secure) shutdown(request->socket, SHUT_RD);
-
 	if (strcasecmp(request->method, "GET") != 0 && strcasecmp(request->method, "POST") != 0) {
 		syslog(LOG_DEBUG, "http: %s not supported\r", request->method);
 		send_error(request, 501, "Not supported", NULL, "Method is not supported.");
@@ -1059,6 +1329,7 @@ static int process(http_request_handle *request) {
 		if (!found && filepath_merge(pathbuf, CONFIG_LUA_RTOS_HTTP_SERVER_DOCUMENT_ROOT, request->path, NULL)    && stat(pathbuf, &statbuf) == 0) found = true;
 		if (!found && filepath_merge(pathbuf, CONFIG_LUA_RTOS_HTTP_SERVER_DOCUMENT_ROOT, request->path, ".lua")  && stat(pathbuf, &statbuf) == 0) found = true;
 		if (!found && filepath_merge(pathbuf, CONFIG_LUA_RTOS_HTTP_SERVER_DOCUMENT_ROOT, request->path, ".html") && stat(pathbuf, &statbuf) == 0) found = true;
+		if (!found && filepath_merge(pathbuf, CONFIG_LUA_RTOS_HTTP_SERVER_DOCUMENT_ROOT, request->path, ".gz")   && stat(pathbuf, &statbuf) == 0) found = true;
 
 		if (!found) {
 			send_error(request, 404, "Not Found", NULL, "File not found.");
@@ -1166,16 +1437,155 @@ static void http_net_callback(system_event_t *event){
 	}
 }
 
-static void mbedtls_zeroize( void *v, size_t n ) {
-	volatile unsigned char *p = v; while( n-- ) *p++ = 0;
+extern __NOINIT_ATTR uint32_t backtrace_count;
+
+// Called by each server thread when it ends, the last one cleans up
+static void http_thread_exit() {
+	http_connection conn;
+
+	if (__sync_sub_and_fetch(&http_refcount, 1) == 0) {
+		//last one needs to unregister the net callback
+		driver_error_t *error;
+		if ((error = net_event_unregister_callback(http_net_callback))) {
+			syslog(LOG_WARNING, "http: couldn't unregister net callback\n");
+		}
+
+		//last one needs to unregister the lua execution callback
+		if (http_callback != NULL) {
+			luaS_callback_destroy(http_callback);
+			http_callback = NULL;
+		}
+
+		//close the connections no worker took
+		while (xQueueReceive(http_queue, &conn, 0) == pdTRUE) {
+			close(conn.socket);
+		}
+
+		//compiled pages are of no use until the server is started again
+		pthread_mutex_lock(&http_lua_mtx);
+		http_pagecache_flush();
+		pthread_mutex_unlock(&http_lua_mtx);
+	}
+}
+
+// Wait for the next request on a persistent connection. The connection is
+// given up if it stays idle, or if other clients are waiting for a worker.
+static int request_wait(http_request_handle *request) {
+	int socket = request->socket;
+	int idle = 0;
+	fd_set set;
+	int rc;
+
+	if ((request->recv_pos < request->recv_len) || (request->config->secure && http_tls_pending(request->tls))) {
+		return 1;
+	}
+
+	while (idle < CONFIG_LUA_RTOS_HTTP_SERVER_IDLE_TIMEOUT * 1000) {
+		if (http_shutdown || uxQueueMessagesWaiting(http_queue)) {
+			return 0;
+		}
+
+		FD_ZERO(&set);
+		FD_SET(socket, &set);
+		struct timeval timeout = {0L, 100000L}; //check every 100ms
+
+		rc = select(socket + 1, &set, NULL, NULL, &timeout);
+		if (rc > 0) {
+			return 1;
+		} else if (rc < 0) {
+			return 0;
+		}
+
+		idle += 100;
+	}
+
+	return 0;
+}
+
+// Serve the requests of a connection until it's closed
+static void http_serve(http_connection *conn) {
+	http_tls_t *tls = NULL;
+	char *recv_buffer;
+	int requests = 0;
+
+	recv_buffer = malloc(HTTP_BUFF_SIZE);
+	if (!recv_buffer) {
+		syslog(LOG_ERR, "http: couldn't allocate connection buffer\n");
+		close(conn->socket);
+		return;
+	}
+
+	if (conn->config->secure) {
+		tls = http_tls_accept(conn->config->ctx, conn->socket);
+		if (!tls) {
+			free(recv_buffer);
+			close(conn->socket);
+			return;
+		}
+	}
+
+	http_request_handle request = HTTP_Request_initializer;
+
+	for(;;) {
+		request.headers_sent = 0;
+		request.chunked = 0;
+		request.keep_alive = (++requests < CONFIG_LUA_RTOS_HTTP_SERVER_KEEPALIVE_MAX) && !http_shutdown && !uxQueueMessagesWaiting(http_queue);
+
+		if ((process(&request) < 0) || !request.keep_alive || script_wants_reboot) {
+			break;
+		}
+
+		if (!request_wait(&request)) {
+			break;
+		}
+
+		//make sure external systems can't occupy our whole cpu...
+		vTaskDelay(1 / portTICK_PERIOD_MS);
+	}
+
+	if (tls) {
+		http_tls_close(tls);
+	} else {
+		shutdown(conn->socket, SHUT_RDWR);
+	}
+
+	free(recv_buffer);
+	close(conn->socket);
+}
+
+static void *http_worker(void *arg) {
+	http_connection conn;
+
+	// http_workers is incremented by the creator, so http_stop can't miss
+	// a worker that is not running yet
+	while (!http_shutdown) {
+		// Wait for a connection ...
+		if (xQueueReceive(http_queue, &conn, 1000 / portTICK_PERIOD_MS) != pdTRUE) {
+			continue; /* check for shutdown every second */
+		}
+
+		http_serve(&conn);
+
+		if (script_wants_reboot) {
+			delay(2); //probably required for data to be sent
+			backtrace_count = 0;
+			esp_restart(); /* restart without panic'ing */
+		}
+
+		//make sure external systems can't occupy our whole cpu...
+		vTaskDelay(1 / portTICK_PERIOD_MS);
+	}
+
+	__sync_fetch_and_sub(&http_workers, 1);
+
+	http_thread_exit();
+
+	return NULL;
 }
 
-extern __NOINIT_ATTR uint32_t backtrace_count;
 static void *http_thread(void *arg) {
 	http_server_config *config = (http_server_config*) arg;
 	struct sockaddr_in6 sin;
-	SSL_CTX *ctx = NULL;
-	SSL *ssl = NULL;
 	int rc = 0;
 
 	net_init();
@@ -1212,127 +1622,55 @@ static void *http_thread(void *arg) {
 	}
 
 	if (config->secure) {
-		ctx = SSL_CTX_new(TLS_server_method());
-		if (!ctx) {
-			syslog(LOG_ERR, "http: couldn't create SSL context\n");
-			return NULL;
-		}
-
-		//load cert
-		size_t certificate_bytes;
-		unsigned char *certificate_buf;
-		if( mbedtls_pk_load_file( config->certificate, &certificate_buf, &certificate_bytes ) != 0 ) {
-			syslog(LOG_ERR, "http: couldn't load SSL certificate\n");
-			SSL_CTX_free(ctx);
-			ctx = NULL;
-			return NULL;
-		}
-		if (!SSL_CTX_use_certificate_ASN1(ctx, certificate_bytes, certificate_buf)) {
-			syslog(LOG_ERR, "http: couldn't set SSL certificate\n");
-			mbedtls_zeroize( certificate_buf, certificate_bytes );
-			//MUST NOT free certificate_buf !!!
-			SSL_CTX_free(ctx);
-			ctx = NULL;
-			return NULL;
-		}
-		mbedtls_zeroize( certificate_buf, certificate_bytes );
-		//MUST NOT free certificate_buf !!!
-
-		//load privkey
-		size_t private_key_bytes;
-		unsigned char *private_key_buf;
-		if( mbedtls_pk_load_file( config->private_key, &private_key_buf, &private_key_bytes ) != 0 ) {
-			syslog(LOG_ERR, "http: couldn't load SSL certificate\n");
-			SSL_CTX_free(ctx);
-			ctx = NULL;
+		// The context of a previous start is reused if the certificate and key didn't change
+		config->ctx = http_tls_context(config->certificate, config->private_key);
+		if (!config->ctx) {
 			return NULL;
 		}
-		if (!SSL_CTX_use_PrivateKey_ASN1(0, ctx, private_key_buf, private_key_bytes)) {
-			syslog(LOG_ERR, "http: couldn't load SSL private key\n");
-			mbedtls_zeroize( private_key_buf, private_key_bytes );
-			//MUST NOT free private_key_buf !!!
-			SSL_CTX_free(ctx);
-			ctx = NULL;
-			return NULL;
-		}
-		mbedtls_zeroize( private_key_buf, private_key_bytes );
-		//MUST NOT free private_key_buf !!!
 	}
 
 	syslog(LOG_INFO, "http: server listening on port %d\n", config->port);
 
-	int client;
-	struct sockaddr_storage client_addr;
-	socklen_t client_addr_len = sizeof(client_addr);
+	http_connection conn;
 
-	http_refcount++;
+	__sync_fetch_and_add(&http_refcount, 1);
 	while (!http_shutdown) {
 
 		// Wait for a request ...
-		if ((client = accept(*config->server, (struct sockaddr *)&client_addr, &client_addr_len)) != -1) {
+		conn.config = config;
+		conn.client_len = sizeof(conn.client);
+		if ((conn.socket = accept(*config->server, (struct sockaddr *)&conn.client, &conn.client_len)) != -1) {
 
 			// We wait for send all data before close socket's stream
 			struct linger so_linger;
 			so_linger.l_onoff  = 1;
 			so_linger.l_linger = 2;
-			setsockopt(client, SOL_SOCKET, SO_LINGER, &so_linger, sizeof(so_linger));
-
-			// Set a timeout for send / receive
-			struct timeval timeout = {60L, 0L}; /* 1 minute to send all data */
-			setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
-			setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
-
-			if (config->secure) {
-				ssl = SSL_new(ctx);
-				if (!ssl) {
-					syslog(LOG_ERR, "http: couldn't create SSL session\n");
-					break; //exit the loop to shutdown the server
-				}
-
-				SSL_set_fd(ssl, client);
-
-				if (!(rc = SSL_accept(ssl))) {
-					int err_SSL_get_error = SSL_get_error(ssl, rc);
-					if (err_SSL_get_error == SSL_ERROR_SYSCALL) {
-						if (errno != EAGAIN && errno != ECONNRESET) {
-							syslog(LOG_ERR, "http: couldn't accept SSL connection - RC %d errno %d %s\n", rc, errno, strerror(errno));
-						}
-					} else {
-						syslog(LOG_ERR, "http: couldn't accept SSL connection - SSL_get_error() returned: %i\n", err_SSL_get_error);
-					}
-				} else {
-					http_request_handle request = HTTP_Request_Secure_initializer;
-					process(&request);
+			setsockopt(conn.socket, SOL_SOCKET, SO_LINGER, &so_linger, sizeof(so_linger));
+
+			// Set a timeout for receive, and for send
+			struct timeval timeout = {CONFIG_LUA_RTOS_HTTP_SERVER_IDLE_TIMEOUT, 0L};
+			setsockopt(conn.socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+			timeout.tv_sec = 60L; /* 1 minute to send all data */
+			setsockopt(conn.socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+			// Hand the connection to a worker
+			while (xQueueSend(http_queue, &conn, 1000 / portTICK_PERIOD_MS) != pdTRUE) {
+				if (http_shutdown) {
+					close(conn.socket);
+					break;
 				}
-
-				SSL_shutdown(ssl);
-				SSL_free(ssl);
-				ssl = NULL;
-			}
-			else
-			{
-				http_request_handle request = HTTP_Request_Normal_initializer;
-				process(&request);
-				shutdown(client, SHUT_RDWR);
 			}
-
-			close(client);
-			client = -1;
-
-			//make sure external systems can't occupy our whole cpu...
-			vTaskDelay(1 / portTICK_PERIOD_MS);
 		}
+	}
 
-		if (script_wants_reboot) {
-			delay(2); //probably required for data to be sent
-			backtrace_count = 0;
-			esp_restart(); /* restart without panic'ing */
-		}
+	// Workers may still be using the SSL context
+	while (http_workers > 0) {
+		delay(10);
 	}
 
 	if (config->secure) {
-		SSL_CTX_free(ctx);
-		ctx = NULL;
+		// The context is kept, so resumed sessions survive a restart
+		config->ctx = NULL;
 
 		free(config->certificate);
 		config->certificate = NULL;
@@ -1356,21 +1694,7 @@ static void *http_thread(void *arg) {
 	    the TCP timewait state."
 	*/
 
-	http_refcount--;
-
-	if (0 == http_refcount) {
-		//last one needs to unregister the net callback
-		driver_error_t *error;
-		if ((error = net_event_unregister_callback(http_net_callback))) {
-			syslog(LOG_WARNING, "http: couldn't unregister net callback\n");
-		}
-
-		//last one needs to unregister the lua execution callback
-		if (http_callback != NULL) {
-			luaS_callback_destroy(http_callback);
-			http_callback = NULL;
-		}
-	}
+	http_thread_exit();
 
 	return NULL;
 }
@@ -1384,7 +1708,9 @@ int http_start(lua_State* L) {
 		struct sched_param sched;
 		pthread_t thread_normal;
 		pthread_t thread_secure;
+		pthread_t thread_worker;
 		int res;
+		int i;
 		driver_error_t *error;
 
 		// Create document root directory if not exist
@@ -1442,9 +1768,30 @@ int http_start(lua_State* L) {
 		pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &cpu_set);
 		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
 
+		// Create the queue for accepted connections
+		if (!http_queue) {
+			http_queue = xQueueCreate(CONFIG_LUA_RTOS_HTTP_SERVER_WORKERS * 2, sizeof(http_connection));
+			if (!http_queue) {
+				return luaL_error(L, "couldn't create http connection queue");
+			}
+		}
+
 		// Create threads
 		http_shutdown = 0;
 
+		for (i = 0; i < CONFIG_LUA_RTOS_HTTP_SERVER_WORKERS; i++) {
+			__sync_fetch_and_add(&http_refcount, 1);
+			__sync_fetch_and_add(&http_workers, 1);
+			res = pthread_create(&thread_worker, &attr, http_worker, NULL);
+			if (res) {
+				__sync_fetch_and_sub(&http_workers, 1);
+				__sync_fetch_and_sub(&http_refcount, 1);
+				return luaL_error(L, "couldn't start http worker");
+			}
+
+			pthread_setname_np(thread_worker, "httpw");
+		}
+
 		http_normal.port = luaL_optinteger( L, 1, CONFIG_LUA_RTOS_HTTP_SERVER_PORT );
 		if (http_normal.port) {
 			res = pthread_create(&thread_normal, &attr, http_thread, &http_normal);
@@ -1486,4 +1833,50 @@ int http_running() {
 	return (http_refcount>0 ? 1 : 0);
 }
 
+int http_cachestats(lua_State* L) {
+	http_pagecache_stats_t stats;
+
+	pthread_mutex_lock(&http_lua_mtx);
+	http_pagecache_stats(&stats);
+	pthread_mutex_unlock(&http_lua_mtx);
+
+	lua_createtable(L, 0, 5);
+
+	lua_pushinteger(L, stats.hits);
+	lua_setfield(L, -2, "hits");
+
+	lua_pushinteger(L, stats.misses);
+	lua_setfield(L, -2, "misses");
+
+	lua_pushinteger(L, stats.entries);
+	lua_setfield(L, -2, "entries");
+
+	lua_pushinteger(L, stats.bytes);
+	lua_setfield(L, -2, "bytes");
+
+	lua_pushinteger(L, stats.size);
+	lua_setfield(L, -2, "size");
+
+	return 1;
+}
+
+int http_tlsstats(lua_State* L) {
+	http_tls_stats_t stats;
+
+	http_tls_stats(&stats);
+
+	lua_createtable(L, 0, 3);
+
+	lua_pushinteger(L, stats.handshakes);
+	lua_setfield(L, -2, "handshakes");
+
+	lua_pushinteger(L, stats.resumed);
+	lua_setfield(L, -2, "resumed");
+
+	lua_pushinteger(L, stats.failed);
+	lua_setfield(L, -2, "failed");
+
+	return 1;
+}
+
 #endif
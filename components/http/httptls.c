@@ -0,0 +1,449 @@
+/*
+ * Copyright (C) 2015 - 2020, IBEROXARXA SERVICIOS INTEGRALES, S.L.
+ * Copyright (C) 2015 - 2020, Jaume Olivé Petrus (jolive@whitecatboard.org)
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *     * The WHITECAT logotype cannot be changed, you can remove it, but you
+ *       cannot change it in any way. The WHITECAT logotype is:
+ *
+ *          /\       /\
+ *         /  \_____/  \
+ *        /_____________\
+ *        W H I T E C A T
+ *
+ *     * Redistributions in binary form must retain all copyright notices printed
+ *       to any local or remote output device. This include any reference to
+ *       Lua RTOS, whitecatboard.org, Lua, and other copyright notices that may
+ *       appear in the future.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Lua RTOS, http server TLS layer
+ *
+ * The server configuration (certificate, private key, random generator and
+ * session cache) is built once, and kept for the next server start while the
+ * certificate and key files don't change. Clients reconnecting within the
+ * session timeout resume their session by session id or by session ticket,
+ * which skips the public key operations of a full handshake.
+ *
+ */
+
+#include "sdkconfig.h"
+
+#if CONFIG_LUA_RTOS_USE_HTTP_SERVER
+
+#include "httptls.h"
+
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/x509_crt.h"
+#include "mbedtls/pk.h"
+#include "mbedtls/ssl_cache.h"
+#include "mbedtls/ssl_ticket.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/syslog.h>
+
+#define HTTP_TLS_PERS "lua-rtos-http-server"
+
+#if (CONFIG_LUA_RTOS_HTTP_SERVER_TLS_SESSION_CACHE > 0) && defined(MBEDTLS_SSL_CACHE_C)
+#define HTTP_TLS_CACHE 1
+#else
+#define HTTP_TLS_CACHE 0
+#endif
+
+#if CONFIG_LUA_RTOS_HTTP_SERVER_TLS_SESSION_TICKETS && defined(MBEDTLS_SSL_TICKET_C)
+#define HTTP_TLS_TICKETS 1
+#else
+#define HTTP_TLS_TICKETS 0
+#endif
+
+struct http_tls_context {
+	char *certificate;
+	char *private_key;
+	time_t certificate_mtime;
+	time_t private_key_mtime;
+	off_t certificate_size;
+	off_t private_key_size;
+	mbedtls_ssl_config conf;
+	mbedtls_x509_crt crt;
+	mbedtls_pk_context key;
+	mbedtls_entropy_context entropy;
+	mbedtls_ctr_drbg_context drbg;
+#if HTTP_TLS_CACHE
+	mbedtls_ssl_cache_context cache;
+#endif
+#if HTTP_TLS_TICKETS
+	mbedtls_ssl_ticket_context ticket;
+#endif
+};
+
+#if CONFIG_LUA_RTOS_HTTP_SERVER_TLS_PREFER_ECDSA
+// ECDSA key exchanges first, as they are cheaper than RSA ones for the
+// server. Cipher suites not built into mbedtls are skipped.
+static const int ecdsa_ciphersuites[] = {
+	MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256,
+	MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_256_GCM_SHA384,
+	MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_CBC_SHA256,
+	MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_CBC_SHA,
+	MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256,
+	MBEDTLS_TLS_ECDHE_RSA_WITH_AES_256_GCM_SHA384,
+	MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_CBC_SHA256,
+	MBEDTLS_TLS_ECDHE_RSA_WITH_AES_128_CBC_SHA,
+	MBEDTLS_TLS_RSA_WITH_AES_128_GCM_SHA256,
+	MBEDTLS_TLS_RSA_WITH_AES_128_CBC_SHA256,
+	MBEDTLS_TLS_RSA_WITH_AES_128_CBC_SHA,
+	0
+};
+
+#if defined(MBEDTLS_ECP_C)
+static const mbedtls_ecp_group_id ecdsa_curves[] = {
+	MBEDTLS_ECP_DP_SECP256R1,
+	MBEDTLS_ECP_DP_SECP384R1,
+	MBEDTLS_ECP_DP_NONE
+};
+#endif
+#endif
+
+static http_tls_context_t *context = NULL;
+static http_tls_stats_t stats = {0, 0, 0};
+
+// mbedtls is built without MBEDTLS_THREADING_C, so the random generator,
+// the session cache and the ticket keys, that are shared by all the
+// workers, are protected here
+static pthread_mutex_t tls_rng_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+#if HTTP_TLS_CACHE || HTTP_TLS_TICKETS
+static pthread_mutex_t tls_session_mtx = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static int tls_file(const char *path, time_t *mtime, off_t *size) {
+	struct stat statbuf;
+
+	if (stat(path, &statbuf) != 0) {
+		return -1;
+	}
+
+	*mtime = statbuf.st_mtime;
+	*size = statbuf.st_size;
+
+	return 0;
+}
+
+static int tls_random(void *data, unsigned char *output, size_t len) {
+	int rc;
+
+	pthread_mutex_lock(&tls_rng_mtx);
+	rc = mbedtls_ctr_drbg_random(data, output, len);
+	pthread_mutex_unlock(&tls_rng_mtx);
+
+	return rc;
+}
+
+#if HTTP_TLS_CACHE
+static int tls_cache_get(void *data, mbedtls_ssl_session *session) {
+	int rc;
+
+	pthread_mutex_lock(&tls_session_mtx);
+	rc = mbedtls_ssl_cache_get(data, session);
+	pthread_mutex_unlock(&tls_session_mtx);
+
+	if (rc == 0) {
+		__sync_fetch_and_add(&stats.resumed, 1);
+	}
+
+	return rc;
+}
+
+static int tls_cache_set(void *data, const mbedtls_ssl_session *session) {
+	int rc;
+
+	pthread_mutex_lock(&tls_session_mtx);
+	rc = mbedtls_ssl_cache_set(data, session);
+	pthread_mutex_unlock(&tls_session_mtx);
+
+	return rc;
+}
+#endif
+
+#if HTTP_TLS_TICKETS
+static int tls_ticket_write(void *data, const mbedtls_ssl_session *session, unsigned char *start, const unsigned char *end, size_t *tlen, uint32_t *lifetime) {
+	int rc;
+
+	pthread_mutex_lock(&tls_session_mtx);
+	rc = mbedtls_ssl_ticket_write(data, session, start, end, tlen, lifetime);
+	pthread_mutex_unlock(&tls_session_mtx);
+
+	return rc;
+}
+
+static int tls_ticket_parse(void *data, mbedtls_ssl_session *session, unsigned char *buf, size_t len) {
+	int rc;
+
+	pthread_mutex_lock(&tls_session_mtx);
+	rc = mbedtls_ssl_ticket_parse(data, session, buf, len);
+	pthread_mutex_unlock(&tls_session_mtx);
+
+	if (rc == 0) {
+		__sync_fetch_and_add(&stats.resumed, 1);
+	}
+
+	return rc;
+}
+#endif
+
+static void tls_context_free(http_tls_context_t *ctx) {
+#if HTTP_TLS_TICKETS
+	mbedtls_ssl_ticket_free(&ctx->ticket);
+#endif
+#if HTTP_TLS_CACHE
+	mbedtls_ssl_cache_free(&ctx->cache);
+#endif
+	mbedtls_ssl_config_free(&ctx->conf);
+	mbedtls_pk_free(&ctx->key);
+	mbedtls_x509_crt_free(&ctx->crt);
+	mbedtls_ctr_drbg_free(&ctx->drbg);
+	mbedtls_entropy_free(&ctx->entropy);
+
+	free(ctx->certificate);
+	free(ctx->private_key);
+	free(ctx);
+}
+
+// Get the server configuration for a certificate and private key. The
+// configuration of the previous server start is reused if both files
+// are unchanged.
+http_tls_context_t *http_tls_context(const char *certificate, const char *private_key) {
+	http_tls_context_t *ctx;
+	time_t certificate_mtime, private_key_mtime;
+	off_t certificate_size, private_key_size;
+	const char *msg;
+
+	if (tls_file(certificate, &certificate_mtime, &certificate_size) != 0) {
+		syslog(LOG_ERR, "http: couldn't load SSL certificate\n");
+		return NULL;
+	}
+
+	if (tls_file(private_key, &private_key_mtime, &private_key_size) != 0) {
+		syslog(LOG_ERR, "http: couldn't load SSL private key\n");
+		return NULL;
+	}
+
+	if (context) {
+		if ((strcmp(context->certificate, certificate) == 0) && (strcmp(context->private_key, private_key) == 0) &&
+			(context->certificate_mtime == certificate_mtime) && (context->certificate_size == certificate_size) &&
+			(context->private_key_mtime == private_key_mtime) && (context->private_key_size == private_key_size)) {
+			return context;
+		}
+
+		tls_context_free(context);
+		context = NULL;
+	}
+
+	ctx = calloc(1, sizeof(http_tls_context_t));
+	if (!ctx) {
+		syslog(LOG_ERR, "http: couldn't create SSL context\n");
+		return NULL;
+	}
+
+	mbedtls_ssl_config_init(&ctx->conf);
+	mbedtls_x509_crt_init(&ctx->crt);
+	mbedtls_pk_init(&ctx->key);
+	mbedtls_entropy_init(&ctx->entropy);
+	mbedtls_ctr_drbg_init(&ctx->drbg);
+#if HTTP_TLS_CACHE
+	mbedtls_ssl_cache_init(&ctx->cache);
+#endif
+#if HTTP_TLS_TICKETS
+	mbedtls_ssl_ticket_init(&ctx->ticket);
+#endif
+
+	ctx->certificate = strdup(certificate);
+	ctx->private_key = strdup(private_key);
+	if (!ctx->certificate || !ctx->private_key) {
+		msg = "couldn't create SSL context";
+		goto fail;
+	}
+
+	ctx->certificate_mtime = certificate_mtime;
+	ctx->certificate_size = certificate_size;
+	ctx->private_key_mtime = private_key_mtime;
+	ctx->private_key_size = private_key_size;
+
+	if (mbedtls_ctr_drbg_seed(&ctx->drbg, mbedtls_entropy_func, &ctx->entropy, (const unsigned char *)HTTP_TLS_PERS, strlen(HTTP_TLS_PERS)) != 0) {
+		msg = "couldn't seed SSL random generator";
+		goto fail;
+	}
+
+	// PEM or DER
+	if (mbedtls_x509_crt_parse_file(&ctx->crt, certificate) != 0) {
+		msg = "couldn't load SSL certificate";
+		goto fail;
+	}
+
+	if (mbedtls_pk_parse_keyfile(&ctx->key, private_key, NULL) != 0) {
+		msg = "couldn't load SSL private key";
+		goto fail;
+	}
+
+	if (mbedtls_ssl_config_defaults(&ctx->conf, MBEDTLS_SSL_IS_SERVER, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT) != 0) {
+		msg = "couldn't create SSL context";
+		goto fail;
+	}
+
+	mbedtls_ssl_conf_rng(&ctx->conf, tls_random, &ctx->drbg);
+
+	if (mbedtls_ssl_conf_own_cert(&ctx->conf, &ctx->crt, &ctx->key) != 0) {
+		msg = "couldn't set SSL certificate";
+		goto fail;
+	}
+
+#if CONFIG_LUA_RTOS_HTTP_SERVER_TLS_PREFER_ECDSA
+	mbedtls_ssl_conf_ciphersuites(&ctx->conf, ecdsa_ciphersuites);
+#if defined(MBEDTLS_ECP_C)
+	mbedtls_ssl_conf_curves(&ctx->conf, ecdsa_curves);
+#endif
+#endif
+
+#if HTTP_TLS_CACHE
+	mbedtls_ssl_cache_set_max_entries(&ctx->cache, CONFIG_LUA_RTOS_HTTP_SERVER_TLS_SESSION_CACHE);
+	mbedtls_ssl_cache_set_timeout(&ctx->cache, CONFIG_LUA_RTOS_HTTP_SERVER_TLS_SESSION_TIMEOUT);
+	mbedtls_ssl_conf_session_cache(&ctx->conf, &ctx->cache, tls_cache_get, tls_cache_set);
+#endif
+
+#if HTTP_TLS_TICKETS
+	if (mbedtls_ssl_ticket_setup(&ctx->ticket, tls_random, &ctx->drbg, MBEDTLS_CIPHER_AES_256_GCM, CONFIG_LUA_RTOS_HTTP_SERVER_TLS_SESSION_TIMEOUT) != 0) {
+		msg = "couldn't set up SSL session tickets";
+		goto fail;
+	}
+
+	mbedtls_ssl_conf_session_tickets_cb(&ctx->conf, tls_ticket_write, tls_ticket_parse, &ctx->ticket);
+#endif
+
+	context = ctx;
+
+	return ctx;
+
+fail:
+	syslog(LOG_ERR, "http: %s\n", msg);
+	tls_context_free(ctx);
+
+	return NULL;
+}
+
+// Do the handshake of an accepted connection
+http_tls_t *http_tls_accept(http_tls_context_t *ctx, int socket) {
+	http_tls_t *tls;
+	int rc;
+
+	tls = calloc(1, sizeof(http_tls_t));
+	if (!tls) {
+		syslog(LOG_ERR, "http: couldn't create SSL session\n");
+		return NULL;
+	}
+
+	mbedtls_ssl_init(&tls->ssl);
+	mbedtls_net_init(&tls->fd);
+	tls->fd.fd = socket;
+
+	if ((rc = mbedtls_ssl_setup(&tls->ssl, &ctx->conf)) != 0) {
+		syslog(LOG_ERR, "http: couldn't create SSL session - error -0x%04x\n", -rc);
+		mbedtls_ssl_free(&tls->ssl);
+		free(tls);
+		return NULL;
+	}
+
+	mbedtls_ssl_set_bio(&tls->ssl, &tls->fd, mbedtls_net_send, mbedtls_net_recv, NULL);
+
+	while ((rc = mbedtls_ssl_handshake(&tls->ssl)) != 0) {
+		if ((rc == MBEDTLS_ERR_SSL_WANT_READ) || (rc == MBEDTLS_ERR_SSL_WANT_WRITE)) {
+			continue;
+		}
+
+		__sync_fetch_and_add(&stats.failed, 1);
+
+		// Clients going away during the handshake are not an error
+		if ((rc != MBEDTLS_ERR_NET_RECV_FAILED) && (rc != MBEDTLS_ERR_NET_SEND_FAILED) &&
+			(rc != MBEDTLS_ERR_NET_CONN_RESET) && (rc != MBEDTLS_ERR_SSL_CONN_EOF)) {
+			syslog(LOG_ERR, "http: couldn't accept SSL connection - error -0x%04x\n", -rc);
+		}
+
+		mbedtls_ssl_free(&tls->ssl);
+		free(tls);
+		return NULL;
+	}
+
+	__sync_fetch_and_add(&stats.handshakes, 1);
+
+	return tls;
+}
+
+// Returns the number of bytes read, 0 if the connection was closed by
+// the client, or -1 on error or timeout.
+int http_tls_read(http_tls_t *tls, char *buffer, int length) {
+	int rc;
+
+	do {
+		rc = mbedtls_ssl_read(&tls->ssl, (unsigned char *)buffer, length);
+	} while ((rc == MBEDTLS_ERR_SSL_WANT_READ) || (rc == MBEDTLS_ERR_SSL_WANT_WRITE));
+
+	if ((rc == 0) || (rc == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY)) {
+		return 0;
+	}
+
+	return (rc < 0) ? -1 : rc;
+}
+
+// Returns the number of bytes written, or -1 on error
+int http_tls_write(http_tls_t *tls, const char *buffer, int length) {
+	int rc;
+
+	do {
+		rc = mbedtls_ssl_write(&tls->ssl, (const unsigned char *)buffer, length);
+	} while ((rc == MBEDTLS_ERR_SSL_WANT_READ) || (rc == MBEDTLS_ERR_SSL_WANT_WRITE));
+
+	return (rc < 0) ? -1 : rc;
+}
+
+// Decrypted bytes available without reading from the socket
+int http_tls_pending(http_tls_t *tls) {
+	return mbedtls_ssl_get_bytes_avail(&tls->ssl) > 0;
+}
+
+// Close the session. The socket is closed by the caller.
+void http_tls_close(http_tls_t *tls) {
+	mbedtls_ssl_close_notify(&tls->ssl);
+	mbedtls_ssl_free(&tls->ssl);
+	free(tls);
+}
+
+void http_tls_stats(http_tls_stats_t *s) {
+	*s = stats;
+}
+
+#endif
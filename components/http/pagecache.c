@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2015 - 2020, IBEROXARXA SERVICIOS INTEGRALES, S.L.
+ * Copyright (C) 2015 - 2020, Jaume Olivé Petrus (jolive@whitecatboard.org)
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *     * The WHITECAT logotype cannot be changed, you can remove it, but you
+ *       cannot change it in any way. The WHITECAT logotype is:
+ *
+ *          /\       /\
+ *         /  \_____/  \
+ *        /_____________\
+ *        W H I T E C A T
+ *
+ *     * Redistributions in binary form must retain all copyright notices printed
+ *       to any local or remote output device. This include any reference to
+ *       Lua RTOS, whitecatboard.org, Lua, and other copyright notices that may
+ *       appear in the future.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Lua RTOS, http lua page bytecode cache
+ *
+ * Compiled pages are kept as bytecode in a LRU list bounded by
+ * CONFIG_LUA_RTOS_HTTP_SERVER_PAGE_CACHE_SIZE, and keyed by the path,
+ * modification time and size of the page source, so a repeated hit
+ * to a page is undumped instead of being preprocessed and parsed.
+ *
+ * Pages are run one at a time, so callers serialize the access.
+ *
+ */
+
+#include "sdkconfig.h"
+
+#if CONFIG_LUA_RTOS_USE_HTTP_SERVER
+
+#include "pagecache.h"
+
+#include "lua.h"
+#include "lauxlib.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define PAGE_CACHE_SIZE (CONFIG_LUA_RTOS_HTTP_SERVER_PAGE_CACHE_SIZE * 1024)
+
+typedef struct page {
+	struct page *prev;
+	struct page *next;
+	char *path;
+	time_t mtime;
+	off_t src_size;
+	size_t size;
+	char *code;
+} page_t;
+
+// Most recently used page first
+static page_t *first = NULL;
+static page_t *last = NULL;
+
+static http_pagecache_stats_t stats = {0, 0, 0, 0, PAGE_CACHE_SIZE};
+
+// Bytecode being dumped
+typedef struct {
+	char *code;
+	size_t size;
+	size_t room;
+} dump_t;
+
+static void page_unlink(page_t *page) {
+	if (page->prev) {
+		page->prev->next = page->next;
+	} else {
+		first = page->next;
+	}
+
+	if (page->next) {
+		page->next->prev = page->prev;
+	} else {
+		last = page->prev;
+	}
+
+	page->prev = page->next = NULL;
+}
+
+static void page_push(page_t *page) {
+	page->prev = NULL;
+	page->next = first;
+
+	if (first) {
+		first->prev = page;
+	} else {
+		last = page;
+	}
+
+	first = page;
+}
+
+static void page_free(page_t *page) {
+	page_unlink(page);
+
+	stats.entries--;
+	stats.bytes -= page->size;
+
+	free(page->code);
+	free(page->path);
+	free(page);
+}
+
+static page_t *page_find(const char *path) {
+	page_t *page = first;
+
+	while (page) {
+		if (strcmp(page->path, path) == 0) {
+			return page;
+		}
+
+		page = page->next;
+	}
+
+	return NULL;
+}
+
+static int page_writer(lua_State *L, const void *p, size_t sz, void *ud) {
+	dump_t *dump = (dump_t *)ud;
+	char *code;
+
+	if (dump->size + sz > PAGE_CACHE_SIZE) {
+		return 1; // Too big to be cached
+	}
+
+	if (dump->size + sz > dump->room) {
+		size_t room = dump->room ? dump->room * 2 : 1024;
+
+		while (room < dump->size + sz) {
+			room *= 2;
+		}
+
+		code = realloc(dump->code, room);
+		if (!code) {
+			return 1;
+		}
+
+		dump->code = code;
+		dump->room = room;
+	}
+
+	memcpy(dump->code + dump->size, p, sz);
+	dump->size += sz;
+
+	return 0;
+}
+
+// Push the compiled page for path, if it's cached and still matches
+// its source. Returns LUA_OK if the page was pushed.
+int http_pagecache_load(lua_State *L, const char *path, time_t mtime, off_t size) {
+	page_t *page;
+	int ret;
+
+	page = page_find(path);
+	if (!page) {
+		stats.misses++;
+		return LUA_ERRFILE;
+	}
+
+	if ((page->mtime != mtime) || (page->src_size != size)) {
+		// The source changed
+		page_free(page);
+		stats.misses++;
+		return LUA_ERRFILE;
+	}
+
+	ret = luaL_loadbufferx(L, page->code, page->size, path, "b");
+	if (ret != LUA_OK) {
+		lua_pop(L, 1);
+		page_free(page);
+		stats.misses++;
+		return ret;
+	}
+
+	// Move to front
+	page_unlink(page);
+	page_push(page);
+
+	stats.hits++;
+
+	return LUA_OK;
+}
+
+// Cache the compiled page on the top of the stack
+void http_pagecache_store(lua_State *L, const char *path, time_t mtime, off_t size) {
+	dump_t dump = {NULL, 0, 0};
+	page_t *page;
+
+	if (PAGE_CACHE_SIZE == 0) {
+		return;
+	}
+
+	if ((page = page_find(path))) {
+		page_free(page);
+	}
+
+	// Keep debug information, so errors in cached pages still report line numbers
+	if ((lua_dump(L, page_writer, &dump, 0) != 0) || (dump.size == 0)) {
+		free(dump.code);
+		return;
+	}
+
+	// Evict the least recently used pages until it fits
+	while (last && (stats.bytes + dump.size > PAGE_CACHE_SIZE)) {
+		page_free(last);
+	}
+
+	page = calloc(1, sizeof(page_t));
+	if (!page) {
+		free(dump.code);
+		return;
+	}
+
+	page->path = strdup(path);
+	if (!page->path) {
+		free(dump.code);
+		free(page);
+		return;
+	}
+
+	// Give back the unused room
+	page->code = realloc(dump.code, dump.size);
+	if (!page->code) {
+		page->code = dump.code;
+	}
+
+	page->size = dump.size;
+	page->mtime = mtime;
+	page->src_size = size;
+
+	page_push(page);
+
+	stats.entries++;
+	stats.bytes += page->size;
+}
+
+void http_pagecache_flush() {
+	while (first) {
+		page_free(first);
+	}
+}
+
+void http_pagecache_stats(http_pagecache_stats_t *s) {
+	*s = stats;
+}
+
+#endif
@@ -0,0 +1,302 @@
+/*
+ * Copyright (C) 2015 - 2020, IBEROXARXA SERVICIOS INTEGRALES, S.L.
+ * Copyright (C) 2015 - 2020, Jaume Olivé Petrus (jolive@whitecatboard.org)
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *     * The WHITECAT logotype cannot be changed, you can remove it, but you
+ *       cannot change it in any way. The WHITECAT logotype is:
+ *
+ *          /\       /\
+ *         /  \_____/  \
+ *        /_____________\
+ *        W H I T E C A T
+ *
+ *     * Redistributions in binary form must retain all copyright notices printed
+ *       to any local or remote output device. This include any reference to
+ *       Lua RTOS, whitecatboard.org, Lua, and other copyright notices that may
+ *       appear in the future.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Lua RTOS, http server TLS layer test cases
+ *
+ */
+
+#include "sdkconfig.h"
+
+#if CONFIG_LUA_RTOS_USE_HTTP_SERVER && CONFIG_LUA_RTOS_USE_RAM_FS
+
+#include "mbedtls/certs.h"
+
+#if defined(MBEDTLS_CERTS_C)
+
+#include "unity.h"
+
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mount.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <drivers/net.h>
+
+#include "httptls.h"
+
+#define TLS_TEST_DIR         "/ramfs"
+#define TLS_TEST_CERTIFICATE TLS_TEST_DIR "/tls_test.crt"
+#define TLS_TEST_KEY         TLS_TEST_DIR "/tls_test.key"
+#define TLS_TEST_PORT        4433
+
+// Handshakes of each kind
+#define TLS_TEST_HANDSHAKES 10
+
+// mbedtls test certificate and key, ECDSA ones if they are preferred
+#if CONFIG_LUA_RTOS_HTTP_SERVER_TLS_PREFER_ECDSA && defined(MBEDTLS_ECDSA_C)
+#define TLS_TEST_CRT mbedtls_test_srv_crt_ec
+#define TLS_TEST_PK  mbedtls_test_srv_key_ec
+#else
+#define TLS_TEST_CRT mbedtls_test_srv_crt
+#define TLS_TEST_PK  mbedtls_test_srv_key
+#endif
+
+typedef struct {
+    http_tls_context_t *ctx;
+    int connections; // Connections to accept
+    int accepted;    // Connections that completed the handshake
+} tls_test_server_t;
+
+static int64_t tls_us(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void tls_test_file(const char *path, const char *data) {
+    FILE *fp;
+
+    fp = fopen(path, "w");
+    TEST_ASSERT(fp != NULL);
+    TEST_ASSERT(fputs(data, fp) >= 0);
+    fclose(fp);
+}
+
+// Stand-in for http_thread, that only does the handshake
+static void *tls_test_server(void *arg) {
+    tls_test_server_t *server = arg;
+    struct sockaddr_in sin;
+    struct timeval timeout;
+    http_tls_t *tls;
+    int s, c, i;
+    int on = 1;
+
+    s = socket(AF_INET, SOCK_STREAM, 0);
+    if (s < 0) {
+        return NULL;
+    }
+
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(TLS_TEST_PORT);
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if ((bind(s, (struct sockaddr *)&sin, sizeof(sin)) != 0) || (listen(s, 1) != 0)) {
+        close(s);
+        return NULL;
+    }
+
+    // Don't wait forever if the client fails
+    timeout.tv_sec = 10;
+    timeout.tv_usec = 0;
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    for (i = 0; i < server->connections; i++) {
+        c = accept(s, NULL, NULL);
+        if (c < 0) {
+            break;
+        }
+
+        setsockopt(c, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        tls = http_tls_accept(server->ctx, c);
+        if (tls) {
+            server->accepted++;
+            http_tls_close(tls);
+        }
+
+        close(c);
+    }
+
+    close(s);
+
+    return NULL;
+}
+
+// Connect to the server, and do the handshake. If session is not NULL, and
+// resume is set, the session is resumed, otherwise the new session is
+// returned in it.
+static int tls_test_connect(mbedtls_ssl_config *conf, mbedtls_ssl_session *session, int resume) {
+    mbedtls_net_context fd;
+    mbedtls_ssl_context ssl;
+    char port[8];
+    int rc;
+
+    mbedtls_net_init(&fd);
+    mbedtls_ssl_init(&ssl);
+
+    snprintf(port, sizeof(port), "%d", TLS_TEST_PORT);
+
+    rc = mbedtls_net_connect(&fd, "127.0.0.1", port, MBEDTLS_NET_PROTO_TCP);
+    if (rc == 0) {
+        rc = mbedtls_ssl_setup(&ssl, conf);
+    }
+
+    if (rc == 0) {
+        mbedtls_ssl_set_bio(&ssl, &fd, mbedtls_net_send, mbedtls_net_recv, NULL);
+
+        if (resume) {
+            rc = mbedtls_ssl_set_session(&ssl, session);
+        }
+    }
+
+    if (rc == 0) {
+        while ((rc = mbedtls_ssl_handshake(&ssl)) != 0) {
+            if ((rc != MBEDTLS_ERR_SSL_WANT_READ) && (rc != MBEDTLS_ERR_SSL_WANT_WRITE)) {
+                break;
+            }
+        }
+    }
+
+    if ((rc == 0) && !resume && session) {
+        rc = mbedtls_ssl_get_session(&ssl, session);
+    }
+
+    if (rc == 0) {
+        mbedtls_ssl_close_notify(&ssl);
+    }
+
+    mbedtls_ssl_free(&ssl);
+    mbedtls_net_free(&fd);
+
+    return rc;
+}
+
+TEST_CASE("https handshake rate", "[http][bench]") {
+    http_tls_stats_t before, after;
+    tls_test_server_t server;
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context drbg;
+    mbedtls_ssl_config conf;
+    mbedtls_ssl_session session;
+    pthread_attr_t attr;
+    pthread_t thread;
+    int64_t full, resumed;
+    int i;
+
+    net_init();
+    mount(TLS_TEST_DIR, "ramfs");
+
+    tls_test_file(TLS_TEST_CERTIFICATE, TLS_TEST_CRT);
+    tls_test_file(TLS_TEST_KEY, TLS_TEST_PK);
+
+    server.ctx = http_tls_context(TLS_TEST_CERTIFICATE, TLS_TEST_KEY);
+    TEST_ASSERT(server.ctx != NULL);
+
+    // The configuration is reused while the files don't change
+    TEST_ASSERT(http_tls_context(TLS_TEST_CERTIFICATE, TLS_TEST_KEY) == server.ctx);
+
+    server.connections = 2 * TLS_TEST_HANDSHAKES;
+    server.accepted = 0;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, CONFIG_LUA_RTOS_HTTP_SERVER_STACK_SIZE);
+    TEST_ASSERT(pthread_create(&thread, &attr, tls_test_server, &server) == 0);
+
+    // Client, that doesn't verify the server certificate
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&drbg);
+    mbedtls_ssl_config_init(&conf);
+    mbedtls_ssl_session_init(&session);
+
+    TEST_ASSERT(mbedtls_ctr_drbg_seed(&drbg, mbedtls_entropy_func, &entropy, NULL, 0) == 0);
+    TEST_ASSERT(mbedtls_ssl_config_defaults(&conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT) == 0);
+    mbedtls_ssl_conf_authmode(&conf, MBEDTLS_SSL_VERIFY_NONE);
+    mbedtls_ssl_conf_rng(&conf, mbedtls_ctr_drbg_random, &drbg);
+
+    // Let the server listen
+    usleep(100000);
+
+    http_tls_stats(&before);
+
+    // Full handshakes, the session of the last one is kept
+    full = tls_us();
+    for (i = 0; i < TLS_TEST_HANDSHAKES; i++) {
+        TEST_ASSERT(tls_test_connect(&conf, &session, 0) == 0);
+    }
+    full = tls_us() - full;
+
+    // Resumed handshakes
+    resumed = tls_us();
+    for (i = 0; i < TLS_TEST_HANDSHAKES; i++) {
+        TEST_ASSERT(tls_test_connect(&conf, &session, 1) == 0);
+    }
+    resumed = tls_us() - resumed;
+
+    pthread_join(thread, NULL);
+
+    http_tls_stats(&after);
+
+    TEST_ASSERT(server.accepted == 2 * TLS_TEST_HANDSHAKES);
+    TEST_ASSERT(after.handshakes - before.handshakes == 2 * TLS_TEST_HANDSHAKES);
+
+#if (CONFIG_LUA_RTOS_HTTP_SERVER_TLS_SESSION_CACHE > 0) || CONFIG_LUA_RTOS_HTTP_SERVER_TLS_SESSION_TICKETS
+    TEST_ASSERT(after.resumed - before.resumed == TLS_TEST_HANDSHAKES);
+#endif
+
+    printf("https: %d full handshakes, %lld us each, %d resumed handshakes, %lld us each\n",
+        TLS_TEST_HANDSHAKES, full / TLS_TEST_HANDSHAKES, TLS_TEST_HANDSHAKES, resumed / TLS_TEST_HANDSHAKES);
+
+    mbedtls_ssl_session_free(&session);
+    mbedtls_ssl_config_free(&conf);
+    mbedtls_ctr_drbg_free(&drbg);
+    mbedtls_entropy_free(&entropy);
+
+    unlink(TLS_TEST_CERTIFICATE);
+    unlink(TLS_TEST_KEY);
+}
+
+#endif
+
+#endif
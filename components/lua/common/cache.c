@@ -39,7 +39,7 @@
  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  *
- * Lua RTOS read only table cache
+ * Lua RTOS read only table index
  *
  */
 
@@ -51,152 +51,207 @@
 
 #include "esp_attr.h"
 
+#include "lstring.h"
+
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <freertos/FreeRTOS.h>
 
-static rotable_cache_t cache;
+/*
+ * Directory of indexes, addressed by the read only table address. Entries are
+ * only added, never removed, and an entry is published only when the index that
+ * it points to is completely built, so readers don't need to take the lock.
+ */
+static rotable_index_t * volatile directory[ROTABLE_INDEX_DIR_SIZE];
+static rotable_index_stats_t stats;
 static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
 
-void rotable_cache_dump() {
-	struct rotable_cache_entry *entry = cache.first;
-	int i = 0;
+static inline uint32_t dir_hash(const luaR_entry *rotable) {
+	// Read only tables are 4-byte aligned, discard the lower bits
+	uint32_t h = ((uint32_t)rotable) >> 2;
 
-	portENTER_CRITICAL(&lock);
+	return (h ^ (h >> 8)) & (ROTABLE_INDEX_DIR_SIZE - 1);
+}
 
-	while (entry) {
-		printf("[%d]: used %d ", i, entry->used);
+static IRAM_ATTR rotable_index_t *dir_get(const luaR_entry *rotable) {
+	uint32_t i = dir_hash(rotable);
+	uint32_t probes;
+	rotable_index_t *index;
 
-		if (entry->rotable) {
-			if (entry->entry->key.len) {
-				printf("%s\r\n", entry->entry->key.id.strkey);
-			}
-		} else {
-			printf("emppty\r\n");
+	for(probes = 0;probes < ROTABLE_INDEX_DIR_SIZE;probes++) {
+		index = directory[i];
+		if (!index || (index->rotable == rotable)) {
+			return index;
 		}
 
-		entry = entry->next;
-		i++;
+		i = (i + 1) & (ROTABLE_INDEX_DIR_SIZE - 1);
 	}
 
-	printf("\r\n");
+	return NULL;
+}
 
-	printf("hit: %d, miss: %d\r\n", cache.hit, cache.miss);
+static rotable_index_t *index_build(const luaR_entry *rotable) {
+	const luaR_entry *entry = rotable;
+	rotable_index_t *index;
+	uint32_t entries = 0;
+	uint32_t size = 4;
+	uint32_t i;
 
-	portEXIT_CRITICAL(&lock);
+	while (entry->key.id.strkey) {
+		entries++;
+		entry++;
+	}
 
-	printf("\r\n\r\n");
-}
+	if (entries >= 0xffff) {
+		return NULL;
+	}
 
-int rotable_cache_init() {
-	struct rotable_cache_entry *entries;
-	int i;
+	// Keep the load factor <= 0.5
+	while (size < entries * 2) {
+		size <<= 1;
+	}
 
-	// Allocate space for cache entries
-	entries = (struct rotable_cache_entry *)calloc(ROTABLE_CACHE_LENGTH, sizeof(struct rotable_cache_entry));
-	if (!entries) {
-		return 1;
+	index = calloc(1, sizeof(rotable_index_t) + size * sizeof(struct rotable_index_slot));
+	if (!index) {
+		return NULL;
 	}
 
-	cache.first = entries;
+	index->rotable = rotable;
+	index->mask = size - 1;
+	index->entries = entries;
 
-	// Initialize linked list
-	entries->previous = NULL;
+	for(entry = rotable;entry->key.id.strkey;entry++) {
+		if (entry->key.type != LUA_TSTRING) {
+			continue;
+		}
 
-	for(i = 0;i < ROTABLE_CACHE_LENGTH;i++) {
-		entries->next = (entries + 1);
+		uint32_t h = luaS_hash(entry->key.id.strkey, entry->key.len, luaR_seed());
 
-		if (i > 0) {
-			entries->previous = (entries - 1);
+		i = h & index->mask;
+		while (index->slot[i].pos) {
+			i = (i + 1) & index->mask;
 		}
-		entries++;
+
+		index->slot[i].hash = h;
+		index->slot[i].pos = (entry - rotable) + 1;
 	}
 
-	entries--;
+	return index;
+}
 
-	entries->next = NULL;
+static rotable_index_t *index_add(const luaR_entry *rotable) {
+	rotable_index_t *index, *current;
+	uint32_t i, probes;
 
-	cache.last = entries;
+	if (stats.indexes >= (ROTABLE_INDEX_DIR_SIZE * 3) / 4) {
+		// Directory is full
+		return NULL;
+	}
 
-	return 0;
-}
+	// Build the index out of the critical section, if other thread builds the
+	// same index first, our copy is discarded
+	index = index_build(rotable);
+	if (!index) {
+		return NULL;
+	}
 
-const IRAM_ATTR TValue *rotable_cache_get(const luaR_entry *rotable, const char *strkey) {
-	// rotable strkey is cached?
-	int len = strlen(strkey);
-
-    portENTER_CRITICAL(&lock);
-
-    struct rotable_cache_entry *entry = cache.first;
-
-	while (entry) {
-		if ((entry->rotable == rotable) && (entry->entry->key.len == len) &&  (!strcmp(entry->entry->key.id.strkey, strkey))) {
-			// hit
-			cache.hit++;
-			entry->used++;
-
-			// Promote this entry to the head
-			if (entry != cache.first) {
-				if (entry != cache.last) {
-					entry->previous->next = entry->next;
-					entry->next->previous = entry->previous;
-					cache.first->previous = entry;
-					entry->next = cache.first;
-					cache.first = entry;
-				} else {
-					cache.last->previous->next = NULL;
-					cache.last = cache.last->previous;
-					entry->next = cache.first;
-					entry->previous = NULL;
-					cache.first->previous = entry;
-					cache.first = entry;
-				}
-			}
+	portENTER_CRITICAL(&lock);
+
+	i = dir_hash(rotable);
+	for(probes = 0;probes < ROTABLE_INDEX_DIR_SIZE;probes++) {
+		current = directory[i];
+		if (!current) {
+			// Ensure that the index is visible before it's published
+			__sync_synchronize();
+
+			directory[i] = index;
+			stats.indexes++;
 
 			portEXIT_CRITICAL(&lock);
-			return &entry->entry->value;
+			return index;
 		}
 
-		entry = entry->next;
-	}
+		if (current->rotable == rotable) {
+			break;
+		}
 
-	// miss
-	cache.miss++;
+		i = (i + 1) & (ROTABLE_INDEX_DIR_SIZE - 1);
+	}
 
 	portEXIT_CRITICAL(&lock);
 
-	return NULL;
-}
-
-void IRAM_ATTR rotable_cache_put(const luaR_entry *rotable, const luaR_entry *entry) {
-    portENTER_CRITICAL(&lock);
+	free(index);
 
-	struct rotable_cache_entry *first  = cache.last;
-	struct rotable_cache_entry *second = cache.first;
-	struct rotable_cache_entry *last   = cache.last->previous;
+	return (probes < ROTABLE_INDEX_DIR_SIZE)?current:NULL;
+}
 
-	first->next      = second;
-	first->previous  = NULL;
-	second->previous = first;
-	last->next       = NULL;
+int rotable_cache_dump(lua_State *L) {
+	rotable_index_t *index;
+	uint32_t slots = 0;
+	int i;
 
-	first->rotable = (luaR_entry *)rotable;
-	first->entry = (luaR_entry *)entry;
+	for(i = 0;i < ROTABLE_INDEX_DIR_SIZE;i++) {
+		index = directory[i];
+		if (index) {
+			slots += index->mask + 1;
+		}
+	}
 
-	cache.first = first;
-	cache.first->used = 1;
-	cache.last = last;
+	printf("indexes: %d, slots: %d, bytes: %d\r\n", stats.indexes, slots,
+		stats.indexes * sizeof(rotable_index_t) + slots * sizeof(struct rotable_index_slot));
+	printf("hit: %d, miss: %d\r\n\r\n", stats.hit, stats.miss);
 
-	portEXIT_CRITICAL(&lock);
+	return 0;
 }
 
 /*
+ * Lookup a string key in a read only table using its index. If the table is not
+ * indexed yet, the index is built. h is the key hash computed by luaS_hash with
+ * the seed returned by luaR_seed, that is the hash that a Lua string with the key
+ * already has.
+ *
+ * Returns 1 if the lookup was resolved (*res is NULL if the key doesn't exist),
+ * or 0 if the table cannot be indexed, and caller must do a linear scan.
+ */
+int IRAM_ATTR rotable_cache_get(const luaR_entry *rotable, const char *strkey, int len, unsigned int h, const TValue **res, unsigned *ppos) {
+	rotable_index_t *index;
+	const luaR_entry *entry;
+	uint32_t i;
+
+	index = dir_get(rotable);
+	if (!index) {
+		index = index_add(rotable);
+		if (!index) {
+			stats.miss++;
+			return 0;
+		}
+	}
+
+	stats.hit++;
 
-bisect, 10000 times
+	i = h & index->mask;
 
-cache = 0, 6.441 secs
-cache = 8, 5.055 secs
+	while (index->slot[i].pos) {
+		if (index->slot[i].hash == h) {
+			entry = &rotable[index->slot[i].pos - 1];
+			if ((entry->key.len == len) && (!memcmp(entry->key.id.strkey, strkey, len))) {
+				if (ppos) {
+					*ppos = index->slot[i].pos - 1;
+				}
+
+				*res = &entry->value;
+				return 1;
+			}
+		}
+
+		i = (i + 1) & index->mask;
+	}
+
+	*res = NULL;
+
+	return 1;
+}
 
-*/
 #endif
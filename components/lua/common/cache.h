@@ -39,7 +39,7 @@
  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  *
- * Lua RTOS read only table cache
+ * Lua RTOS read only table index
  *
  */
 
@@ -52,31 +52,37 @@
 #ifndef ROTABLE_CACHE_H
 #define ROTABLE_CACHE_H
 
-#define ROTABLE_CACHE_LENGTH 8
-
-#include <sys/mutex.h>
-
-struct rotable_cache_entry {
-	struct rotable_cache_entry *previous; // Previous entry
-	struct rotable_cache_entry *next;     // Next entry
+/*
+ * Number of read only tables that can be indexed. Must be a power of 2. Lookups
+ * on read only tables that don't fit in the directory fall back to a linear scan.
+ */
+#define ROTABLE_INDEX_DIR_SIZE 256
 
-	luaR_entry *rotable; // cached rotable
-	luaR_entry *entry;   // cached entry
-	uint32_t used;
+struct rotable_index_slot {
+	uint32_t hash; // Key hash
+	uint16_t pos;  // Entry position + 1, 0 means empty slot
 };
 
+/*
+ * Open addressing hash index for a read only table. It is built the first time
+ * that the table is accessed and it never changes after that, so it can be read
+ * without taking any lock.
+ */
 typedef struct {
-	uint32_t miss;     // Number of cache misses
-	uint32_t hit;      // Number of cache hits
+	const luaR_entry *rotable;         // Indexed read only table
+	uint16_t mask;                     // Number of slots - 1
+	uint16_t entries;                  // Number of entries in the read only table
+	struct rotable_index_slot slot[];  // Slots
+} rotable_index_t;
 
-	struct rotable_cache_entry *first; // First entry
-	struct rotable_cache_entry *last;  // Last entry
-} rotable_cache_t;
+typedef struct {
+	uint32_t indexes;  // Number of read only tables indexed
+	uint32_t hit;      // Number of lookups resolved by an index
+	uint32_t miss;     // Number of lookups resolved by a linear scan
+} rotable_index_stats_t;
 
-void rotable_cache_dump();
-int rotable_cache_init();
-const TValue *rotable_cache_get(const luaR_entry *rotable, const char *strkey);
-void rotable_cache_put(const luaR_entry *rotable, const luaR_entry *entry);
+int rotable_cache_dump(lua_State *L);
+int rotable_cache_get(const luaR_entry *rotable, const char *strkey, int len, unsigned int h, const TValue **res, unsigned *ppos);
 
 #endif
 
@@ -19,9 +19,23 @@
 /* Externally defined read-only table array */
 extern const luaR_entry lua_rotable[];
 
+/* String hash seed, 0 until the first Lua state is created */
+static volatile unsigned int hash_seed = 0;
+
 static const TValue *luaR_auxfind(const luaR_entry *pentry, const char *strkey,
 		luaR_numkey numkey, unsigned *ppos);
 
+/* Set the string hash seed, if it is not set yet, and return it */
+unsigned int luaR_initseed(unsigned int seed) {
+	__sync_bool_compare_and_swap(&hash_seed, 0, seed?seed:1);
+
+	return hash_seed;
+}
+
+unsigned int IRAM_ATTR luaR_seed(void) {
+	return hash_seed;
+}
+
 /*
  * Only for debug purposes.
  */
@@ -59,6 +73,38 @@ void luaA_pushobject(lua_State *L, const TValue *o) {
 	api_incr_top(L);
 }
 
+/*
+ * Find a string key in a rotable and return it. h is the key hash computed by luaS_hash
+ * with the seed returned by luaR_seed, that is the hash that a Lua string with the key
+ * already has.
+ */
+static const IRAM_ATTR TValue *luaR_auxfindstr(const luaR_entry *pentry, const char *k, size_t kl, unsigned int h, unsigned *ppos) {
+	const luaR_entry *entry = pentry;
+	int i = 0;
+
+	// Try to get from index
+	#if CONFIG_LUA_RTOS_LUA_USE_ROTABLE_CACHE && !CONFIG_LUA_RTOS_LUA_USE_JIT_BYTECODE_OPTIMIZER
+	const TValue *res = NULL;
+
+	if (rotable_cache_get(pentry, k, kl, h, &res, ppos)) {
+		return res;
+	}
+	#endif
+
+	while (entry->key.id.strkey) {
+		if ((entry->key.type == LUA_TSTRING) && (entry->key.len == kl) && (!memcmp(entry->key.id.strkey, k, kl))) {
+			if (ppos)
+				*ppos = i;
+
+			return &entry->value;
+		}
+		entry++;
+		i++;
+	}
+
+	return NULL;
+}
+
 /* Find an entry in a rotable and return it */
 static const IRAM_ATTR TValue *luaR_auxfind(const luaR_entry *pentry, const char *k, luaR_numkey nk, unsigned *ppos) {
 	const TValue *res = NULL;
@@ -66,38 +112,18 @@ static const IRAM_ATTR TValue *luaR_auxfind(const luaR_entry *pentry, const char
 	int i = 0;
 
 	if (k) {
-		// Try to get from cache
-		#if CONFIG_LUA_RTOS_LUA_USE_ROTABLE_CACHE && !CONFIG_LUA_RTOS_LUA_USE_JIT_BYTECODE_OPTIMIZER
-		res = rotable_cache_get(pentry, k);
-		if (res) {
-			return res;
-		}
-		#endif
+		size_t kl = strlen(k);
 
-		int kl = strlen(k);
-
-		while (entry->key.id.strkey) {
-			if ((entry->key.type == LUA_TSTRING) && (entry->key.len == kl) && (!strncmp(entry->key.id.strkey, k, kl))) {
-				#if CONFIG_LUA_RTOS_LUA_USE_ROTABLE_CACHE && !CONFIG_LUA_RTOS_LUA_USE_JIT_BYTECODE_OPTIMIZER
-				// Put in cache
-				rotable_cache_put(pentry, entry);
-				#endif
+		return luaR_auxfindstr(pentry, k, kl, luaS_hash(k, kl, luaR_seed()), ppos);
+	}
 
-				res = &entry->value;
-				break;
-			}
-			entry++;
-			i++;
-		}
-	} else {
-		while (entry->key.id.strkey) {
-			if (i == nk) {
-				res = &entry->value;
-				break;
-			}
-			entry++;
-			i++;
+	while (entry->key.id.strkey) {
+		if (i == nk) {
+			res = &entry->value;
+			break;
 		}
+		entry++;
+		i++;
 	}
 
 	if (res && ppos)
@@ -116,40 +142,17 @@ static const IRAM_ATTR TValue *luaR_auxfind(const luaR_entry *pentry, const char
  *     - If not exists, NULL
  *
  */
-const IRAM_ATTR TValue *luaR_findglobal(const char *name) {
-	// Try to get from cache
-	#if CONFIG_LUA_RTOS_LUA_USE_ROTABLE_CACHE && !CONFIG_LUA_RTOS_LUA_USE_JIT_BYTECODE_OPTIMIZER
-	const TValue *res = NULL;
-
-	res = rotable_cache_get(lua_rotable, name);
-	if (res) {
-		return res;
-	}
-	#endif
-
-	const luaR_entry *entry = lua_rotable;
-	int len = strlen(name);
-
-	while (entry->key.id.strkey) {
-		if ((entry->key.len == len) && (!strncmp(entry->key.id.strkey, name, len))) {
-			#if CONFIG_LUA_RTOS_LUA_USE_ROTABLE_CACHE && !CONFIG_LUA_RTOS_LUA_USE_JIT_BYTECODE_OPTIMIZER
-			// Put in cache
-			rotable_cache_put(lua_rotable, entry);
-			#endif
-
-			return &entry->value;
-		}
-		entry++;
-	}
-
-	return NULL;
+const IRAM_ATTR TValue *luaR_findglobal(const char *name, size_t len) {
+	return luaR_auxfindstr(lua_rotable, name, len, luaS_hash(name, len, luaR_seed()), NULL);
 }
 
 int IRAM_ATTR luaR_findfunction(lua_State *L, const luaR_entry *ptable) {
 	const TValue *res = NULL;
-	const char *key = luaL_checkstring(L, 2);
 
-	res = luaR_auxfind(ptable, key, 0, NULL);
+	// After the check, the key in the stack is always a string
+	luaL_checkstring(L, 2);
+
+	res = luaR_findstrentry(ptable, tsvalue(L->ci->func + 2), NULL);
 	if (res && ttislcf(res)) {
 		luaA_pushobject(L, res);
 		return 1;
@@ -168,6 +171,14 @@ const TValue *luaR_findentry(const void *pentry, const char *strkey,
 		return luaR_auxfind(lua_rotable, strkey, numkey, ppos);
 	}
 }
+
+/* Find an entry in a rotable using a Lua string as key. The key hash and length
+ are taken from the Lua string, so the key is never scanned */
+const IRAM_ATTR TValue *luaR_findstrentry(const void *pentry, TString *key, unsigned *ppos) {
+	unsigned int h = (key->tt == LUA_TSHRSTR)?key->hash:luaS_hashlongstr(key);
+
+	return luaR_auxfindstr(pentry?(const luaR_entry *)pentry:lua_rotable, getstr(key), tsslen(key), h, ppos);
+}
 extern uint32_t _rodata_start;
 extern uint32_t _lua_rtos_rodata_end;
 extern uint32_t _text_start;
@@ -210,8 +221,6 @@ static void luaR_next_helper(lua_State *L, const luaR_entry *pentries, int pos,
 /* next (used for iteration) */
 void luaR_next(lua_State *L, void *data, TValue *key, TValue *val) {
 	const luaR_entry *pentries = (const luaR_entry *) data;
-	char strkey[LUA_MAX_ROTABLE_NAME + 1], *pstrkey = NULL;
-	luaR_numkey numkey = 0;
 	unsigned keypos;
 
 	/* Special case: if key is nil, return the first element of the rotable */
@@ -219,13 +228,10 @@ void luaR_next(lua_State *L, void *data, TValue *key, TValue *val) {
 		luaR_next_helper(L, pentries, 0, key, val);
 	else if (ttisstring(key) || ttisnumber(key)) {
 		/* Find the previoud key again */
-		if (ttisstring(key)) {
-			// TO DO: ??? rawtsvalue changed to tsvalue
-			luaR_getcstr(strkey, tsvalue(key), LUA_MAX_ROTABLE_NAME);
-			pstrkey = strkey;
-		} else
-			numkey = (luaR_numkey) nvalue(key);
-		luaR_findentry(data, pstrkey, numkey, &keypos);
+		if (ttisstring(key))
+			luaR_findstrentry(data, tsvalue(key), &keypos);
+		else
+			luaR_findentry(data, NULL, (luaR_numkey) nvalue(key), &keypos);
 		/* Advance to next key */
 		keypos++;
 		luaR_next_helper(L, pentries, keypos, key, val);
@@ -258,8 +264,7 @@ int luaR_index(lua_State *L, const void *funcs, const void *consts) {
 		return res;
 
 	if (consts) {
-		const char *key = luaL_checkstring(L, 2);
-		const TValue *val = luaR_findentry(consts, key, 0, NULL);
+		const TValue *val = luaR_findstrentry(consts, tsvalue(L->ci->func + 2), NULL);
 		if (val != luaO_nilobject) {
 			if (ttnov(val) == LUA_TROTABLE) {
 				lua_pushrotable(L, val->value_.p);
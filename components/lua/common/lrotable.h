@@ -45,6 +45,14 @@
 #define LRO_NUMKEY(k)   {LUA_TNUMINT, -1, {.numkey = k}}
 #define LRO_NILKEY      {LUA_TNIL,    -1, {.strkey=NULL}, __COUNTER__}
 
+/*
+ * Seed used by luaS_hash when rotables are in use. It's random, set by the first Lua
+ * state, and shared by all the states and by the rotable indexes, so rotable keys can
+ * be looked up using the hash that the Lua string already has.
+ */
+unsigned int luaR_initseed(unsigned int seed);
+unsigned int luaR_seed(void);
+
 /* Maximum length of a rotable name and of a string key*/
 #define LUA_MAX_ROTABLE_NAME      32
 
@@ -71,9 +79,10 @@ typedef struct
   const TValue value;
 } luaR_entry;
 
-const TValue* luaR_findglobal(const char *key);
+const TValue* luaR_findglobal(const char *key, size_t len);
 int luaR_findfunction(lua_State *L, const luaR_entry *ptable);
 const TValue* luaR_findentry(const void *pentry, const char *strkey, luaR_numkey numkey, unsigned *ppos);
+const TValue* luaR_findstrentry(const void *pentry, TString *key, unsigned *ppos);
 void luaR_getcstr(char *dest, const TString *src, size_t maxsize);
 void luaR_next(lua_State *L, void *data, TValue *key, TValue *val);
 int luaR_isrotable(const void *p);
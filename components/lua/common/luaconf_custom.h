@@ -13,14 +13,33 @@
 #if CONFIG_LUA_RTOS_LUA_USE_LOCKS && !CONFIG_LUA_RTOS_LUA_USE_JIT_BYTECODE_OPTIMIZER
 	void LuaLock(lua_State *L);
 	void LuaUnlock(lua_State *L);
+	void LuaYield(lua_State *L);
+	int  LuaRelease(lua_State *L);
+	void LuaAcquire(lua_State *L, int depth);
 
 	#define lua_lock(L)          LuaLock(L)
 	#define lua_unlock(L)        LuaUnlock(L)
-	#define luai_threadyield(L) {lua_unlock(L); lua_lock(L);}
+	#define luai_threadyield(L)  LuaYield(L)
+
+	#if CONFIG_LUA_RTOS_LUA_LOCK_STATS
+	typedef struct {
+		uint32_t acquisitions; // Number of times that the lock was acquired
+		uint32_t contended;    // Number of acquisitions that had to wait
+		uint32_t yields;       // Number of lock handoffs at VM yield points
+		uint64_t wait_us;      // Total time waiting for the lock
+		uint64_t hold_us;      // Total time holding the lock
+		uint32_t max_wait_us;  // Max time waiting for the lock
+		uint32_t max_hold_us;  // Max time holding the lock
+	} lua_lock_stats_t;
+
+	void LuaLockStats(lua_State *L, lua_lock_stats_t *stats, int reset);
+	#endif
 #else
 	#define lua_lock(L)
 	#define lua_unlock(L)        
 	#define luai_threadyield(L) 
+	#define LuaRelease(L)        0
+	#define LuaAcquire(L, depth)
 #endif
 
 #undef  LUA_PROMPT
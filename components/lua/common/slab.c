@@ -0,0 +1,344 @@
+/*
+ * Copyright (C) 2015 - 2020, IBEROXARXA SERVICIOS INTEGRALES, S.L.
+ * Copyright (C) 2015 - 2020, Jaume Olivé Petrus (jolive@whitecatboard.org)
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *     * The WHITECAT logotype cannot be changed, you can remove it, but you
+ *       cannot change it in any way. The WHITECAT logotype is:
+ *
+ *          /\       /\
+ *         /  \_____/  \
+ *        /_____________\
+ *        W H I T E C A T
+ *
+ *     * Redistributions in binary form must retain all copyright notices printed
+ *       to any local or remote output device. This include any reference to
+ *       Lua RTOS, whitecatboard.org, Lua, and other copyright notices that may
+ *       appear in the future.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * Lua RTOS, Lua heap size-class allocator
+ *
+ */
+
+#include "sdkconfig.h"
+
+#if CONFIG_LUA_RTOS_LUA_USE_SLAB_ALLOCATOR
+
+#include "slab.h"
+
+#include "esp_attr.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <freertos/FreeRTOS.h>
+
+#define SLAB_ARENA_SIZE (CONFIG_LUA_RTOS_LUA_SLAB_SIZE * 1024)
+#define SLAB_PAGES      (SLAB_ARENA_SIZE / SLAB_PAGE_SIZE)
+
+#define slab_class(size) (((size) - 1) / SLAB_GRANULE)
+#define slab_size(cls)   (((cls) + 1) * SLAB_GRANULE)
+
+/*
+ * Page descriptor. Descriptors are kept outside the pages, so pages only contain
+ * objects, and the descriptor of an object is found from its address.
+ */
+typedef struct slab_page {
+	void *free;             // Free objects list
+	struct slab_page *next; // Next page in the class / free list
+	struct slab_page *prev; // Previous page in the class list
+	uint16_t used;          // Number of objects in use
+	uint8_t cls;            // Size class
+} slab_page_t;
+
+static char *arena = NULL;
+static char *arena_end = NULL;
+static slab_page_t *pages = NULL;
+
+static slab_page_t *partial[SLAB_CLASSES]; // Pages with free objects, by class
+static slab_page_t *empty;                 // Pages not assigned to a class
+
+static slab_class_stats_t stats[SLAB_CLASSES];
+static uint8_t failed = 0;
+
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+static int slab_init() {
+	char *mem;
+	slab_page_t *desc;
+	int i;
+
+	if (arena) {
+		return 0;
+	}
+
+	if (failed) {
+		return -1;
+	}
+
+	mem = malloc(SLAB_ARENA_SIZE);
+	desc = calloc(SLAB_PAGES, sizeof(slab_page_t));
+	if (!mem || !desc) {
+		free(mem);
+		free(desc);
+
+		failed = 1;
+		return -1;
+	}
+
+	for(i = SLAB_PAGES - 1;i > 0;i--) {
+		desc[i - 1].next = &desc[i];
+	}
+
+	portENTER_CRITICAL(&lock);
+	if (arena) {
+		// Another thread initialized the arena first
+		portEXIT_CRITICAL(&lock);
+
+		free(mem);
+		free(desc);
+
+		return 0;
+	}
+
+	pages = desc;
+	empty = desc;
+	arena_end = mem + SLAB_ARENA_SIZE;
+
+	__sync_synchronize();
+
+	arena = mem;
+	portEXIT_CRITICAL(&lock);
+
+	return 0;
+}
+
+static inline int slab_owns(void *ptr) {
+	return ((char *)ptr >= arena) && ((char *)ptr < arena_end);
+}
+
+static inline char *page_addr(slab_page_t *page) {
+	return arena + (page - pages) * SLAB_PAGE_SIZE;
+}
+
+static inline void partial_remove(slab_page_t *page) {
+	if (page->prev) {
+		page->prev->next = page->next;
+	} else {
+		partial[page->cls] = page->next;
+	}
+
+	if (page->next) {
+		page->next->prev = page->prev;
+	}
+
+	page->next = NULL;
+	page->prev = NULL;
+}
+
+static inline void partial_add(slab_page_t *page) {
+	page->prev = NULL;
+	page->next = partial[page->cls];
+
+	if (page->next) {
+		page->next->prev = page;
+	}
+
+	partial[page->cls] = page;
+}
+
+static IRAM_ATTR void *slab_alloc(size_t size) {
+	slab_page_t *page;
+	void *obj = NULL;
+	char *addr;
+	int cls = slab_class(size);
+	int i, n;
+
+	portENTER_CRITICAL(&lock);
+
+	page = partial[cls];
+	if (!page && empty) {
+		// Assign an empty page to the class, and build its free list
+		page = empty;
+		empty = page->next;
+
+		page->cls = cls;
+		page->used = 0;
+		page->free = NULL;
+
+		addr = page_addr(page);
+		n = SLAB_PAGE_SIZE / slab_size(cls);
+		for(i = n - 1;i >= 0;i--) {
+			*(void **)(addr + i * slab_size(cls)) = page->free;
+			page->free = addr + i * slab_size(cls);
+		}
+
+		partial_add(page);
+		stats[cls].pages++;
+	}
+
+	if (page) {
+		obj = page->free;
+		page->free = *(void **)obj;
+		page->used++;
+
+		if (!page->free) {
+			// Page is full
+			partial_remove(page);
+		}
+
+		stats[cls].allocs++;
+		stats[cls].inuse++;
+	} else {
+		stats[cls].fallbacks++;
+	}
+
+	portEXIT_CRITICAL(&lock);
+
+	return obj;
+}
+
+static IRAM_ATTR void slab_free(void *ptr) {
+	slab_page_t *page = &pages[((char *)ptr - arena) / SLAB_PAGE_SIZE];
+	int cls;
+
+	portENTER_CRITICAL(&lock);
+
+	cls = page->cls;
+
+	if (!page->free) {
+		// Page was full, now it has a free object
+		partial_add(page);
+	}
+
+	*(void **)ptr = page->free;
+	page->free = ptr;
+	page->used--;
+
+	if (page->used == 0) {
+		// Return page to the empty list, so it can be used by any class
+		partial_remove(page);
+
+		page->next = empty;
+		empty = page;
+
+		stats[cls].pages--;
+	}
+
+	stats[cls].frees++;
+	stats[cls].inuse--;
+
+	portEXIT_CRITICAL(&lock);
+}
+
+/*
+ * Allocation function for the Lua states, with the same semantics as the
+ * standard Lua allocation function. When the arena is full, or for objects
+ * greater than SLAB_MAX_SIZE, malloc is used.
+ */
+void *slab_realloc(void *ptr, size_t osize, size_t nsize) {
+	void *nptr = NULL;
+
+	if (nsize == 0) {
+		if (ptr) {
+			if (slab_owns(ptr)) {
+				slab_free(ptr);
+			} else {
+				free(ptr);
+			}
+		}
+
+		return NULL;
+	}
+
+	if (nsize <= SLAB_MAX_SIZE) {
+		if (slab_init() < 0) {
+			return realloc(ptr, nsize);
+		}
+
+		if (ptr && slab_owns(ptr) && (slab_class(nsize) == slab_class(osize))) {
+			// Fits in the current object
+			return ptr;
+		}
+
+		nptr = slab_alloc(nsize);
+	}
+
+	if (!ptr) {
+		return nptr?nptr:malloc(nsize);
+	}
+
+	if (!slab_owns(ptr)) {
+		if (!nptr) {
+			return realloc(ptr, nsize);
+		}
+
+		memcpy(nptr, ptr, (osize < nsize)?osize:nsize);
+		free(ptr);
+
+		return nptr;
+	}
+
+	// Move the object out from its slab
+	if (!nptr) {
+		nptr = malloc(nsize);
+		if (!nptr) {
+			// A shrink can't fail, the object still fits in its slab
+			return (nsize <= osize)?ptr:NULL;
+		}
+	}
+
+	memcpy(nptr, ptr, (osize < nsize)?osize:nsize);
+	slab_free(ptr);
+
+	return nptr;
+}
+
+int slab_dump(lua_State *L) {
+	slab_class_stats_t cstats[SLAB_CLASSES];
+	uint32_t used = 0;
+	int i;
+
+	portENTER_CRITICAL(&lock);
+	memcpy(cstats, stats, sizeof(stats));
+	portEXIT_CRITICAL(&lock);
+
+	printf("size    allocs     frees     inuse  pages  fallbacks\r\n");
+	printf("----  --------  --------  --------  -----  ---------\r\n");
+
+	for(i = 0;i < SLAB_CLASSES;i++) {
+		printf("%4d  %8u  %8u  %8u  %5u  %9u\r\n", slab_size(i),
+			cstats[i].allocs, cstats[i].frees, cstats[i].inuse, cstats[i].pages, cstats[i].fallbacks);
+
+		used += cstats[i].pages;
+	}
+
+	printf("\r\npages: %d, used: %d\r\n\r\n", SLAB_PAGES, used);
+
+	return 0;
+}
+
+#endif
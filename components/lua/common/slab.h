@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2015 - 2020, IBEROXARXA SERVICIOS INTEGRALES, S.L.
+ * Copyright (C) 2015 - 2020, Jaume Olivé Petrus (jolive@whitecatboard.org)
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *     * The WHITECAT logotype cannot be changed, you can remove it, but you
+ *       cannot change it in any way. The WHITECAT logotype is:
+ *
+ *          /\       /\
+ *         /  \_____/  \
+ *        /_____________\
+ *        W H I T E C A T
+ *
+ *     * Redistributions in binary form must retain all copyright notices printed
+ *       to any local or remote output device. This include any reference to
+ *       Lua RTOS, whitecatboard.org, Lua, and other copyright notices that may
+ *       appear in the future.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * Lua RTOS, Lua heap size-class allocator
+ *
+ */
+
+#include "sdkconfig.h"
+
+#if CONFIG_LUA_RTOS_LUA_USE_SLAB_ALLOCATOR
+
+#ifndef LUA_SLAB_H
+#define LUA_SLAB_H
+
+#include "lua.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Objects up to SLAB_MAX_SIZE bytes are allocated from an arena of fixed size
+ * pages. Each page holds objects of only one size class, so small objects don't
+ * fragment the heap. Classes are multiple of SLAB_GRANULE.
+ */
+#define SLAB_GRANULE   8
+#define SLAB_MAX_SIZE  64
+#define SLAB_CLASSES   (SLAB_MAX_SIZE / SLAB_GRANULE)
+#define SLAB_PAGE_SIZE 1024
+
+typedef struct {
+	uint32_t allocs;    // Number of allocations served by the class
+	uint32_t frees;     // Number of frees
+	uint32_t inuse;     // Number of objects in use
+	uint32_t pages;     // Number of pages assigned to the class
+	uint32_t fallbacks; // Number of allocations served by malloc, because arena was full
+} slab_class_stats_t;
+
+void *slab_realloc(void *ptr, size_t osize, size_t nsize);
+int slab_dump(lua_State *L);
+
+#endif
+
+#endif
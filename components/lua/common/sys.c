@@ -43,15 +43,201 @@
  *
  */
 
+#include "sdkconfig.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_timer.h"
+
 #include "sys.h"
 #include "lualib.h"
 #include "lauxlib.h"
 
 #include <stdlib.h>
+#include <string.h>
+
+// Event states
+#define EVENT_FREE    0
+#define EVENT_PENDING 1
+#define EVENT_BATCH   2
+#define EVENT_RUNNING 3
+
+typedef struct lua_event {
+    lua_callback_t *callback;
+    const lua_event_type_t *type;
+    uint32_t source;
+    uint8_t priority;
+    uint8_t state;
+    uint8_t destroy;          // Callback destroyed while running
+    int64_t posted;           // Post time, in microseconds since boot
+    struct lua_event *next;
+
+    union {
+        uint64_t align;
+        uint8_t bytes[LUA_EVENT_DATA_SIZE];
+    } data;
+} lua_event_t;
+
+static lua_event_t events[LUA_EVENT_QUEUE_SIZE];
+static lua_event_t *free_events = NULL;
+static lua_event_t *pending_head[LUA_EVENT_PRIORITIES];
+static lua_event_t *pending_tail[LUA_EVENT_PRIORITIES];
+static lua_event_stats_t event_stats;
+static portMUX_TYPE event_mux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t event_task = NULL;
+static uint8_t event_started = 0;
+
+static void luaS_callback_free(lua_callback_t *callback);
+
+/*
+ * Event dispatcher helper functions. Must be called inside the event_mux critical
+ * section.
+ */
+
+static void event_append(lua_event_t *ev) {
+    ev->next = NULL;
+
+    if (pending_tail[ev->priority]) {
+        pending_tail[ev->priority]->next = ev;
+    } else {
+        pending_head[ev->priority] = ev;
+    }
+
+    pending_tail[ev->priority] = ev;
+}
+
+static void event_unlink(lua_event_t *ev) {
+    lua_event_t *prev = NULL;
+    lua_event_t *cur = pending_head[ev->priority];
+
+    while (cur != ev) {
+        prev = cur;
+        cur = cur->next;
+    }
+
+    if (prev) {
+        prev->next = ev->next;
+    } else {
+        pending_head[ev->priority] = ev->next;
+    }
+
+    if (pending_tail[ev->priority] == ev) {
+        pending_tail[ev->priority] = prev;
+    }
+}
+
+static void event_free(lua_event_t *ev) {
+    ev->state = EVENT_FREE;
+    ev->callback = NULL;
+    ev->next = free_events;
+    free_events = ev;
+}
+
+/*
+ * Event dispatcher
+ */
+
+static void event_dispatch(lua_event_t *ev) {
+    lua_callback_t *callback;
+    int destroy, args;
+
+    portENTER_CRITICAL(&event_mux);
+    callback = ev->callback;
+    ev->state = EVENT_RUNNING;
+    portEXIT_CRITICAL(&event_mux);
+
+    // Callback is NULL if it was destroyed while the event was in the batch
+    if (callback) {
+        args = ev->type->push(callback->TL, ev->data.bytes);
+        luaS_callback_call(callback, args);
+    }
+
+    if (ev->type->release) {
+        ev->type->release(ev->data.bytes);
+    }
+
+    portENTER_CRITICAL(&event_mux);
+    destroy = ev->destroy;
+    event_free(ev);
+    portEXIT_CRITICAL(&event_mux);
+
+    if (destroy) {
+        luaS_callback_free(callback);
+    }
+}
+
+static void event_dispatcher(void *arg) {
+    lua_event_t *batch[LUA_EVENT_BATCH];
+    lua_event_t *ev;
+    uint32_t latency;
+    int64_t now;
+    int i, n, p;
+
+    for(;;) {
+        do {
+            // Get a batch of events, in priority order
+            now = esp_timer_get_time();
+            n = 0;
+
+            portENTER_CRITICAL(&event_mux);
+            for(p = 0;(p < LUA_EVENT_PRIORITIES) && (n < LUA_EVENT_BATCH);p++) {
+                while (pending_head[p] && (n < LUA_EVENT_BATCH)) {
+                    ev = pending_head[p];
+                    event_unlink(ev);
+
+                    ev->state = EVENT_BATCH;
+                    ev->destroy = 0;
+                    batch[n++] = ev;
+
+                    latency = (now > ev->posted)?(uint32_t)(now - ev->posted):0;
+                    event_stats.latency_us += latency;
+                    if (latency > event_stats.max_latency_us) {
+                        event_stats.max_latency_us = latency;
+                    }
+
+                    event_stats.pending--;
+                    event_stats.dispatched++;
+                }
+            }
+            portEXIT_CRITICAL(&event_mux);
+
+            for(i = 0;i < n;i++) {
+                event_dispatch(batch[i]);
+            }
+        } while (n > 0);
+
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+}
+
+static void event_start() {
+    BaseType_t xReturn;
+    int i;
+
+    portENTER_CRITICAL(&event_mux);
+    if (event_started) {
+        portEXIT_CRITICAL(&event_mux);
+        return;
+    }
+
+    event_started = 1;
+
+    for(i = 0;i < LUA_EVENT_QUEUE_SIZE;i++) {
+        event_free(&events[i]);
+    }
+    portEXIT_CRITICAL(&event_mux);
+
+    xReturn = xTaskCreatePinnedToCore(event_dispatcher, "luaevt", CONFIG_LUA_RTOS_LUA_THREAD_STACK_SIZE, NULL, CONFIG_LUA_RTOS_LUA_THREAD_PRIORITY, &event_task, xPortGetCoreID());
+    assert(xReturn == pdPASS);
+}
 
 lua_callback_t *luaS_callback_create(lua_State *L, int index) {
     lua_callback_t *callback;
 
+    // Start the event dispatcher, if needed
+    event_start();
+
     // Allocate the callback structure
     callback = calloc(1,sizeof(lua_callback_t));
     if (callback == NULL) {
@@ -123,9 +309,7 @@ int luaS_callback_call(lua_callback_t *callback, int args) {
     return luaS_callback_call_return(callback, args, 0);
 }
 
-void luaS_callback_destroy(lua_callback_t *callback) {
-    assert(callback != NULL);
-
+static void luaS_callback_free(lua_callback_t *callback) {
     lua_lock(callback->L);
     luaL_unref(callback->L, LUA_REGISTRYINDEX, callback->callback);
     luaL_unref(callback->L, LUA_REGISTRYINDEX, callback->lthread);
@@ -133,3 +317,188 @@ void luaS_callback_destroy(lua_callback_t *callback) {
 
     free(callback);
 }
+
+void luaS_callback_destroy(lua_callback_t *callback) {
+    union {
+        uint64_t align;
+        uint8_t bytes[LUA_EVENT_DATA_SIZE];
+    } data;
+    const lua_event_type_t *type;
+    lua_event_t *ev;
+    int i, deferred = 0;
+
+    assert(callback != NULL);
+
+    // Discard the pending events of the callback, one at a time, as its data must be
+    // released outside the critical section
+    for(;;) {
+        type = NULL;
+
+        portENTER_CRITICAL(&event_mux);
+        for(i = 0;i < LUA_EVENT_QUEUE_SIZE;i++) {
+            ev = &events[i];
+            if (ev->callback != callback) {
+                continue;
+            }
+
+            if (ev->state == EVENT_PENDING) {
+                event_unlink(ev);
+                event_stats.pending--;
+
+                type = ev->type;
+                memcpy(data.bytes, ev->data.bytes, LUA_EVENT_DATA_SIZE);
+                event_free(ev);
+                break;
+            } else if (ev->state == EVENT_BATCH) {
+                // The dispatcher releases its data
+                ev->callback = NULL;
+            } else if (ev->state == EVENT_RUNNING) {
+                // The dispatcher frees the callback when it returns
+                ev->destroy = 1;
+                deferred = 1;
+            }
+        }
+        portEXIT_CRITICAL(&event_mux);
+
+        if (!type) {
+            break;
+        }
+
+        if (type->release) {
+            type->release(data.bytes);
+        }
+    }
+
+    if (!deferred) {
+        luaS_callback_free(callback);
+    }
+}
+
+int luaS_event_post(lua_callback_t *callback, uint32_t source, int priority, const lua_event_type_t *type, const void *data, size_t size) {
+    union {
+        uint64_t align;
+        uint8_t bytes[LUA_EVENT_DATA_SIZE];
+    } old;
+    const lua_event_type_t *old_type = NULL;
+    lua_event_t *ev = NULL;
+    int64_t now = esp_timer_get_time();
+    int i, p, ret = LUA_EVENT_QUEUED;
+
+    assert(size <= LUA_EVENT_DATA_SIZE);
+
+    if (priority < LUA_EVENT_HIGH) {
+        priority = LUA_EVENT_HIGH;
+    } else if (priority > LUA_EVENT_LOW) {
+        priority = LUA_EVENT_LOW;
+    }
+
+    portENTER_CRITICAL(&event_mux);
+
+    event_stats.posted++;
+
+    // Coalesce with a pending event of the same source
+    if (source) {
+        for(i = 0;i < LUA_EVENT_QUEUE_SIZE;i++) {
+            ev = &events[i];
+            if ((ev->state == EVENT_PENDING) && (ev->callback == callback) && (ev->source == source) && (ev->type == type)) {
+                break;
+            }
+        }
+
+        if (i < LUA_EVENT_QUEUE_SIZE) {
+            if (type->merge) {
+                type->merge(ev->data.bytes, data);
+            } else {
+                if (type->release) {
+                    old_type = type;
+                    memcpy(old.bytes, ev->data.bytes, LUA_EVENT_DATA_SIZE);
+                }
+
+                memcpy(ev->data.bytes, data, size);
+            }
+
+            // Move the event up if the new one has a higher priority
+            if (priority < ev->priority) {
+                event_unlink(ev);
+                ev->priority = priority;
+                event_append(ev);
+            }
+
+            event_stats.coalesced++;
+            ret = LUA_EVENT_COALESCED;
+            goto exit;
+        }
+    }
+
+    // Get a free event. If there is none, drop the oldest event with the lowest priority,
+    // if it's lower than the new event one.
+    ev = free_events;
+    if (ev) {
+        free_events = ev->next;
+    } else {
+        for(p = LUA_EVENT_LOW;(p > priority) && !pending_head[p];p--);
+
+        if (p == priority) {
+            old_type = type;
+            memcpy(old.bytes, data, size);
+
+            event_stats.dropped++;
+            ret = LUA_EVENT_DROPPED;
+            goto exit;
+        }
+
+        ev = pending_head[p];
+        event_unlink(ev);
+        event_stats.pending--;
+        event_stats.dropped++;
+
+        old_type = ev->type;
+        memcpy(old.bytes, ev->data.bytes, LUA_EVENT_DATA_SIZE);
+    }
+
+    ev->callback = callback;
+    ev->type = type;
+    ev->source = source;
+    ev->priority = priority;
+    ev->state = EVENT_PENDING;
+    ev->destroy = 0;
+    ev->posted = now;
+    memcpy(ev->data.bytes, data, size);
+
+    event_append(ev);
+
+    if (++event_stats.pending > event_stats.max_pending) {
+        event_stats.max_pending = event_stats.pending;
+    }
+
+exit:
+    portEXIT_CRITICAL(&event_mux);
+
+    if (old_type && old_type->release) {
+        old_type->release(old.bytes);
+    }
+
+    if ((ret != LUA_EVENT_DROPPED) && event_task) {
+        xTaskNotifyGive(event_task);
+    }
+
+    return ret;
+}
+
+void luaS_event_stats(lua_event_stats_t *stats, int reset) {
+    portENTER_CRITICAL(&event_mux);
+
+    memcpy(stats, &event_stats, sizeof(lua_event_stats_t));
+
+    if (reset) {
+        event_stats.posted = 0;
+        event_stats.coalesced = 0;
+        event_stats.dropped = 0;
+        event_stats.dispatched = 0;
+        event_stats.max_pending = event_stats.pending;
+        event_stats.max_latency_us = 0;
+        event_stats.latency_us = 0;
+    }
+
+    portEXIT_CRITICAL(&event_mux);
+}
@@ -48,6 +48,9 @@
 
 #include "lua.h"
 
+#include <stddef.h>
+#include <stdint.h>
+
 typedef struct {
     lua_State *L;  // Parent Lua thread
     lua_State *TL; // Callback Lua thread
@@ -99,11 +102,93 @@ int luaS_callback_call(lua_callback_t *callback, int args);
 int luaS_callback_call_return(lua_callback_t *callback, int args, int rets);
 
 /**
- * @brief Destroy a callback.
+ * @brief Destroy a callback. Pending events for the callback are discarded. If the
+ *        callback is running in the event dispatcher, it is destroyed when it returns.
  *
  * @param callback A pointer to a callback handler created with the luaS_callback_create
  *                 function.
  */
 void luaS_callback_destroy(lua_callback_t *callback);
 
+/*
+ * Event dispatcher
+ *
+ * Drivers post events for a callback instead of calling it from their own task. Events
+ * are queued in a fixed pool, and a dispatcher task runs the callbacks in batches, in
+ * priority order, so drivers never wait for the Lua interpreter.
+ */
+
+// Number of events that can be queued
+#define LUA_EVENT_QUEUE_SIZE 32
+
+// Maximum size of the data of an event
+#define LUA_EVENT_DATA_SIZE 144
+
+// Maximum number of events dispatched in a batch
+#define LUA_EVENT_BATCH 8
+
+// Event priorities
+#define LUA_EVENT_HIGH       0
+#define LUA_EVENT_NORMAL     1
+#define LUA_EVENT_LOW        2
+#define LUA_EVENT_PRIORITIES 3
+
+// Return values of luaS_event_post
+#define LUA_EVENT_QUEUED     0
+#define LUA_EVENT_COALESCED  1
+#define LUA_EVENT_DROPPED   -1
+
+typedef struct {
+    // Push the callback arguments from the event data. Returns the number of arguments.
+    int (*push)(lua_State *L, void *data);
+
+    // Merge new event data into a pending event of the same source. If NULL, the pending
+    // event data is replaced. Called with interrupts disabled, so it must be short.
+    void (*merge)(void *pending, const void *data);
+
+    // Free the resources referenced by the event data, if any, or NULL.
+    void (*release)(void *data);
+} lua_event_type_t;
+
+typedef struct {
+    uint32_t posted;         // Events posted
+    uint32_t coalesced;      // Events merged into a pending event of the same source
+    uint32_t dropped;        // Events dropped because the queue was full
+    uint32_t dispatched;     // Events dispatched
+    uint32_t pending;        // Events waiting to be dispatched
+    uint32_t max_pending;    // Maximum number of events waiting to be dispatched
+    uint32_t max_latency_us; // Maximum time between post and dispatch, in microseconds
+    uint64_t latency_us;     // Total time between post and dispatch, in microseconds
+} lua_event_stats_t;
+
+/**
+ * @brief Post an event for a callback. The event is dispatched from the dispatcher task,
+ *        by pushing its arguments with type->push and calling the callback. If source is
+ *        not 0, and there is a pending event for the same callback and source, the event
+ *        is coalesced with it. If the queue is full, the oldest event with a lower priority
+ *        is dropped, or this event if there is none. This function can't be called from
+ *        an ISR.
+ *
+ * @param callback A pointer to a callback handler created with the luaS_callback_create
+ *                 function.
+ * @param source Event source, or 0 if events must not be coalesced.
+ * @param priority LUA_EVENT_HIGH, LUA_EVENT_NORMAL or LUA_EVENT_LOW.
+ * @param type Event type.
+ * @param data Event data, copied into the event. The event takes ownership of the
+ *             resources referenced by it, even if it is dropped.
+ * @param size Size of data, up to LUA_EVENT_DATA_SIZE bytes.
+ *
+ * @return
+ *     - LUA_EVENT_QUEUED, LUA_EVENT_COALESCED or LUA_EVENT_DROPPED.
+ */
+int luaS_event_post(lua_callback_t *callback, uint32_t source, int priority, const lua_event_type_t *type, const void *data, size_t size);
+
+/**
+ * @brief Get the event dispatcher statistics.
+ *
+ * @param stats A pointer to a lua_event_stats_t structure where the statistics are stored.
+ * @param reset If 1, counters are reset after being read.
+ */
+void luaS_event_stats(lua_event_stats_t *stats, int reset);
+
 #endif /* _LUA_SYS_H_ */
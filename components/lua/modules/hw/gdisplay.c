@@ -248,6 +248,12 @@ static int lgdisplay_setwrap( lua_State* L ) {
 	return 0;
 }
 
+//======================================
+static int lgdisplay_setantialias( lua_State* L ) {
+	gdisplay_set_antialias(lgdisplay_getbool(L, 1));
+	return 0;
+}
+
 //======================================
 static int lgdisplay_settransp( lua_State* L ) {
 	gdisplay_set_transparency(lgdisplay_getbool(L, 1));
@@ -1311,6 +1317,44 @@ static int lgdisplay_touch_set_cal(lua_State *L) {
 	return 0;
 }
 
+//==================================
+static int lgdisplay_stats(lua_State *L) {
+	driver_error_t *error;
+	gdisplay_stats_t stats;
+
+	uint8_t reset = lua_toboolean(L, 1);
+
+	error = gdisplay_stats(&stats, reset);
+	if (error) {
+		return luaL_driver_error(L, error);
+	}
+
+	lua_createtable(L, 0, 7);
+
+	lua_pushinteger(L, stats.frames);
+	lua_setfield (L, -2, "frames");
+
+	lua_pushinteger(L, stats.rects);
+	lua_setfield (L, -2, "rects");
+
+	lua_pushinteger(L, stats.bytes);
+	lua_setfield (L, -2, "bytes");
+
+	lua_pushinteger(L, stats.last_us);
+	lua_setfield (L, -2, "last_us");
+
+	lua_pushinteger(L, stats.busy_us);
+	lua_setfield (L, -2, "busy_us");
+
+	lua_pushinteger(L, stats.elapsed_us);
+	lua_setfield (L, -2, "elapsed_us");
+
+	lua_pushnumber(L, stats.fps);
+	lua_setfield (L, -2, "fps");
+
+	return 1;
+}
+
 static int lgdisplay_init( lua_State* L ) {
 	driver_error_t *error;
 	uint8_t buffered = 0;
@@ -1382,6 +1426,7 @@ static const LUA_REG_TYPE gdisplay_map[] = {
 	{ LSTRKEY( "settransp" ),      LFUNCVAL( lgdisplay_settransp )},
 	{ LSTRKEY( "setfixed" ),       LFUNCVAL( lgdisplay_setfixed )},
 	{ LSTRKEY( "setwrap" ),        LFUNCVAL( lgdisplay_setwrap )},
+	{ LSTRKEY( "setantialias" ),   LFUNCVAL( lgdisplay_setantialias )},
 	{ LSTRKEY( "setangleoffset" ), LFUNCVAL( lgdisplay_set_angleOffset )},
 	{ LSTRKEY( "getangleoffset" ), LFUNCVAL( lgdisplay_get_angleOffset )},
 	{ LSTRKEY( "setclipwin" ),     LFUNCVAL( lgdisplay_setclipwin )},
@@ -1411,6 +1456,7 @@ static const LUA_REG_TYPE gdisplay_map[] = {
 	{ LSTRKEY( "gettouch" ),       LFUNCVAL( lgdisplay_read_touch )},
 	{ LSTRKEY( "getrawtouch" ),    LFUNCVAL( lgdisplay_read_raw_touch )},
 	{ LSTRKEY( "setcal" ),         LFUNCVAL( lgdisplay_touch_set_cal )},
+	{ LSTRKEY( "stats" ),          LFUNCVAL( lgdisplay_stats )},
 	// Constant definitions
 	{ LSTRKEY( "PORTRAIT" ),       LINTVAL( PORTRAIT ) },
 	{ LSTRKEY( "PORTRAIT_FLIP" ),  LINTVAL( PORTRAIT_FLIP ) },
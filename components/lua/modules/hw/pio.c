@@ -72,15 +72,25 @@ static void IRAM_ATTR pio_intr_handler(void* arg) {
     }
 }
 
+static int pio_event_push(lua_State *L, void *data) {
+    lua_pushinteger(L, ((pio_intr_data_t *)data)->value);
+
+    return 1;
+}
+
+static const lua_event_type_t pio_event = {pio_event_push, NULL, NULL};
+
 static void pioTask(void *taskArgs) {
     pio_intr_t *args = (pio_intr_t *)taskArgs;
+    pio_intr_data_t event;
     uint32_t data;
 
     for(;;) {
         xTaskNotifyWait(0, 0, &data, portMAX_DELAY);
 
-        lua_pushinteger(luaS_callback_state(args->callback), data);
-        luaS_callback_call(args->callback, 1);
+        // Only the last pin value is kept if the callback is busy
+        event.value = data;
+        luaS_event_post(args->callback, args->pin + 1, LUA_EVENT_HIGH, &pio_event, &event, sizeof(event));
 
         if (args->pin < 40) {
             gpio_intr_enable(args->pin);
@@ -60,22 +60,35 @@
 
 #include <time.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <drivers/owire.h>
 #include <drivers/sensor.h>
+#include <drivers/sensor_sched.h>
+
+// Number of samples copied at once by window
+#define LSENSOR_WINDOW_CHUNK 16
 
 extern TM_One_Wire_Devices_t ow_devices[MAX_ONEWIRE_PINS];
 
 // This variables are defined at linker time
 extern const sensor_t sensors[];
 
-static void callback_func(int id, sensor_instance_t *instance, sensor_value_t *data, sensor_latch_t *latch) {
+// Sensor event, with the data properties that have changed. The event owns a
+// copy of the string properties that have changed, as the sensor can free or
+// overwrite them before the event is dispatched.
+typedef struct {
+    const sensor_t *sensor;
+    uint32_t changed;
+    int64_t raw[SENSOR_MAX_PROPERTIES];
+} sensor_event_t;
+
+static int sensor_event_push(lua_State *L, void *arg) {
+    sensor_event_t *event = (sensor_event_t *)arg;
+    const sensor_t *csensor = event->sensor;
+    sensor_value_t value;
     int idx;
-    int changed;
-    const sensor_t *csensor = instance->sensor;
-
-    lua_callback_t *callback = (lua_callback_t *)id;
 
     // Count properties
     int cnt = 0;
@@ -86,12 +99,86 @@ static void callback_func(int id, sensor_instance_t *instance, sensor_value_t *d
     }
 
     // Create a table with all the properties values
-    lua_createtable(luaS_callback_state(callback), 0, cnt);
+    lua_createtable(L, 0, cnt);
 
     for(idx=0; idx < SENSOR_MAX_PROPERTIES; idx++) {
         if (csensor->data[idx].id) {
-            lua_pushstring(luaS_callback_state(callback), (char *)csensor->data[idx].id);
+            lua_pushstring(L, (char *)csensor->data[idx].id);
+
+            if (event->changed & (1 << idx)) {
+                value.raw.value = event->raw[idx];
+
+                switch (csensor->data[idx].type) {
+                    case SENSOR_NO_DATA: break;
+                    case SENSOR_DATA_INT:    lua_pushinteger(L, value.integerd.value); break;
+                    case SENSOR_DATA_FLOAT:  lua_pushnumber (L, value.floatd.value); break;
+                    case SENSOR_DATA_DOUBLE: lua_pushnumber (L, value.doubled.value); break;
+                    case SENSOR_DATA_STRING: lua_pushstring (L, value.stringd.value); break;
+                }
+            } else {
+                lua_pushnil(L);
+            }
+
+            lua_settable(L, -3);
+        }
+    }
+
+    return 1;
+}
+
+static inline int sensor_event_owns(const sensor_event_t *event, int idx) {
+    return (event->changed & (1 << idx)) && (event->sensor->data[idx].type == SENSOR_DATA_STRING);
+}
+
+// Keep the last value of the properties changed in any of the coalesced events
+static void sensor_event_merge(void *pending, const void *arg) {
+    sensor_event_t *event = (sensor_event_t *)pending;
+    const sensor_event_t *new_event = (const sensor_event_t *)arg;
+    sensor_value_t value;
+    int idx;
+
+    for(idx=0; idx < SENSOR_MAX_PROPERTIES; idx++) {
+        if (new_event->changed & (1 << idx)) {
+            if (sensor_event_owns(event, idx)) {
+                value.raw.value = event->raw[idx];
+                free(value.stringd.value);
+            }
+
+            event->raw[idx] = new_event->raw[idx];
+        }
+    }
+
+    event->changed |= new_event->changed;
+}
+
+static void sensor_event_release(void *arg) {
+    sensor_event_t *event = (sensor_event_t *)arg;
+    sensor_value_t value;
+    int idx;
+
+    for(idx=0; idx < SENSOR_MAX_PROPERTIES; idx++) {
+        if (sensor_event_owns(event, idx)) {
+            value.raw.value = event->raw[idx];
+            free(value.stringd.value);
+        }
+    }
+}
+
+static const lua_event_type_t sensor_event = {sensor_event_push, sensor_event_merge, sensor_event_release};
+
+static void callback_func(int id, sensor_instance_t *instance, sensor_value_t *data, sensor_latch_t *latch) {
+    int idx;
+    int changed;
+    const sensor_t *csensor = instance->sensor;
+    sensor_event_t event;
 
+    lua_callback_t *callback = (lua_callback_t *)id;
+
+    event.sensor = csensor;
+    event.changed = 0;
+
+    for(idx=0; idx < SENSOR_MAX_PROPERTIES; idx++) {
+        if (csensor->data[idx].id) {
             // Test if property has changed
             changed = 0;
             switch (csensor->data[idx].type) {
@@ -103,22 +190,24 @@ static void callback_func(int id, sensor_instance_t *instance, sensor_value_t *d
             }
 
             if (changed || latch[idx].timeout || latch[idx].repeat) {
-                switch (csensor->data[idx].type) {
-                    case SENSOR_NO_DATA: break;
-                    case SENSOR_DATA_INT:    lua_pushinteger(luaS_callback_state(callback), data[idx].integerd.value); break;
-                    case SENSOR_DATA_FLOAT:  lua_pushnumber (luaS_callback_state(callback), data[idx].floatd.value); break;
-                    case SENSOR_DATA_DOUBLE: lua_pushnumber (luaS_callback_state(callback), data[idx].doubled.value); break;
-                    case SENSOR_DATA_STRING: lua_pushstring (luaS_callback_state(callback), data[idx].stringd.value); break;
-                }
-            } else {
-                lua_pushnil(luaS_callback_state(callback));
+                event.changed |= (1 << idx);
             }
+        }
 
-            lua_settable(luaS_callback_state(callback), -3);
+        event.raw[idx] = data[idx].raw.value;
+
+        if (sensor_event_owns(&event, idx)) {
+            sensor_value_t value;
+
+            value.raw.value = 0;
+            value.stringd.value = data[idx].stringd.value ? strdup(data[idx].stringd.value) : NULL;
+            event.raw[idx] = value.raw.value;
         }
     }
 
-    luaS_callback_call(callback, 1);
+    // Run the Lua callback from the event dispatcher, so the sensor task doesn't wait
+    // for the interpreter
+    luaS_event_post(callback, (uint32_t)instance, LUA_EVENT_NORMAL, &sensor_event, &event, sizeof(event));
 }
 
 static void lsensor_setup_prepare( lua_State* L, const sensor_t *sensor, sensor_setup_t *setup) {
@@ -366,7 +455,15 @@ static int lsensor_read( lua_State* L ) {
     udata = (sensor_userdata *)luaL_checkudata(L, 1, "sensor.ins");
     luaL_argcheck(L, udata, 1, "sensor expected");
 
-    const char *id = luaL_checkstring( L, 2 );
+    // Data can be read by name, or by the index returned by sensor:index
+    int idx = -1;
+    const char *id = NULL;
+
+    if (lua_type(L, 2) == LUA_TNUMBER) {
+        idx = luaL_checkinteger( L, 2 ) - 1;
+    } else {
+        id = luaL_checkstring( L, 2 );
+    }
 
     if (!udata->instance) {
         return luaL_exception(L, SENSOR_ERR_DETACHED);
@@ -379,9 +476,15 @@ static int lsensor_read( lua_State* L ) {
         }
     }
 
-    if ((strcmp(id, "all") != 0) && (strcmp(id, "ALL") != 0)) {
+    if (!id || ((strcmp(id, "all") != 0) && (strcmp(id, "ALL") != 0))) {
         // Read specified data
-        if ((error = sensor_read(udata->instance, id, &value))) {
+        if (id) {
+            error = sensor_read(udata->instance, id, &value);
+        } else {
+            error = sensor_read_index(udata->instance, idx, &value);
+        }
+
+        if (error) {
             return luaL_driver_error(L, error);
         }
 
@@ -440,6 +543,128 @@ static int lsensor_read( lua_State* L ) {
 
     return 0;
 }
+
+static int lsensor_index( lua_State* L ) {
+    sensor_userdata *udata = NULL;
+    int idx;
+
+    udata = (sensor_userdata *)luaL_checkudata(L, 1, "sensor.ins");
+    luaL_argcheck(L, udata, 1, "sensor expected");
+
+    const char *id = luaL_checkstring( L, 2 );
+
+    if (!udata->instance) {
+        return luaL_exception(L, SENSOR_ERR_DETACHED);
+    }
+
+    if ((idx = sensor_data_index(udata->instance->sensor, id)) < 0) {
+        return luaL_exception(L, SENSOR_ERR_NOT_FOUND);
+    }
+
+    lua_pushinteger(L, idx + 1);
+
+    return 1;
+}
+
+static int lsensor_schedule( lua_State* L ) {
+    sensor_userdata *udata = NULL;
+    driver_error_t *error;
+
+    udata = (sensor_userdata *)luaL_checkudata(L, 1, "sensor.ins");
+    luaL_argcheck(L, udata, 1, "sensor expected");
+
+    uint32_t period = luaL_checkinteger( L, 2 );
+    uint16_t depth = luaL_optinteger( L, 3, SENSOR_SCHED_DEFAULT_DEPTH );
+
+    if (!udata->instance) {
+        return luaL_exception(L, SENSOR_ERR_DETACHED);
+    }
+
+    if ((error = sensor_sched_add(udata->instance, period, depth))) {
+        return luaL_driver_error(L, error);
+    }
+
+    return 0;
+}
+
+static int lsensor_unschedule( lua_State* L ) {
+    sensor_userdata *udata = NULL;
+
+    udata = (sensor_userdata *)luaL_checkudata(L, 1, "sensor.ins");
+    luaL_argcheck(L, udata, 1, "sensor expected");
+
+    if (!udata->instance) {
+        return luaL_exception(L, SENSOR_ERR_DETACHED);
+    }
+
+    sensor_sched_remove(udata->instance);
+
+    return 0;
+}
+
+static int lsensor_window( lua_State* L ) {
+    sensor_userdata *udata = NULL;
+    driver_error_t *error;
+    sensor_value_t values[LSENSOR_WINDOW_CHUNK];
+    int64_t stamps[LSENSOR_WINDOW_CHUNK];
+    uint32_t seq, last;
+    int i, n, count = 0;
+
+    udata = (sensor_userdata *)luaL_checkudata(L, 1, "sensor.ins");
+    luaL_argcheck(L, udata, 1, "sensor expected");
+
+    int idx = luaL_checkinteger( L, 2 ) - 1;
+    uint32_t max = luaL_optinteger( L, 3, UINT16_MAX );
+
+    if (!udata->instance) {
+        return luaL_exception(L, SENSOR_ERR_DETACHED);
+    }
+
+    // Get the last max samples
+    if ((error = sensor_sched_seq(udata->instance, &last))) {
+        return luaL_driver_error(L, error);
+    }
+
+    seq = (last > max)?(last - max):0;
+
+    // Values, and sample times in milliseconds since boot
+    lua_createtable(L, 0, 0);
+    lua_createtable(L, 0, 0);
+
+    while (seq != last) {
+        if ((error = sensor_sched_window(udata->instance, idx, &seq, values, stamps, LSENSOR_WINDOW_CHUNK, &n))) {
+            return luaL_driver_error(L, error);
+        }
+
+        // Samples taken after the window was requested are left out
+        if ((int32_t)(seq - last) > 0) {
+            n -= seq - last;
+            seq = last;
+        }
+
+        if (n <= 0) {
+            break;
+        }
+
+        for(i=0;i < n;i++) {
+            count++;
+
+            switch (values[i].type) {
+                case SENSOR_DATA_INT:    lua_pushinteger(L, values[i].integerd.value); break;
+                case SENSOR_DATA_FLOAT:  lua_pushnumber (L, values[i].floatd.value); break;
+                case SENSOR_DATA_DOUBLE: lua_pushnumber (L, values[i].doubled.value); break;
+                default:                 lua_pushboolean(L, 0); break;
+            }
+            lua_rawseti(L, -3, count);
+
+            lua_pushinteger(L, (lua_Integer)(stamps[i] / 1000));
+            lua_rawseti(L, -2, count);
+        }
+    }
+
+    return 2;
+}
+
 static int lsensor_list( lua_State* L ) {
     const sensor_t *csensor = sensors;
 
@@ -809,6 +1034,10 @@ static const LUA_REG_TYPE lsensor_ins_map[] = {
       { LSTRKEY( "set"         ),    LFUNCVAL( lsensor_set         ) },
       { LSTRKEY( "get"         ),    LFUNCVAL( lsensor_get         ) },
       { LSTRKEY( "callback"    ),    LFUNCVAL( lsensor_callback  ) },
+    { LSTRKEY( "index"       ),    LFUNCVAL( lsensor_index     ) },
+    { LSTRKEY( "schedule"    ),    LFUNCVAL( lsensor_schedule  ) },
+    { LSTRKEY( "unschedule"  ),    LFUNCVAL( lsensor_unschedule ) },
+    { LSTRKEY( "window"      ),    LFUNCVAL( lsensor_window    ) },
     { LSTRKEY( "__metatable" ),    LROVAL  ( lsensor_ins_map   ) },
     { LSTRKEY( "__index"     ),  LROVAL  ( lsensor_ins_map   ) },
     { LSTRKEY( "__gc"        ),  LFUNCVAL( lsensor_ins_gc    ) },
@@ -63,6 +63,7 @@
 
 #include <mqtt/MQTTAsync.h>
 #include <mqtt/MQTTClientPersistence.h>
+#include <mqtt/MQTTPersistenceRam.h>
 
 #include <sys/mutex.h>
 #include <sys/delay.h>
@@ -72,8 +73,13 @@
 
 #include <sys/drivers/net.h>
 
+#include "mqtt_trie.h"
+
 #define MQTT_CONNECT_TIMEOUT 20000
 
+// Messages are kept in RAM, optionally mirrored to a log file
+#define LUA_MQTT_PERSISTENCE_RAM 3
+
 #define evMQTT_CONNECTED  ( 1 << 0 )
 #define evMQTT_TIMEOUT    ( 1 << 1 )
 
@@ -102,6 +108,10 @@ DRIVER_REGISTER_END(MQTT,mqtt,0,NULL,NULL);
 // MQTT client initialized?
 static int initialized = 0;
 
+// Backoff, in milliseconds, before a message that couldn't be queued is delivered again
+#define MQTT_RETRY_DELAY_MIN 10
+#define MQTT_RETRY_DELAY_MAX 500
+
 // MQTT subscription
 typedef struct {
     char *topic;              // Subscribed topic
@@ -110,8 +120,19 @@ typedef struct {
     void *luafunc;            // For comparison *only*
     lua_callback_t *callback; // Lua callback, called when a message is received on topic
     void *next;               // Next subscribed topic
+    void *next_match;         // Next subscription on the same topic filter
+    uint32_t delivered;       // Sequence number of the last message queued for this subscription
 } mqtt_subs;
 
+// Message being dispatched to the subscriptions
+typedef struct {
+    MQTTAsync_message *m;
+    const char *topic;
+    int topic_len;
+    uint32_t seq;             // Message sequence number
+    int dropped;              // Subscriptions the message couldn't be queued for
+} mqtt_delivery;
+
 // MQTT user data
 typedef struct {
     struct mtx mtx;
@@ -129,8 +150,23 @@ typedef struct {
     // Subscription list
     mqtt_subs *subs;
 
+    // Subscriptions, by topic filter level
+    mqtt_node trie;
+
+    // Delivery of received messages. A message that couldn't be queued for all
+    // its subscriptions is delivered again by the client, and only queued for
+    // the subscriptions that missed it.
+    uint32_t seq;                // Sequence number of the last received message
+    MQTTAsync_message *retry;    // Message being delivered again, if any
+    int retry_msgid;
+    int retry_delay;
+
     int secure;
     int persistence;
+
+    // RAM persistence
+    MQTTClient_persistence ram_persistence;
+    MQTTPersistenceRam_options ram_options;
 } mqtt_userdata;
 
 // Emit a Lua exception using the result code (rc) provided by the MQTT library
@@ -196,75 +232,65 @@ static int mqtt_emit_exeption(lua_State* L, int exception, int rc) {
     return 0;
 }
 
-// Extracted from:
-//
-// http://git.eclipse.org/c/mosquitto/org.eclipse.mosquitto.git/tree/lib/util_mosq.c
-//
-// mosquitto_topic_matches_sub function
-static int topic_matches_sub(const char *sub, const char *topic) {
-    int slen, tlen;
-    int spos, tpos;
-    bool multilevel_wildcard = false;
+// Message event, with a copy of the payload followed by the topic
+typedef struct {
+    char *buffer;
+    int payload_len;
+    int topic_len;
+} mqtt_event_t;
+
+static int mqtt_event_push(lua_State *L, void *data) {
+    mqtt_event_t *event = (mqtt_event_t *)data;
+
+    // Push argument for the callback's function
+    lua_pushinteger(L, event->payload_len);
+    lua_pushlstring(L, event->buffer, event->payload_len);
+    lua_pushinteger(L, event->topic_len);
+    lua_pushlstring(L, event->buffer + event->payload_len, event->topic_len);
+
+    return 4;
+}
+
+static void mqtt_event_release(void *data) {
+    free(((mqtt_event_t *)data)->buffer);
+}
 
-    slen = strlen(sub);
-    tlen = strlen(topic);
+static const lua_event_type_t mqtt_event = {mqtt_event_push, NULL, mqtt_event_release};
 
-    if (slen && tlen) {
-        if ((sub[0] == '$' && topic[0] != '$')
-                || (topic[0] == '$' && sub[0] != '$')) {
+// Queue a message for the subscriptions of a matching topic filter
+static void trie_deliver(void *list, void *arg) {
+    mqtt_delivery *delivery = (mqtt_delivery *)arg;
+    mqtt_subs *subs = (mqtt_subs *)list;
+    mqtt_event_t event;
 
-            return 0;
+    while (subs) {
+        // Skip the subscriptions that already got the message in a previous try
+        if (subs->delivered == delivery->seq) {
+            subs = subs->next_match;
+            continue;
         }
-    }
 
-    spos = 0;
-    tpos = 0;
+        // The Lua callback runs from the event dispatcher, after the message is freed
+        event.payload_len = delivery->m->payloadlen;
+        event.topic_len = delivery->topic_len;
+        event.buffer = malloc(event.payload_len + event.topic_len);
 
-    while (spos < slen && tpos < tlen) {
-        if (sub[spos] == topic[tpos]) {
-            if (tpos == tlen - 1) {
-                /* Check for e.g. foo matching foo/# */
-                if (spos == slen - 3 && sub[spos + 1] == '/'
-                        && sub[spos + 2] == '#') {
-                    multilevel_wildcard = true;
-                    return 1;
-                }
-            }
-            spos++;
-            tpos++;
-            if (spos == slen && tpos == tlen) {
-                return 1;
-            } else if (tpos == tlen && spos == slen - 1 && sub[spos] == '+') {
-                spos++;
-                return 1;
-            }
-        } else {
-            if (sub[spos] == '+') {
-                spos++;
-                while (tpos < tlen && topic[tpos] != '/') {
-                    tpos++;
-                }
-                if (tpos == tlen && spos == slen) {
-                    return 1;
-                }
-            } else if (sub[spos] == '#') {
-                multilevel_wildcard = true;
-                if (spos + 1 != slen) {
-                    return 0;
-                } else {
-                    return 1;
-                }
+        if (event.buffer) {
+            memcpy(event.buffer, delivery->m->payload, event.payload_len);
+            memcpy(event.buffer + event.payload_len, delivery->topic, event.topic_len);
+
+            if (luaS_event_post(subs->callback, 0, LUA_EVENT_NORMAL, &mqtt_event, &event, sizeof(event)) == LUA_EVENT_DROPPED) {
+                delivery->dropped++;
             } else {
-                return 0;
+                subs->delivered = delivery->seq;
             }
+        } else {
+            syslog(LOG_ERR, "mqtt: not enough memory to deliver a message\n");
+            delivery->dropped++;
         }
-    }
 
-    if (multilevel_wildcard == false && (tpos < tlen || spos < slen)) {
-        return 0;
+        subs = subs->next_match;
     }
-
-    return 0;
 }
 
 // Add a topic to the subscription list, and subscribe the topic to the broker if client is
@@ -300,19 +326,32 @@ static int add_subs(lua_State *L, int index, mqtt_userdata *mqtt, const char *to
         return luaL_exception_extended(L, LUA_MQTT_ERR_NOT_ENOUGH_MEMORY, NULL);
     }
 
+    // Get the topic filter in the subscription trie
+    mqtt_node *node = mqtt_trie_add(&mqtt->trie, topic);
+    if (!node) {
+        mqtt_trie_prune(&mqtt->trie, topic);
+        free(subs->topic);
+        free(subs);
+        return luaL_exception_extended(L, LUA_MQTT_ERR_NOT_ENOUGH_MEMORY, NULL);
+    }
+
     // Create the lua callback
     subs->callback = luaS_callback_create(L, index);
     if (subs->callback == NULL) {
+        mqtt_trie_prune(&mqtt->trie, topic);
         free(subs->topic);
         free(subs);
 
         return luaL_exception_extended(L, LUA_MQTT_ERR_NOT_ENOUGH_MEMORY, NULL);
     }
 
-    // Add the subscription to the subscription list
+    // Add the subscription to the subscription list, and to the trie
     subs->next = mqtt->subs;
     mqtt->subs = subs;
 
+    subs->next_match = node->subs;
+    node->subs = subs;
+
     if (MQTTAsync_isConnected(mqtt->client)) {
         // If client is connected, subscribe to topic now
         int rc;
@@ -429,31 +468,64 @@ static void discSuccess(void *context, MQTTAsync_successData *response) {
 static int msgArrived(void *context, char * topicName, int topicLen, MQTTAsync_message* m) {
     mqtt_userdata *mqtt = (mqtt_userdata *) context;
     if (mqtt) {
-        mqtt_subs *subs;
+        mqtt_delivery delivery;
+
+        delivery.m = m;
+        delivery.topic = topicName;
+        delivery.dropped = 0;
+
+        // see: https://www.ibm.com/support/knowledgecenter/SSFKSJ_7.5.0/com.ibm.mq.javadoc.doc/WMQMQxrCClasses/_m_q_t_t_client_8h.html?view=kc#aa42130dd069e7e949bcab37b6dce64a5
+        delivery.topic_len = (topicLen == 0) ? strlen(topicName) : topicLen;
 
         mtx_lock(&mqtt->mtx);
 
-        subs = mqtt->subs;
-        while (subs) {
-            if (topic_matches_sub(subs->topic, topicName)) {
-                // Push argument for the callback's function
-                lua_pushinteger(luaS_callback_state(subs->callback), m->payloadlen);
-                lua_pushlstring(luaS_callback_state(subs->callback), m->payload, m->payloadlen);
-
-                // see: https://www.ibm.com/support/knowledgecenter/SSFKSJ_7.5.0/com.ibm.mq.javadoc.doc/WMQMQxrCClasses/_m_q_t_t_client_8h.html?view=kc#aa42130dd069e7e949bcab37b6dce64a5
-                if (topicLen == 0) {
-                    lua_pushinteger(luaS_callback_state(subs->callback), strlen(topicName));
-                    lua_pushstring(luaS_callback_state(subs->callback), topicName);
-                } else {
-                    lua_pushinteger(luaS_callback_state(subs->callback), topicLen);
-                    lua_pushlstring(luaS_callback_state(subs->callback), topicName, topicLen);
+        // A message delivered again keeps its sequence number
+        if ((m != mqtt->retry) || (m->msgid != mqtt->retry_msgid)) {
+            if (++mqtt->seq == 0) {
+                mqtt->seq = 1;
+            }
+        }
+
+        delivery.seq = mqtt->seq;
+
+        mqtt_trie_match(&mqtt->trie, topicName, delivery.topic_len, trie_deliver, &delivery);
+
+        if (delivery.dropped) {
+            // The event queue is full. QoS 1 and 2 messages are kept by the
+            // client, and delivered again later, so they are not lost.
+            if (m->qos > 0) {
+                int retry_delay;
+
+                if (m != mqtt->retry) {
+                    syslog(LOG_WARNING, "mqtt: event queue full, message on %.*s will be redelivered\n", delivery.topic_len, topicName);
+                }
+
+                mqtt->retry = m;
+                mqtt->retry_msgid = m->msgid;
+
+                if (mqtt->retry_delay < MQTT_RETRY_DELAY_MIN) {
+                    mqtt->retry_delay = MQTT_RETRY_DELAY_MIN;
+                } else if (mqtt->retry_delay < MQTT_RETRY_DELAY_MAX) {
+                    mqtt->retry_delay *= 2;
                 }
 
-                luaS_callback_call(subs->callback, 4);
+                retry_delay = mqtt->retry_delay;
+
+                mtx_unlock(&mqtt->mtx);
+
+                // Give the event dispatcher time to drain the queue, instead of
+                // trying again on each cycle of the client
+                delay(retry_delay);
+
+                return 0;
             }
-            subs = subs->next;
+
+            syslog(LOG_WARNING, "mqtt: event queue full, message on %.*s dropped\n", delivery.topic_len, topicName);
         }
 
+        mqtt->retry = NULL;
+        mqtt->retry_delay = 0;
+
         MQTTAsync_freeMessage(&m);
         MQTTAsync_free(topicName);
 
@@ -482,11 +554,17 @@ static int lmqtt_client(lua_State* L) {
 #endif
 
     if (lua_gettop(L) > 5) {
-        luaL_checktype(L, 6, LUA_TBOOLEAN);
-        persistence =
-                lua_toboolean(L, 6) ?
-                        MQTTCLIENT_PERSISTENCE_DEFAULT :
-                        MQTTCLIENT_PERSISTENCE_NONE;
+        if (lua_type(L, 6) == LUA_TNUMBER) {
+            persistence = luaL_checkinteger(L, 6);
+            luaL_argcheck(L, (persistence == MQTTCLIENT_PERSISTENCE_DEFAULT) || (persistence == MQTTCLIENT_PERSISTENCE_NONE) ||
+                             (persistence == LUA_MQTT_PERSISTENCE_RAM), 6, "invalid persistence");
+        } else {
+            luaL_checktype(L, 6, LUA_TBOOLEAN);
+            persistence =
+                    lua_toboolean(L, 6) ?
+                            MQTTCLIENT_PERSISTENCE_DEFAULT :
+                            MQTTCLIENT_PERSISTENCE_NONE;
+        }
         persistence_folder = luaL_optstring(L, 7, NULL); //is being strdup'd in MQTTClient_create
     }
 
@@ -496,7 +574,27 @@ static int lmqtt_client(lua_State* L) {
     mqtt->discTask = NULL;
     mqtt->client = NULL;
     mqtt->subs = NULL;
+    memset(&mqtt->trie, 0, sizeof(mqtt_node));
+    mqtt->seq = 0;
+    mqtt->retry = NULL;
+    mqtt->retry_msgid = 0;
+    mqtt->retry_delay = 0;
     mqtt->secure = secure;
+    mqtt->ram_options.size = CONFIG_LUA_RTOS_MQTT_PERSISTENCE_RAM_SIZE * 1024;
+    mqtt->ram_options.dir = NULL;
+
+    // The RAM store is given to the MQTT library as a user persistence, with
+    // the folder, if any, used for the log file
+    void *persistence_context = (void *)persistence_folder;
+
+    if (persistence == LUA_MQTT_PERSISTENCE_RAM) {
+        mqtt->ram_options.dir = (persistence_folder ? strdup(persistence_folder) : NULL);
+        MQTTPersistenceRam_init(&mqtt->ram_persistence, &mqtt->ram_options);
+
+        persistence = MQTTCLIENT_PERSISTENCE_USER;
+        persistence_context = &mqtt->ram_persistence;
+    }
+
     mqtt->persistence = persistence;
 #ifdef OPENSSL
     mqtt->ca_file = (ca_file ? strdup(ca_file) : NULL); //save for use during mqtt_connect
@@ -519,9 +617,9 @@ static int lmqtt_client(lua_State* L) {
     //url is being strdup'd in MQTTClient_create
     MQTTAsync_createOptions create_opts = MQTTAsync_createOptions_initializer;
 
-    create_opts.sendWhileDisconnected = (persistence == MQTTCLIENT_PERSISTENCE_DEFAULT);
+    create_opts.sendWhileDisconnected = (persistence != MQTTCLIENT_PERSISTENCE_NONE);
 
-    rc = MQTTAsync_createWithOptions(&mqtt->client, url, clientId, persistence, (char*)persistence_folder, &create_opts);
+    rc = MQTTAsync_createWithOptions(&mqtt->client, url, clientId, persistence, persistence_context, &create_opts);
     if (rc < 0) {
         return mqtt_emit_exeption(L, LUA_MQTT_ERR_CANT_CREATE_CLIENT, rc);
     }
@@ -731,7 +829,7 @@ static int lmqtt_publish(lua_State* L) {
     MQTTAsync_message msg = MQTTAsync_message_initializer;
 
     msg.payload = payload;
-    msg.payloadlen = strlen(payload);
+    msg.payloadlen = payload_len;
     msg.qos = qos;
     msg.retained = retained;
 
@@ -743,6 +841,62 @@ static int lmqtt_publish(lua_State* L) {
     return 0;
 }
 
+// Publish a batch of QOS 0 messages, given as a table of {topic, payload [, retained]}
+// entries. The messages are encoded in one buffer and sent with a single socket write.
+static int lmqtt_publish_batch(lua_State* L) {
+    int rc;
+    int i, count;
+    size_t payload_len;
+    char **topics;
+    MQTTAsync_message *msgs;
+    MQTTAsync_message msg = MQTTAsync_message_initializer;
+
+    // Get user data
+    mqtt_userdata *mqtt = (mqtt_userdata *) luaL_checkudata(L, 1, "mqtt.cli");
+    luaL_argcheck(L, mqtt, 1, "mqtt expected");
+
+    luaL_checktype(L, 2, LUA_TTABLE);
+
+    count = luaL_len(L, 2);
+    if (count == 0) {
+        return 0;
+    }
+
+    // Scratch arrays are Lua userdata, so they are released even if an argument is wrong
+    topics = (char **)lua_newuserdata(L, count * sizeof(char *));
+    msgs = (MQTTAsync_message *)lua_newuserdata(L, count * sizeof(MQTTAsync_message));
+
+    // The topic and payload strings are referenced by the table, so they
+    // stay valid while the messages are encoded
+    for (i = 0; i < count; i++) {
+        lua_rawgeti(L, 2, i + 1);
+        luaL_argcheck(L, lua_istable(L, -1), 2, "{topic, payload} entries expected");
+
+        lua_rawgeti(L, -1, 1);
+        lua_rawgeti(L, -2, 2);
+        lua_rawgeti(L, -3, 3);
+
+        luaL_argcheck(L, lua_type(L, -3) == LUA_TSTRING, 2, "topic expected");
+        luaL_argcheck(L, lua_type(L, -2) == LUA_TSTRING, 2, "payload expected");
+
+        bcopy(&msg, &msgs[i], sizeof(MQTTAsync_message));
+
+        topics[i] = (char *)lua_tostring(L, -3);
+        msgs[i].payload = (char *)lua_tolstring(L, -2, &payload_len);
+        msgs[i].payloadlen = payload_len;
+        msgs[i].retained = lua_toboolean(L, -1);
+
+        lua_pop(L, 4);
+    }
+
+    // Send messages
+    if ((rc = MQTTAsync_sendMessages(mqtt->client, count, topics, msgs)) != MQTTASYNC_SUCCESS) {
+        return mqtt_emit_exeption(L, LUA_MQTT_ERR_CANT_PUBLISH, rc);
+    }
+
+    return 0;
+}
+
 static int lmqtt_disconnect(lua_State* L) {
     // Get user data
     mqtt_userdata *mqtt = (mqtt_userdata *) luaL_checkudata(L, 1, "mqtt.cli");
@@ -832,10 +986,17 @@ static int lmqtt_client_gc(lua_State *L) {
 
         mqtt->subs = NULL;
 
+        mqtt_trie_free(&mqtt->trie);
+
         // Destroy client
         MQTTAsync_destroy(&mqtt->client);
         mqtt->client = NULL;
 
+        if (mqtt->ram_options.dir) {
+            free((char*) mqtt->ram_options.dir);
+            mqtt->ram_options.dir = NULL;
+        }
+
 #ifdef OPENSSL
         if (mqtt->ca_file) {
             free((char*) mqtt->ca_file);
@@ -871,6 +1032,7 @@ static const LUA_REG_TYPE lmqtt_map[] = {
     { LSTRKEY("PERSISTENCE_FILE"), LINTVAL(MQTTCLIENT_PERSISTENCE_DEFAULT) },
     { LSTRKEY("PERSISTENCE_NONE"), LINTVAL(MQTTCLIENT_PERSISTENCE_NONE) },
     { LSTRKEY("PERSISTENCE_USER"), LINTVAL(MQTTCLIENT_PERSISTENCE_USER) },
+    { LSTRKEY("PERSISTENCE_RAM"),  LINTVAL(LUA_MQTT_PERSISTENCE_RAM) },
 
     // Error definitions
     DRIVER_REGISTER_LUA_ERRORS(mqtt)
@@ -883,6 +1045,7 @@ static const LUA_REG_TYPE lmqtt_client_map[] = {
     { LSTRKEY( "disconnect"  ),   LFUNCVAL( lmqtt_disconnect ) },
     { LSTRKEY( "subscribe"   ),   LFUNCVAL( lmqtt_subscribe  ) },
     { LSTRKEY( "publish"     ),   LFUNCVAL( lmqtt_publish    ) },
+    { LSTRKEY( "publishbatch"),   LFUNCVAL( lmqtt_publish_batch ) },
     { LSTRKEY( "__metatable" ),   LROVAL  ( lmqtt_client_map ) },
     { LSTRKEY( "__index"     ),   LROVAL  ( lmqtt_client_map ) },
     { LSTRKEY( "__gc"        ),   LFUNCVAL( lmqtt_client_gc  ) },
@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2015 - 2020, IBEROXARXA SERVICIOS INTEGRALES, S.L.
+ * Copyright (C) 2015 - 2020, Jaume Olivé Petrus (jolive@whitecatboard.org)
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *     * The WHITECAT logotype cannot be changed, you can remove it, but you
+ *       cannot change it in any way. The WHITECAT logotype is:
+ *
+ *          /\       /\
+ *         /  \_____/  \
+ *        /_____________\
+ *        W H I T E C A T
+ *
+ *     * Redistributions in binary form must retain all copyright notices printed
+ *       to any local or remote output device. This include any reference to
+ *       Lua RTOS, whitecatboard.org, Lua, and other copyright notices that may
+ *       appear in the future.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Lua RTOS, MQTT subscription trie
+ *
+ */
+
+#include "luartos.h"
+
+#if CONFIG_LUA_RTOS_LUA_USE_MQTT
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mqtt_trie.h"
+
+// Get the link to the child node of a topic filter level, that points to NULL if
+// the level is not in the trie
+static mqtt_node **trie_link(mqtt_node *node, const char *topic, size_t len, int last) {
+    mqtt_node **link;
+
+    if ((len == 1) && (*topic == '+')) {
+        return &node->plus;
+    } else if ((len == 1) && (*topic == '#') && last) {
+        return &node->hash;
+    }
+
+    link = &node->child;
+    while (*link && (((*link)->len != len) || (memcmp((*link)->level, topic, len) != 0))) {
+        link = &(*link)->next;
+    }
+
+    return link;
+}
+
+// Match the topic levels that follow a node. topic is NULL when all the levels
+// are matched.
+static void trie_match(mqtt_node *node, const char *topic, const char *end, int wildcards, mqtt_trie_deliver_t deliver, void *arg) {
+    const char *sep;
+    const char *next;
+    mqtt_node *child;
+    size_t len;
+
+    // '#' matches the remaining levels, including none
+    if (wildcards && node->hash && node->hash->subs) {
+        deliver(node->hash->subs, arg);
+    }
+
+    if (!topic) {
+        if (node->subs) {
+            deliver(node->subs, arg);
+        }
+        return;
+    }
+
+    sep = memchr(topic, '/', end - topic);
+    len = sep ? (size_t)(sep - topic) : (size_t)(end - topic);
+    next = sep ? sep + 1 : NULL;
+
+    for (child = node->child; child; child = child->next) {
+        if ((child->len == len) && (memcmp(child->level, topic, len) == 0)) {
+            trie_match(child, next, end, 1, deliver, arg);
+            break;
+        }
+    }
+
+    if (wildcards && node->plus) {
+        trie_match(node->plus, next, end, 1, deliver, arg);
+    }
+}
+
+mqtt_node *mqtt_trie_add(mqtt_node *root, const char *topic) {
+    mqtt_node *node = root;
+    const char *sep;
+    mqtt_node **link;
+    mqtt_node *child;
+    size_t len;
+
+    for(;;) {
+        sep = strchr(topic, '/');
+        len = sep ? (size_t)(sep - topic) : strlen(topic);
+        link = trie_link(node, topic, len, !sep);
+
+        if (!*link) {
+            child = (mqtt_node *)calloc(1, sizeof(mqtt_node));
+            if (!child) {
+                return NULL;
+            }
+
+            child->level = strndup(topic, len);
+            if (!child->level) {
+                free(child);
+                return NULL;
+            }
+
+            child->len = len;
+            *link = child;
+        }
+
+        node = *link;
+
+        if (!sep) {
+            return node;
+        }
+
+        topic = sep + 1;
+    }
+}
+
+void mqtt_trie_prune(mqtt_node *root, const char *topic) {
+    const char *sep;
+    mqtt_node **link;
+    mqtt_node *child;
+    size_t len;
+
+    sep = strchr(topic, '/');
+    len = sep ? (size_t)(sep - topic) : strlen(topic);
+    link = trie_link(root, topic, len, !sep);
+
+    if (!(child = *link)) {
+        return;
+    }
+
+    if (sep) {
+        mqtt_trie_prune(child, sep + 1);
+    }
+
+    if (!child->subs && !child->child && !child->plus && !child->hash) {
+        *link = child->next;
+        free(child->level);
+        free(child);
+    }
+}
+
+void mqtt_trie_free(mqtt_node *root) {
+    mqtt_node *child;
+    mqtt_node *next;
+
+    if (root->plus) {
+        mqtt_trie_free(root->plus);
+        free(root->plus->level);
+        free(root->plus);
+    }
+
+    if (root->hash) {
+        mqtt_trie_free(root->hash);
+        free(root->hash->level);
+        free(root->hash);
+    }
+
+    child = root->child;
+    while (child) {
+        next = child->next;
+
+        mqtt_trie_free(child);
+        free(child->level);
+        free(child);
+
+        child = next;
+    }
+
+    root->child = NULL;
+    root->plus = NULL;
+    root->hash = NULL;
+    root->subs = NULL;
+}
+
+void mqtt_trie_match(mqtt_node *root, const char *topic, size_t len, mqtt_trie_deliver_t deliver, void *arg) {
+    trie_match(root, topic, topic + len, (*topic != '$'), deliver, arg);
+}
+
+#endif
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2015 - 2020, IBEROXARXA SERVICIOS INTEGRALES, S.L.
+ * Copyright (C) 2015 - 2020, Jaume Olivé Petrus (jolive@whitecatboard.org)
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *     * The WHITECAT logotype cannot be changed, you can remove it, but you
+ *       cannot change it in any way. The WHITECAT logotype is:
+ *
+ *          /\       /\
+ *         /  \_____/  \
+ *        /_____________\
+ *        W H I T E C A T
+ *
+ *     * Redistributions in binary form must retain all copyright notices printed
+ *       to any local or remote output device. This include any reference to
+ *       Lua RTOS, whitecatboard.org, Lua, and other copyright notices that may
+ *       appear in the future.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Lua RTOS, MQTT subscription trie
+ *
+ */
+
+#ifndef LMQTT_TRIE_H
+#define LMQTT_TRIE_H
+
+#include <stddef.h>
+
+// Topic filter level, in the subscription trie
+typedef struct mqtt_node {
+    char *level;              // Level name
+    size_t len;               // Level name length
+    struct mqtt_node *child;  // First child level
+    struct mqtt_node *next;   // Next sibling level
+    struct mqtt_node *plus;   // '+' child level
+    struct mqtt_node *hash;   // '#' child level
+    void *subs;               // Subscriptions whose topic filter ends at this level
+} mqtt_node;
+
+// Called with the subscriptions of each topic filter that matches a topic
+typedef void (*mqtt_trie_deliver_t)(void *subs, void *arg);
+
+// Get the node of a topic filter, creating the missing levels. Returns NULL if
+// there is not enough memory, and the levels created so far are left in the trie.
+mqtt_node *mqtt_trie_add(mqtt_node *root, const char *topic);
+
+// Remove the levels of a topic filter that have no subscriptions and no child levels
+void mqtt_trie_prune(mqtt_node *root, const char *topic);
+
+// Free all the levels of the trie. The subscriptions are not freed.
+void mqtt_trie_free(mqtt_node *root);
+
+// Call deliver for every topic filter that matches a topic of len bytes. Wildcards
+// don't match the first level of topics starting with '$'.
+void mqtt_trie_match(mqtt_node *root, const char *topic, size_t len, mqtt_trie_deliver_t deliver, void *arg);
+
+#endif /* LMQTT_TRIE_H */
@@ -56,6 +56,7 @@
 #include "thread.h"
 #include "error.h"
 #include "blocks.h"
+#include "sys.h"
 
 #include <unistd.h>
 #include <stdlib.h>
@@ -70,18 +71,6 @@
 #include <sys/console.h>
 #include <sys/fcntl.h>
 
-// Module errors
-#define LUA_THREAD_ERR_NOT_ENOUGH_MEMORY    	(DRIVER_EXCEPTION_BASE(THREAD_DRIVER_ID) |  0)
-#define LUA_THREAD_ERR_NOT_ALLOWED          	(DRIVER_EXCEPTION_BASE(THREAD_DRIVER_ID) |  1)
-#define LUA_THREAD_ERR_NON_EXISTENT         	(DRIVER_EXCEPTION_BASE(THREAD_DRIVER_ID) |  2)
-#define LUA_THREAD_ERR_CANNOT_START         	(DRIVER_EXCEPTION_BASE(THREAD_DRIVER_ID) |  3)
-#define LUA_THREAD_ERR_INVALID_STACK_SIZE   	(DRIVER_EXCEPTION_BASE(THREAD_DRIVER_ID) |  4)
-#define LUA_THREAD_ERR_INVALID_PRIORITY     	(DRIVER_EXCEPTION_BASE(THREAD_DRIVER_ID) |  5)
-#define LUA_THREAD_ERR_INVALID_CPU_AFFINITY 	(DRIVER_EXCEPTION_BASE(THREAD_DRIVER_ID) |  6)
-#define LUA_THREAD_ERR_CANNOT_MONITOR_AS_TABLE 	(DRIVER_EXCEPTION_BASE(THREAD_DRIVER_ID) |  7)
-#define LUA_THREAD_ERR_INVALID_THREAD_ID	    (DRIVER_EXCEPTION_BASE(THREAD_DRIVER_ID) |  8)
-#define LUA_THREAD_ERR_GET_TASKLIST	          (DRIVER_EXCEPTION_BASE(THREAD_DRIVER_ID) |  9)
-
 // Register driver and messages
 DRIVER_REGISTER_BEGIN(THREAD,thread,0,NULL,NULL);
 	DRIVER_REGISTER_ERROR(THREAD, thread, NotEnoughtMemory, "not enough memory", LUA_THREAD_ERR_NOT_ENOUGH_MEMORY);
@@ -94,6 +83,7 @@ DRIVER_REGISTER_BEGIN(THREAD,thread,0,NULL,NULL);
 	DRIVER_REGISTER_ERROR(THREAD, thread, CannotMonitorAsTable, "you can't monitor thread as table", LUA_THREAD_ERR_CANNOT_MONITOR_AS_TABLE);
 	DRIVER_REGISTER_ERROR(THREAD, thread, InvalidThreadId, "invalid thread id", LUA_THREAD_ERR_INVALID_THREAD_ID);
 	DRIVER_REGISTER_ERROR(THREAD, thread, GetTaskList, "cannot get tasklist", LUA_THREAD_ERR_GET_TASKLIST);
+	DRIVER_REGISTER_ERROR(THREAD, thread, CannotSend, "value cannot be sent", LUA_THREAD_ERR_CANNOT_SEND);
 DRIVER_REGISTER_END(THREAD,thread,0,NULL,NULL);
 
 typedef struct {
@@ -755,6 +745,85 @@ static int lthread_status(lua_State* L) {
 	return 0;
 }
 
+#if CONFIG_LUA_RTOS_LUA_LOCK_STATS && !CONFIG_LUA_RTOS_LUA_USE_JIT_BYTECODE_OPTIMIZER
+static int lthread_stats(lua_State* L) {
+	lua_lock_stats_t stats;
+	int reset = 0;
+
+	if (lua_gettop(L) > 0) {
+		luaL_checktype(L, 1, LUA_TBOOLEAN);
+		reset = lua_toboolean(L, 1);
+	}
+
+	LuaLockStats(L, &stats, reset);
+
+	lua_createtable(L, 0, 7);
+
+	lua_pushinteger(L, stats.acquisitions);
+	lua_setfield (L, -2, "acquisitions");
+
+	lua_pushinteger(L, stats.contended);
+	lua_setfield (L, -2, "contended");
+
+	lua_pushinteger(L, stats.yields);
+	lua_setfield (L, -2, "yields");
+
+	lua_pushnumber(L, stats.wait_us);
+	lua_setfield (L, -2, "wait_us");
+
+	lua_pushnumber(L, stats.hold_us);
+	lua_setfield (L, -2, "hold_us");
+
+	lua_pushinteger(L, stats.max_wait_us);
+	lua_setfield (L, -2, "max_wait_us");
+
+	lua_pushinteger(L, stats.max_hold_us);
+	lua_setfield (L, -2, "max_hold_us");
+
+	return 1;
+}
+#endif
+
+static int lthread_events(lua_State* L) {
+	lua_event_stats_t stats;
+	int reset = 0;
+
+	if (lua_gettop(L) > 0) {
+		luaL_checktype(L, 1, LUA_TBOOLEAN);
+		reset = lua_toboolean(L, 1);
+	}
+
+	luaS_event_stats(&stats, reset);
+
+	lua_createtable(L, 0, 8);
+
+	lua_pushinteger(L, stats.posted);
+	lua_setfield (L, -2, "posted");
+
+	lua_pushinteger(L, stats.coalesced);
+	lua_setfield (L, -2, "coalesced");
+
+	lua_pushinteger(L, stats.dropped);
+	lua_setfield (L, -2, "dropped");
+
+	lua_pushinteger(L, stats.dispatched);
+	lua_setfield (L, -2, "dispatched");
+
+	lua_pushinteger(L, stats.pending);
+	lua_setfield (L, -2, "pending");
+
+	lua_pushinteger(L, stats.max_pending);
+	lua_setfield (L, -2, "max_pending");
+
+	lua_pushnumber(L, stats.latency_us);
+	lua_setfield (L, -2, "latency_us");
+
+	lua_pushinteger(L, stats.max_latency_us);
+	lua_setfield (L, -2, "max_latency_us");
+
+	return 1;
+}
+
 #include "modules.h"
 
 static const LUA_REG_TYPE thread[] = {
@@ -763,10 +832,16 @@ static const LUA_REG_TYPE thread[] = {
     { LSTRKEY( "self"        ),          LFUNCVAL( lthread_self          ) },
     { LSTRKEY( "createmutex" ),			LFUNCVAL( lthread_create_mutex  ) },
     { LSTRKEY( "start"       ),			LFUNCVAL( lthread_start         ) },
+    { LSTRKEY( "worker"      ),			LFUNCVAL( lthread_worker        ) },
+    { LSTRKEY( "channel"     ),			LFUNCVAL( lthread_channel       ) },
     { LSTRKEY( "suspend"     ),			LFUNCVAL( lthread_suspend       ) },
     { LSTRKEY( "resume"      ),			LFUNCVAL( lthread_resume        ) },
     { LSTRKEY( "stop"        ),			LFUNCVAL( lthread_stop          ) },
     { LSTRKEY( "list"        ),			LFUNCVAL( lthread_list          ) },
+#if CONFIG_LUA_RTOS_LUA_LOCK_STATS && !CONFIG_LUA_RTOS_LUA_USE_JIT_BYTECODE_OPTIMIZER
+    { LSTRKEY( "stats"       ),			LFUNCVAL( lthread_stats         ) },
+#endif
+    { LSTRKEY( "events"      ),			LFUNCVAL( lthread_events        ) },
     { LSTRKEY( "sleep"       ),			LFUNCVAL( lthread_sleep         ) },
     { LSTRKEY( "sleepms"     ),			LFUNCVAL( lthread_sleepms       ) },
     { LSTRKEY( "sleepus"     ),			LFUNCVAL( lthread_sleepus       ) },
@@ -790,7 +865,8 @@ static const LUA_REG_TYPE mutex_map[] = {
 
 int luaopen_thread(lua_State* L) {
 	luaL_newmetarotable(L,"thread.mutex", (void *)mutex_map);
-	
+	lthread_worker_open(L);
+
 	return 0;
 } 
  
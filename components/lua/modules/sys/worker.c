@@ -0,0 +1,755 @@
+/*
+ * Copyright (C) 2015 - 2020, IBEROXARXA SERVICIOS INTEGRALES, S.L.
+ * Copyright (C) 2015 - 2020, Jaume Olivé Petrus (jolive@whitecatboard.org)
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *     * The WHITECAT logotype cannot be changed, you can remove it, but you
+ *       cannot change it in any way. The WHITECAT logotype is:
+ *
+ *          /\       /\
+ *         /  \_____/  \
+ *        /_____________\
+ *        W H I T E C A T
+ *
+ *     * Redistributions in binary form must retain all copyright notices printed
+ *       to any local or remote output device. This include any reference to
+ *       Lua RTOS, whitecatboard.org, Lua, and other copyright notices that may
+ *       appear in the future.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Lua RTOS, Lua thread module, isolated workers and channels
+ *
+ */
+
+#include "sdkconfig.h"
+
+#if CONFIG_LUA_RTOS_LUA_USE_THREAD
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+#include "lstate.h"
+#include "thread.h"
+#include "error.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <pthread.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+
+/*
+ * A worker is a Lua thread that runs in it's own Lua state, so it doesn't share
+ * anything with other Lua threads, and doesn't need to take the Lua lock. Workers
+ * can run at the same time in both cores, and exchange values through channels.
+ *
+ * Values sent through a channel are copied into a message. Supported values are
+ * nil, booleans, numbers, strings, channels, and tables with supported keys and
+ * values.
+ */
+
+// Message tags
+#define MSG_NIL      0
+#define MSG_FALSE    1
+#define MSG_TRUE     2
+#define MSG_INT      3
+#define MSG_FLT      4
+#define MSG_STR      5
+#define MSG_TABLE    6
+#define MSG_END      7
+#define MSG_CHANNEL  8
+
+// Maximum nesting level of tables in a message
+#define MSG_MAX_DEPTH 16
+
+// Default number of messages that a channel can hold
+#define CHANNEL_DEFAULT_CAPACITY 8
+
+typedef struct lchannel {
+	QueueHandle_t q; // Queue of messages
+	int refs;        // Number of references (userdata + messages in flight)
+} lchannel_t;
+
+typedef struct {
+	lchannel_t *ch;
+} channel_userdata;
+
+typedef struct {
+	char *data;
+	size_t len;
+	size_t size;
+} msg_buffer_t;
+
+typedef struct {
+	char *code;      // Worker function, as a binary chunk
+	size_t code_len; // Binary chunk length
+	char *arg;       // Message with the argument of the worker function
+} lworker_t;
+
+static portMUX_TYPE ref_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void msg_free(char *msg);
+
+/*
+ * Channel references
+ */
+static void channel_ref(lchannel_t *ch) {
+	portENTER_CRITICAL(&ref_mux);
+	ch->refs++;
+	portEXIT_CRITICAL(&ref_mux);
+}
+
+static void channel_unref(lchannel_t *ch) {
+	char *msg;
+	int refs;
+
+	portENTER_CRITICAL(&ref_mux);
+	refs = --ch->refs;
+	portEXIT_CRITICAL(&ref_mux);
+
+	if (refs == 0) {
+		// Discard pending messages
+		while (xQueueReceive(ch->q, &msg, 0) == pdTRUE) {
+			msg_free(msg);
+		}
+
+		vQueueDelete(ch->q);
+		free(ch);
+	}
+}
+
+/*
+ * Message encoding
+ */
+static void msg_check(lua_State *L, int idx, int depth) {
+	idx = lua_absindex(L, idx);
+
+	switch (lua_type(L, idx)) {
+		case LUA_TNIL:
+		case LUA_TBOOLEAN:
+		case LUA_TNUMBER:
+		case LUA_TSTRING:
+			return;
+
+		case LUA_TUSERDATA:
+			if (luaL_testudata(L, idx, "thread.channel")) {
+				return;
+			}
+			break;
+
+		case LUA_TTABLE:
+			if (depth >= MSG_MAX_DEPTH) {
+				luaL_exception_extended(L, LUA_THREAD_ERR_CANNOT_SEND, "too many nested tables");
+			}
+
+			lua_pushnil(L);
+			while (lua_next(L, idx) != 0) {
+				msg_check(L, -2, depth + 1);
+				msg_check(L, -1, depth + 1);
+				lua_pop(L, 1);
+			}
+			return;
+	}
+
+	luaL_exception_extended(L, LUA_THREAD_ERR_CANNOT_SEND, luaL_typename(L, idx));
+}
+
+static int msg_put(msg_buffer_t *buff, const void *data, size_t len) {
+	if (buff->len + len > buff->size) {
+		size_t size = buff->size;
+		char *ndata;
+
+		while (size < buff->len + len) {
+			size <<= 1;
+		}
+
+		ndata = realloc(buff->data, size);
+		if (!ndata) {
+			return -1;
+		}
+
+		buff->data = ndata;
+		buff->size = size;
+	}
+
+	memcpy(buff->data + buff->len, data, len);
+	buff->len += len;
+
+	return 0;
+}
+
+static int msg_put_tag(msg_buffer_t *buff, uint8_t tag) {
+	return msg_put(buff, &tag, 1);
+}
+
+static int msg_encode_value(lua_State *L, msg_buffer_t *buff, int idx) {
+	idx = lua_absindex(L, idx);
+
+	switch (lua_type(L, idx)) {
+		case LUA_TNIL:
+			return msg_put_tag(buff, MSG_NIL);
+
+		case LUA_TBOOLEAN:
+			return msg_put_tag(buff, lua_toboolean(L, idx)?MSG_TRUE:MSG_FALSE);
+
+		case LUA_TNUMBER:
+			if (lua_isinteger(L, idx)) {
+				lua_Integer i = lua_tointeger(L, idx);
+
+				return msg_put_tag(buff, MSG_INT) || msg_put(buff, &i, sizeof(i));
+			} else {
+				lua_Number n = lua_tonumber(L, idx);
+
+				return msg_put_tag(buff, MSG_FLT) || msg_put(buff, &n, sizeof(n));
+			}
+
+		case LUA_TSTRING: {
+			size_t len;
+			const char *str = lua_tolstring(L, idx, &len);
+			uint32_t len32 = len;
+
+			return msg_put_tag(buff, MSG_STR) || msg_put(buff, &len32, sizeof(len32)) || msg_put(buff, str, len);
+		}
+
+		case LUA_TUSERDATA: {
+			channel_userdata *udata = (channel_userdata *)lua_touserdata(L, idx);
+
+			return msg_put_tag(buff, MSG_CHANNEL) || msg_put(buff, &udata->ch, sizeof(lchannel_t *));
+		}
+
+		case LUA_TTABLE:
+			if (msg_put_tag(buff, MSG_TABLE)) {
+				return -1;
+			}
+
+			lua_pushnil(L);
+			while (lua_next(L, idx) != 0) {
+				if (msg_encode_value(L, buff, -2) || msg_encode_value(L, buff, -1)) {
+					lua_pop(L, 2);
+					return -1;
+				}
+				lua_pop(L, 1);
+			}
+
+			return msg_put_tag(buff, MSG_END);
+	}
+
+	return -1;
+}
+
+/*
+ * Walk a message, starting at *p, and update the references of the channels
+ * contained on it. Returns a pointer to the next value.
+ */
+static const char *msg_walk(const char *p, int ref) {
+	uint32_t len;
+	lchannel_t *ch;
+
+	switch (*p++) {
+		case MSG_INT:
+			return p + sizeof(lua_Integer);
+
+		case MSG_FLT:
+			return p + sizeof(lua_Number);
+
+		case MSG_STR:
+			memcpy(&len, p, sizeof(len));
+			return p + sizeof(len) + len;
+
+		case MSG_CHANNEL:
+			memcpy(&ch, p, sizeof(ch));
+			if (ref) {
+				channel_ref(ch);
+			} else {
+				channel_unref(ch);
+			}
+			return p + sizeof(ch);
+
+		case MSG_TABLE:
+			while (*p != MSG_END) {
+				p = msg_walk(p, ref); // key
+				p = msg_walk(p, ref); // value
+			}
+			return p + 1;
+	}
+
+	return p;
+}
+
+/*
+ * Encode the value at index idx into a new message. The message is owner of a
+ * reference to each channel contained on it.
+ */
+static char *msg_encode(lua_State *L, int idx) {
+	msg_buffer_t buff;
+
+	msg_check(L, idx, 0);
+
+	buff.len = 0;
+	buff.size = 32;
+	buff.data = malloc(buff.size);
+	if (!buff.data) {
+		luaL_exception(L, LUA_THREAD_ERR_NOT_ENOUGH_MEMORY);
+	}
+
+	if (msg_encode_value(L, &buff, idx)) {
+		free(buff.data);
+		luaL_exception(L, LUA_THREAD_ERR_NOT_ENOUGH_MEMORY);
+	}
+
+	msg_walk(buff.data, 1);
+
+	return buff.data;
+}
+
+static void msg_free(char *msg) {
+	msg_walk(msg, 0);
+	free(msg);
+}
+
+/*
+ * Push the value at *p to the stack. Channel references owned by the message are
+ * transferred to the new channel userdatas.
+ */
+static const char *msg_decode_value(lua_State *L, const char *p) {
+	lua_Integer i;
+	lua_Number n;
+	uint32_t len;
+	lchannel_t *ch;
+
+	luaL_checkstack(L, 3, "message too complex");
+
+	switch (*p++) {
+		case MSG_NIL:
+			lua_pushnil(L);
+			break;
+
+		case MSG_FALSE:
+			lua_pushboolean(L, 0);
+			break;
+
+		case MSG_TRUE:
+			lua_pushboolean(L, 1);
+			break;
+
+		case MSG_INT:
+			memcpy(&i, p, sizeof(i));
+			lua_pushinteger(L, i);
+			p += sizeof(i);
+			break;
+
+		case MSG_FLT:
+			memcpy(&n, p, sizeof(n));
+			lua_pushnumber(L, n);
+			p += sizeof(n);
+			break;
+
+		case MSG_STR:
+			memcpy(&len, p, sizeof(len));
+			p += sizeof(len);
+			lua_pushlstring(L, p, len);
+			p += len;
+			break;
+
+		case MSG_CHANNEL: {
+			channel_userdata *udata = (channel_userdata *)lua_newuserdata(L, sizeof(channel_userdata));
+
+			memcpy(&ch, p, sizeof(ch));
+			udata->ch = ch;
+
+			luaL_getmetatable(L, "thread.channel");
+			lua_setmetatable(L, -2);
+
+			p += sizeof(ch);
+			break;
+		}
+
+		case MSG_TABLE:
+			lua_newtable(L);
+			while (*p != MSG_END) {
+				p = msg_decode_value(L, p); // key
+				p = msg_decode_value(L, p); // value
+				lua_rawset(L, -3);
+			}
+			p++;
+			break;
+	}
+
+	return p;
+}
+
+static void msg_decode(lua_State *L, char *msg) {
+	msg_decode_value(L, msg);
+	free(msg);
+}
+
+/*
+ * Workers
+ */
+static int worker_writer(lua_State *L, const void *p, size_t sz, void *ud) {
+	msg_buffer_t *buff = (msg_buffer_t *)ud;
+
+	return msg_put(buff, p, sz);
+}
+
+static void worker_free(lworker_t *worker) {
+	if (worker->arg) {
+		msg_free(worker->arg);
+	}
+
+	free(worker->code);
+	free(worker);
+}
+
+static void *worker_start_task(void *arg) {
+	lworker_t *worker = (lworker_t *)arg;
+	lthread_t *lthread;
+	const char *name;
+	lua_State *L;
+
+	lthread = pvGetLThread();
+
+	L = luaL_newstate();
+	if (!L) {
+		lua_writestringerror("%s\n", "not enough memory");
+		goto exit;
+	}
+
+	// This state is only used by this thread
+	G(L)->isolated = 1;
+
+	if (lthread) {
+		lthread->L = L;
+	}
+
+	luaL_openlibs(L);
+
+	if (luaL_loadbufferx(L, worker->code, worker->code_len, "=worker", "b") != LUA_OK) {
+		lua_writestringerror("%s\n", lua_tostring(L, -1));
+		goto exit;
+	}
+
+	// lua_load sets the first upvalue to the worker's globals, which is only
+	// right if it is _ENV
+	name = lua_getupvalue(L, -1, 1);
+	if (name) {
+		lua_pop(L, 1);
+		if (strcmp(name, "_ENV") != 0) {
+			lua_pushnil(L);
+			lua_setupvalue(L, -2, 1);
+		}
+	}
+
+	msg_decode(L, worker->arg);
+	worker->arg = NULL;
+
+	if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
+		lua_writestringerror("%s\n", lua_tostring(L, -1));
+	}
+
+exit:
+	if (L) {
+		lua_close(L);
+	}
+
+	worker_free(worker);
+
+	if (lthread) {
+		uxSetLThread(NULL);
+		free(lthread);
+	}
+
+	pthread_exit(NULL);
+}
+
+/*
+ * The worker function is loaded in a new state, so it can't capture locals
+ * of the creator. Only a single _ENV upvalue is allowed.
+ */
+static int worker_check_upvalues(lua_State *L, int idx) {
+	const char *name;
+
+	if (lua_iscfunction(L, idx)) {
+		return 0;
+	}
+
+	name = lua_getupvalue(L, idx, 1);
+	if (!name) {
+		return 1;
+	}
+
+	lua_pop(L, 1);
+	if (strcmp(name, "_ENV") != 0) {
+		return 0;
+	}
+
+	if (lua_getupvalue(L, idx, 2)) {
+		lua_pop(L, 1);
+		return 0;
+	}
+
+	return 1;
+}
+
+static void worker_init(void *arg) {
+	lthread_t *lthread = calloc(1, sizeof(lthread_t));
+
+	if (lthread) {
+		lthread->function_ref = LUA_NOREF;
+		lthread->thread_ref = LUA_NOREF;
+	}
+
+	uxSetLThread(lthread);
+}
+
+// Create a new worker, and run it
+int lthread_worker(lua_State* L) {
+	lworker_t *worker;
+	msg_buffer_t code;
+	pthread_attr_t attr;
+	struct sched_param sched;
+	pthread_t id;
+	char *arg;
+	int res;
+
+	luaL_checktype(L, 1, LUA_TFUNCTION);
+
+	if (!worker_check_upvalues(L, 1)) {
+		return luaL_exception_extended(L, LUA_THREAD_ERR_NOT_ALLOWED, "worker function can only have _ENV as upvalue");
+	}
+
+	// Get stack size, priotity and cpu affinity
+	int stack = luaL_optinteger(L, 3, CONFIG_LUA_RTOS_LUA_THREAD_STACK_SIZE);
+	int priority = luaL_optinteger(L, 4, CONFIG_LUA_RTOS_LUA_THREAD_PRIORITY);
+	int affinity = luaL_optinteger(L, 5, CONFIG_LUA_RTOS_LUA_THREAD_CPU);
+	const char *name = luaL_optstring(L, 6, "lua_worker");
+
+	// Sanity checks
+	if (stack < PTHREAD_STACK_MIN) {
+		return luaL_exception(L, LUA_THREAD_ERR_INVALID_STACK_SIZE);
+	}
+
+	if ((priority < ESP_TASK_PRIO_MIN + 3) || (priority > ESP_TASK_PRIO_MAX)) {
+		return luaL_exception(L, LUA_THREAD_ERR_INVALID_PRIORITY);
+	}
+
+	if ((affinity < 0) || (affinity > 1)) {
+		return luaL_exception(L, LUA_THREAD_ERR_INVALID_CPU_AFFINITY);
+	}
+
+	// Copy the argument. This can raise an error, so it's done before any
+	// allocation.
+	if (lua_gettop(L) < 2) {
+		lua_settop(L, 2);
+	}
+
+	arg = msg_encode(L, 2);
+
+	// Dump the worker function, that will be loaded in the worker's state
+	code.len = 0;
+	code.size = 256;
+	code.data = malloc(code.size);
+	if (!code.data) {
+		msg_free(arg);
+		return luaL_exception(L, LUA_THREAD_ERR_NOT_ENOUGH_MEMORY);
+	}
+
+	lua_pushvalue(L, 1);
+	res = lua_dump(L, worker_writer, &code, 0);
+	lua_pop(L, 1);
+
+	if (res) {
+		free(code.data);
+		msg_free(arg);
+		return luaL_exception(L, LUA_THREAD_ERR_NOT_ENOUGH_MEMORY);
+	}
+
+	worker = calloc(1, sizeof(lworker_t));
+	if (!worker) {
+		free(code.data);
+		msg_free(arg);
+		return luaL_exception(L, LUA_THREAD_ERR_NOT_ENOUGH_MEMORY);
+	}
+
+	worker->code = code.data;
+	worker->code_len = code.len;
+	worker->arg = arg;
+
+	// Init thread attributes
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, stack);
+
+	sched.sched_priority = priority;
+	pthread_attr_setschedparam(&attr, &sched);
+
+	cpu_set_t cpu_set = CPU_INITIALIZER;
+
+	CPU_SET(affinity, &cpu_set);
+
+	pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &cpu_set);
+	pthread_attr_setinitfunc_np(&attr, worker_init);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	res = pthread_create(&id, &attr, worker_start_task, worker);
+	if (res) {
+		worker_free(worker);
+		return luaL_exception_extended(L, LUA_THREAD_ERR_CANNOT_START, strerror(res));
+	}
+
+	pthread_setname_np(id, name);
+
+	lua_pushinteger(L, id);
+
+	return 1;
+}
+
+/*
+ * Channels
+ */
+int lthread_channel(lua_State* L) {
+	int capacity = luaL_optinteger(L, 1, CHANNEL_DEFAULT_CAPACITY);
+	channel_userdata *udata;
+	lchannel_t *ch;
+
+	luaL_argcheck(L, capacity > 0, 1, "capacity must be greater than 0");
+
+	ch = calloc(1, sizeof(lchannel_t));
+	if (!ch) {
+		return luaL_exception(L, LUA_THREAD_ERR_NOT_ENOUGH_MEMORY);
+	}
+
+	ch->q = xQueueCreate(capacity, sizeof(char *));
+	if (!ch->q) {
+		free(ch);
+		return luaL_exception(L, LUA_THREAD_ERR_NOT_ENOUGH_MEMORY);
+	}
+
+	ch->refs = 1;
+
+	udata = (channel_userdata *)lua_newuserdata(L, sizeof(channel_userdata));
+	udata->ch = ch;
+
+	luaL_getmetatable(L, "thread.channel");
+	lua_setmetatable(L, -2);
+
+	return 1;
+}
+
+static TickType_t channel_timeout(lua_State* L, int idx) {
+	int timeout = luaL_optinteger(L, idx, -1);
+
+	if (timeout < 0) {
+		return portMAX_DELAY;
+	}
+
+	return timeout / portTICK_PERIOD_MS;
+}
+
+static int lchannel_send(lua_State* L) {
+	channel_userdata *udata = (channel_userdata *)luaL_checkudata(L, 1, "thread.channel");
+	TickType_t timeout = channel_timeout(L, 3);
+	BaseType_t res;
+	char *msg;
+	int depth;
+
+	luaL_checkany(L, 2);
+
+	msg = msg_encode(L, 2);
+
+	// Let other Lua threads run while waiting
+	depth = LuaRelease(L);
+	res = xQueueSend(udata->ch->q, &msg, timeout);
+	LuaAcquire(L, depth);
+
+	if (res != pdTRUE) {
+		msg_free(msg);
+		lua_pushboolean(L, 0);
+	} else {
+		lua_pushboolean(L, 1);
+	}
+
+	return 1;
+}
+
+static int lchannel_receive(lua_State* L) {
+	channel_userdata *udata = (channel_userdata *)luaL_checkudata(L, 1, "thread.channel");
+	TickType_t timeout = channel_timeout(L, 2);
+	BaseType_t res;
+	char *msg;
+	int depth;
+
+	// Let other Lua threads run while waiting
+	depth = LuaRelease(L);
+	res = xQueueReceive(udata->ch->q, &msg, timeout);
+	LuaAcquire(L, depth);
+
+	if (res != pdTRUE) {
+		lua_pushnil(L);
+	} else {
+		msg_decode(L, msg);
+	}
+
+	return 1;
+}
+
+static int lchannel_count(lua_State* L) {
+	channel_userdata *udata = (channel_userdata *)luaL_checkudata(L, 1, "thread.channel");
+
+	lua_pushinteger(L, uxQueueMessagesWaiting(udata->ch->q));
+
+	return 1;
+}
+
+static int lchannel_gc(lua_State* L) {
+	channel_userdata *udata = (channel_userdata *)luaL_testudata(L, 1, "thread.channel");
+
+	if (udata && udata->ch) {
+		channel_unref(udata->ch);
+		udata->ch = NULL;
+	}
+
+	return 0;
+}
+
+#include "modules.h"
+
+static const LUA_REG_TYPE channel_map[] = {
+	{ LSTRKEY( "send"        ),   LFUNCVAL( lchannel_send    ) },
+	{ LSTRKEY( "receive"     ),   LFUNCVAL( lchannel_receive ) },
+	{ LSTRKEY( "count"       ),   LFUNCVAL( lchannel_count   ) },
+	{ LSTRKEY( "__metatable" ),	  LROVAL  ( channel_map      ) },
+	{ LSTRKEY( "__index"     ),   LROVAL  ( channel_map      ) },
+	{ LSTRKEY( "__gc"        ),   LFUNCVAL( lchannel_gc      ) },
+	{ LNILKEY, LNILVAL }
+};
+
+void lthread_worker_open(lua_State* L) {
+	luaL_newmetarotable(L,"thread.channel", (void *)channel_map);
+}
+
+#endif
@@ -37,6 +37,9 @@ void lua_writestringerror(const char * fmt, ...) { \
     vsyslog(LOG_ERR, fmt, ap);
     va_end(ap);
 
+    // Error messages must reach the console before the next prompt
+    syslog_flush();
+
     if (! (getlogstat() & LOG_CONS)) {
         va_start(ap, fmt);
         vfprintf(stderr, fmt, ap);
@@ -46,6 +49,10 @@ void lua_writestringerror(const char * fmt, ...) { \
 }
 #endif
 
+#if CONFIG_LUA_RTOS_LUA_USE_SLAB_ALLOCATOR
+#include "lua/common/slab.h"
+#endif
+
 /*
 ** {======================================================
 ** Traceback
@@ -1001,7 +1008,7 @@ LUALIB_API void luaL_requiref (lua_State *L, const char *modname,
 
 #if LUA_USE_ROTABLE
 	// If name is in rotable, package is loaded
-	const TValue *res = luaR_findglobal(modname);
+	const TValue *res = luaR_findglobal(modname, strlen(modname));
 	if (res) {
 		lua_pushrotable(L, (void *)rvalue(res));
 	}
@@ -1034,6 +1041,11 @@ LUALIB_API const char *luaL_gsub (lua_State *L, const char *s, const char *p,
 
 
 static void *l_alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
+#if CONFIG_LUA_RTOS_LUA_USE_SLAB_ALLOCATOR
+  (void)ud;  /* not used */
+  /* when 'ptr' is NULL, 'osize' is the object type, not a size */
+  return slab_realloc(ptr, ptr ? osize : 0, nsize);
+#else
   (void)ud; (void)osize;  /* not used */
   if (nsize == 0) {
 #if LUA_USE_ROTABLE
@@ -1056,6 +1068,7 @@ static void *l_alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
 #else
     return realloc(ptr, nsize);
 #endif
+#endif
 }
 
 static int panic (lua_State *L) {
@@ -30,6 +30,10 @@ LUALIB_API void luaL_checkanytable (lua_State *L, int arg);
 #include "lua/common/cache.h"
 #endif
 
+#if CONFIG_LUA_RTOS_LUA_USE_SLAB_ALLOCATOR
+#include "lua/common/slab.h"
+#endif
+
 static int luaB_print (lua_State *L) {
   int n = lua_gettop(L);  /* number of arguments */
   int i;
@@ -476,6 +480,9 @@ static int luaB_tostring (lua_State *L) {
 static const LUA_REG_TYPE base_funcs[] = {
 #if LUA_USE_ROTABLE && CONFIG_LUA_RTOS_LUA_USE_ROTABLE_CACHE && !CONFIG_LUA_RTOS_LUA_USE_JIT_BYTECODE_OPTIMIZER
   { LSTRKEY( "cache" 		  ),			LFUNCVAL( rotable_cache_dump  	) },
+#endif
+#if CONFIG_LUA_RTOS_LUA_USE_SLAB_ALLOCATOR
+  { LSTRKEY( "slab" 		  ),			LFUNCVAL( slab_dump  			) },
 #endif
   { LSTRKEY( "compile" 		  ),			LFUNCVAL( luaB_compile   		) },
   { LSTRKEY( "decompile" 	  ),			LFUNCVAL( luaB_decompile   		) },
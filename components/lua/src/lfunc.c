@@ -121,6 +121,10 @@ Proto *luaF_newproto (lua_State *L) {
 #if CONFIG_LUA_RTOS_LUA_USE_JIT_BYTECODE_OPTIMIZER
   f->optimized = 0;
   f->icode = NULL;
+#endif
+#if CONFIG_LUA_RTOS_LUA_USE_INLINE_CACHE
+  f->sizeic = 0;
+  f->ic = NULL;
 #endif
   return f;
 }
@@ -133,6 +137,9 @@ void luaF_freeproto (lua_State *L, Proto *f) {
   luaM_freearray(L, f->lineinfo, f->sizelineinfo);
   luaM_freearray(L, f->locvars, f->sizelocvars);
   luaM_freearray(L, f->upvalues, f->sizeupvalues);
+#if CONFIG_LUA_RTOS_LUA_USE_INLINE_CACHE
+  luaM_freearray(L, f->ic, f->sizeic);
+#endif
   luaM_free(L, f);
 }
 
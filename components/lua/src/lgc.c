@@ -58,6 +58,12 @@ static struct mtx mtx_gc;
 #define STEPMULADJ		200
 
 
+/*
+** amount of work done by an emergency step ('luaC_emergencystep')
+*/
+#define GCEMERGENCYWORK	(GCSTEPSIZE * 4)
+
+
 /*
 ** macro to adjust 'pause': 'pause' is actually used like
 ** 'pause / PAUSEADJ' (value chosen by tests)
@@ -500,6 +506,9 @@ static int traverseproto (global_State *g, Proto *f) {
                          sizeof(TValue) * f->sizek +
                          sizeof(int) * f->sizelineinfo +
                          sizeof(LocVar) * f->sizelocvars +
+#if CONFIG_LUA_RTOS_LUA_USE_INLINE_CACHE
+                         sizeof(ICache) * f->sizeic +
+#endif
                          sizeof(Upvaldesc) * f->sizeupvalues;
 }
 
@@ -1152,6 +1161,45 @@ void luaC_step (lua_State *L) {
 }
 
 
+/*
+** Performs a bounded amount of incremental GC work when an allocation
+** fails, before falling back to a full collection. As in an emergency
+** full collection, finalizers are not run and structures are not shrunk.
+** Returns 1 if some memory was released.
+*/
+int luaC_emergencystep (lua_State *L) {
+  global_State *g;
+  lu_mem before;
+  l_mem work = 0;
+#if LUA_USE_ROTABLE
+  if (mtx_initialized == 0) {
+    mtx_init(&mtx_gc, NULL, NULL, 0);
+    mtx_initialized = 1;
+  }
+
+  mtx_lock(&mtx_gc);
+  lua_lock(L);
+#endif
+  g = G(L);
+  before = gettotalbytes(g);
+  if (g->gckind == KGC_NORMAL) {
+    g->gckind = KGC_EMERGENCY;
+    do {
+      work += singlestep(L);
+    } while (work < GCEMERGENCYWORK && g->gcstate != GCScallfin &&
+             g->gcstate != GCSpause);
+    g->gckind = KGC_NORMAL;
+    if (g->gcstate == GCSpause)
+      setpause(g);
+  }
+#if LUA_USE_ROTABLE
+  lua_unlock(L);
+  mtx_unlock(&mtx_gc);
+#endif
+  return gettotalbytes(g) < before;
+}
+
+
 /*
 ** Performs a full GC cycle; if 'isemergency', set a flag to avoid
 ** some operations which could change the interpreter state in some
@@ -87,8 +87,12 @@ void *luaM_realloc_ (lua_State *L, void *block, size_t osize, size_t nsize) {
   if (newblock == NULL && nsize > 0) {
     lua_assert(nsize > realosize);  /* cannot fail when shrinking a block */
     if (g->version) {  /* is state fully built? */
-      luaC_fullgc(L, 1);  /* try to free some memory... */
-      newblock = (*g->frealloc)(g->ud, block, osize, nsize);  /* try again */
+      if (luaC_emergencystep(L))  /* try an incremental step first... */
+        newblock = (*g->frealloc)(g->ud, block, osize, nsize);
+      if (newblock == NULL) {
+        luaC_fullgc(L, 1);  /* try to free some memory... */
+        newblock = (*g->frealloc)(g->ud, block, osize, nsize);  /* try again */
+      }
     }
     if (newblock == NULL)
       luaD_throw(L, LUA_ERRMEM);
@@ -598,7 +598,8 @@ static void findloader (lua_State *L, const char *name) {
 
 
 static int ll_require (lua_State *L) {
-  const char *name = luaL_checkstring(L, 1);
+  size_t len;
+  const char *name = luaL_checklstring(L, 1, &len);
   lua_settop(L, 1);  /* LOADED table will be at index 2 */
   lua_getfield(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE);
   lua_getfield(L, 2, name);  /* LOADED[name] */
@@ -607,7 +608,7 @@ static int ll_require (lua_State *L) {
 
 #if LUA_USE_ROTABLE
   // If name is in rotable, package is loaded
-  const TValue *res = luaR_findglobal(name);
+  const TValue *res = luaR_findglobal(name, len);
   if (res) {
     lua_pushrotable(L, (void *)rvalue(res));
     return 1;
@@ -401,6 +401,18 @@ typedef struct LocVar {
 } LocVar;
 
 
+#if CONFIG_LUA_RTOS_LUA_USE_INLINE_CACHE
+/*
+** Inline cache entry, for table accesses with a constant short string key
+*/
+typedef struct ICache {
+  int pc;  /* instruction that owns the entry, -1 if empty */
+  const void *t;  /* table or rotable where the key was found */
+  const TValue *slot;  /* value of the key in 't' */
+} ICache;
+#endif
+
+
 /*
 ** Function Prototypes
 */
@@ -430,6 +442,10 @@ typedef struct Proto {
   int optimized;
   char *icode;
 #endif
+#if CONFIG_LUA_RTOS_LUA_USE_INLINE_CACHE
+  int sizeic;  /* size of 'ic' (power of 2) */
+  ICache *ic;  /* inline caches, built on first execution */
+#endif
 } Proto;
 
 
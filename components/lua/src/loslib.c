@@ -516,6 +516,7 @@ static const LUA_REG_TYPE syslib[] =
   { LSTRKEY( "logcons" ),     LFUNCVAL( os_logcons ) },
   { LSTRKEY( "loglevel" ),    LFUNCVAL( os_loglevel ) },
   { LSTRKEY( "syslog" ),      LFUNCVAL( os_syslog ) },
+  { LSTRKEY( "logstats" ),    LFUNCVAL( os_logstats ) },
 #if CONFIG_LUA_RTOS_USE_RSYSLOG
   { LSTRKEY( "rsyslog" ),     LFUNCVAL( os_setrsyslog ) },
 #endif
@@ -27,6 +27,10 @@
 #include "ltable.h"
 #include "ltm.h"
 
+#if LUA_USE_ROTABLE
+#include "lrotable.h"
+#endif
+
 
 #if !defined(LUAI_GCPAUSE)
 #define LUAI_GCPAUSE	200  /* 200% */
@@ -334,8 +338,14 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   g->frealloc = f;
   g->ud = ud;
   g->mainthread = L;
+#if LUA_USE_ROTABLE
+  /* all the states share the seed of the first one, as the rotable indexes */
+  g->seed = luaR_initseed(makeseed(L));
+#else
   g->seed = makeseed(L);
+#endif
   g->gcrunning = 0;  /* no GC while building state */
+  g->isolated = 0;
   g->GCestimate = 0;
   g->strt.size = g->strt.nuse = 0;
   g->strt.hash = NULL;
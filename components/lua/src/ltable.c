@@ -547,7 +547,7 @@ const TValue *luaH_getint (Table *t, lua_Integer key) {
 const TValue *luaH_getshortstr (Table *t, TString *key) {
 #if LUA_USE_ROTABLE
   if (luaR_isrotable((const void *)t)) {
-	  const TValue *res = luaR_findentry((const void *)t, getstr(key), 0, NULL);
+	  const TValue *res = luaR_findstrentry((const void *)t, key, NULL);
 
 	  if (!res) {
 		 return luaO_nilobject;
@@ -580,7 +580,7 @@ const TValue *luaH_getshortstr (Table *t, TString *key) {
 static const TValue *getgeneric (Table *t, const TValue *key) {
 #if LUA_USE_ROTABLE
   if (luaR_isrotable((const void *)t)) {
-	  const TValue *res = luaR_findentry((const void *)t, getstr(key), 0, NULL);
+	  const TValue *res = ttisstring(key)?luaR_findstrentry((const void *)t, tsvalue(key), NULL):NULL;
 
 	  if (!res) {
 		 return luaO_nilobject;
@@ -896,6 +896,98 @@ void luaV_finishOp (lua_State *L) {
   if (!luaV_fastset(L,t,k,slot,luaH_get,v)) \
     Protect(luaV_finishset(L,t,k,v,slot)); }
 
+#if CONFIG_LUA_RTOS_LUA_USE_INLINE_CACHE
+/*
+** Inline caches. Each GETTABUP / GETTABLE / SELF instruction with a constant
+** short string key remembers the table (or rotable) and the slot where the
+** key was found the last time, so next time the lookup is skipped if the
+** instruction is executed over the same table. Caches are direct mapped by
+** instruction position, and there are at most LUAI_MAXIC entries by function.
+*/
+#define LUAI_MAXIC	64
+
+/* instruction can use an inline cache? */
+static int iscacheable (const Proto *p, Instruction i) {
+  switch (GET_OPCODE(i)) {
+    case OP_GETTABUP: case OP_GETTABLE: case OP_SELF:
+      return ISK(GETARG_C(i)) && ttisshrstring(p->k + INDEXK(GETARG_C(i)));
+    default:
+      return 0;
+  }
+}
+
+static void icinit (lua_State *L, Proto *p) {
+  int n = 0;
+  int size = 1;
+  int pc;
+  for (pc = 0; pc < p->sizecode; pc++) {
+    if (iscacheable(p, p->code[pc]))
+      n++;
+  }
+  while (size < n && size < LUAI_MAXIC)
+    size <<= 1;
+  p->ic = luaM_newvector(L, size, ICache);
+  p->sizeic = size;
+  for (pc = 0; pc < size; pc++)
+    p->ic[pc].pc = -1;
+}
+
+/*
+** get the cached slot of key 'key' in 't' for instruction 'pc', or NULL
+** if the entry is empty, belongs to other instruction, or is stale. Only
+** instructions with a constant key are cached, so the key of a rotable
+** entry doesn't need to be checked.
+*/
+static inline const TValue *icget (const ICache *ic, int pc,
+                                     const TValue *t, TString *key) {
+  if (ic->pc != pc)
+    return NULL;
+#if LUA_USE_ROTABLE
+  if (ttisrotable(t))  /* rotables never change, and the key is constant */
+    return (rvalue(t) == ic->t) ? ic->slot : NULL;
+#endif
+  if (ttistable(t) && hvalue(t) == ic->t) {
+    Table *h = hvalue(t);
+    Node *n = cast(Node *, ic->slot);
+    /* node must be still in the table, with the same key, and not empty */
+    if (cast(size_t, n - h->node) < cast(size_t, sizenode(h)) &&
+        ttisshrstring(gkey(n)) && eqshrstr(tsvalue(gkey(n)), key) &&
+        !ttisnil(gval(n)))
+      return gval(n);
+  }
+  return NULL;
+}
+
+static inline void icset (ICache *ic, int pc, const TValue *t,
+                            const TValue *slot) {
+  ic->pc = pc;
+#if LUA_USE_ROTABLE
+  ic->t = ttisrotable(t) ? rvalue(t) : cast(const void *, hvalue(t));
+#else
+  ic->t = hvalue(t);
+#endif
+  ic->slot = slot;
+}
+
+/*
+** same as 'gettableProtected', but looking first in the inline cache of
+** the current instruction, and updating it when the key is found by the
+** fast track. Only constant keys are cached.
+*/
+#define icgettableProtected(L,t,k,v)  { const TValue *slot; \
+  if (ISK(GETARG_C(i)) && ttisshrstring(k)) { \
+    int pc = pcRel(ci->u.l.savedpc, cl->p); \
+    ICache *ic = &cl->p->ic[pc & (cl->p->sizeic - 1)]; \
+    if ((slot = icget(ic, pc, t, tsvalue(k))) != NULL) \
+      { setobj2s(L, v, slot); } \
+    else if (luaV_fastget(L,t,k,slot,luaH_get)) \
+      { setobj2s(L, v, slot); icset(ic, pc, t, slot); } \
+    else Protect(luaV_finishget(L,t,k,v,slot)); } \
+  else gettableProtected(L,t,k,v); }
+#else
+#define icgettableProtected(L,t,k,v)	gettableProtected(L,t,k,v)
+#endif
+
 #include <lua/common/jit_optimizer.inc>
 
 void luaV_execute(lua_State *L) {
@@ -916,6 +1008,12 @@ void luaV_execute(lua_State *L) {
     }
 #endif
 
+#if CONFIG_LUA_RTOS_LUA_USE_INLINE_CACHE
+    if (!cl->p->ic) {
+        icinit(L, cl->p);
+    }
+#endif
+
     k = cl->p->k; /* local reference to function's constant table */
     base = ci->u.l.base; /* local copy of function's base */
 
@@ -961,13 +1059,13 @@ void luaV_execute(lua_State *L) {
       vmcase(OP_GETTABUP) {
         TValue *upval = cl->upvals[GETARG_B(i)]->v;
         TValue *rc = RKC(i);
-        gettableProtected(L, upval, rc, ra);
+        icgettableProtected(L, upval, rc, ra);
         vmbreak;
       }
       vmcase(OP_GETTABLE) {
         StkId rb = RB(i);
         TValue *rc = RKC(i);
-        gettableProtected(L, rb, rc, ra);
+        icgettableProtected(L, rb, rc, ra);
         vmbreak;
       }
       vmcase(OP_SETTABUP) {
@@ -1013,6 +1111,21 @@ void luaV_execute(lua_State *L) {
         TValue *rc = RKC(i);
         TString *key = tsvalue(rc);  /* key must be a string */
         setobjs2s(L, ra + 1, rb);
+#if CONFIG_LUA_RTOS_LUA_USE_INLINE_CACHE
+        if (ISK(GETARG_C(i)) && ttisshrstring(rc)) {
+          int pc = pcRel(ci->u.l.savedpc, cl->p);
+          ICache *ic = &cl->p->ic[pc & (cl->p->sizeic - 1)];
+          if ((aux = icget(ic, pc, rb, key)) != NULL) {
+            setobj2s(L, ra, aux);
+          }
+          else if (luaV_fastget(L, rb, key, aux, luaH_getstr)) {
+            setobj2s(L, ra, aux);
+            icset(ic, pc, rb, aux);
+          }
+          else Protect(luaV_finishget(L, rb, rc, ra, aux));
+          vmbreak;
+        }
+#endif
         if (luaV_fastget(L, rb, key, aux, luaH_getstr)) {
           setobj2s(L, ra, aux);
         }
@@ -1399,6 +1512,8 @@ void luaV_execute(lua_State *L) {
       }
       vmcase(OP_JMP) {
         dojump(ci, i, 0);
+        if (GETARG_sBx(i) < 0)  /* backward jump? */
+          Protect(luai_threadyield(L));
         vmbreak;
       }
       vmcase(OP_EQ) {
@@ -1516,6 +1631,7 @@ void luaV_execute(lua_State *L) {
             ci->u.l.savedpc += GETARG_sBx(i);  /* jump back */
             chgivalue(ra, idx);  /* update internal index... */
             setivalue(ra + 3, idx);  /* ...and external index */
+            Protect(luai_threadyield(L));
           }
         }
         else {  /* floating loop */
@@ -1527,6 +1643,7 @@ void luaV_execute(lua_State *L) {
             ci->u.l.savedpc += GETARG_sBx(i);  /* jump back */
             chgfltvalue(ra, idx);  /* update internal index... */
             setfltvalue(ra + 3, idx);  /* ...and external index */
+            Protect(luai_threadyield(L));
           }
         }
         vmbreak;
@@ -1577,6 +1694,7 @@ void luaV_execute(lua_State *L) {
         if (!ttisnil(ra + 1)) {  /* continue loop? */
           setobjs2s(L, ra, ra + 1);  /* save control variable */
            ci->u.l.savedpc += GETARG_sBx(i);  /* jump back */
+           Protect(luai_threadyield(L));
         }
         vmbreak;
       }
@@ -0,0 +1,288 @@
+/*
+ * Copyright (C) 2015 - 2020, IBEROXARXA SERVICIOS INTEGRALES, S.L.
+ * Copyright (C) 2015 - 2020, Jaume Olivé Petrus (jolive@whitecatboard.org)
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *     * The WHITECAT logotype cannot be changed, you can remove it, but you
+ *       cannot change it in any way. The WHITECAT logotype is:
+ *
+ *          /\       /\
+ *         /  \_____/  \
+ *        /_____________\
+ *        W H I T E C A T
+ *
+ *     * Redistributions in binary form must retain all copyright notices printed
+ *       to any local or remote output device. This include any reference to
+ *       Lua RTOS, whitecatboard.org, Lua, and other copyright notices that may
+ *       appear in the future.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Lua RTOS, Lua event queue test cases
+ *
+ */
+
+#include "sdkconfig.h"
+
+#include "unity.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "sys.h"
+
+// Events dispatched, in order
+#define EVENT_TEST_LOG 64
+
+typedef struct {
+    int id;
+    int value;
+    char *buffer; // Freed by the release function
+} event_test_t;
+
+static struct {
+    int id;
+    int value;
+} dispatched[EVENT_TEST_LOG];
+
+static volatile int ndispatched;
+static volatile int released;
+
+// While set, the dispatcher is held in the push function of the gate event, so
+// the events posted meanwhile stay in the queue
+static volatile int gate;
+static volatile int gate_entered;
+
+#define EVENT_TEST_GATE -1
+
+static int event_test_push(lua_State *L, void *data) {
+    event_test_t *event = (event_test_t *)data;
+
+    if (event->id == EVENT_TEST_GATE) {
+        gate_entered = 1;
+        while (gate) {
+            vTaskDelay(1);
+        }
+    } else if (ndispatched < EVENT_TEST_LOG) {
+        dispatched[ndispatched].id = event->id;
+        dispatched[ndispatched].value = event->value;
+        ndispatched++;
+    }
+
+    return 0;
+}
+
+static void event_test_merge(void *pending, const void *data) {
+    ((event_test_t *)pending)->value += ((const event_test_t *)data)->value;
+}
+
+static void event_test_release(void *data) {
+    free(((event_test_t *)data)->buffer);
+    released++;
+}
+
+static const lua_event_type_t replace_event = {event_test_push, NULL, event_test_release};
+static const lua_event_type_t merge_event = {event_test_push, event_test_merge, event_test_release};
+
+static int event_test_post(lua_callback_t *callback, uint32_t source, int priority, const lua_event_type_t *type, int id, int value) {
+    event_test_t event;
+
+    event.id = id;
+    event.value = value;
+
+    // Merge runs in a critical section and can't free, so merged events have no buffer
+    event.buffer = (type == &replace_event)?malloc(16):NULL;
+
+    return luaS_event_post(callback, source, priority, type, &event, sizeof(event));
+}
+
+static int event_test_callback(lua_State *L) {
+    return 0;
+}
+
+static lua_State *L;
+
+static lua_callback_t *event_test_create() {
+    lua_callback_t *callback;
+
+    if (!L) {
+        L = luaL_newstate();
+        TEST_ASSERT(L != NULL);
+    }
+
+    lua_settop(L, 0);
+    lua_pushcfunction(L, event_test_callback);
+    callback = luaS_callback_create(L, 1);
+    lua_settop(L, 0);
+
+    TEST_ASSERT(callback != NULL);
+
+    return callback;
+}
+
+static void event_test_close(lua_callback_t *gate_callback) {
+    gate = 1;
+    gate_entered = 0;
+    ndispatched = 0;
+    released = 0;
+
+    TEST_ASSERT(event_test_post(gate_callback, 0, LUA_EVENT_HIGH, &replace_event, EVENT_TEST_GATE, 0) == LUA_EVENT_QUEUED);
+
+    while (!gate_entered) {
+        vTaskDelay(1);
+    }
+}
+
+static void event_test_open(int expected) {
+    int tries;
+
+    gate = 0;
+
+    for(tries = 0;(tries < 100) && (ndispatched < expected);tries++) {
+        vTaskDelay(10 / portTICK_PERIOD_MS);
+    }
+
+    TEST_ASSERT(ndispatched == expected);
+
+    // Let the dispatcher release the last event
+    vTaskDelay(10 / portTICK_PERIOD_MS);
+}
+
+TEST_CASE("lua event coalescing", "[lua event]") {
+    lua_callback_t *gate_callback = event_test_create();
+    lua_callback_t *callback = event_test_create();
+    lua_event_stats_t stats;
+
+    event_test_close(gate_callback);
+    luaS_event_stats(&stats, 1);
+
+    // Same source, the pending event data is replaced
+    TEST_ASSERT(event_test_post(callback, 1, LUA_EVENT_NORMAL, &replace_event, 1, 10) == LUA_EVENT_QUEUED);
+    TEST_ASSERT(event_test_post(callback, 1, LUA_EVENT_NORMAL, &replace_event, 1, 20) == LUA_EVENT_COALESCED);
+    TEST_ASSERT(event_test_post(callback, 1, LUA_EVENT_NORMAL, &replace_event, 1, 30) == LUA_EVENT_COALESCED);
+    TEST_ASSERT(released == 2);
+
+    // Same source, the new event data is merged into the pending one
+    TEST_ASSERT(event_test_post(callback, 2, LUA_EVENT_NORMAL, &merge_event, 2, 1) == LUA_EVENT_QUEUED);
+    TEST_ASSERT(event_test_post(callback, 2, LUA_EVENT_NORMAL, &merge_event, 2, 2) == LUA_EVENT_COALESCED);
+    TEST_ASSERT(event_test_post(callback, 2, LUA_EVENT_NORMAL, &merge_event, 2, 3) == LUA_EVENT_COALESCED);
+
+    // No source, never coalesced
+    TEST_ASSERT(event_test_post(callback, 0, LUA_EVENT_NORMAL, &replace_event, 3, 1) == LUA_EVENT_QUEUED);
+    TEST_ASSERT(event_test_post(callback, 0, LUA_EVENT_NORMAL, &replace_event, 3, 2) == LUA_EVENT_QUEUED);
+
+    luaS_event_stats(&stats, 0);
+    TEST_ASSERT(stats.posted == 8);
+    TEST_ASSERT(stats.coalesced == 4);
+    TEST_ASSERT(stats.pending == 4);
+
+    event_test_open(4);
+
+    TEST_ASSERT((dispatched[0].id == 1) && (dispatched[0].value == 30));
+    TEST_ASSERT((dispatched[1].id == 2) && (dispatched[1].value == 6));
+    TEST_ASSERT((dispatched[2].id == 3) && (dispatched[2].value == 1));
+    TEST_ASSERT((dispatched[3].id == 3) && (dispatched[3].value == 2));
+
+    // Replaced data, dispatched events and the gate one
+    TEST_ASSERT(released == 2 + 4 + 1);
+
+    luaS_callback_destroy(callback);
+    luaS_callback_destroy(gate_callback);
+}
+
+TEST_CASE("lua event priorities and drops", "[lua event]") {
+    lua_callback_t *gate_callback = event_test_create();
+    lua_callback_t *callback = event_test_create();
+    lua_event_stats_t stats;
+    int i;
+
+    event_test_close(gate_callback);
+    luaS_event_stats(&stats, 1);
+
+    // Fill the queue, one slot is taken by the gate event
+    for(i = 0;i < LUA_EVENT_QUEUE_SIZE - 1;i++) {
+        TEST_ASSERT(event_test_post(callback, 0, LUA_EVENT_LOW, &replace_event, 1, i) == LUA_EVENT_QUEUED);
+    }
+
+    // Drops the oldest low priority event
+    TEST_ASSERT(event_test_post(callback, 0, LUA_EVENT_HIGH, &replace_event, 2, 0) == LUA_EVENT_QUEUED);
+    TEST_ASSERT(released == 1);
+
+    // Nothing with a lower priority to drop
+    TEST_ASSERT(event_test_post(callback, 0, LUA_EVENT_LOW, &replace_event, 3, 0) == LUA_EVENT_DROPPED);
+    TEST_ASSERT(released == 2);
+
+    luaS_event_stats(&stats, 0);
+    TEST_ASSERT(stats.dropped == 2);
+    TEST_ASSERT(stats.pending == LUA_EVENT_QUEUE_SIZE - 1);
+
+    event_test_open(LUA_EVENT_QUEUE_SIZE - 1);
+
+    // High priority first, then the low priority ones in order
+    TEST_ASSERT(dispatched[0].id == 2);
+    for(i = 1;i < LUA_EVENT_QUEUE_SIZE - 1;i++) {
+        TEST_ASSERT((dispatched[i].id == 1) && (dispatched[i].value == i));
+    }
+
+    luaS_callback_destroy(callback);
+    luaS_callback_destroy(gate_callback);
+}
+
+TEST_CASE("lua event callback destroy", "[lua event]") {
+    lua_callback_t *gate_callback = event_test_create();
+    lua_callback_t *callback = event_test_create();
+    lua_callback_t *other = event_test_create();
+    lua_event_stats_t stats;
+    int i;
+
+    event_test_close(gate_callback);
+
+    for(i = 0;i < 3;i++) {
+        TEST_ASSERT(event_test_post(callback, 0, LUA_EVENT_NORMAL, &replace_event, 1, i) == LUA_EVENT_QUEUED);
+        TEST_ASSERT(event_test_post(other, 0, LUA_EVENT_NORMAL, &replace_event, 2, i) == LUA_EVENT_QUEUED);
+    }
+
+    // The pending events of the callback are discarded, and their data released
+    luaS_callback_destroy(callback);
+    TEST_ASSERT(released == 3);
+
+    event_test_open(3);
+
+    for(i = 0;i < 3;i++) {
+        TEST_ASSERT((dispatched[i].id == 2) && (dispatched[i].value == i));
+    }
+
+    TEST_ASSERT(released == 3 + 3 + 1);
+
+    luaS_event_stats(&stats, 0);
+    TEST_ASSERT(stats.pending == 0);
+
+    luaS_callback_destroy(other);
+    luaS_callback_destroy(gate_callback);
+}
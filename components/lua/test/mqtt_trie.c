@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2015 - 2020, IBEROXARXA SERVICIOS INTEGRALES, S.L.
+ * Copyright (C) 2015 - 2020, Jaume Olivé Petrus (jolive@whitecatboard.org)
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *     * The WHITECAT logotype cannot be changed, you can remove it, but you
+ *       cannot change it in any way. The WHITECAT logotype is:
+ *
+ *          /\       /\
+ *         /  \_____/  \
+ *        /_____________\
+ *        W H I T E C A T
+ *
+ *     * Redistributions in binary form must retain all copyright notices printed
+ *       to any local or remote output device. This include any reference to
+ *       Lua RTOS, whitecatboard.org, Lua, and other copyright notices that may
+ *       appear in the future.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Lua RTOS, MQTT subscription trie test cases
+ *
+ */
+
+#include "luartos.h"
+
+#if CONFIG_LUA_RTOS_LUA_USE_MQTT
+
+#include "unity.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "mqtt_trie.h"
+
+// Test filters. The subscriptions of filter n are &ids[n], and the matches
+// are collected as a bit mask.
+static const char *filters[] = {
+    "a/b", "a/+", "a/#", "#", "+/b", "$SYS/#", "+/+/c", "a/b/c"
+};
+
+#define FILTERS (sizeof(filters) / sizeof(filters[0]))
+
+static int ids[FILTERS];
+
+static void deliver(void *subs, void *arg) {
+    *(uint32_t *)arg |= 1 << ((int *)subs - ids);
+}
+
+static void trie_build(mqtt_node *root) {
+    mqtt_node *node;
+    int i;
+
+    memset(root, 0, sizeof(mqtt_node));
+
+    for (i = 0; i < FILTERS; i++) {
+        node = mqtt_trie_add(root, filters[i]);
+        TEST_ASSERT(node != NULL);
+        TEST_ASSERT(node->subs == NULL);
+
+        node->subs = &ids[i];
+    }
+}
+
+static uint32_t trie_match(mqtt_node *root, const char *topic) {
+    uint32_t matched = 0;
+
+    mqtt_trie_match(root, topic, strlen(topic), deliver, &matched);
+
+    return matched;
+}
+
+#define F(n) (1 << (n))
+
+TEST_CASE("mqtt trie match", "[mqtt]") {
+    mqtt_node root;
+
+    trie_build(&root);
+
+    TEST_ASSERT(trie_match(&root, "a/b") == (F(0) | F(1) | F(2) | F(3) | F(4)));
+    TEST_ASSERT(trie_match(&root, "a/b/c") == (F(2) | F(3) | F(6) | F(7)));
+    TEST_ASSERT(trie_match(&root, "x/b") == (F(3) | F(4)));
+    TEST_ASSERT(trie_match(&root, "x/y/z") == F(3));
+
+    // '#' also matches the parent level, '+' matches an empty level
+    TEST_ASSERT(trie_match(&root, "a") == (F(2) | F(3)));
+    TEST_ASSERT(trie_match(&root, "a/") == (F(1) | F(2) | F(3)));
+
+    // Wildcards don't match the first level of topics starting with '$'
+    TEST_ASSERT(trie_match(&root, "$SYS/uptime") == F(5));
+    TEST_ASSERT(trie_match(&root, "$SYS") == F(5));
+    TEST_ASSERT(trie_match(&root, "$other/b") == 0);
+
+    // Topic is not NUL terminated
+    uint32_t matched = 0;
+    mqtt_trie_match(&root, "a/b/c", 3, deliver, &matched);
+    TEST_ASSERT(matched == (F(0) | F(1) | F(2) | F(3) | F(4)));
+
+    mqtt_trie_free(&root);
+
+    TEST_ASSERT(root.child == NULL);
+    TEST_ASSERT(root.plus == NULL);
+    TEST_ASSERT(root.hash == NULL);
+    TEST_ASSERT(trie_match(&root, "a/b") == 0);
+}
+
+TEST_CASE("mqtt trie shared levels", "[mqtt]") {
+    mqtt_node root;
+    mqtt_node *node;
+
+    trie_build(&root);
+
+    // Existing filters get the same node
+    node = mqtt_trie_add(&root, "a/b");
+    TEST_ASSERT(node->subs == &ids[0]);
+
+    node = mqtt_trie_add(&root, "+/+/c");
+    TEST_ASSERT(node->subs == &ids[6]);
+
+    // '#' is a plain level if it's not the last one
+    node = mqtt_trie_add(&root, "#/b");
+    TEST_ASSERT(node != NULL);
+    TEST_ASSERT(node->subs == NULL);
+    TEST_ASSERT(root.hash->subs == &ids[3]);
+
+    mqtt_trie_free(&root);
+}
+
+TEST_CASE("mqtt trie prune", "[mqtt]") {
+    mqtt_node root;
+    mqtt_node *node;
+
+    trie_build(&root);
+
+    // Levels without subscriptions are removed, up to the first one in use
+    node = mqtt_trie_add(&root, "a/b/c/d/e");
+    TEST_ASSERT(node != NULL);
+
+    mqtt_trie_prune(&root, "a/b/c/d/e");
+    node = mqtt_trie_add(&root, "a/b/c");
+    TEST_ASSERT(node->subs == &ids[7]);
+    TEST_ASSERT(node->child == NULL);
+
+    node = mqtt_trie_add(&root, "x/+/#");
+    TEST_ASSERT(node != NULL);
+
+    mqtt_trie_prune(&root, "x/+/#");
+    TEST_ASSERT(trie_match(&root, "x/y/z") == F(3));
+
+    // The only level "x" was removed
+    node = root.child;
+    while (node) {
+        TEST_ASSERT((node->len != 1) || (node->level[0] != 'x'));
+        node = node->next;
+    }
+
+    // Levels in use, and filters not in the trie, are left untouched
+    mqtt_trie_prune(&root, "a/b");
+    mqtt_trie_prune(&root, "y/z");
+    mqtt_trie_prune(&root, "+/+");
+
+    TEST_ASSERT(trie_match(&root, "a/b") == (F(0) | F(1) | F(2) | F(3) | F(4)));
+    TEST_ASSERT(trie_match(&root, "a/b/c") == (F(2) | F(3) | F(6) | F(7)));
+
+    mqtt_trie_free(&root);
+}
+
+static void count(void *subs, void *arg) {
+    (*(uint32_t *)arg)++;
+}
+
+static int64_t trie_us(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+TEST_CASE("mqtt trie throughput", "[mqtt][bench]") {
+    static char topics[256][16];
+    static int subs[256];
+    mqtt_node root;
+    mqtt_node *node;
+    uint32_t matched = 0;
+    int64_t t0;
+    int i;
+
+    // 256 filters: 64 topics, each one with and without wildcards
+    memset(&root, 0, sizeof(mqtt_node));
+
+    for (i = 0; i < 256; i++) {
+        switch (i & 3) {
+            case 0: sprintf(topics[i], "s%d/t/v", i >> 2); break;
+            case 1: sprintf(topics[i], "s%d/+/v", i >> 2); break;
+            case 2: sprintf(topics[i], "s%d/#", i >> 2); break;
+            case 3: sprintf(topics[i], "+/t%d", i >> 2); break;
+        }
+
+        node = mqtt_trie_add(&root, topics[i]);
+        TEST_ASSERT(node != NULL);
+
+        node->subs = &subs[i];
+    }
+
+    t0 = trie_us();
+    for (i = 0; i < 10000; i++) {
+        mqtt_trie_match(&root, topics[(i & 63) << 2], strlen(topics[(i & 63) << 2]), count, &matched);
+    }
+    t0 = trie_us() - t0;
+
+    // Each topic matches its own filter, the '+' one and the '#' one
+    TEST_ASSERT(matched == 3 * 10000);
+
+    printf("mqtt trie: 10000 messages, 256 filters, %lld us\n", t0);
+
+    mqtt_trie_free(&root);
+}
+
+#endif
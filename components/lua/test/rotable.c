@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2015 - 2020, IBEROXARXA SERVICIOS INTEGRALES, S.L.
+ * Copyright (C) 2015 - 2020, Jaume Olivé Petrus (jolive@whitecatboard.org)
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *     * The WHITECAT logotype cannot be changed, you can remove it, but you
+ *       cannot change it in any way. The WHITECAT logotype is:
+ *
+ *          /\       /\
+ *         /  \_____/  \
+ *        /_____________\
+ *        W H I T E C A T
+ *
+ *     * Redistributions in binary form must retain all copyright notices printed
+ *       to any local or remote output device. This include any reference to
+ *       Lua RTOS, whitecatboard.org, Lua, and other copyright notices that may
+ *       appear in the future.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Lua RTOS, read only table lookup test cases
+ *
+ */
+
+#include "sdkconfig.h"
+
+#include "unity.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "lua.h"
+
+#if LUA_USE_ROTABLE
+
+#include "lrotable.h"
+#include "lstring.h"
+
+extern const luaR_entry lua_rotable[];
+
+// Lookup rounds done in the benchmark
+#define ROTABLE_BENCH_ROUNDS 200
+
+// Reference lookup, a linear scan that compares the keys with strlen and
+// strncmp, as rotables were looked up before they were indexed
+static const TValue *linear_find(const luaR_entry *entry, const char *key) {
+    size_t len = strlen(key);
+
+    while (entry->key.id.strkey) {
+        if ((entry->key.type == LUA_TSTRING) && (strlen(entry->key.id.strkey) == len) &&
+            (strncmp(entry->key.id.strkey, key, len) == 0)) {
+            return &entry->value;
+        }
+
+        entry++;
+    }
+
+    return NULL;
+}
+
+static int64_t rotable_us(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void rotable_seed(void) {
+    // The seed is set by the first Lua state, and the test may run before it
+    if (luaR_seed() == 0) {
+        luaR_initseed(0x5eed);
+    }
+}
+
+TEST_CASE("rotable lookup", "[lua]") {
+    const luaR_entry *module;
+    const luaR_entry *entry;
+    const TValue *value;
+    unsigned pos;
+
+    rotable_seed();
+
+    for (module = lua_rotable; module->key.id.strkey; module++) {
+        if (module->key.type != LUA_TSTRING) continue;
+
+        // Modules are found by name
+        value = luaR_findglobal(module->key.id.strkey, strlen(module->key.id.strkey));
+        TEST_ASSERT(value == linear_find(lua_rotable, module->key.id.strkey));
+
+        if (!ttisrotable(&module->value)) continue;
+
+        // Every key of the module is found, with its position
+        for (entry = rvalue(&module->value); entry->key.id.strkey; entry++) {
+            if (entry->key.type != LUA_TSTRING) continue;
+
+            value = luaR_findentry(rvalue(&module->value), entry->key.id.strkey, 0, &pos);
+            TEST_ASSERT(value != NULL);
+            TEST_ASSERT(value == linear_find(rvalue(&module->value), entry->key.id.strkey));
+            TEST_ASSERT(value == &((const luaR_entry *)rvalue(&module->value))[pos].value);
+        }
+
+        // Keys that are not in the module are not found
+        TEST_ASSERT(luaR_findentry(rvalue(&module->value), "__not_a_key__", 0, NULL) == NULL);
+    }
+
+    TEST_ASSERT(luaR_findglobal("__not_a_module__", 16) == NULL);
+}
+
+TEST_CASE("rotable lookup throughput", "[lua][bench]") {
+    const luaR_entry *module;
+    const luaR_entry *entry;
+    const TValue *found = NULL;
+    int64_t indexed = 0, linear;
+    int lookups = 0;
+    int round;
+
+    rotable_seed();
+
+    // Index lookups. The first round also builds the indexes, so it is not timed.
+    for (round = 0; round <= ROTABLE_BENCH_ROUNDS; round++) {
+        if (round == 1) {
+            indexed = rotable_us();
+        }
+
+        for (module = lua_rotable; module->key.id.strkey; module++) {
+            if ((module->key.type != LUA_TSTRING) || !ttisrotable(&module->value)) continue;
+
+            for (entry = rvalue(&module->value); entry->key.id.strkey; entry++) {
+                if (entry->key.type != LUA_TSTRING) continue;
+
+                found = luaR_findentry(rvalue(&module->value), entry->key.id.strkey, 0, NULL);
+                if (round > 0) lookups++;
+            }
+        }
+    }
+    indexed = rotable_us() - indexed;
+    TEST_ASSERT(found != NULL);
+
+    // Reference lookups, with the same keys
+    linear = rotable_us();
+    for (round = 0; round < ROTABLE_BENCH_ROUNDS; round++) {
+        for (module = lua_rotable; module->key.id.strkey; module++) {
+            if ((module->key.type != LUA_TSTRING) || !ttisrotable(&module->value)) continue;
+
+            for (entry = rvalue(&module->value); entry->key.id.strkey; entry++) {
+                if (entry->key.type != LUA_TSTRING) continue;
+
+                found = linear_find(rvalue(&module->value), entry->key.id.strkey);
+            }
+        }
+    }
+    linear = rotable_us() - linear;
+    TEST_ASSERT(found != NULL);
+
+    if (indexed == 0) indexed = 1;
+    if (linear == 0) linear = 1;
+
+    printf("rotable: %d lookups, indexed %lld us (%lld lookups/s), linear %lld us (%lld lookups/s)\n",
+        lookups, indexed, (int64_t)lookups * 1000000 / indexed, linear, (int64_t)lookups * 1000000 / linear);
+}
+
+#endif
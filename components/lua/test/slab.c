@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2015 - 2020, IBEROXARXA SERVICIOS INTEGRALES, S.L.
+ * Copyright (C) 2015 - 2020, Jaume Olivé Petrus (jolive@whitecatboard.org)
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *     * The WHITECAT logotype cannot be changed, you can remove it, but you
+ *       cannot change it in any way. The WHITECAT logotype is:
+ *
+ *          /\       /\
+ *         /  \_____/  \
+ *        /_____________\
+ *        W H I T E C A T
+ *
+ *     * Redistributions in binary form must retain all copyright notices printed
+ *       to any local or remote output device. This include any reference to
+ *       Lua RTOS, whitecatboard.org, Lua, and other copyright notices that may
+ *       appear in the future.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Lua RTOS, Lua heap size-class allocator test cases
+ *
+ */
+
+#include "sdkconfig.h"
+
+#if CONFIG_LUA_RTOS_LUA_USE_SLAB_ALLOCATOR
+
+#include "unity.h"
+
+#include "esp_heap_caps.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "slab.h"
+
+// Objects live at the same time in the trace
+#define SLAB_TRACE_SLOTS 512
+
+// Operations in the trace
+#define SLAB_TRACE_OPS 20000
+
+typedef void *(*slab_test_alloc_t)(void *ptr, size_t osize, size_t nsize);
+
+typedef struct {
+    int64_t us;         // Time spent in the allocation function
+    size_t free;        // Free heap with the live objects of the trace
+    size_t largest;     // Largest free block with the live objects of the trace
+} slab_trace_result_t;
+
+static void *objs[SLAB_TRACE_SLOTS];
+static size_t sizes[SLAB_TRACE_SLOTS];
+
+// Allocation function used by Lua when the size-class allocator is not used
+static void *malloc_realloc(void *ptr, size_t osize, size_t nsize) {
+    if (nsize == 0) {
+        free(ptr);
+        return NULL;
+    }
+
+    return realloc(ptr, nsize);
+}
+
+static int64_t slab_us(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+// Fill an object with a pattern that depends on its slot
+static void obj_fill(int slot) {
+    memset(objs[slot], slot & 0xff, sizes[slot]);
+}
+
+static int obj_check(int slot, size_t size) {
+    const uint8_t *p = objs[slot];
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        if (p[i] != (slot & 0xff)) return 0;
+    }
+
+    return 1;
+}
+
+/*
+ * Replay an allocation trace similar to the one of a Lua state: mostly
+ * objects of 16 to 64 bytes (strings, tables, closures, upvalues), some
+ * greater objects (arrays, buffers), objects that grow, and objects freed in
+ * any order. The trace is generated from a fixed seed, so it is the same for
+ * every allocation function. Half of the objects are left allocated at the
+ * end, when the heap is measured, and then they are freed.
+ */
+static void slab_trace(slab_test_alloc_t f, slab_trace_result_t *res) {
+    uint32_t seed = 1;
+    size_t size, osize;
+    int64_t t0;
+    int op, slot;
+
+    memset(objs, 0, sizeof(objs));
+    memset(sizes, 0, sizeof(sizes));
+
+    res->us = 0;
+
+    for (op = 0; op < SLAB_TRACE_OPS; op++) {
+        seed = seed * 1103515245 + 12345;
+        slot = (seed >> 8) % SLAB_TRACE_SLOTS;
+
+        if ((seed >> 28) < 12) {
+            size = 12 + ((seed >> 20) % 53);
+        } else {
+            size = 65 + ((seed >> 18) % 448);
+        }
+
+        osize = sizes[slot];
+        if (objs[slot] && ((seed >> 4) & 3) == 0) {
+            // Grow
+            size = osize + 8;
+        } else if (objs[slot] && ((seed >> 4) & 3) == 1) {
+            // Free
+            size = 0;
+        }
+
+        t0 = slab_us();
+        objs[slot] = f(objs[slot], osize, size);
+        res->us += slab_us() - t0;
+
+        TEST_ASSERT((size == 0) || (objs[slot] != NULL));
+        TEST_ASSERT(obj_check(slot, (osize < size)?osize:size));
+
+        sizes[slot] = size;
+        if (size) {
+            obj_fill(slot);
+        }
+    }
+
+    for (slot = 0; slot < SLAB_TRACE_SLOTS; slot += 2) {
+        objs[slot] = f(objs[slot], sizes[slot], 0);
+        sizes[slot] = 0;
+    }
+
+    res->free = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    res->largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+
+    for (slot = 1; slot < SLAB_TRACE_SLOTS; slot += 2) {
+        TEST_ASSERT(obj_check(slot, sizes[slot]));
+        objs[slot] = f(objs[slot], sizes[slot], 0);
+        sizes[slot] = 0;
+    }
+}
+
+TEST_CASE("slab realloc", "[lua]") {
+    void *p, *q;
+    int i;
+
+    // New objects, with the object type as osize, as Lua does
+    p = slab_realloc(NULL, 5, 24);
+    TEST_ASSERT(p != NULL);
+    memset(p, 0xa5, 24);
+
+    // Same class, the object doesn't move
+    TEST_ASSERT(slab_realloc(p, 24, 20) == p);
+
+    // Other class, the content is kept
+    q = slab_realloc(p, 20, 40);
+    TEST_ASSERT(q != NULL);
+    for (i = 0; i < 20; i++) {
+        TEST_ASSERT(((uint8_t *)q)[i] == 0xa5);
+    }
+
+    // Out of the small objects, and back
+    p = slab_realloc(q, 40, SLAB_MAX_SIZE + 100);
+    TEST_ASSERT(p != NULL);
+    for (i = 0; i < 20; i++) {
+        TEST_ASSERT(((uint8_t *)p)[i] == 0xa5);
+    }
+
+    q = slab_realloc(p, SLAB_MAX_SIZE + 100, 16);
+    TEST_ASSERT(q != NULL);
+    for (i = 0; i < 16; i++) {
+        TEST_ASSERT(((uint8_t *)q)[i] == 0xa5);
+    }
+
+    TEST_ASSERT(slab_realloc(q, 16, 0) == NULL);
+    TEST_ASSERT(slab_realloc(NULL, 0, 0) == NULL);
+}
+
+TEST_CASE("slab trace replay", "[lua][bench]") {
+    slab_trace_result_t slab, heap;
+
+    // Allocate the arena before measuring anything
+    slab_realloc(slab_realloc(NULL, 0, 16), 16, 0);
+
+    slab_trace(malloc_realloc, &heap);
+    slab_trace(slab_realloc, &slab);
+
+    printf("slab: %d ops, malloc %lld us, free %u, largest block %u\n",
+        SLAB_TRACE_OPS, heap.us, heap.free, heap.largest);
+    printf("slab: %d ops, slab %lld us, free %u, largest block %u\n",
+        SLAB_TRACE_OPS, slab.us, slab.free, slab.largest);
+
+    slab_dump(NULL);
+}
+
+#endif
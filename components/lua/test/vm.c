@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2015 - 2020, IBEROXARXA SERVICIOS INTEGRALES, S.L.
+ * Copyright (C) 2015 - 2020, Jaume Olivé Petrus (jolive@whitecatboard.org)
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *     * The WHITECAT logotype cannot be changed, you can remove it, but you
+ *       cannot change it in any way. The WHITECAT logotype is:
+ *
+ *          /\       /\
+ *         /  \_____/  \
+ *        /_____________\
+ *        W H I T E C A T
+ *
+ *     * Redistributions in binary form must retain all copyright notices printed
+ *       to any local or remote output device. This include any reference to
+ *       Lua RTOS, whitecatboard.org, Lua, and other copyright notices that may
+ *       appear in the future.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Lua RTOS, Lua VM loop benchmark test cases
+ *
+ */
+
+#include "sdkconfig.h"
+
+#include "unity.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+#include "lstate.h"
+
+// Iterations of each loop
+#define VM_BENCH_LOOPS 20000
+
+typedef struct {
+    const char *name;
+    const char *code; // Loop body, run VM_BENCH_LOOPS times with i as index
+} vm_bench_t;
+
+// Loops, each one stresses the instructions that index globals, modules or
+// tables (GETTABUP, GETTABLE, SETTABLE and SELF)
+static const vm_bench_t vm_bench[] = {
+    {"global",        "g = g + 1"},
+    {"module const",  "x = math.pi"},
+    {"module call",   "x = math.abs(-i)"},
+    {"local module",  "x = lm.max(i, 10)"},
+    {"table field",   "t.a = t.b + i"},
+    {"table index",   "t[1] = t[2] + i"},
+    {"method call",   "x = s:len()"},
+    {"string.sub",    "x = string.sub(s, 2, 4)"},
+    {"string.format", "x = string.format('%d', i)"},
+};
+
+#define VM_BENCHS (sizeof(vm_bench) / sizeof(vm_bench[0]))
+
+// Build options that change the speed of the loops
+static const char vm_config[] = ""
+#if CONFIG_LUA_RTOS_LUA_USE_LOCKS
+    " locks"
+#endif
+#if CONFIG_LUA_RTOS_LUA_USE_ROTABLE_CACHE
+    " rotable-index"
+#endif
+#if CONFIG_LUA_RTOS_LUA_USE_INLINE_CACHE
+    " inline-cache"
+#endif
+#if CONFIG_LUA_RTOS_LUA_USE_JIT_BYTECODE_OPTIMIZER
+    " jit-optimizer"
+#endif
+;
+
+static int64_t vm_us(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+TEST_CASE("lua vm loop throughput", "[lua][bench]") {
+    char code[256];
+    lua_State *L;
+    int64_t t0;
+    int i;
+
+    // The state is isolated, as worker states are, so it doesn't need the
+    // global Lua lock, that is initialized by the Lua RTOS main task
+    L = luaL_newstate();
+    TEST_ASSERT(L != NULL);
+
+    G(L)->isolated = 1;
+
+    luaL_openlibs(L);
+
+    printf("lua vm: options:%s\n", vm_config);
+
+    for (i = 0; i < VM_BENCHS; i++) {
+        snprintf(code, sizeof(code),
+            "g = 0 t = {a = 1, b = 2, 1, 2} s = 'abcdef' "
+            "return function() local t, s, lm = t, s, math "
+            "for i = 1, %d do %s end return g end",
+            VM_BENCH_LOOPS, vm_bench[i].code);
+
+        TEST_ASSERT(luaL_dostring(L, code) == LUA_OK);
+
+        t0 = vm_us();
+        TEST_ASSERT(lua_pcall(L, 0, 1, 0) == LUA_OK);
+        t0 = vm_us() - t0;
+
+        // Only the first loop counts in g
+        TEST_ASSERT(lua_tointeger(L, -1) == ((i == 0)?VM_BENCH_LOOPS:0));
+        lua_pop(L, 1);
+
+        if (t0 == 0) t0 = 1;
+
+        printf("lua vm: %-13s %d ops, %lld us, %lld ops/s\n",
+            vm_bench[i].name, VM_BENCH_LOOPS, t0, (int64_t)VM_BENCH_LOOPS * 1000000 / t0);
+    }
+
+    lua_close(L);
+}
@@ -280,6 +280,7 @@ typedef struct
 			void* payload;
 			int qos;
 			int retained;
+			int batch; /* payload holds this number of encoded QoS 0 packets */
 		} pub;
 		struct
 		{
@@ -1379,6 +1380,16 @@ static int MQTTAsync_processCommand(void)
 		rc = MQTTProtocol_unsubscribe(command->client->c, topics, command->command.token);
 		ListFreeNoContent(topics);
 	}
+	else if (command->command.type == PUBLISH && command->command.details.pub.batch)
+	{
+		rc = MQTTPacket_send_encoded(&command->client->c->net, command->command.details.pub.payload,
+				command->command.details.pub.payloadlen);
+		if (rc == TCPSOCKET_INTERRUPTED)
+		{
+			command->command.details.pub.payload = NULL; /* this will be freed by the socket buffer */
+			command->client->pending_write = &command->command;
+		}
+	}
 	else if (command->command.type == PUBLISH)
 	{
 		Messages* msg = NULL;
@@ -3114,6 +3125,98 @@ exit:
 
 
 
+int MQTTAsync_sendMessages(MQTTAsync handle, int count, char* const* destinationNames, const MQTTAsync_message* messages)
+{
+	int rc = MQTTASYNC_SUCCESS;
+	MQTTAsyncs* m = handle;
+	MQTTAsync_queuedCommand* pub;
+	size_t total = 0;
+	char* buf;
+	char* ptr;
+	int i;
+
+	FUNC_ENTRY;
+	if (m == NULL || m->c == NULL)
+		rc = MQTTASYNC_FAILURE;
+	else if (count <= 0 || destinationNames == NULL || messages == NULL)
+		rc = MQTTASYNC_NULL_PARAMETER;
+	else if (m->c->connected == 0 && (m->createOptions == NULL ||
+		m->createOptions->sendWhileDisconnected == 0 || m->shouldBeConnected == 0))
+		rc = MQTTASYNC_DISCONNECTED;
+	else if (m->createOptions && (MQTTAsync_countBufferedMessages(m) >= m->createOptions->maxBufferedMessages))
+		rc = MQTTASYNC_MAX_BUFFERED_MESSAGES;
+
+	for (i = 0; i < count && rc == MQTTASYNC_SUCCESS; i++)
+	{
+		if (strncmp(messages[i].struct_id, "MQTM", 4) != 0 || messages[i].struct_version != 0)
+			rc = MQTTASYNC_BAD_STRUCTURE;
+		else if (!UTF8_validateString(destinationNames[i]))
+			rc = MQTTASYNC_BAD_UTF8_STRING;
+		else if (messages[i].qos != 0)
+			rc = MQTTASYNC_BAD_QOS;
+		else /* fixed header is at most 5 bytes, topic length is 2 */
+			total += 5 + 2 + strlen(destinationNames[i]) + messages[i].payloadlen;
+	}
+
+	if (rc != MQTTASYNC_SUCCESS)
+		goto exit;
+
+#if !defined(NO_PERSISTENCE)
+	/* persisted commands hold one message each */
+	if (m->c->persistence)
+	{
+		for (i = 0; i < count && rc == MQTTASYNC_SUCCESS; i++)
+			rc = MQTTAsync_send(handle, destinationNames[i], messages[i].payloadlen, messages[i].payload,
+					0, messages[i].retained, NULL);
+		goto exit;
+	}
+#endif
+
+	if ((buf = malloc(total)) == NULL)
+	{
+		rc = MQTTASYNC_FAILURE;
+		goto exit;
+	}
+
+	ptr = buf;
+	for (i = 0; i < count; i++)
+	{
+		Header header;
+		int topiclen = (int)strlen(destinationNames[i]);
+
+		header.byte = 0;
+		header.bits.type = PUBLISH;
+		header.bits.retain = messages[i].retained;
+		*ptr++ = header.byte;
+		ptr += MQTTPacket_encode(ptr, 2 + topiclen + messages[i].payloadlen);
+		writeInt(&ptr, topiclen);
+		memcpy(ptr, destinationNames[i], topiclen);
+		ptr += topiclen;
+		memcpy(ptr, messages[i].payload, messages[i].payloadlen);
+		ptr += messages[i].payloadlen;
+	}
+
+	/* Add publish request to operation queue */
+	if ((pub = malloc(sizeof(MQTTAsync_queuedCommand))) == NULL)
+	{
+		free(buf);
+		rc = MQTTASYNC_FAILURE;
+		goto exit;
+	}
+	memset(pub, '\0', sizeof(MQTTAsync_queuedCommand));
+	pub->client = m;
+	pub->command.type = PUBLISH;
+	pub->command.details.pub.payloadlen = (int)(ptr - buf);
+	pub->command.details.pub.payload = buf;
+	pub->command.details.pub.batch = count;
+	rc = MQTTAsync_addCommand(pub, sizeof(pub));
+
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
 int MQTTAsync_sendMessage(MQTTAsync handle, const char* destinationName, const MQTTAsync_message* message,
 													 MQTTAsync_responseOptions* response)
 {
@@ -1056,6 +1056,24 @@ DLLExport int MQTTAsync_send(MQTTAsync handle, const char* destinationName, int
 DLLExport int MQTTAsync_sendMessage(MQTTAsync handle, const char* destinationName, const MQTTAsync_message* msg, MQTTAsync_responseOptions* response);
 
 
+/**
+  * This function publishes several QoS 0 messages at once. The messages are
+  * encoded into a single buffer, which is written to the network in one go, in
+  * the order given. If the client uses persistence, the messages are queued
+  * one by one, as with MQTTAsync_sendMessage().
+  * @param handle A valid client handle from a successful call to
+  * MQTTAsync_create().
+  * @param count The number of messages.
+  * @param destinationNames An array of the topics associated with each message.
+  * @param msgs An array of valid MQTTAsync_message structures containing
+  * the payload and attributes of each message. The qos of all the messages
+  * must be 0.
+  * @return ::MQTTASYNC_SUCCESS if the messages are accepted for publication.
+  * An error code is returned if there was a problem accepting the messages.
+  */
+DLLExport int MQTTAsync_sendMessages(MQTTAsync handle, int count, char* const* destinationNames, const MQTTAsync_message* msgs);
+
+
 /**
   * This function sets a pointer to an array of tokens for
   * messages that are currently in-flight (pending completion).
@@ -31,6 +31,7 @@
 #endif
 #include "Messages.h"
 #include "StackTrace.h"
+#include "Pool.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -157,18 +158,12 @@ void* MQTTPacket_Factory(networkHandles* net, int* error)
 			else if (header.bits.type == PUBLISH && header.bits.qos == 2)
 			{
 				int buf0len;
-				char *buf = malloc(10);
-#if __XTENSA__
-        if (buf) {
-#endif
+				char buf[10];
+
 				buf[0] = header.byte;
 				buf0len = 1 + MQTTPacket_encode(&buf[1], remaining_length);
 				*error = MQTTPersistence_put(net->socket, buf, buf0len, 1,
 					&data, &remaining_length, header.bits.type, ((Publish *)pack)->msgId, 1);
-				free(buf);
-#if __XTENSA__
-        }
-#endif
 			}
 #endif
 		}
@@ -197,7 +192,7 @@ int MQTTPacket_send(networkHandles* net, Header header, char* buffer, size_t buf
 	int count = 0;
 
 	FUNC_ENTRY;
-	buf = malloc(10);
+	buf = Pool_malloc(10);
 #if __XTENSA__
   rc = 0;
   if (buf) {
@@ -229,7 +224,7 @@ int MQTTPacket_send(networkHandles* net, Header header, char* buffer, size_t buf
 		time(&(net->lastSent));
 	
 	if (rc != TCPSOCKET_INTERRUPTED)
-	  free(buf);
+	  Pool_free(buf);
 #if __XTENSA__
   }
 #endif
@@ -255,7 +250,7 @@ int MQTTPacket_sends(networkHandles* net, Header header, int count, char** buffe
 	char *buf;
 
 	FUNC_ENTRY;
-	buf = malloc(10);
+	buf = Pool_malloc(10);
 #if __XTENSA__
   rc = 0;
   if (buf) {
@@ -284,7 +279,7 @@ int MQTTPacket_sends(networkHandles* net, Header header, int count, char** buffe
 		time(&(net->lastSent));
 	
 	if (rc != TCPSOCKET_INTERRUPTED)
-	  free(buf);
+	  Pool_free(buf);
 
 #if __XTENSA__
   }
@@ -596,7 +591,7 @@ static int MQTTPacket_send_ack(int type, int msgid, int dup, networkHandles *net
 {
 	Header header;
 	int rc;
-	char *buf = malloc(2);
+	char *buf = Pool_malloc(2);
 	char *ptr = buf;
 
 	FUNC_ENTRY;
@@ -611,7 +606,7 @@ static int MQTTPacket_send_ack(int type, int msgid, int dup, networkHandles *net
 	    header.bits.qos = 1;
 	writeInt(&ptr, msgid);
 	if ((rc = MQTTPacket_send(net, header, buf, 2, 1)) != TCPSOCKET_INTERRUPTED)
-		free(buf);
+		Pool_free(buf);
 #if __XTENSA__
   }
 #endif
@@ -720,7 +715,7 @@ int MQTTPacket_send_pubcomp(int msgid, networkHandles* net, const char* clientID
  */
 void* MQTTPacket_ack(unsigned char aHeader, char* data, size_t datalen)
 {
-	Ack* pack = malloc(sizeof(Ack));
+	Ack* pack = Pool_malloc(sizeof(Ack));
 	char* curdata = data;
 
 	FUNC_ENTRY;
@@ -754,7 +749,7 @@ int MQTTPacket_send_publish(Publish* pack, int dup, int qos, int retained, netwo
 	int rc = -1;
 
 	FUNC_ENTRY;
-	topiclen = malloc(2);
+	topiclen = Pool_malloc(2);
 #if __XTENSA__
   if (pack && net && topiclen) {
 #endif
@@ -765,7 +760,7 @@ int MQTTPacket_send_publish(Publish* pack, int dup, int qos, int retained, netwo
 	header.bits.retain = retained;
 	if (qos > 0)
 	{
-		char *buf = malloc(2);
+		char *buf = Pool_malloc(2);
 #if __XTENSA__
     if (buf) {
 #endif
@@ -779,7 +774,7 @@ int MQTTPacket_send_publish(Publish* pack, int dup, int qos, int retained, netwo
 		writeInt(&ptr, (int)lens[1]);
 		rc = MQTTPacket_sends(net, header, 4, bufs, lens, frees);
 		if (rc != TCPSOCKET_INTERRUPTED)
-			free(buf);
+			Pool_free(buf);
 #if __XTENSA__
     }
 #endif
@@ -795,7 +790,7 @@ int MQTTPacket_send_publish(Publish* pack, int dup, int qos, int retained, netwo
 		rc = MQTTPacket_sends(net, header, 3, bufs, lens, frees);
 	}
 	if (rc != TCPSOCKET_INTERRUPTED)
-		free(topiclen);
+		Pool_free(topiclen);
 	if (qos == 0)
 		Log(LOG_PROTOCOL, 27, NULL, net->socket, clientID, retained, rc);
 	else
@@ -809,3 +804,30 @@ int MQTTPacket_send_publish(Publish* pack, int dup, int qos, int retained, netwo
 	FUNC_EXIT_RC(rc);
 	return rc;
 }
+
+
+/**
+ * Send a buffer of already encoded packets.
+ * @param net the network handle to send the data to
+ * @param buffer the encoded packets, freed by the socket buffer if the write is interrupted
+ * @param buflen the length of the buffer
+ * @return the completion code (TCPSOCKET_COMPLETE etc)
+ */
+int MQTTPacket_send_encoded(networkHandles* net, char* buffer, size_t buflen)
+{
+	int rc;
+
+	FUNC_ENTRY;
+#if defined(OPENSSL)
+	if (net->ssl)
+		rc = SSLSocket_putdatas(net->ssl, net->socket, buffer, buflen, 0, NULL, NULL, NULL);
+	else
+#endif
+		rc = Socket_putdatas(net->socket, buffer, buflen, 0, NULL, NULL, NULL);
+
+	if (rc == TCPSOCKET_COMPLETE)
+		time(&(net->lastSent));
+
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
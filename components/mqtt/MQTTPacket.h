@@ -248,6 +248,7 @@ int MQTTPacket_send_disconnect(networkHandles* net, const char* clientID);
 void* MQTTPacket_publish(unsigned char aHeader, char* data, size_t datalen);
 void MQTTPacket_freePublish(Publish* pack);
 int MQTTPacket_send_publish(Publish* pack, int dup, int qos, int retained, networkHandles* net, const char* clientID);
+int MQTTPacket_send_encoded(networkHandles* net, char* buffer, size_t buflen);
 int MQTTPacket_send_puback(int msgid, networkHandles* net, const char* clientID);
 void* MQTTPacket_ack(unsigned char aHeader, char* data, size_t datalen);
 
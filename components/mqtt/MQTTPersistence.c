@@ -42,6 +42,7 @@ static void MQTTPersistence_insertInSeqOrder(List* list, MQTTPersistence_qEntry*
  * @return 0 if success, #MQTTCLIENT_PERSISTENCE_ERROR otherwise.
  */
 #include "StackTrace.h"
+#include "Pool.h"
 
 int MQTTPersistence_create(MQTTClient_persistence** persistence, int type, void* pcontext)
 {
@@ -250,7 +251,7 @@ int MQTTPersistence_restore(Clients *c)
 						sprintf(key, "%s%d", PERSISTENCE_PUBLISH_SENT, pubrel->msgId);
 						if ( c->persistence->pcontainskey(c->phandle, key) != 0 )
 							rc = c->persistence->premove(c->phandle, msgkeys[i]);
-						free(pubrel);
+						Pool_free(pubrel);
 						free(key);
 #if __XTENSA__
             }
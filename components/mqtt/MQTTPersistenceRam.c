@@ -0,0 +1,609 @@
+/*
+ * Copyright (C) 2015 - 2020, IBEROXARXA SERVICIOS INTEGRALES, S.L.
+ * Copyright (C) 2015 - 2020, Jaume Olivé Petrus (jolive@whitecatboard.org)
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *     * The WHITECAT logotype cannot be changed, you can remove it, but you
+ *       cannot change it in any way. The WHITECAT logotype is:
+ *
+ *          /\       /\
+ *         /  \_____/  \
+ *        /_____________\
+ *        W H I T E C A T
+ *
+ *     * Redistributions in binary form must retain all copyright notices printed
+ *       to any local or remote output device. This include any reference to
+ *       Lua RTOS, whitecatboard.org, Lua, and other copyright notices that may
+ *       appear in the future.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Lua RTOS, MQTT RAM persistence
+ *
+ * Messages are kept in a fixed-size RAM arena, appended in the order they
+ * are put. Removed messages are reclaimed when the arena is full, by sliding
+ * the remaining ones down.
+ *
+ * Optionally, the store is mirrored to a single append-only log file, that is
+ * replayed when the store is opened. The log is rewritten with the messages
+ * still in the store when it grows beyond twice the arena size.
+ *
+ */
+
+#if !defined(NO_PERSISTENCE)
+
+#include "MQTTPersistenceRam.h"
+#include "StackTrace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Heap.h"
+
+/* log record types */
+#define RAM_LOG_PUT    'P'
+#define RAM_LOG_REMOVE 'R'
+
+#define RAM_ALIGN(len) (((len) + 3) & ~3)
+
+/* Record header, followed by the key and the data */
+typedef struct
+{
+	int len;       /* record length, header included */
+	int datalen;   /* data length */
+	short keylen;  /* key length, '\0' included */
+	short removed; /* the record was removed */
+} ram_record;
+
+typedef struct
+{
+	char* arena;   /* records, in the order they were put */
+	int size;      /* arena size */
+	int used;      /* bytes used by the records, removed ones included */
+	int count;     /* records not removed */
+	char* logname; /* log file name, or NULL */
+	FILE* log;     /* log file */
+	long logsize;  /* log file size */
+} ram_store;
+
+
+void MQTTPersistenceRam_init(MQTTClient_persistence* persistence, MQTTPersistenceRam_options* options)
+{
+	persistence->context      = options;
+	persistence->popen        = ramopen;
+	persistence->pclose       = ramclose;
+	persistence->pput         = ramput;
+	persistence->pget         = ramget;
+	persistence->premove      = ramremove;
+	persistence->pkeys        = ramkeys;
+	persistence->pclear       = ramclear;
+	persistence->pcontainskey = ramcontainskey;
+}
+
+
+static ram_record* ram_find(ram_store* store, const char* key)
+{
+	ram_record* rec;
+	int pos = 0;
+
+	while (pos < store->used)
+	{
+		rec = (ram_record*)(store->arena + pos);
+		if (!rec->removed && strcmp((char*)(rec + 1), key) == 0)
+			return rec;
+		pos += rec->len;
+	}
+
+	return NULL;
+}
+
+
+static void ram_drop(ram_store* store, ram_record* rec)
+{
+	rec->removed = 1;
+	store->count--;
+
+	/* the space of the last record, or of all the records, is reusable at once */
+	if (store->count == 0)
+		store->used = 0;
+	else if ((char*)rec + rec->len == store->arena + store->used)
+		store->used -= rec->len;
+}
+
+
+/* Bytes used by the records not removed */
+static int ram_live(ram_store* store)
+{
+	ram_record* rec;
+	int pos = 0;
+	int live = 0;
+
+	while (pos < store->used)
+	{
+		rec = (ram_record*)(store->arena + pos);
+		if (!rec->removed)
+			live += rec->len;
+		pos += rec->len;
+	}
+
+	return live;
+}
+
+
+/* Slide the records not removed down to the start of the arena */
+static void ram_compact(ram_store* store)
+{
+	ram_record* rec;
+	int pos = 0;
+	int dst = 0;
+	int len;
+
+	while (pos < store->used)
+	{
+		rec = (ram_record*)(store->arena + pos);
+		len = rec->len;
+		if (!rec->removed)
+		{
+			if (dst != pos)
+				memmove(store->arena + dst, rec, len);
+			dst += len;
+		}
+		pos += len;
+	}
+
+	store->used = dst;
+}
+
+
+static int ram_store_put(ram_store* store, const char* key, int bufcount, char* buffers[], int buflens[])
+{
+	ram_record* rec;
+	char* ptr;
+	int keylen = (int)strlen(key) + 1;
+	int datalen = 0;
+	int len, i;
+
+	for (i = 0; i < bufcount; i++)
+		datalen += buflens[i];
+
+	len = RAM_ALIGN(sizeof(ram_record) + keylen + datalen);
+
+	rec = ram_find(store, key);
+
+	/* the old record is only dropped once the new one is known to fit */
+	if (store->used + len > store->size &&
+		ram_live(store) - (rec ? rec->len : 0) + len > store->size)
+		return MQTTCLIENT_PERSISTENCE_ERROR;
+
+	if (rec != NULL)
+		ram_drop(store, rec);
+
+	if (store->used + len > store->size)
+		ram_compact(store);
+
+	rec = (ram_record*)(store->arena + store->used);
+	rec->len = len;
+	rec->datalen = datalen;
+	rec->keylen = (short)keylen;
+	rec->removed = 0;
+
+	ptr = (char*)(rec + 1);
+	memcpy(ptr, key, keylen);
+	ptr += keylen;
+	for (i = 0; i < bufcount; i++)
+	{
+		memcpy(ptr, buffers[i], buflens[i]);
+		ptr += buflens[i];
+	}
+
+	store->used += len;
+	store->count++;
+
+	return 0;
+}
+
+
+static int ram_log(ram_store* store, char type, const char* key, int bufcount, char* buffers[], int buflens[])
+{
+	int keylen = (int)strlen(key) + 1;
+	int datalen = 0;
+	int i;
+
+	for (i = 0; i < bufcount; i++)
+		datalen += buflens[i];
+
+	if (fputc(type, store->log) == EOF ||
+		fwrite(&keylen, sizeof(keylen), 1, store->log) != 1 ||
+		fwrite(&datalen, sizeof(datalen), 1, store->log) != 1 ||
+		fwrite(key, keylen, 1, store->log) != 1)
+		return MQTTCLIENT_PERSISTENCE_ERROR;
+
+	for (i = 0; i < bufcount; i++)
+	{
+		if (buflens[i] > 0 && fwrite(buffers[i], buflens[i], 1, store->log) != 1)
+			return MQTTCLIENT_PERSISTENCE_ERROR;
+	}
+
+	if (fflush(store->log) != 0)
+		return MQTTCLIENT_PERSISTENCE_ERROR;
+
+	store->logsize += 1 + sizeof(keylen) + sizeof(datalen) + keylen + datalen;
+
+	return 0;
+}
+
+
+/* Rewrite the log with the records in the store */
+static int ram_log_rewrite(ram_store* store)
+{
+	ram_record* rec;
+	char* tmpname;
+	char* data;
+	int rc = 0;
+	int pos = 0;
+
+	if (store->log)
+	{
+		fclose(store->log);
+		store->log = NULL;
+	}
+
+	if ((tmpname = malloc(strlen(store->logname) + 5)) == NULL)
+		return MQTTCLIENT_PERSISTENCE_ERROR;
+	sprintf(tmpname, "%s.tmp", store->logname);
+
+	if ((store->log = fopen(tmpname, "wb")) == NULL)
+	{
+		free(tmpname);
+		return MQTTCLIENT_PERSISTENCE_ERROR;
+	}
+
+	store->logsize = 0;
+	while (pos < store->used && rc == 0)
+	{
+		rec = (ram_record*)(store->arena + pos);
+		if (!rec->removed)
+		{
+			data = (char*)(rec + 1) + rec->keylen;
+			rc = ram_log(store, RAM_LOG_PUT, (char*)(rec + 1), 1, &data, &rec->datalen);
+		}
+		pos += rec->len;
+	}
+
+	fclose(store->log);
+	store->log = NULL;
+
+	if (rc == 0)
+	{
+		remove(store->logname);
+		if (rename(tmpname, store->logname) != 0)
+			rc = MQTTCLIENT_PERSISTENCE_ERROR;
+	}
+	free(tmpname);
+
+	if ((store->log = fopen(store->logname, "ab")) == NULL)
+		rc = MQTTCLIENT_PERSISTENCE_ERROR;
+
+	return rc;
+}
+
+
+/* Rebuild the store from the log. A truncated last record is ignored. */
+static void ram_log_replay(ram_store* store)
+{
+	ram_record* rec;
+	FILE* fp;
+	char* buf;
+	char* data;
+	int keylen, datalen;
+	int type;
+
+	if ((fp = fopen(store->logname, "rb")) == NULL)
+		return;
+
+	while ((type = fgetc(fp)) != EOF)
+	{
+		if (fread(&keylen, sizeof(keylen), 1, fp) != 1 || fread(&datalen, sizeof(datalen), 1, fp) != 1 ||
+			keylen <= 0 || datalen < 0 || keylen + datalen > store->size)
+			break;
+
+		if ((buf = malloc(keylen + datalen)) == NULL)
+			break;
+
+		if (fread(buf, keylen + datalen, 1, fp) != 1 || buf[keylen - 1] != '\0')
+		{
+			free(buf);
+			break;
+		}
+
+		if (type == RAM_LOG_PUT)
+		{
+			data = buf + keylen;
+			ram_store_put(store, buf, 1, &data, &datalen);
+		}
+		else if (type == RAM_LOG_REMOVE)
+		{
+			if ((rec = ram_find(store, buf)) != NULL)
+				ram_drop(store, rec);
+		}
+		free(buf);
+	}
+
+	fclose(fp);
+}
+
+
+/** Create the store for the client. If a log directory is given, the log
+ *  file is context/clientID-serverURI.log.
+ *  See ::Persistence_open
+ */
+int ramopen(void** handle, const char* clientID, const char* serverURI, void* context)
+{
+	MQTTPersistenceRam_options* options = context;
+	ram_store* store;
+	char* ptr;
+	int rc = 0;
+
+	FUNC_ENTRY;
+	if ((store = malloc(sizeof(ram_store))) == NULL)
+	{
+		rc = MQTTCLIENT_PERSISTENCE_ERROR;
+		goto exit;
+	}
+	memset(store, '\0', sizeof(ram_store));
+
+	store->size = options->size;
+	if ((store->arena = malloc(store->size)) == NULL)
+	{
+		free(store);
+		rc = MQTTCLIENT_PERSISTENCE_ERROR;
+		goto exit;
+	}
+
+	if (options->dir)
+	{
+		/* consider '/'  +  '-'  +  ".log"  +  '\0' */
+		store->logname = malloc(strlen(options->dir) + strlen(clientID) + strlen(serverURI) + 7);
+		if (store->logname)
+		{
+			sprintf(store->logname, "%s/%s-%s.log", options->dir, clientID, serverURI);
+
+			/* ':' and '/' of the server URI are not allowed in a file name */
+			for (ptr = store->logname + strlen(options->dir) + 1; *ptr; ptr++)
+			{
+				if (*ptr == ':' || *ptr == '/')
+					*ptr = '-';
+			}
+
+			ram_log_replay(store);
+			rc = ram_log_rewrite(store);
+		}
+		else
+			rc = MQTTCLIENT_PERSISTENCE_ERROR;
+	}
+
+	if (rc == 0)
+		*handle = store;
+	else
+		ramclose(store);
+
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+int ramclose(void* handle)
+{
+	ram_store* store = handle;
+
+	FUNC_ENTRY;
+	if (store)
+	{
+		if (store->log)
+			fclose(store->log);
+		free(store->logname);
+		free(store->arena);
+		free(store);
+	}
+
+	FUNC_EXIT;
+	return 0;
+}
+
+
+int ramput(void* handle, char* key, int bufcount, char* buffers[], int buflens[])
+{
+	ram_store* store = handle;
+	int rc = 0;
+
+	FUNC_ENTRY;
+	if (store == NULL)
+	{
+		rc = MQTTCLIENT_PERSISTENCE_ERROR;
+		goto exit;
+	}
+
+	if ((rc = ram_store_put(store, key, bufcount, buffers, buflens)) != 0)
+		goto exit;
+
+	if (store->log)
+	{
+		if (store->logsize > 2 * store->size)
+			rc = ram_log_rewrite(store);
+		else
+			rc = ram_log(store, RAM_LOG_PUT, key, bufcount, buffers, buflens);
+	}
+
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+int ramget(void* handle, char* key, char** buffer, int* buflen)
+{
+	ram_store* store = handle;
+	ram_record* rec;
+	int rc = 0;
+
+	FUNC_ENTRY;
+	if (store == NULL || (rec = ram_find(store, key)) == NULL)
+	{
+		rc = MQTTCLIENT_PERSISTENCE_ERROR;
+		goto exit;
+	}
+
+	if ((*buffer = malloc(rec->datalen > 0 ? rec->datalen : 1)) == NULL)
+	{
+		rc = MQTTCLIENT_PERSISTENCE_ERROR;
+		goto exit;
+	}
+
+	memcpy(*buffer, (char*)(rec + 1) + rec->keylen, rec->datalen);
+	*buflen = rec->datalen;
+
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+int ramremove(void* handle, char* key)
+{
+	ram_store* store = handle;
+	ram_record* rec;
+	int rc = 0;
+
+	FUNC_ENTRY;
+	if (store == NULL || (rec = ram_find(store, key)) == NULL)
+	{
+		rc = MQTTCLIENT_PERSISTENCE_ERROR;
+		goto exit;
+	}
+
+	ram_drop(store, rec);
+
+	if (store->log)
+	{
+		if (store->logsize > 2 * store->size)
+			rc = ram_log_rewrite(store);
+		else
+			rc = ram_log(store, RAM_LOG_REMOVE, key, 0, NULL, NULL);
+	}
+
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+int ramkeys(void* handle, char*** keys, int* nkeys)
+{
+	ram_store* store = handle;
+	ram_record* rec;
+	char** fkeys = NULL;
+	int rc = 0;
+	int pos = 0;
+	int i = 0;
+
+	FUNC_ENTRY;
+	if (store == NULL)
+	{
+		rc = MQTTCLIENT_PERSISTENCE_ERROR;
+		goto exit;
+	}
+
+	if (store->count > 0 && (fkeys = (char**)malloc(store->count * sizeof(char*))) == NULL)
+	{
+		rc = MQTTCLIENT_PERSISTENCE_ERROR;
+		goto exit;
+	}
+
+	while (pos < store->used)
+	{
+		rec = (ram_record*)(store->arena + pos);
+		if (!rec->removed)
+		{
+			if ((fkeys[i] = malloc(rec->keylen)) == NULL)
+			{
+				while (i > 0)
+					free(fkeys[--i]);
+				free(fkeys);
+				rc = MQTTCLIENT_PERSISTENCE_ERROR;
+				goto exit;
+			}
+			strcpy(fkeys[i++], (char*)(rec + 1));
+		}
+		pos += rec->len;
+	}
+
+	*keys = fkeys;
+	*nkeys = i;
+
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+int ramclear(void* handle)
+{
+	ram_store* store = handle;
+	int rc = 0;
+
+	FUNC_ENTRY;
+	if (store == NULL)
+	{
+		rc = MQTTCLIENT_PERSISTENCE_ERROR;
+		goto exit;
+	}
+
+	store->used = 0;
+	store->count = 0;
+
+	if (store->log)
+		rc = ram_log_rewrite(store);
+
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
+int ramcontainskey(void* handle, char* key)
+{
+	ram_store* store = handle;
+	int rc = 0;
+
+	FUNC_ENTRY;
+	if (store == NULL || ram_find(store, key) == NULL)
+		rc = MQTTCLIENT_PERSISTENCE_ERROR;
+
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+#endif
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2015 - 2020, IBEROXARXA SERVICIOS INTEGRALES, S.L.
+ * Copyright (C) 2015 - 2020, Jaume Olivé Petrus (jolive@whitecatboard.org)
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *     * The WHITECAT logotype cannot be changed, you can remove it, but you
+ *       cannot change it in any way. The WHITECAT logotype is:
+ *
+ *          /\       /\
+ *         /  \_____/  \
+ *        /_____________\
+ *        W H I T E C A T
+ *
+ *     * Redistributions in binary form must retain all copyright notices printed
+ *       to any local or remote output device. This include any reference to
+ *       Lua RTOS, whitecatboard.org, Lua, and other copyright notices that may
+ *       appear in the future.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Lua RTOS, MQTT RAM persistence
+ *
+ */
+
+#if !defined(MQTTPERSISTENCERAM_H)
+#define MQTTPERSISTENCERAM_H
+
+#include "MQTTClientPersistence.h"
+
+/** Options of the RAM persistence, used as the persistence context */
+typedef struct
+{
+	/** Bytes of RAM reserved for the messages of each client */
+	int size;
+	/** Directory of the log file mirroring the store, or NULL to keep it in RAM only */
+	const char* dir;
+} MQTTPersistenceRam_options;
+
+void MQTTPersistenceRam_init(MQTTClient_persistence* persistence, MQTTPersistenceRam_options* options);
+
+/* prototypes of the functions for the RAM persistence */
+int ramopen(void** handle, const char* clientID, const char* serverURI, void* context);
+int ramclose(void* handle);
+int ramput(void* handle, char* key, int bufcount, char* buffers[], int buflens[]);
+int ramget(void* handle, char* key, char** buffer, int* buflen);
+int ramremove(void* handle, char* key);
+int ramkeys(void* handle, char*** keys, int* nkeys);
+int ramclear(void* handle);
+int ramcontainskey(void* handle, char* key);
+
+#endif
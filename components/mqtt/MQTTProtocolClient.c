@@ -37,6 +37,7 @@
 #endif
 #include "SocketBuffer.h"
 #include "StackTrace.h"
+#include "Pool.h"
 #include "Heap.h"
 
 #if !defined(min)
@@ -384,7 +385,7 @@ int MQTTProtocol_handlePubacks(void* pack, int sock)
 			ListRemove(client->outboundMsgs, m);
 		}
 	}
-	free(pack);
+	Pool_free(pack);
 	FUNC_EXIT_RC(rc);
 	return rc;
 }
@@ -433,7 +434,7 @@ int MQTTProtocol_handlePubrecs(void* pack, int sock)
 			time(&(m->lastTouch));
 		}
 	}
-	free(pack);
+	Pool_free(pack);
 	FUNC_EXIT_RC(rc);
 	return rc;
 }
@@ -497,7 +498,7 @@ int MQTTProtocol_handlePubrels(void* pack, int sock)
 			++(state.msgs_received);
 		}
 	}
-	free(pack);
+	Pool_free(pack);
 	FUNC_EXIT_RC(rc);
 	return rc;
 }
@@ -546,7 +547,7 @@ int MQTTProtocol_handlePubcomps(void* pack, int sock)
 			}
 		}
 	}
-	free(pack);
+	Pool_free(pack);
 	FUNC_EXIT_RC(rc);
 	return rc;
 }
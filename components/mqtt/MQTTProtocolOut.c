@@ -34,6 +34,7 @@
 
 #include "MQTTProtocolOut.h"
 #include "StackTrace.h"
+#include "Pool.h"
 #include "Heap.h"
 
 extern ClientStates* bstate;
@@ -244,7 +245,7 @@ int MQTTProtocol_handleUnsubacks(void* pack, int sock)
 	FUNC_ENTRY;
 	client = (Clients*)(ListFindItem(bstate->clients, &sock, clientSocketCompare)->content);
 	Log(LOG_PROTOCOL, 24, NULL, sock, client->clientID, unsuback->msgId);
-	free(unsuback);
+	Pool_free(unsuback);
 	FUNC_EXIT_RC(rc);
 	return rc;
 }
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2015 - 2020, IBEROXARXA SERVICIOS INTEGRALES, S.L.
+ * Copyright (C) 2015 - 2020, Jaume Olivé Petrus (jolive@whitecatboard.org)
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *     * The WHITECAT logotype cannot be changed, you can remove it, but you
+ *       cannot change it in any way. The WHITECAT logotype is:
+ *
+ *          /\       /\
+ *         /  \_____/  \
+ *        /_____________\
+ *        W H I T E C A T
+ *
+ *     * Redistributions in binary form must retain all copyright notices printed
+ *       to any local or remote output device. This include any reference to
+ *       Lua RTOS, whitecatboard.org, Lua, and other copyright notices that may
+ *       appear in the future.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Lua RTOS, MQTT small block pool
+ *
+ * Acks and fixed headers are a few bytes long, and are allocated and freed
+ * once per packet. They are taken from a static array of blocks, tracked by a
+ * bitmap updated with atomic operations, as they are allocated and freed from
+ * both the send and the receive threads. Requests that don't fit in a block,
+ * or made when the pool is exhausted, fall back to malloc.
+ *
+ */
+
+#include "Pool.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "Heap.h"
+
+#if POOL_BLOCKS > 32
+#error "POOL_BLOCKS must be 32 or less"
+#endif
+
+static char pool[POOL_BLOCKS][POOL_BLOCK_SIZE] __attribute__((aligned(sizeof(void*))));
+
+/* bit i set = block i in use */
+static volatile uint32_t pool_used = 0;
+
+
+/**
+ * Allocate memory from the pool, or from the heap if the pool can't serve it
+ * @param size the number of bytes to allocate
+ * @return pointer to the memory, or NULL
+ */
+void* Pool_malloc(size_t size)
+{
+	if (size <= POOL_BLOCK_SIZE)
+	{
+		uint32_t used;
+
+		while ((used = pool_used) != ((POOL_BLOCKS == 32) ? 0xffffffff : ((1u << POOL_BLOCKS) - 1)))
+		{
+			int i = __builtin_ctz(~used);
+
+			if (__sync_bool_compare_and_swap(&pool_used, used, used | (1u << i)))
+				return pool[i];
+		}
+	}
+	return malloc(size);
+}
+
+
+/**
+ * Free memory obtained from Pool_malloc, or from malloc
+ * @param p pointer to the memory to free
+ */
+void Pool_free(void* p)
+{
+	if ((char*)p >= pool[0] && (char*)p < pool[POOL_BLOCKS])
+	{
+		int i = ((char*)p - pool[0]) / POOL_BLOCK_SIZE;
+
+		__sync_fetch_and_and(&pool_used, ~(1u << i));
+	}
+	else
+		free(p);
+}
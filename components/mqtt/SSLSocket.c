@@ -34,6 +34,7 @@
 #include "Log.h"
 #include "StackTrace.h"
 #include "Socket.h"
+#include "Pool.h"
 char* MQTTProtocol_addressPort(const char* uri, int* port);
 
 #include "Heap.h"
@@ -1052,12 +1053,12 @@ int SSLSocket_putdatas(SSL* ssl, int socket, char* buf0, size_t buf0len, int cou
 #if !__XTENSA__
 		int i;
 #endif
-		free(buf0);
+		Pool_free(buf0);
 		for (i = 0; i < count; ++i)
 		{
 		    if (frees[i])
 		    {
-			free(buffers[i]);
+			Pool_free(buffers[i]);
 			buffers[i] = NULL;
 		    }
 		}	
@@ -33,6 +33,7 @@
 #include "SocketBuffer.h"
 #include "Messages.h"
 #include "StackTrace.h"
+#include "Pool.h"
 #if defined(OPENSSL)
 #include "SSLSocket.h"
 #endif
@@ -57,6 +58,7 @@ int Socket_continueWrite(int socket);
 int Socket_continueWrites(fd_set* pwset);
 char* Socket_getaddrname(struct sockaddr* sa, int sock);
 int Socket_abortWrite(int socket);
+int Socket_recv(int socket, char* buf, size_t len);
 
 #if defined(WIN32) || defined(WIN64)
 #define iov_len len
@@ -225,7 +227,8 @@ int isReady(int socket, fd_set* read_set, fd_set* write_set)
 	if  (ListFindItem(s.connect_pending, &socket, intcompare) && FD_ISSET(socket, write_set))
 		ListRemoveItem(s.connect_pending, &socket, intcompare);
 	else
-		rc = FD_ISSET(socket, read_set) && FD_ISSET(socket, write_set) && Socket_noPendingWrites(socket);
+		rc = (FD_ISSET(socket, read_set) || SocketBuffer_readAheadPending(socket)) &&
+			FD_ISSET(socket, write_set) && Socket_noPendingWrites(socket);
 	FUNC_EXIT_RC(rc);
 	return rc;
 }
@@ -250,7 +253,7 @@ int Socket_getReadySocket(int more_work, struct timeval *tp, mutex_type mutex)
 	if (s.clientsds->count == 0)
 		goto exit;
 
-	if (more_work)
+	if (more_work || SocketBuffer_anyReadAheadPending())
 		timeout = zero;
 	else if (tp)
 		timeout = *tp;
@@ -322,6 +325,61 @@ exit:
 } /* end getReadySocket */
 
 
+/**
+ *  Reads from a socket through its receive buffer, with the same return values as recv.
+ *  Small reads fill the receive buffer with as much as the stack has, so that a whole
+ *  fixed header, or several small packets, are read with a single recv call. Reads larger
+ *  than the buffer go straight to the caller's memory once the buffered bytes are used.
+ *  @param socket the socket to read from
+ *  @param buf the buffer to read into
+ *  @param len the number of bytes to read
+ *  @return the number of bytes read, 0 if the peer closed the socket, or SOCKET_ERROR
+ */
+int Socket_recv(int socket, char* buf, size_t len)
+{
+	socket_readahead* ra = SocketBuffer_getReadAhead(socket);
+	int rc = 0, rc1;
+	size_t n;
+
+	FUNC_ENTRY;
+	if (ra && ra->end > ra->start)
+	{
+		n = min(len, ra->end - ra->start);
+		memcpy(buf, &ra->buf[ra->start], n);
+		ra->start += n;
+		buf += n;
+		len -= n;
+		rc = (int)n;
+	}
+	if (len == 0)
+		goto exit;
+
+	if (ra && len < sizeof(ra->buf))
+	{
+		ra->start = ra->end = 0;
+		if ((rc1 = recv(socket, ra->buf, sizeof(ra->buf), 0)) > 0)
+		{
+			ra->end = rc1;
+			n = min(len, ra->end);
+			memcpy(buf, ra->buf, n);
+			ra->start = n;
+			rc1 = (int)n;
+		}
+	}
+	else
+		rc1 = recv(socket, buf, len, 0);
+
+	/* report what was already copied, the error or the close will be seen by the next read */
+	if (rc1 > 0)
+		rc += rc1;
+	else if (rc == 0)
+		rc = rc1;
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
 /**
  *  Reads one byte from a socket
  *  @param socket the socket to read from
@@ -336,7 +394,7 @@ int Socket_getch(int socket, char* c)
 	if ((rc = SocketBuffer_getQueuedChar(socket, c)) != SOCKETBUFFER_INTERRUPTED)
 		goto exit;
 
-	if ((rc = recv(socket, c, (size_t)1, 0)) == SOCKET_ERROR)
+	if ((rc = Socket_recv(socket, c, (size_t)1)) == SOCKET_ERROR)
 	{
 		int err = Socket_error("recv - getch", socket);
 		if (err == EWOULDBLOCK || err == EAGAIN)
@@ -380,7 +438,7 @@ char *Socket_getdata(int socket, size_t bytes, size_t* actual_len)
 
 	buf = SocketBuffer_getQueuedData(socket, bytes, actual_len);
 
-	if ((rc = recv(socket, buf + (*actual_len), (int)(bytes - (*actual_len)), 0)) == SOCKET_ERROR)
+	if ((rc = Socket_recv(socket, buf + (*actual_len), bytes - (*actual_len))) == SOCKET_ERROR)
 	{
 		rc = Socket_error("recv - getdata", socket);
 		if (rc != EAGAIN && rc != EWOULDBLOCK)
@@ -853,7 +911,7 @@ int Socket_continueWrite(int socket)
 			{
 				if (pw->frees[i])
                                 {
-					free(pw->iovecs[i].iov_base);
+					Pool_free(pw->iovecs[i].iov_base);
                                         pw->iovecs[i].iov_base = NULL;
                                 }
 			}
@@ -872,7 +930,7 @@ int Socket_continueWrite(int socket)
 		{
 			if (pw->frees[i])
                         {
-				free(pw->iovecs[i].iov_base);
+				Pool_free(pw->iovecs[i].iov_base);
                                 pw->iovecs[i].iov_base = NULL;
                         }
 		}
@@ -910,7 +968,7 @@ int Socket_abortWrite(int socket)
 		if (pw->frees[i])
 		{
 			printf("cleaning in abortwrite for socket %d\n", socket);
-			free(pw->iovecs[i].iov_base);
+			Pool_free(pw->iovecs[i].iov_base);
 		}
 	}
 exit:
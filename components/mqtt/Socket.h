@@ -98,6 +98,10 @@
 #define max(A,B) ( (A) > (B) ? (A):(B))
 #endif
 
+#if !defined(min)
+#define min(A,B) ( (A) < (B) ? (A):(B))
+#endif
+
 #include "LinkedList.h"
 
 /*BE
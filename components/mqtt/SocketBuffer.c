@@ -54,11 +54,17 @@ static List* queues;
  */
 static List writes;
 
+/**
+ * List of per-socket receive buffers
+ */
+static List* readaheads;
+
 
 int socketcompare(void* a, void* b);
 void SocketBuffer_newDefQ(void);
 void SocketBuffer_freeDefQ(void);
 int pending_socketcompare(void* a, void* b);
+int readaheadcompare(void* a, void* b);
 
 
 /**
@@ -105,6 +111,7 @@ void SocketBuffer_initialize(void)
 	FUNC_ENTRY;
 	SocketBuffer_newDefQ();
 	queues = ListInitialize();
+	readaheads = ListInitialize();
 	ListZero(&writes);
 	FUNC_EXIT;
 }
@@ -133,6 +140,7 @@ void SocketBuffer_terminate(void)
 	while (ListNextElement(queues, &cur))
 		free(((socket_queue*)(cur->content))->buf);
 	ListFree(queues);
+	ListFree(readaheads);
 	SocketBuffer_freeDefQ();
 	FUNC_EXIT;
 }
@@ -151,6 +159,7 @@ void SocketBuffer_cleanup(int socket)
 		free(((socket_queue*)(queues->current->content))->buf);
 		ListRemove(queues, queues->current->content);
 	}
+	ListRemoveItem(readaheads, &socket, readaheadcompare);
 	if (def_queue->socket == socket)
 	{
 		def_queue->socket = def_queue->index = 0;
@@ -328,6 +337,75 @@ void SocketBuffer_queueChar(int socket, char c)
 }
 
 
+/**
+ * List callback function for comparing socket_readaheads by socket
+ * @param a first integer value
+ * @param b second integer value
+ * @return boolean indicating whether a and b are equal
+ */
+int readaheadcompare(void* a, void* b)
+{
+	return ((socket_readahead*)a)->socket == *(int*)b;
+}
+
+
+/**
+ * Get the receive buffer of a socket, creating it on first use
+ * @param socket the socket to get the receive buffer for
+ * @return pointer to the receive buffer, or NULL if it could not be allocated
+ */
+socket_readahead* SocketBuffer_getReadAhead(int socket)
+{
+	socket_readahead* ra = NULL;
+	ListElement* le = NULL;
+
+	FUNC_ENTRY;
+	if ((le = ListFindItem(readaheads, &socket, readaheadcompare)) != NULL)
+		ra = (socket_readahead*)(le->content);
+	else if ((ra = malloc(sizeof(socket_readahead))) != NULL)
+	{
+		ra->socket = socket;
+		ra->start = ra->end = 0;
+		ListAppend(readaheads, ra, sizeof(socket_readahead));
+	}
+	FUNC_EXIT;
+	return ra;
+}
+
+
+/**
+ * Get the number of bytes received for a socket and not yet consumed
+ * @param socket the socket to check
+ * @return the number of bytes waiting in the receive buffer
+ */
+int SocketBuffer_readAheadPending(int socket)
+{
+	ListElement* le = ListFindItem(readaheads, &socket, readaheadcompare);
+	socket_readahead* ra = (le) ? (socket_readahead*)(le->content) : NULL;
+
+	return (ra) ? (int)(ra->end - ra->start) : 0;
+}
+
+
+/**
+ * Check whether any socket has bytes waiting in its receive buffer. select
+ * won't report those sockets as readable, as the data is no longer in the stack.
+ * @return boolean - is there any data waiting?
+ */
+int SocketBuffer_anyReadAheadPending(void)
+{
+	ListElement* cur = NULL;
+
+	while (ListNextElement(readaheads, &cur))
+	{
+		socket_readahead* ra = (socket_readahead*)(cur->content);
+		if (ra->end > ra->start)
+			return 1;
+	}
+	return 0;
+}
+
+
 /**
  * A socket write was interrupted so store the remaining data
  * @param socket the socket for which the write was interrupted
@@ -45,6 +45,19 @@ typedef struct
 	char* buf;
 } socket_queue;
 
+#if !defined(SOCKETBUFFER_READAHEAD)
+	/** size of the per-socket receive buffer, filled by one recv call */
+	#define SOCKETBUFFER_READAHEAD 512
+#endif
+
+typedef struct
+{
+	int socket;
+	size_t start,			/**< offset of the first byte not yet consumed */
+		end;				/**< offset past the last byte received */
+	char buf[SOCKETBUFFER_READAHEAD];
+} socket_readahead;
+
 typedef struct
 {
 	int socket, count;
@@ -71,6 +84,9 @@ int SocketBuffer_getQueuedChar(int socket, char* c);
 void SocketBuffer_interrupted(int socket, size_t actual_len);
 char* SocketBuffer_complete(int socket);
 void SocketBuffer_queueChar(int socket, char c);
+socket_readahead* SocketBuffer_getReadAhead(int socket);
+int SocketBuffer_readAheadPending(int socket);
+int SocketBuffer_anyReadAheadPending(void);
 
 #if defined(OPENSSL)
 void SocketBuffer_pendingWrite(int socket, SSL* ssl, int count, iobuf* iovecs, int* frees, size_t total, size_t bytes);
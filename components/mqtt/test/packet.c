@@ -0,0 +1,341 @@
+/*
+ * Copyright (C) 2015 - 2020, IBEROXARXA SERVICIOS INTEGRALES, S.L.
+ * Copyright (C) 2015 - 2020, Jaume Olivé Petrus (jolive@whitecatboard.org)
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *     * The WHITECAT logotype cannot be changed, you can remove it, but you
+ *       cannot change it in any way. The WHITECAT logotype is:
+ *
+ *          /\       /\
+ *         /  \_____/  \
+ *        /_____________\
+ *        W H I T E C A T
+ *
+ *     * Redistributions in binary form must retain all copyright notices printed
+ *       to any local or remote output device. This include any reference to
+ *       Lua RTOS, whitecatboard.org, Lua, and other copyright notices that may
+ *       appear in the future.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Lua RTOS, MQTT packet reader test cases
+ *
+ */
+
+#include "sdkconfig.h"
+
+#if CONFIG_LUA_RTOS_LUA_USE_MQTT
+
+#include "unity.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <drivers/net.h>
+
+#include "Clients.h"
+#include "MQTTPacket.h"
+#include "Pool.h"
+#include "Socket.h"
+
+#define PACKET_TEST_PORT 18830
+
+// Bytes sent and not decoded yet, kept under the TCP window
+#define PACKET_TEST_INFLIGHT 2048
+
+// Rounds without progress before giving up
+#define PACKET_TEST_IDLE 2000
+
+typedef struct {
+    int writer;       // Socket where the packet stream is written
+    int reader;       // Socket where the packets are read, by the MQTT client
+    int next;         // Next packet expected
+    size_t consumed;  // Bytes of the packets decoded
+    int64_t us;       // Time spent in MQTTPacket_Factory
+} packet_test_t;
+
+static int64_t packet_us(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/*
+ * Packet n of the stream, as received by a client that publishes and
+ * subscribes: publications with QoS 0 and 1 (small, and some of 600 bytes),
+ * acks, suback and pingresp. Returns the packet length.
+ */
+static int packet_build(int n, char *buf) {
+    char body[700];
+    char *ptr = body;
+    char topic[16];
+    int header = 0;
+    int len = 0, i;
+
+    switch (n % 8) {
+        case 0:
+        case 1:
+        case 7:
+            header = (PUBLISH << 4) | (((n % 8) == 1) << 1);
+            len = ((n % 8) == 0)?16:(((n % 8) == 1)?40:(((n % 16) == 7)?600:4));
+
+            sprintf(topic, "sensor/%d", n % 100);
+            writeUTF(&ptr, topic);
+            if ((n % 8) == 1) {
+                writeInt(&ptr, 1 + (n % 1000));
+            }
+
+            for (i = 0; i < len; i++) {
+                writeChar(&ptr, (n + i) & 0xff);
+            }
+            break;
+
+        case 2: header = PUBACK << 4;  writeInt(&ptr, 1 + (n % 1000)); break;
+        case 3: header = PUBREC << 4;  writeInt(&ptr, 1 + (n % 1000)); break;
+        case 4: header = PUBCOMP << 4; writeInt(&ptr, 1 + (n % 1000)); break;
+
+        case 5:
+            header = SUBACK << 4;
+            writeInt(&ptr, 1 + (n % 1000));
+            writeChar(&ptr, 0);
+            writeChar(&ptr, 1);
+            break;
+
+        case 6: header = PINGRESP << 4; break;
+    }
+
+    buf[0] = header;
+    len = 1 + MQTTPacket_encode(&buf[1], ptr - body);
+    memcpy(&buf[len], body, ptr - body);
+
+    return len + (ptr - body);
+}
+
+// Check that a decoded packet is packet n of the stream, and free it
+static void packet_check(int n, void *pack) {
+    int type = ((unsigned char)*(char *)pack) >> 4;
+    Publish *publish;
+    Suback *suback;
+    int i;
+
+    switch (n % 8) {
+        case 0:
+        case 1:
+        case 7:
+            TEST_ASSERT(type == PUBLISH);
+
+            publish = pack;
+            TEST_ASSERT(publish->msgId == (((n % 8) == 1)?1 + (n % 1000):0));
+            TEST_ASSERT(publish->payloadlen == (((n % 8) == 0)?16:(((n % 8) == 1)?40:(((n % 16) == 7)?600:4))));
+            for (i = 0; i < publish->payloadlen; i++) {
+                TEST_ASSERT((unsigned char)publish->payload[i] == ((n + i) & 0xff));
+            }
+
+            MQTTPacket_freePublish(publish);
+            break;
+
+        case 2: case 3: case 4:
+            TEST_ASSERT(type == ((n % 8 == 2)?PUBACK:((n % 8 == 3)?PUBREC:PUBCOMP)));
+            TEST_ASSERT(((Ack *)pack)->msgId == 1 + (n % 1000));
+
+            Pool_free(pack);
+            break;
+
+        case 5:
+            TEST_ASSERT(type == SUBACK);
+
+            suback = pack;
+            TEST_ASSERT(suback->msgId == 1 + (n % 1000));
+            TEST_ASSERT(suback->qoss->count == 2);
+
+            MQTTPacket_freeSuback(suback);
+            break;
+
+        case 6:
+            TEST_ASSERT(type == PINGRESP);
+            break;
+    }
+}
+
+static void packet_connect(packet_test_t *test) {
+    struct sockaddr_in sin;
+    int s;
+    int on = 1;
+
+    memset(test, 0, sizeof(packet_test_t));
+
+    s = socket(AF_INET, SOCK_STREAM, 0);
+    TEST_ASSERT(s >= 0);
+
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(PACKET_TEST_PORT);
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    TEST_ASSERT(bind(s, (struct sockaddr *)&sin, sizeof(sin)) == 0);
+    TEST_ASSERT(listen(s, 1) == 0);
+
+    test->reader = socket(AF_INET, SOCK_STREAM, 0);
+    TEST_ASSERT(test->reader >= 0);
+    TEST_ASSERT(connect(test->reader, (struct sockaddr *)&sin, sizeof(sin)) == 0);
+
+    test->writer = accept(s, NULL, NULL);
+    TEST_ASSERT(test->writer >= 0);
+
+    close(s);
+
+    Socket_outInitialize();
+    TEST_ASSERT(Socket_addSocket(test->reader) == 0);
+}
+
+static void packet_disconnect(packet_test_t *test) {
+    Socket_close(test->reader);
+    Socket_outTerminate();
+
+    close(test->writer);
+}
+
+// Decode the packets received until the reader would block. Returns the
+// number of packets decoded.
+static int packet_read(packet_test_t *test) {
+    networkHandles net;
+    char buf[800];
+    void *pack;
+    int64_t t0;
+    int error;
+    int n = 0;
+
+    memset(&net, 0, sizeof(net));
+    net.socket = test->reader;
+
+    for (;;) {
+        t0 = packet_us();
+        pack = MQTTPacket_Factory(&net, &error);
+        test->us += packet_us() - t0;
+
+        if (!pack) {
+            TEST_ASSERT(error == TCPSOCKET_INTERRUPTED);
+            return n;
+        }
+
+        packet_check(test->next, pack);
+        test->consumed += packet_build(test->next, buf);
+        test->next++;
+        n++;
+    }
+}
+
+/*
+ * Send the first packets of the stream in chunks of chunk bytes, or of
+ * random sizes if chunk is 0, decoding the packets received meanwhile.
+ */
+static void packet_stream(packet_test_t *test, int packets, int chunk) {
+    static char stream[4096];
+    uint32_t seed = 1;
+    size_t stream_len = 0, sent = 0, off = 0, len;
+    int n = 0, idle = 0;
+
+    while (test->next < packets) {
+        // Fill the stream buffer with the next packets
+        if ((off == stream_len) && (n < packets)) {
+            off = 0;
+            stream_len = 0;
+            while ((n < packets) && (stream_len + 800 <= sizeof(stream))) {
+                stream_len += packet_build(n++, stream + stream_len);
+            }
+        }
+
+        if ((off < stream_len) && (sent - test->consumed < PACKET_TEST_INFLIGHT)) {
+            if (chunk) {
+                len = chunk;
+            } else {
+                seed = seed * 1103515245 + 12345;
+                len = 1 + (seed >> 16) % 300;
+            }
+
+            if (len > stream_len - off) {
+                len = stream_len - off;
+            }
+
+            TEST_ASSERT(send(test->writer, stream + off, len, 0) == (int)len);
+
+            off += len;
+            sent += len;
+        }
+
+        if (packet_read(test) > 0) {
+            idle = 0;
+        } else if ((off == stream_len) || (sent - test->consumed >= PACKET_TEST_INFLIGHT)) {
+            // Wait for the loopback interface
+            TEST_ASSERT(++idle < PACKET_TEST_IDLE);
+            usleep(1000);
+        }
+    }
+}
+
+TEST_CASE("mqtt packet reader", "[mqtt]") {
+    packet_test_t test;
+
+    net_init();
+
+    // Random fragments, that split headers, lengths and payloads
+    packet_connect(&test);
+    packet_stream(&test, 400, 0);
+    TEST_ASSERT(test.next == 400);
+    packet_disconnect(&test);
+
+    // Byte by byte
+    packet_connect(&test);
+    packet_stream(&test, 50, 1);
+    TEST_ASSERT(test.next == 50);
+    packet_disconnect(&test);
+}
+
+TEST_CASE("mqtt packet decode throughput", "[mqtt][bench]") {
+    packet_test_t test;
+
+    net_init();
+
+    packet_connect(&test);
+    packet_stream(&test, 2000, 1024);
+    TEST_ASSERT(test.next == 2000);
+    packet_disconnect(&test);
+
+    if (test.us == 0) test.us = 1;
+
+    printf("mqtt packet: %d packets, %u bytes, %lld us in MQTTPacket_Factory, %lld packets/s\n",
+        test.next, test.consumed, test.us, (int64_t)test.next * 1000000 / test.us);
+}
+
+#endif
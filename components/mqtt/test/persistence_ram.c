@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2015 - 2020, IBEROXARXA SERVICIOS INTEGRALES, S.L.
+ * Copyright (C) 2015 - 2020, Jaume Olivé Petrus (jolive@whitecatboard.org)
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *     * The WHITECAT logotype cannot be changed, you can remove it, but you
+ *       cannot change it in any way. The WHITECAT logotype is:
+ *
+ *          /\       /\
+ *         /  \_____/  \
+ *        /_____________\
+ *        W H I T E C A T
+ *
+ *     * Redistributions in binary form must retain all copyright notices printed
+ *       to any local or remote output device. This include any reference to
+ *       Lua RTOS, whitecatboard.org, Lua, and other copyright notices that may
+ *       appear in the future.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Lua RTOS, MQTT RAM persistence test cases
+ *
+ */
+
+#include "sdkconfig.h"
+
+#if CONFIG_LUA_RTOS_LUA_USE_MQTT
+
+#include "unity.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/mount.h>
+
+#include "MQTTPersistenceRam.h"
+
+// Directory of the log file
+#define RAM_TEST_DIR "/ramfs"
+
+static MQTTClient_persistence persistence;
+
+static void *ram_test_open(int size, const char *dir) {
+    static MQTTPersistenceRam_options options;
+    void *handle = NULL;
+
+    options.size = size;
+    options.dir = dir;
+
+    MQTTPersistenceRam_init(&persistence, &options);
+
+    TEST_ASSERT(persistence.popen(&handle, "client", "tcp://broker:1883", persistence.context) == 0);
+    TEST_ASSERT(handle != NULL);
+
+    return handle;
+}
+
+static int ram_test_put(void *handle, char *key, char *data, int len) {
+    char *buffers[2] = {data, data + len / 2};
+    int buflens[2] = {len / 2, len - len / 2};
+
+    return persistence.pput(handle, key, 2, buffers, buflens);
+}
+
+static void ram_test_check(void *handle, char *key, char *data, int len) {
+    char *buffer;
+    int buflen;
+
+    TEST_ASSERT(persistence.pcontainskey(handle, key) == 0);
+    TEST_ASSERT(persistence.pget(handle, key, &buffer, &buflen) == 0);
+    TEST_ASSERT(buflen == len);
+    TEST_ASSERT(memcmp(buffer, data, len) == 0);
+
+    free(buffer);
+}
+
+static int ram_test_count(void *handle) {
+    char **keys;
+    int i, nkeys;
+
+    TEST_ASSERT(persistence.pkeys(handle, &keys, &nkeys) == 0);
+
+    for (i = 0; i < nkeys; i++) {
+        free(keys[i]);
+    }
+
+    if (nkeys > 0) {
+        free(keys);
+    }
+
+    return nkeys;
+}
+
+TEST_CASE("mqtt ram persistence put, get, remove", "[mqtt]") {
+    void *handle = ram_test_open(512, NULL);
+    char *buffer;
+    int buflen;
+
+    TEST_ASSERT(ram_test_put(handle, "s-1", "first message", 13) == 0);
+    TEST_ASSERT(ram_test_put(handle, "s-2", "second message", 14) == 0);
+    TEST_ASSERT(ram_test_count(handle) == 2);
+
+    ram_test_check(handle, "s-1", "first message", 13);
+    ram_test_check(handle, "s-2", "second message", 14);
+
+    // Replace a record
+    TEST_ASSERT(ram_test_put(handle, "s-1", "replaced", 8) == 0);
+    TEST_ASSERT(ram_test_count(handle) == 2);
+    ram_test_check(handle, "s-1", "replaced", 8);
+
+    TEST_ASSERT(persistence.premove(handle, "s-1") == 0);
+    TEST_ASSERT(persistence.pcontainskey(handle, "s-1") != 0);
+    TEST_ASSERT(persistence.pget(handle, "s-1", &buffer, &buflen) != 0);
+    TEST_ASSERT(persistence.premove(handle, "s-1") != 0);
+    TEST_ASSERT(ram_test_count(handle) == 1);
+
+    TEST_ASSERT(persistence.pclear(handle) == 0);
+    TEST_ASSERT(ram_test_count(handle) == 0);
+
+    TEST_ASSERT(persistence.pclose(handle) == 0);
+}
+
+TEST_CASE("mqtt ram persistence full store", "[mqtt]") {
+    void *handle = ram_test_open(256, NULL);
+    char data[200];
+    char key[16];
+    int i;
+
+    memset(data, 'x', sizeof(data));
+
+    TEST_ASSERT(ram_test_put(handle, "a", data, 100) == 0);
+    TEST_ASSERT(ram_test_put(handle, "b", data, 100) == 0);
+
+    // Doesn't fit, the old record is kept
+    TEST_ASSERT(ram_test_put(handle, "a", data, 200) != 0);
+    ram_test_check(handle, "a", data, 100);
+
+    // Fits once the old record is dropped
+    data[0] = 'y';
+    TEST_ASSERT(ram_test_put(handle, "a", data, 120) == 0);
+    ram_test_check(handle, "a", data, 120);
+    ram_test_check(handle, "b", data + 1, 100);
+
+    TEST_ASSERT(persistence.pclear(handle) == 0);
+
+    // In-flight window of 3 messages, the space of removed records is reused
+    for (i = 0; i < 200; i++) {
+        sprintf(key, "s-%d", i);
+        TEST_ASSERT(ram_test_put(handle, key, data, 40 + (i % 7)) == 0);
+
+        if (i >= 3) {
+            sprintf(key, "s-%d", i - 3);
+            TEST_ASSERT(persistence.premove(handle, key) == 0);
+        }
+    }
+
+    TEST_ASSERT(ram_test_count(handle) == 3);
+    ram_test_check(handle, "s-199", data, 40 + (199 % 7));
+
+    TEST_ASSERT(persistence.pclose(handle) == 0);
+}
+
+TEST_CASE("mqtt ram persistence log", "[mqtt]") {
+    void *handle;
+    char data[64];
+    char key[16];
+    int i;
+
+    mount(RAM_TEST_DIR, "ramfs");
+
+    memset(data, 'z', sizeof(data));
+
+    handle = ram_test_open(512, RAM_TEST_DIR);
+    TEST_ASSERT(persistence.pclear(handle) == 0);
+
+    // Enough operations to rewrite the log a few times
+    for (i = 0; i < 100; i++) {
+        sprintf(key, "s-%d", i);
+        TEST_ASSERT(ram_test_put(handle, key, data, 50) == 0);
+
+        if (i >= 2) {
+            sprintf(key, "s-%d", i - 2);
+            TEST_ASSERT(persistence.premove(handle, key) == 0);
+        }
+    }
+
+    TEST_ASSERT(persistence.pclose(handle) == 0);
+
+    // The store is rebuilt from the log
+    handle = ram_test_open(512, RAM_TEST_DIR);
+    TEST_ASSERT(ram_test_count(handle) == 2);
+    ram_test_check(handle, "s-98", data, 50);
+    ram_test_check(handle, "s-99", data, 50);
+    TEST_ASSERT(persistence.pclear(handle) == 0);
+    TEST_ASSERT(persistence.pclose(handle) == 0);
+
+    handle = ram_test_open(512, RAM_TEST_DIR);
+    TEST_ASSERT(ram_test_count(handle) == 0);
+    TEST_ASSERT(persistence.pclose(handle) == 0);
+
+    umount(RAM_TEST_DIR);
+}
+
+TEST_CASE("mqtt ram persistence open error", "[mqtt]") {
+    MQTTPersistenceRam_options options = {512, RAM_TEST_DIR "/missing/dir"};
+    void *handle = &options;
+
+    MQTTPersistenceRam_init(&persistence, &options);
+
+    // The log can't be created, and the handle is left untouched
+    TEST_ASSERT(persistence.popen(&handle, "client", "tcp://broker:1883", persistence.context) != 0);
+    TEST_ASSERT(handle == &options);
+}
+
+#endif
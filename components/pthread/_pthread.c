@@ -70,8 +70,6 @@ static struct list active_threads;
 // in a list to allow joins after the thread termination.
 static struct list inactive_threads;
 
-struct list key_list;
-
 static uint8_t inited = 0;
 
 // Arguments for the thread task
@@ -101,8 +99,6 @@ void _pthread_init() {
         lstinit(&active_threads, 1, LIST_NOT_INDEXED);
         lstinit(&inactive_threads, 1, LIST_NOT_INDEXED);
 
-        lstinit(&key_list, 1, LIST_DEFAULT);
-
         inited = 1;
     }
 }
@@ -650,6 +646,9 @@ void pthreadTask(void *taskArgs) {
     // Call start function
     void *ret = args->pthread_function(args->args);
 
+    // Call destructors of thread-specific data
+    _pthread_key_destroy(thread);
+
     _pthread_lock();
 
     if (args->thread->attr.detachstate == PTHREAD_CREATE_JOINABLE) {
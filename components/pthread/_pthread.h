@@ -94,6 +94,16 @@
 #define PTHREAD_MTX_DEBUG_LOCK()
 #endif
 
+// Each thread has a slot for each key, so thread-specific data can be get / set
+// without locks.
+//
+// This defines how many keys can be created
+#define PTHREAD_NKEYS 16
+
+// Number of times that the destructors of thread-specific data are called on thread
+// exit, while there are non NULL values
+#define PTHREAD_KEY_DESTRUCTOR_ITERATIONS 4
+
 // Minimal stack size per thread
 #define PTHREAD_STACK_MIN (1024 * 2)
 
@@ -121,12 +131,12 @@ struct pthread_cond {
 };
 
 struct pthread_key_specific {
-    pthread_t thread;
+    uint32_t seq;
     const void *value;
 };
 
 struct pthread_key {
-    struct list specific;
+    uint32_t seq;
     void (*destructor)(void*);
 };
 
@@ -149,6 +159,7 @@ struct pthread {
     xTaskHandle joined_task;
     void *res;
     pthread_attr_t attr;
+    struct pthread_key_specific specific[PTHREAD_NKEYS];
 };
 
 // Helper functions, only for internal use
@@ -176,6 +187,7 @@ void  _pthread_cleanup_push(void (*routine)(void *), void *arg);
 void  _pthread_cleanup_pop(int execute);
 void  _pthread_cleanup();
 int   _pthread_detach(pthread_t id);
+void  _pthread_key_destroy(struct pthread *thread);
 
 // API functions
 int  pthread_attr_init(pthread_attr_t *attr);
@@ -44,120 +44,135 @@
  */
 
 #include "_pthread.h"
+#include "esp_attr.h"
 
-#include <stdlib.h>
+// Keys. A key is in use when its sequence number is odd. The sequence number
+// changes each time that the key is created or deleted, and it's stored
+// with the thread-specific values, so values set before the key was deleted
+// are not visible after the key is created again.
+static struct pthread_key keys[PTHREAD_NKEYS];
 
-extern struct list key_list;
+// Thread-specific values for tasks that are not threads
+static struct pthread_key_specific nothread_specific[PTHREAD_NKEYS];
 
-int pthread_key_create(pthread_key_t *k, void (*destructor)(void*)) {
-    struct pthread_key *key;
-    int res;
+static portMUX_TYPE key_mux = portMUX_INITIALIZER_UNLOCKED;
 
-    // Allocate space for the key
-    key = (struct pthread_key *)malloc(sizeof(struct pthread_key));
-    if (!key) {
-        return ENOMEM;
-    }
-    
-    // Init key
-    key->destructor = destructor;
-    
-    lstinit(&key->specific, 1, LIST_DEFAULT);
-    
-    // Add key to key list
-    res = lstadd(&key_list, (void *)key, (int*)k);
-    if (res) {
-        free(key);
-        return res;
-    }
+#define key_in_use(k) \
+    ((k >= 0) && (k < PTHREAD_NKEYS) && (keys[k].seq & 1))
 
-    return 0;
-}
+static inline struct pthread_key_specific *key_specific(pthread_key_t k) {
+    struct pthread *thread = (struct pthread *)pthread_self();
 
-int pthread_setspecific(pthread_key_t k, const void *value) {
-    struct pthread_key_specific *specific;
-    struct pthread_key *key;
-    pthread_t thread;
-    int res;
-	int index;
-
-    // Get key
-    res = lstget(&key_list, k, (void **)&key);
-    if (res) {
-        return res;
+    if (thread) {
+        return &thread->specific[k];
     }
 
-    if (value) {
-        // Allocate space for specific
-        specific = (struct pthread_key_specific *)malloc(sizeof(struct pthread_key_specific));
-        if (!specific) {
-            return ENOMEM;
-        }
+    return &nothread_specific[k];
+}
 
-        specific->thread = pthread_self();
-        specific->value = value;
+int pthread_key_create(pthread_key_t *k, void (*destructor)(void*)) {
+    int i;
 
-        lstadd(&key->specific, (void **)specific, &index);
-    } else {
-        thread = pthread_self();
+    portENTER_CRITICAL(&key_mux);
 
-        index = lstfirst(&key->specific);
-        while (index >= 0) {
-            lstget(&key->specific, index, (void **)&specific);
+    // Get a free key
+    for(i = 0;i < PTHREAD_NKEYS;i++) {
+        if (!(keys[i].seq & 1)) {
+            keys[i].destructor = destructor;
+            keys[i].seq++;
 
-            if (specific->thread == thread) {
-            	lstremove(&key->specific, k, 1);
-            	break;
-            }
+            portEXIT_CRITICAL(&key_mux);
+
+            *k = i;
 
-            index = lstnext(&key->specific, index);
+            return 0;
         }
     }
 
+    portEXIT_CRITICAL(&key_mux);
+
+    return EAGAIN;
+}
+
+int pthread_setspecific(pthread_key_t k, const void *value) {
+    struct pthread_key_specific *specific;
+
+    if (!key_in_use(k)) {
+        return EINVAL;
+    }
+
+    specific = key_specific(k);
+
+    specific->value = value;
+    specific->seq = keys[k].seq;
+
     return 0;
 }
 
-void *pthread_getspecific(pthread_key_t k) {
+void *IRAM_ATTR pthread_getspecific(pthread_key_t k) {
     struct pthread_key_specific *specific;
-    struct pthread_key *key;
-    pthread_t thread;
-    int res;
-    int index;
-
-    // Get key
-    res = lstget(&key_list, k, (void **)&key);
-    if (res) {
+
+    if (!key_in_use(k)) {
         return NULL;
     }
-    
-    // Get specific value
-    thread = pthread_self();
-
-    index = lstfirst(&key->specific);
-    while (index >= 0) {
-        lstget(&key->specific, index, (void **)&specific);
-                
-        if (specific->thread == thread) {
-            return (void *)specific->value;
-        }
-        
-        index = lstnext(&key->specific, index);
+
+    specific = key_specific(k);
+
+    // Value was set for a previous use of the key
+    if (specific->seq != keys[k].seq) {
+        return NULL;
     }
-    
-    return NULL;
+
+    return (void *)specific->value;
 }
 
 int pthread_key_delete(pthread_key_t k) {
-    struct pthread_key *key;
-    int res;
+    portENTER_CRITICAL(&key_mux);
+
+    if (!key_in_use(k)) {
+        portEXIT_CRITICAL(&key_mux);
 
-    // Get key
-    res = lstget(&key_list, k, (void **)&key);
-    if (res) {
-        return res;
+        return EINVAL;
     }
-    
-    lstremove(&key_list, k, 1);
+
+    keys[k].destructor = NULL;
+    keys[k].seq++;
+
+    portEXIT_CRITICAL(&key_mux);
 
     return 0;
 }
+
+void _pthread_key_destroy(struct pthread *thread) {
+    struct pthread_key_specific *specific;
+    void (*destructor)(void*);
+    const void *value;
+    int i, k, called;
+
+    for(i = 0;i < PTHREAD_KEY_DESTRUCTOR_ITERATIONS;i++) {
+        called = 0;
+
+        for(k = 0;k < PTHREAD_NKEYS;k++) {
+            specific = &thread->specific[k];
+
+            if (!key_in_use(k) || (specific->seq != keys[k].seq) || !specific->value) {
+                continue;
+            }
+
+            destructor = keys[k].destructor;
+            value = specific->value;
+
+            // Value must be NULL before calling the destructor
+            specific->value = NULL;
+
+            if (destructor) {
+                destructor((void *)value);
+                called = 1;
+            }
+        }
+
+        if (!called) {
+            break;
+        }
+    }
+}
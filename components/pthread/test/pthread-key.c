@@ -0,0 +1,90 @@
+#include "unity.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sys/delay.h>
+
+#define NUM_THREADS  2
+
+static pthread_t threads[NUM_THREADS];
+
+static pthread_key_t key;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static int destroyed;
+
+static void destructor(void *value) {
+	int ret;
+
+	ret = pthread_mutex_lock(&mutex);
+	TEST_ASSERT(ret == 0);
+
+	destroyed += *((int *)value);
+
+	ret = pthread_mutex_unlock(&mutex);
+	TEST_ASSERT(ret == 0);
+}
+
+static void *thread1(void *args) {
+	int ret;
+
+	TEST_ASSERT(pthread_getspecific(key) == NULL);
+
+	ret = pthread_setspecific(key, args);
+	TEST_ASSERT(ret == 0);
+
+	// Simulate some work
+	usleep(1000);
+
+	// Each thread must see its own value
+	TEST_ASSERT(pthread_getspecific(key) == args);
+
+	pthread_exit(NULL);
+ }
+
+TEST_CASE("pthread key", "[pthread]") {
+	pthread_attr_t attr;
+	int values[NUM_THREADS] = {1, 2};
+	int i, ret;
+
+	ret = pthread_attr_init(&attr);
+	TEST_ASSERT(ret == 0);
+
+	ret = pthread_key_create(&key, destructor);
+	TEST_ASSERT(ret == 0);
+
+	for (i=0; i< NUM_THREADS; i++) {
+		ret = pthread_create(&threads[i], &attr, thread1, &values[i]);
+		TEST_ASSERT(ret == 0);
+	}
+
+	// Wait for all threads completion
+	for (i=0; i< NUM_THREADS; i++) {
+		ret = pthread_join(threads[i], NULL);
+		TEST_ASSERT(ret == 0);
+	}
+
+	// Destructors must be called on thread exit
+	TEST_ASSERT(destroyed == 3);
+
+	// Values set before deleting the key are not visible if key is created again
+	ret = pthread_setspecific(key, &values[0]);
+	TEST_ASSERT(ret == 0);
+
+	ret = pthread_key_delete(key);
+	TEST_ASSERT(ret == 0);
+
+	ret = pthread_setspecific(key, &values[0]);
+	TEST_ASSERT(ret == EINVAL);
+
+	ret = pthread_key_create(&key, NULL);
+	TEST_ASSERT(ret == 0);
+
+	TEST_ASSERT(pthread_getspecific(key) == NULL);
+
+	// Clean up
+	ret = pthread_key_delete(key);
+	TEST_ASSERT(ret == 0);
+
+	ret = pthread_attr_destroy(&attr);
+	TEST_ASSERT(ret == 0);
+}
@@ -56,6 +56,7 @@ static void remove_reference(ramfs_t *fs, ramfs_entry_t *entry);
 static int get_reference_uses(ramfs_t *fs, ramfs_entry_t *entry);
 static void remove_block(ramfs_t *fs, ramfs_file_t *file);
 static int add_block(ramfs_t *fs, ramfs_file_t *file);
+static ramfs_block_t *get_block(ramfs_t *fs, ramfs_file_t *file, ramfs_size_t block_num);
 static int add_entry(ramfs_t *fs, const char *name, ramfs_entry_t *parent, ramfs_entry_t **entry, ramfs_entry_type_t entry_type);
 static void remove_entry(ramfs_t *fs, ramfs_entry_t *entry, ramfs_entry_t *parent_entry, ramfs_entry_t *prev_entry, int remove);
 static int traverse(ramfs_t *fs, const char *path, ramfs_entry_t **entry, ramfs_entry_t **parent_entry, ramfs_entry_t **prev_entry, int creat, ramfs_entry_type_t type);
@@ -149,28 +150,41 @@ static int get_reference_uses(ramfs_t *fs, ramfs_entry_t *entry) {
 }
 
 static void remove_block(ramfs_t *fs, ramfs_file_t *file) {
+    ram_file_header_t *header = file->entry->file.header;
     ramfs_block_t *block;
 
-    block = file->entry->file.header->tail;
+    block = header->tail;
     if (block) {
-        // Find the block into the file block chain to
+        // Find the previous block into the file block chain to
         // update the block chain
         ramfs_block_t *prev_block = NULL;
-        ramfs_block_t *cblock = file->entry->file.header->head;
 
-        while (cblock && (cblock != block)) {
-            prev_block = cblock;
-            cblock = cblock->next;
+        if (header->index) {
+            if (header->blocks > 1) {
+                prev_block = header->index[header->blocks - 2];
+            }
+        } else {
+            ramfs_block_t *cblock = header->head;
+
+            while (cblock && (cblock != block)) {
+                prev_block = cblock;
+                cblock = cblock->next;
+            }
         }
 
         if (prev_block) {
             prev_block->next = NULL;
-            file->entry->file.header->tail = prev_block;
+            header->tail = prev_block;
         }    else {
-            file->entry->file.header->head = NULL;
-            file->entry->file.header->tail = NULL;
+            header->head = NULL;
+            header->tail = NULL;
         }
 
+        header->blocks--;
+
+        // Cached blocks of the opened files can point to the removed block
+        header->version++;
+
         // Free block
         free(block);
 
@@ -180,31 +194,56 @@ static void remove_block(ramfs_t *fs, ramfs_file_t *file) {
 }
 
 static int add_block(ramfs_t *fs, ramfs_file_t *file) {
+    ram_file_header_t *header = file->entry->file.header;
+
     // Check for space
     ramfs_size_t size = sizeof(ramfs_block_t) + fs->block_size - 1;
+    ramfs_size_t index_size = header->index_size;
+
+    if (fs->block_index && (header->blocks == index_size)) {
+        // Block index must grow
+        index_size = (index_size ? index_size * 2 : 8);
+    }
 
-    if (fs->current_size + size > fs->size) {
+    ramfs_size_t index_grow = (index_size - header->index_size) * sizeof(ramfs_block_t *);
+
+    if (fs->current_size + size + index_grow > fs->size) {
         return RAMFS_ERR_NOSPC;
     }
 
+    if (index_grow) {
+        ramfs_block_t **index = (ramfs_block_t **)realloc(header->index, index_size * sizeof(ramfs_block_t *));
+        if (!index) {
+            return RAMFS_ERR_NOMEM;
+        }
+
+        header->index = index;
+        header->index_size = index_size;
+
+        fs->current_size += index_grow;
+    }
+
     // Create block
     ramfs_block_t *block = (ramfs_block_t *)calloc(1, size);
     if (!block) {
         return RAMFS_ERR_NOMEM;
     }
 
-    if (!file->entry->file.header->head) {
+    if (!header->head) {
         // First block of the file
-        file->entry->file.header->head = block;
-        file->entry->file.header->tail = block;
+        header->head = block;
+        header->tail = block;
     } else {
         // Add the block to the end of the file block chain
-        file->entry->file.header->tail->next = block;
-        file->entry->file.header->tail = block;
+        header->tail->next = block;
+        header->tail = block;
     }
 
-    file->block = block;
-    file->ptr = block->data;
+    if (header->index) {
+        header->index[header->blocks] = block;
+    }
+
+    header->blocks++;
 
     // Update the file system size
     fs->current_size += size;
@@ -212,6 +251,48 @@ static int add_block(ramfs_t *fs, ramfs_file_t *file) {
     return RAMFS_ERR_OK;
 }
 
+/*
+ * Get a block of a file by its number. The last block used by the file is cached,
+ * so sequential access and seeks forward don't need to walk the block chain from
+ * the head.
+ */
+static ramfs_block_t *get_block(ramfs_t *fs, ramfs_file_t *file, ramfs_size_t block_num) {
+    ram_file_header_t *header = file->entry->file.header;
+    ramfs_block_t *block;
+    ramfs_size_t curr_block;
+
+    if (block_num >= header->blocks) {
+        return NULL;
+    }
+
+    if (file->block && (file->version == header->version) && (file->block_num == block_num)) {
+        return file->block;
+    }
+
+    if (header->index) {
+        block = header->index[block_num];
+    } else {
+        if (file->block && (file->version == header->version) && (file->block_num < block_num)) {
+            // Start from the cached block
+            block = file->block;
+            curr_block = file->block_num;
+        } else {
+            block = header->head;
+            curr_block = 0;
+        }
+
+        for(;block && (curr_block < block_num);curr_block++) {
+            block = block->next;
+        }
+    }
+
+    file->block = block;
+    file->block_num = block_num;
+    file->version = header->version;
+
+    return block;
+}
+
 static int add_entry(ramfs_t *fs, const char *name, ramfs_entry_t *parent, ramfs_entry_t **entry, ramfs_entry_type_t entry_type) {
     int name_len = strlen(name);
 
@@ -323,6 +404,7 @@ static void remove_entry(ramfs_t *fs, ramfs_entry_t *entry, ramfs_entry_t *paren
         ramfs_block_t *tmp;
 
         size += sizeof(ram_file_header_t);
+        size += entry->file.header->index_size * sizeof(ramfs_block_t *);
 
         while (block) {
             size += sizeof(ramfs_block_t) + fs->block_size - 1;
@@ -333,6 +415,7 @@ static void remove_entry(ramfs_t *fs, ramfs_entry_t *entry, ramfs_entry_t *paren
             free(tmp);
         }
 
+        free(entry->file.header->index);
         free(entry->file.header);
     }
 
@@ -484,28 +567,13 @@ static ramfs_off_t ramfs_file_seek_internal(ramfs_t *fs, ramfs_file_t *file, ram
         return RAMFS_ERR_INVAL;
     }
 
-    int block_num = file->offset / fs->block_size;
-    int block_off = file->offset % fs->block_size;
-
-    if (file->entry->file.header->head) {
-        ramfs_block_t *block = file->entry->file.header->head;
-        int curr_block;
-
-        for(curr_block = 0;block && (curr_block < block_num);curr_block++) {
-            block = block->next;
-        }
-
-        file->block = block;
-        file->ptr = (block?block->data + block_off:NULL);
-    } else {
-        file->block = NULL;
-        file->ptr = NULL;
-    }
-
-    return block_num * fs->block_size + block_off;
+    // The block for the new offset is get on the next read / write, starting
+    // from the cached block
+    return file->offset;
 }
 
 static int ramfs_file_truncate_internal(ramfs_t *fs, ramfs_file_t *file, ramfs_off_t size) {
+    ram_file_header_t *header;
     ramfs_error_t ret;
 
     int access_mode = (file->flags & RAMFS_ACCMODE);
@@ -522,28 +590,31 @@ static int ramfs_file_truncate_internal(ramfs_t *fs, ramfs_file_t *file, ramfs_o
         return RAMFS_ERR_INVAL;
     }
 
-    int block_delta = ((size - 1) / fs->block_size) - ((file->entry->file.header->size - 1) / fs->block_size);
+    header = file->entry->file.header;
 
-    if (block_delta < 0) {
-        // Decrease size
-        while (block_delta < 0) {
-            remove_block(fs, file);
-            block_delta++;
-        }
-    } else if (block_delta > 0) {
-        // Increase size
-        while (block_delta > 0) {
-            if ((ret = add_block(fs, file)) != RAMFS_ERR_OK) {
-                return ret;
-            }
+    ramfs_size_t blocks = (size + fs->block_size - 1) / fs->block_size;
 
-            block_delta--;
-        }
+    // Decrease size
+    while (header->blocks > blocks) {
+        remove_block(fs, file);
+    }
+
+    // Bytes after the end of file must be 0, so if the file grows later
+    // the gap is read as 0
+    if ((size < header->size) && (size % fs->block_size)) {
+        ramfs_block_t *block = get_block(fs, file, size / fs->block_size);
+
+        memset(block->data + (size % fs->block_size), 0, fs->block_size - (size % fs->block_size));
     }
 
-    file->entry->file.header->size = size;
+    // Increase size
+    while (header->blocks < blocks) {
+        if ((ret = add_block(fs, file)) != RAMFS_ERR_OK) {
+            return ret;
+        }
+    }
 
-    ramfs_file_seek_internal(fs, file, file->offset, RAMFS_SEEK_SET);
+    header->size = size;
 
     return RAMFS_ERR_OK;
 }
@@ -555,6 +626,7 @@ int ramfs_mount(ramfs_t *fs, ramfs_config_t *config) {
 
     fs->size = config->size;
     fs->block_size = config->block_size;
+    fs->block_index = config->block_index;
 
     return RAMFS_ERR_OK;
 }
@@ -862,6 +934,11 @@ int ramfs_file_sync(ramfs_t *fs, ramfs_file_t *file) {
 }
 
 ramfs_size_t ramfs_file_read(ramfs_t *fs, ramfs_file_t *file, void *buffer, ramfs_size_t size) {
+    ram_file_header_t *header;
+    ramfs_block_t *block;
+    ramfs_size_t block_off;
+    ramfs_size_t bytes;
+
     int access_mode = (file->flags & RAMFS_ACCMODE);
 
     if ((access_mode != RAMFS_O_RDONLY) && (access_mode != RAMFS_O_RDWR)) {
@@ -870,32 +947,37 @@ ramfs_size_t ramfs_file_read(ramfs_t *fs, ramfs_file_t *file, void *buffer, ramf
 
     ramfs_lock(fs->lock);
 
-    ramfs_size_t reads = 0;
-    while ((reads < size) && (file->offset < file->entry->file.header->size)) {
-        if ((!file->block) || (file->ptr > file->block->data + fs->block_size - 1)) {
-            if (file->block) {
-                file->block = file->block->next;
-                if (file->block) {
-                    file->ptr = file->block->data;
-                } else {
-                    file->ptr = NULL;
-                    ramfs_unlock(fs->lock);
+    header = file->entry->file.header;
 
-                    return reads;
-                }
-            } else {
-                file->block = NULL;
-                file->ptr = NULL;
+    // Don't read past the end of file
+    if (file->offset >= header->size) {
+        ramfs_unlock(fs->lock);
 
-                ramfs_unlock(fs->lock);
-                return reads;
-            }
+        return 0;
+    }
+
+    if (size > header->size - file->offset) {
+        size = header->size - file->offset;
+    }
+
+    ramfs_size_t reads = 0;
+    while (reads < size) {
+        block = get_block(fs, file, file->offset / fs->block_size);
+        if (!block) {
+            break;
+        }
+
+        // Copy the block span
+        block_off = file->offset % fs->block_size;
+        bytes = fs->block_size - block_off;
+        if (bytes > size - reads) {
+            bytes = size - reads;
         }
 
-        *(((uint8_t *)buffer++)) = *(file->ptr++);
+        memcpy((uint8_t *)buffer + reads, block->data + block_off, bytes);
 
-        reads++;
-        file->offset++;
+        reads += bytes;
+        file->offset += bytes;
     }
 
     ramfs_unlock(fs->lock);
@@ -904,7 +986,12 @@ ramfs_size_t ramfs_file_read(ramfs_t *fs, ramfs_file_t *file, void *buffer, ramf
 }
 
 ramfs_size_t ramfs_file_write(ramfs_t *fs, ramfs_file_t *file, const void *buffer, ramfs_size_t size) {
-    ramfs_error_t ret;
+    ram_file_header_t *header;
+    ramfs_block_t *block;
+    ramfs_size_t block_num;
+    ramfs_size_t block_off;
+    ramfs_size_t bytes;
+    ramfs_error_t ret = RAMFS_ERR_OK;
 
     int access_mode = (file->flags & RAMFS_ACCMODE);
 
@@ -914,35 +1001,54 @@ ramfs_size_t ramfs_file_write(ramfs_t *fs, ramfs_file_t *file, const void *buffe
 
     ramfs_lock(fs->lock);
 
+    header = file->entry->file.header;
+
+    if (file->flags & RAMFS_O_APPEND) {
+        file->offset = header->size;
+    }
+
     ramfs_size_t writes = 0;
     while (writes < size) {
-        if ((!file->block) || (!file->ptr) || (file->ptr > file->block->data + fs->block_size - 1)) {
-            if (file->block && file->block->next) {
-                file->block = file->block->next;
-                file->ptr = file->block->data;
-            } else {
-                ret = add_block(fs, file);
-                if (ret != RAMFS_ERR_OK) {
-                    file->block = NULL;
-                    file->ptr = NULL;
-                    ramfs_unlock(fs->lock);
-                    return ret;
-                }
+        block_num = file->offset / fs->block_size;
+
+        // Add the required blocks. Blocks are created filled with 0, so if
+        // offset is past the end of file, the gap is read as 0
+        while (header->blocks <= block_num) {
+            if ((ret = add_block(fs, file)) != RAMFS_ERR_OK) {
+                break;
             }
         }
 
-        *(file->ptr++) = *(((uint8_t *)buffer++));
+        if (ret != RAMFS_ERR_OK) {
+            break;
+        }
 
-        writes++;
-        file->offset++;
+        block = get_block(fs, file, block_num);
 
-        if (file->offset > file->entry->file.header->size) {
-            file->entry->file.header->size++;
+        // Copy the block span
+        block_off = file->offset % fs->block_size;
+        bytes = fs->block_size - block_off;
+        if (bytes > size - writes) {
+            bytes = size - writes;
+        }
+
+        memcpy(block->data + block_off, (const uint8_t *)buffer + writes, bytes);
+
+        writes += bytes;
+        file->offset += bytes;
+
+        if (file->offset > header->size) {
+            header->size = file->offset;
         }
     }
 
     ramfs_unlock(fs->lock);
 
+    // Return the error only if nothing was written
+    if ((writes == 0) && (ret != RAMFS_ERR_OK)) {
+        return ret;
+    }
+
     return writes;
 }
 
@@ -190,9 +190,13 @@ typedef struct ramfs_block {
 } ramfs_block_t;
 
 typedef struct ram_file_header {
-    ramfs_block_t *head; /*!< File head */
-    ramfs_block_t *tail; /*!< File tail */
-    ramfs_size_t  size;  /*!< File size */
+    ramfs_block_t *head;      /*!< File head */
+    ramfs_block_t *tail;      /*!< File tail */
+    ramfs_size_t  size;       /*!< File size */
+    ramfs_size_t  blocks;     /*!< Number of blocks in chain */
+    ramfs_block_t **index;    /*!< Block index, only if enabled in the file system */
+    ramfs_size_t  index_size; /*!< Number of entries allocated in the block index */
+    uint32_t      version;    /*!< Incremented each time a block is removed */
 } ram_file_header_t;
 
 typedef struct ramfs_entry {
@@ -216,11 +220,12 @@ typedef struct {
 } ramfs_dir_t;
 
 typedef struct {
-    ramfs_entry_t *entry; /*!< File entry reference */
-    uint32_t flags;       /*!< Open flags */
-    ramfs_off_t offset;   /*!< Current seek offset */
-    ramfs_block_t *block; /*!< Current read/write block */
-    uint8_t *ptr;         /*!< Current read/write pointer into current block */
+    ramfs_entry_t *entry;   /*!< File entry reference */
+    uint32_t flags;         /*!< Open flags */
+    ramfs_off_t offset;     /*!< Current seek offset */
+    ramfs_block_t *block;   /*!< Cached block */
+    ramfs_size_t block_num; /*!< Number of the cached block */
+    uint32_t version;       /*!< File header version when block was cached */
 } ramfs_file_t;
 
 typedef struct {
@@ -241,6 +246,7 @@ typedef struct {
     ramfs_size_t size;
     ramfs_size_t current_size;
     ramfs_size_t block_size;
+    uint8_t block_index;
 #ifdef ramfs_lock_t
     ramfs_lock_t lock;
 #endif
@@ -249,6 +255,7 @@ typedef struct {
 typedef struct {
     ramfs_size_t size;
     ramfs_size_t block_size;
+    uint8_t block_index;     /*!< If 1, files have a block index for random access */
 } ramfs_config_t;
 
 int ramfs_mount(ramfs_t *fs, ramfs_config_t *config);
@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2015 - 2020, IBEROXARXA SERVICIOS INTEGRALES, S.L.
+ * Copyright (C) 2015 - 2020, Jaume Olivé Petrus (jolive@whitecatboard.org)
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *     * The WHITECAT logotype cannot be changed, you can remove it, but you
+ *       cannot change it in any way. The WHITECAT logotype is:
+ *
+ *          /\       /\
+ *         /  \_____/  \
+ *        /_____________\
+ *        W H I T E C A T
+ *
+ *     * Redistributions in binary form must retain all copyright notices printed
+ *       to any local or remote output device. This include any reference to
+ *       Lua RTOS, whitecatboard.org, Lua, and other copyright notices that may
+ *       appear in the future.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Lua RTOS, RAM file system test cases
+ *
+ */
+
+#include "unity.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "ramfs.h"
+
+#define RAMFS_TEST_BLOCK_SIZE 512
+#define RAMFS_TEST_FILE_SIZE  (32 * 1024)
+
+// Size of the random reads
+#define RAMFS_TEST_RANDOM_SIZE 64
+#define RAMFS_TEST_RANDOM_OPS  2000
+
+static uint8_t *ramfs_test_data;
+static uint8_t *ramfs_test_buffer;
+
+static int64_t ramfs_us(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static int64_t ramfs_rate(int64_t bytes, int64_t us) {
+    return bytes * 1000000 / 1024 / ((us > 0)?us:1);
+}
+
+static void ramfs_test_mount(ramfs_t *fs, int block_index) {
+    ramfs_config_t config;
+
+    config.size = 2 * RAMFS_TEST_FILE_SIZE;
+    config.block_size = RAMFS_TEST_BLOCK_SIZE;
+    config.block_index = block_index;
+
+    TEST_ASSERT(ramfs_mount(fs, &config) == RAMFS_ERR_OK);
+}
+
+static void ramfs_test_alloc(void) {
+    int i;
+
+    ramfs_test_data = malloc(RAMFS_TEST_FILE_SIZE);
+    ramfs_test_buffer = malloc(RAMFS_TEST_FILE_SIZE);
+    TEST_ASSERT(ramfs_test_data != NULL);
+    TEST_ASSERT(ramfs_test_buffer != NULL);
+
+    for (i = 0; i < RAMFS_TEST_FILE_SIZE; i++) {
+        ramfs_test_data[i] = (i * 7) ^ (i >> 8);
+    }
+}
+
+static void ramfs_test_free(void) {
+    free(ramfs_test_data);
+    free(ramfs_test_buffer);
+}
+
+// Write the test data in chunks that don't match the block size, and read it
+// back from random offsets
+static void ramfs_test_rw(int block_index) {
+    ramfs_file_t file;
+    ramfs_t fs;
+    uint32_t seed = 1;
+    int off, len, done;
+    int i;
+
+    ramfs_test_mount(&fs, block_index);
+
+    TEST_ASSERT(ramfs_file_open(&fs, &file, "/data", RAMFS_O_RDWR | RAMFS_O_CREAT) == RAMFS_ERR_OK);
+
+    for (done = 0; done < RAMFS_TEST_FILE_SIZE; done += len) {
+        len = 1 + (done % 700);
+        if (len > RAMFS_TEST_FILE_SIZE - done) {
+            len = RAMFS_TEST_FILE_SIZE - done;
+        }
+
+        TEST_ASSERT(ramfs_file_write(&fs, &file, ramfs_test_data + done, len) == len);
+    }
+
+    for (i = 0; i < 500; i++) {
+        seed = seed * 1103515245 + 12345;
+        off = (seed >> 8) % RAMFS_TEST_FILE_SIZE;
+        len = 1 + (seed >> 4) % (2 * RAMFS_TEST_BLOCK_SIZE);
+        if (len > RAMFS_TEST_FILE_SIZE - off) {
+            len = RAMFS_TEST_FILE_SIZE - off;
+        }
+
+        TEST_ASSERT(ramfs_file_seek(&fs, &file, off, RAMFS_SEEK_SET) == off);
+        TEST_ASSERT(ramfs_file_read(&fs, &file, ramfs_test_buffer, len) == len);
+        TEST_ASSERT(memcmp(ramfs_test_buffer, ramfs_test_data + off, len) == 0);
+    }
+
+    // Reads stop at the end of the file
+    TEST_ASSERT(ramfs_file_seek(&fs, &file, -10, RAMFS_SEEK_END) == RAMFS_TEST_FILE_SIZE - 10);
+    TEST_ASSERT(ramfs_file_read(&fs, &file, ramfs_test_buffer, 100) == 10);
+    TEST_ASSERT(ramfs_file_read(&fs, &file, ramfs_test_buffer, 100) == 0);
+
+    TEST_ASSERT(ramfs_file_close(&fs, &file) == RAMFS_ERR_OK);
+    TEST_ASSERT(ramfs_umount(&fs) == RAMFS_ERR_OK);
+}
+
+TEST_CASE("ramfs read and write", "[ramfs]") {
+    ramfs_test_alloc();
+
+    ramfs_test_rw(0);
+    ramfs_test_rw(1);
+
+    ramfs_test_free();
+}
+
+TEST_CASE("ramfs throughput", "[ramfs][bench]") {
+    int64_t seq_write, seq_read, random_read;
+    ramfs_file_t file;
+    ramfs_t fs;
+    uint32_t seed;
+    int block_index;
+    int64_t t0;
+    int off, i;
+
+    ramfs_test_alloc();
+
+    // Memory bandwidth, as reference
+    t0 = ramfs_us();
+    memcpy(ramfs_test_buffer, ramfs_test_data, RAMFS_TEST_FILE_SIZE);
+    t0 = ramfs_us() - t0;
+
+    printf("ramfs: memcpy %lld KB/s\n", ramfs_rate(RAMFS_TEST_FILE_SIZE, t0));
+
+    for (block_index = 0; block_index <= 1; block_index++) {
+        ramfs_test_mount(&fs, block_index);
+
+        TEST_ASSERT(ramfs_file_open(&fs, &file, "/data", RAMFS_O_RDWR | RAMFS_O_CREAT) == RAMFS_ERR_OK);
+
+        // Sequential write and read, in chunks of the block size
+        seq_write = ramfs_us();
+        for (off = 0; off < RAMFS_TEST_FILE_SIZE; off += RAMFS_TEST_BLOCK_SIZE) {
+            TEST_ASSERT(ramfs_file_write(&fs, &file, ramfs_test_data + off, RAMFS_TEST_BLOCK_SIZE) == RAMFS_TEST_BLOCK_SIZE);
+        }
+        seq_write = ramfs_us() - seq_write;
+
+        TEST_ASSERT(ramfs_file_seek(&fs, &file, 0, RAMFS_SEEK_SET) == 0);
+
+        seq_read = ramfs_us();
+        for (off = 0; off < RAMFS_TEST_FILE_SIZE; off += RAMFS_TEST_BLOCK_SIZE) {
+            TEST_ASSERT(ramfs_file_read(&fs, &file, ramfs_test_buffer + off, RAMFS_TEST_BLOCK_SIZE) == RAMFS_TEST_BLOCK_SIZE);
+        }
+        seq_read = ramfs_us() - seq_read;
+
+        TEST_ASSERT(memcmp(ramfs_test_buffer, ramfs_test_data, RAMFS_TEST_FILE_SIZE) == 0);
+
+        // Random seeks and reads
+        seed = 1;
+        random_read = ramfs_us();
+        for (i = 0; i < RAMFS_TEST_RANDOM_OPS; i++) {
+            seed = seed * 1103515245 + 12345;
+            off = (seed >> 8) % (RAMFS_TEST_FILE_SIZE - RAMFS_TEST_RANDOM_SIZE);
+
+            ramfs_file_seek(&fs, &file, off, RAMFS_SEEK_SET);
+            ramfs_file_read(&fs, &file, ramfs_test_buffer, RAMFS_TEST_RANDOM_SIZE);
+        }
+        random_read = ramfs_us() - random_read;
+
+        TEST_ASSERT(memcmp(ramfs_test_buffer, ramfs_test_data + off, RAMFS_TEST_RANDOM_SIZE) == 0);
+
+        printf("ramfs: block index %d, sequential write %lld KB/s, sequential read %lld KB/s, random read %lld KB/s\n",
+            block_index, ramfs_rate(RAMFS_TEST_FILE_SIZE, seq_write), ramfs_rate(RAMFS_TEST_FILE_SIZE, seq_read),
+            ramfs_rate(RAMFS_TEST_RANDOM_OPS * RAMFS_TEST_RANDOM_SIZE, random_read));
+
+        TEST_ASSERT(ramfs_file_close(&fs, &file) == RAMFS_ERR_OK);
+        TEST_ASSERT(ramfs_umount(&fs) == RAMFS_ERR_OK);
+    }
+
+    ramfs_test_free();
+}
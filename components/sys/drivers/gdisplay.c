@@ -50,10 +50,16 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+
 #include <stdlib.h>
+#include <string.h>
 
 #include <machine/endian.h>
 
+#include <sys/tiles.h>
+
 #include <gdisplay/gdisplay.h>
 #include <drivers/gdisplay.h>
 #include <drivers/gpio.h>
@@ -86,6 +92,23 @@ static int buff_y1 = 0;
 // Pixels in buffer
 static int buff_pixels  = 0;
 
+/*
+ * Second DMA buffer
+ *
+ * When the frame buffer is used, the pixels to update are copied from the
+ * frame buffer in chunks, alternating between buff and dma_buff, so the next
+ * chunk is copied while the previous one is sent by DMA.
+ *
+ */
+static uint8_t *dma_buff = NULL;
+
+// Tiles of the frame buffer changed since the last update
+static tiles_t tiles = {NULL, 0, 0, 0, 0, 0, 0, 0};
+
+// Update statistics
+static gdisplay_stats_t stats;
+static int64_t stats_since = 0;
+
 void gdisplay_ll_command(uint8_t command) {
 	gpio_ll_pin_clr(CONFIG_LUA_RTOS_GDISPLAY_CMD);
 	spi_ll_select(caps.device);
@@ -151,12 +174,20 @@ uint8_t *gdisplay_ll_allocate_buffer(uint32_t size) {
 	if (caps.bytes_per_pixel == 0) {
 		buff = calloc(size, 1);
 	} else {
-		buff = calloc(size, caps.bytes_per_pixel);
+		buff = heap_caps_calloc(size, caps.bytes_per_pixel, MALLOC_CAP_DMA);
 	}
 	if (!buff) {
 		return NULL;
 	}
 
+	// If there is not memory for the second buffer, updates are done
+	// without overlapping copies and transfers
+	if ((caps.bytes_per_pixel > 0) && (caps.interface == GDisplaySPIInterface)) {
+		dma_buff = heap_caps_malloc(size * caps.bytes_per_pixel, MALLOC_CAP_DMA);
+	}
+
+	gdisplay_ll_reset_stats();
+
 	buff_size = size;
 
 	gdisplay_ll_invalidate_buffer();
@@ -172,7 +203,130 @@ uint32_t gdisplay_ll_get_buffer_size() {
 	return buff_size;
 }
 
+void gdisplay_ll_mark(int x0, int y0, int x1, int y1) {
+	if ((caps.bytes_per_pixel == 0) || (caps.interface != GDisplaySPIInterface)) {
+		return;
+	}
+
+	// Tiles follow the display size, that changes with the orientation
+	if (tiles.map && ((tiles.width != caps.width) || (tiles.height != caps.height))) {
+		tiles_destroy(&tiles);
+	}
+
+	if (!tiles.map) {
+		if (tiles_init(&tiles, caps.width, caps.height, GDISPLAY_TILE_SHIFT) < 0) {
+			return;
+		}
+	}
+
+	tiles_mark(&tiles, x0, y0, x1, y1);
+}
+
+void gdisplay_ll_get_stats(gdisplay_stats_t *cstats) {
+	memcpy(cstats, &stats, sizeof(gdisplay_stats_t));
+
+	cstats->elapsed_us = (uint32_t)(esp_timer_get_time() - stats_since);
+	if (cstats->elapsed_us > 0) {
+		cstats->fps = ((float)cstats->frames * 1000000.0) / (float)cstats->elapsed_us;
+	} else {
+		cstats->fps = 0;
+	}
+}
+
+void gdisplay_ll_reset_stats() {
+	memset(&stats, 0, sizeof(gdisplay_stats_t));
+	stats_since = esp_timer_get_time();
+}
+
+/*
+ * Copy the next chunk of pixels of a rectangle of the frame buffer into dst. x, y is
+ * the next pixel of the rectangle to copy, and it's updated. Returns the number of
+ * copied pixels.
+ */
+static int gdisplay_ll_pack(uint16_t *dst, uint16_t *fb, tiles_rect_t *rect, int *x, int *y) {
+	int len = 0;
+	int n;
+
+	while ((*y <= rect->y1) && (len < buff_size)) {
+		n = rect->x1 - *x + 1;
+		if (n > buff_size - len) {
+			n = buff_size - len;
+		}
+
+		memcpy(dst + len, fb + *y * caps.width + *x, n * sizeof(uint16_t));
+
+		len += n;
+		*x += n;
+
+		if (*x > rect->x1) {
+			*x = rect->x0;
+			(*y)++;
+		}
+	}
+
+	return len;
+}
+
+/*
+ * Send rectangles of the frame buffer to the display. Chunks are queued to the
+ * SPI driver, and while one chunk is sent by DMA the next one is copied into the
+ * other buffer.
+ */
+static void gdisplay_ll_flush(uint16_t *fb, tiles_rect_t *rects, int n) {
+	uint8_t *bufs[2] = {buff, dma_buff?dma_buff:buff};
+	int pending = dma_buff?1:0;
+	int selected = 0;
+	int cur = 0;
+	int i, x, y, len, first;
+
+	for(i = 0;i < n;i++) {
+		x = rects[i].x0;
+		y = rects[i].y0;
+		first = 1;
+
+		while (y <= rects[i].y1) {
+			// Wait until the write of the buffer ends
+			if (selected) {
+				spi_ll_queue_wait(caps.device, pending);
+			}
+
+			len = gdisplay_ll_pack((uint16_t *)bufs[cur], fb, &rects[i], &x, &y);
+
+			if (first) {
+				// The address window is set in command mode, so all the queued
+				// chunks must end before
+				if (selected) {
+					spi_ll_deselect(caps.device);
+				}
+
+				caps.addr_window(1, rects[i].x0, rects[i].y0, rects[i].x1, rects[i].y1);
+
+				// Set DC to 1 (data mode)
+				gpio_ll_pin_set(CONFIG_LUA_RTOS_GDISPLAY_CMD);
+				spi_ll_select(caps.device);
+
+				selected = 1;
+				first = 0;
+			}
+
+			spi_ll_queue_write(caps.device, len * sizeof(uint16_t), bufs[cur]);
+			cur ^= 1;
+
+			stats.bytes += len * sizeof(uint16_t);
+		}
+
+		stats.rects++;
+	}
+
+	if (selected) {
+		spi_ll_deselect(caps.device);
+	}
+}
+
 void gdisplay_ll_update(int x0, int y0, int x1, int y1, uint8_t *buffer) {
+	int64_t start = esp_timer_get_time();
+	uint64_t bytes = stats.bytes;
+
 	if ((buffer == (uint8_t *)buff) || (buffer == NULL)) {
 		if (buff_pixels > 0) {
 			if (buffer) {
@@ -193,18 +347,50 @@ void gdisplay_ll_update(int x0, int y0, int x1, int y1, uint8_t *buffer) {
 				} else{
 					ssd1306_update(x0, y0, x1, y1, buff);
 				}
+
+				stats.bytes += buff_size;
 			} else {
 				if (caps.interface == GDisplaySPIInterface) {
 					spi_ll_bulk_write16(caps.device, buff_pixels, (uint16_t *)buff);
 				} else {
 					ssd1306_update(x0, y0, x1, y1, buff);
 				}
+
+				stats.bytes += buff_pixels * caps.bytes_per_pixel;
 			}
 
+			stats.rects++;
+
 			if (caps.interface == GDisplaySPIInterface) {
 				spi_ll_deselect(caps.device);
 			}
 		}
+	} else if ((caps.bytes_per_pixel > 0) && (caps.interface == GDisplaySPIInterface)) {
+		tiles_rect_t rects[GDISPLAY_MAX_RECTS];
+		int n = 0;
+
+		// Send only the changed tiles. If they are not tracked, send the bounding box.
+		if (tiles.map && (tiles.width == caps.width) && (tiles.height == caps.height)) {
+			n = tiles_coalesce(&tiles, rects, GDISPLAY_MAX_RECTS);
+		}
+
+		if (n == 0) {
+			if (x0 < 0) x0 = 0;
+			if (y0 < 0) y0 = 0;
+			if (x1 >= caps.width) x1 = caps.width - 1;
+			if (y1 >= caps.height) y1 = caps.height - 1;
+
+			if ((x0 <= x1) && (y0 <= y1)) {
+				rects[0].x0 = x0;
+				rects[0].y0 = y0;
+				rects[0].x1 = x1;
+				rects[0].y1 = y1;
+
+				n = 1;
+			}
+		}
+
+		gdisplay_ll_flush((uint16_t *)buffer, rects, n);
 	} else {
 		caps.addr_window(1, x0, y0, x1, y1);
 
@@ -222,6 +408,9 @@ void gdisplay_ll_update(int x0, int y0, int x1, int y1, uint8_t *buffer) {
 			} else {
 				ssd1306_update(x0, y0, x1, y1, buff);
 			}
+
+			stats.bytes += buff_size;
+			stats.rects++;
 		} else {
 			uint16_t *origin = (uint16_t *)buffer;
 			uint16_t *destination =(uint16_t *) buff;
@@ -262,6 +451,14 @@ void gdisplay_ll_update(int x0, int y0, int x1, int y1, uint8_t *buffer) {
 		}
 	}
 
+	if (stats.bytes != bytes) {
+		uint32_t elapsed = (uint32_t)(esp_timer_get_time() - start);
+
+		stats.frames++;
+		stats.last_us = elapsed;
+		stats.busy_us += elapsed;
+	}
+
 	gdisplay_ll_invalidate_buffer();
 }
 
@@ -55,6 +55,12 @@
 
 #define DELAY 0x80
 
+// When the frame buffer is used, changes are tracked in tiles of
+// 1 << GDISPLAY_TILE_SHIFT pixels, and sent to the display in up to
+// GDISPLAY_MAX_RECTS rectangles
+#define GDISPLAY_TILE_SHIFT 4
+#define GDISPLAY_MAX_RECTS  16
+
 typedef enum {
 	GDisplaySPIInterface,
 	GDisplayI2CInterface
@@ -85,6 +91,16 @@ typedef struct {
 	uint8_t address;
 } gdisplay_caps_t;
 
+typedef struct {
+	uint32_t frames;     // Updates that sent pixels to the display
+	uint32_t rects;      // Rectangles sent
+	uint64_t bytes;      // Pixel bytes sent
+	uint32_t last_us;    // Time spent in the last update, in usecs
+	uint32_t busy_us;    // Time spent in updates, in usecs
+	uint32_t elapsed_us; // Time since the statistics were reset, in usecs
+	float fps;           // Frames per second since the statistics were reset
+} gdisplay_stats_t;
+
 /**
  * @brief Sends a command to the display
  *
@@ -119,6 +135,22 @@ uint8_t *gdisplay_ll_allocate_buffer(uint32_t size);
 uint8_t *gdisplay_ll_get_buffer();
 uint32_t gdisplay_ll_get_buffer_size();
 void gdisplay_ll_update(int x0, int y0, int x1, int y1, uint8_t *buffer);
+
+/**
+ * @brief Mark a rectangle of the frame buffer as changed, so it is sent to the
+ *        display in the next update. Coordinates are inclusive.
+ *
+ */
+void gdisplay_ll_mark(int x0, int y0, int x1, int y1);
+
+/**
+ * @brief Get the display update statistics.
+ *
+ * @param stats Where to store the statistics.
+ *
+ */
+void gdisplay_ll_get_stats(gdisplay_stats_t *stats);
+void gdisplay_ll_reset_stats();
 void gdisplay_ll_set_pixel(int x, int y, uint32_t color, uint8_t *buffer, int buffw, int buffh);
 uint32_t gdisplay_ll_get_pixel(int x, int y, uint8_t *buffer, int buffw, int buffh);
 void gdisplay_ll_set_bitmap(int x, int y, uint8_t *buffer, uint8_t *buff, int buffw, int buffh);
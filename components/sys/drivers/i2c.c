@@ -123,7 +123,7 @@ static void i2c_init() {
     memset(i2c, 0, sizeof(i2c_t) * (CPU_LAST_I2C + 1));
 
     // Init transaction list
-    lstinit(&transactions, 0, LIST_DEFAULT);
+    lstinit(&transactions, 0, LIST_DEFAULT | LIST_TAGGED);
 
     // Init mutexes and pin maps
     for (i = 0; i < CPU_LAST_I2C + 1; i++) {
@@ -703,4 +703,23 @@ driver_error_t *i2c_read(int deviceid, int *transaction, char *data, int len) {
     return NULL;
 }
 
+driver_error_t *i2c_lock_bus(int deviceid) {
+    driver_error_t *error;
+
+    int unit = (deviceid & 0xff00) >> 8;
+
+    // Sanity checks
+    if ((error = i2c_check(unit))) {
+        return error;
+    }
+
+    i2c_lock(unit);
+
+    return NULL;
+}
+
+void i2c_unlock_bus(int deviceid) {
+    i2c_unlock((deviceid & 0xff00) >> 8);
+}
+
 #endif
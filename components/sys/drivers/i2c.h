@@ -268,4 +268,28 @@ driver_error_t *i2c_read(int deviceid, int *transaction, char *data, int len);
  */
 driver_error_t *i2c_flush(int deviceid, int *transaction, int new_transaction);
 
+/**
+ * @brief Take exclusive ownership of the I2C bus a device is attached to. Other tasks
+ *        can't use the bus until i2c_unlock_bus is called, so a set of devices can be
+ *        read in a single window. Calls can be nested, and the owner task can still
+ *        use any of the I2C functions.
+ *
+ * @param deviceid A device identifier returned by the i2c_attach function.
+ *
+ * @return
+ *     - NULL success
+ *     - Pointer to driver_error_t if some error occurs.
+ *
+ *          I2C_ERR_INVALID_UNIT
+ *          I2C_ERR_IS_NOT_SETUP
+ */
+driver_error_t *i2c_lock_bus(int deviceid);
+
+/**
+ * @brief Release the I2C bus taken with i2c_lock_bus.
+ *
+ * @param deviceid A device identifier returned by the i2c_attach function.
+ */
+void i2c_unlock_bus(int deviceid);
+
 #endif /* I2C_H */
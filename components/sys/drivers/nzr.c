@@ -156,42 +156,63 @@ driver_error_t *nzr_send(uint32_t unit, uint8_t *data, uint32_t bits) {
         // RMT implementation
         driver_error_t *error = NULL;
 
-        // Create buffer
-        rmt_item_t *buffer = calloc(bits, sizeof(rmt_item_t));
-        if (!buffer) {
-            return driver_error(NZR_DRIVER, NZR_ERR_NOT_ENOUGH_MEMORY, NULL);
-        }
+        if ((bits & 7) == 0) {
+            // Whole bytes are encoded on the fly while they are transmitted
+            rmt_item_t bit0, bit1;
+
+            bit0.val = 0;
+            bit0.duration0 = instance->timings.n.t0h;
+            bit0.level0 = 1;
+            bit0.duration1 = instance->timings.n.t0l;
+            bit0.level1 = 0;
+
+            bit1.val = 0;
+            bit1.duration0 = instance->timings.n.t1h;
+            bit1.level0 = 1;
+            bit1.duration1 = instance->timings.n.t1l;
+            bit1.level1 = 0;
+
+            if ((error = rmt_tx_bytes(instance->deviceid, bit0, bit1, data, bits >> 3))) {
+                return error;
+            }
+        } else {
+            // Create buffer
+            rmt_item_t *buffer = calloc(bits, sizeof(rmt_item_t));
+            if (!buffer) {
+                return driver_error(NZR_DRIVER, NZR_ERR_NOT_ENOUGH_MEMORY, NULL);
+            }
 
-        // Prepare data
-        rmt_item_t *cbuffer = buffer;
+            // Prepare data
+            rmt_item_t *cbuffer = buffer;
 
-        mask = 0x80;
-        for(bit = 0;bit < bits; bit++) {
-            pulseH = ((*data) & mask)?instance->timings.n.t1h:instance->timings.n.t0h;
-            pulseL = ((*data) & mask)?instance->timings.n.t1l:instance->timings.n.t0l;
+            mask = 0x80;
+            for(bit = 0;bit < bits; bit++) {
+                pulseH = ((*data) & mask)?instance->timings.n.t1h:instance->timings.n.t0h;
+                pulseL = ((*data) & mask)?instance->timings.n.t1l:instance->timings.n.t0l;
 
-            cbuffer->duration0 = pulseH;
-            cbuffer->level0 = 1;
+                cbuffer->duration0 = pulseH;
+                cbuffer->level0 = 1;
 
-            cbuffer->duration1 = pulseL;
-            cbuffer->level1 = 0;
+                cbuffer->duration1 = pulseL;
+                cbuffer->level1 = 0;
 
-            cbuffer++;
+                cbuffer++;
 
-            mask = mask >> 1;
-            if (mask == 0) {
-                mask = 0x80;
-                data++;
+                mask = mask >> 1;
+                if (mask == 0) {
+                    mask = 0x80;
+                    data++;
+                }
+            }
+
+            error = rmt_tx(instance->deviceid, buffer, bits);
+            if (error) {
+                free(buffer);
+                return error;
             }
-        }
 
-        error = rmt_tx(instance->deviceid, buffer, bits);
-        if (error) {
             free(buffer);
-            return error;
         }
-
-        free(buffer);
     } else {
 #endif
         // Bit bang implementation
@@ -48,8 +48,10 @@
 #if CONFIG_LUA_RTOS_LUA_USE_RMT
 
 #include <math.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include <esp_attr.h>
 #include <esp_log.h>
 #include <soc/soc.h>
 #include <driver/rmt.h>
@@ -92,6 +94,45 @@ static void tx_end(rmt_channel_t channel, void *arg) {
     }
 }
 
+// Translate bytes to items, using the channel's nibble lookup table. This is called from the
+// RMT ISR to refill the RMT memory, in steps of half of the channel memory.
+static void IRAM_ATTR bytes_to_items(int channel, const void *src, rmt_item32_t *dest, size_t src_size,
+                                     size_t wanted_num, size_t *translated_size, size_t *item_num) {
+    const rmt_item32_t *lut = (const rmt_item32_t *)devices[channel].tx.lut;
+    const uint8_t *psrc = (const uint8_t *)src;
+    size_t size = 0;
+    size_t num = 0;
+
+    if (src && dest) {
+        while ((size < src_size) && (num + 8 <= wanted_num)) {
+            memcpy(dest, &lut[(psrc[size] >> 4) * 4], 4 * sizeof(rmt_item32_t));
+            memcpy(dest + 4, &lut[(psrc[size] & 0x0f) * 4], 4 * sizeof(rmt_item32_t));
+
+            dest += 8;
+            num += 8;
+            size++;
+        }
+    }
+
+    *translated_size = size;
+    *item_num = num;
+}
+
+// The translator doesn't receive the channel, so there is one entry point per channel
+#define BYTES_TO_ITEMS(ch) \
+static void IRAM_ATTR bytes_to_items_##ch(const void *src, rmt_item32_t *dest, size_t src_size, \
+                                          size_t wanted_num, size_t *translated_size, size_t *item_num) { \
+    bytes_to_items(ch, src, dest, src_size, wanted_num, translated_size, item_num); \
+}
+
+BYTES_TO_ITEMS(0) BYTES_TO_ITEMS(1) BYTES_TO_ITEMS(2) BYTES_TO_ITEMS(3)
+BYTES_TO_ITEMS(4) BYTES_TO_ITEMS(5) BYTES_TO_ITEMS(6) BYTES_TO_ITEMS(7)
+
+static const sample_to_rmt_t translators[] = {
+    bytes_to_items_0, bytes_to_items_1, bytes_to_items_2, bytes_to_items_3,
+    bytes_to_items_4, bytes_to_items_5, bytes_to_items_6, bytes_to_items_7,
+};
+
 static void switch_rx(int channel) {
     // Stop transmission
     rmt_tx_stop(channel);
@@ -490,6 +531,56 @@ driver_error_t *rmt_tx(int deviceid, rmt_item_t *tx, size_t tx_pulses) {
     return NULL;
 }
 
+driver_error_t *rmt_tx_bytes(int deviceid, rmt_item_t bit0, rmt_item_t bit1, const uint8_t *data, size_t bytes) {
+    uint8_t channel = deviceid; // RMT channel
+    rmt_item_t *item;
+    int nibble, bit;
+
+    mtx_lock(&devices[channel].mtx);
+
+    // Items are expressed in channel's range time units, so scale values if it's required
+    if (devices[channel].tx.scale != 1.0) {
+        bit0.duration0 /= devices[channel].tx.scale;
+        bit0.duration1 /= devices[channel].tx.scale;
+        bit1.duration0 /= devices[channel].tx.scale;
+        bit1.duration1 /= devices[channel].tx.scale;
+    }
+
+    // Build the lookup table, if bit items are not the same used the last time
+    if (!devices[channel].tx.lut) {
+        devices[channel].tx.lut = malloc(16 * 4 * sizeof(rmt_item_t));
+        if (!devices[channel].tx.lut) {
+            mtx_unlock(&devices[channel].mtx);
+
+            return driver_error(RMT_DRIVER, RMT_ERR_NOT_ENOUGH_MEMORY, NULL);
+        }
+
+        devices[channel].tx.lut_bit[0] = ~bit0.val;
+    }
+
+    if ((devices[channel].tx.lut_bit[0] != bit0.val) || (devices[channel].tx.lut_bit[1] != bit1.val)) {
+        item = devices[channel].tx.lut;
+        for (nibble = 0; nibble < 16; nibble++) {
+            for (bit = 3; bit >= 0; bit--) {
+                *item++ = (nibble & (1 << bit)) ? bit1 : bit0;
+            }
+        }
+
+        devices[channel].tx.lut_bit[0] = bit0.val;
+        devices[channel].tx.lut_bit[1] = bit1.val;
+    }
+
+    // Start RMT and transmit data
+    rmt_set_pin(channel, RMT_MODE_TX, devices[channel].pin);
+    assert(rmt_translator_init(channel, translators[channel]) == ESP_OK);
+    assert(rmt_write_sample(channel, data, bytes, 1) == ESP_OK);
+    assert(rmt_tx_stop(channel) == ESP_OK);
+
+    mtx_unlock(&devices[channel].mtx);
+
+    return NULL;
+}
+
 driver_error_t *rmt_tx_rx(int deviceid, rmt_item_t *tx, size_t tx_pulses, rmt_item_t *rx, size_t rx_pulses, uint32_t timeout) {
     uint8_t channel = deviceid; // RMT channel
     rmt_item_t *cbuff;          // Current position in tx / rx buffer
@@ -597,6 +688,9 @@ void rmt_unsetup_tx(int deviceid) {
     // Device now is not for TX
     devices[channel].tx_config = 0;
 
+    free(devices[channel].tx.lut);
+    devices[channel].tx.lut = NULL;
+
     if (!devices[channel].rx_config) {
         // Device is also not for RX, we can free resources
 
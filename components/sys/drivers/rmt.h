@@ -99,6 +99,8 @@ typedef struct {
         rmt_pulse_range_t range;
         float scale;
         rmt_callback_t callback;
+        rmt_item_t *lut;    // Items for each nibble value, used to encode bytes
+        uint32_t lut_bit[2]; // Items for bit 0 and bit 1 used to build lut
     } tx;
 } rmt_device_t;
 
@@ -247,5 +249,31 @@ driver_error_t *rmt_tx(int deviceid, rmt_item_t *tx, size_t tx_pulses);
  */
 driver_error_t *rmt_tx_rx(int deviceid, rmt_item_t *tx, size_t tx_pulses, rmt_item_t *rx, size_t rx_pulses, uint32_t timeout);
 
+/**
+ * @brief Transmit a byte array to the RMT device, one item per bit, MSB first, until it is transmitted. Items
+ *        are not built in advance: the RMT memory is refilled from the byte array in the TX threshold
+ *        interrupt, using a lookup table with the items for each nibble value, so the memory needed doesn't
+ *        depend on the number of bytes. This function is thread safe.
+ *
+ * @param deviceid RMT device id.
+ *
+ * @param bit0 Item to transmit for a 0 bit, with the pulse duration expressed in the device's pulse_range units
+ *             (nanoseconds, microseconds, or milliseconds).
+ *
+ * @param bit1 Item to transmit for a 1 bit, with the pulse duration expressed in the device's pulse_range units
+ *             (nanoseconds, microseconds, or milliseconds).
+ *
+ * @param data A pointer to the bytes to transmit.
+ *
+ * @param bytes Number of bytes to transmit.
+ *
+ * @return
+ *     - NULL success
+ *     - Pointer to driver_error_t if some error occurs.
+ *
+ *          RMT_ERR_NOT_ENOUGH_MEMORY
+ */
+driver_error_t *rmt_tx_bytes(int deviceid, rmt_item_t bit0, rmt_item_t bit1, const uint8_t *data, size_t bytes);
+
 
 #endif /* _DRIVERS_RMT_H_ */
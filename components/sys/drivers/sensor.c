@@ -60,6 +60,7 @@
 #include <sys/syslog.h>
 
 #include <drivers/sensor.h>
+#include <drivers/sensor_sched.h>
 #include <drivers/adc.h>
 #include <drivers/adc_internal.h>
 #include <drivers/gpio.h>
@@ -72,7 +73,9 @@
 extern const sensor_t sensors[];
 
 // Register drivers and errors
-DRIVER_REGISTER_BEGIN(SENSOR,sensor,0,NULL,NULL);
+static void sensor_init();
+
+DRIVER_REGISTER_BEGIN(SENSOR,sensor,0,sensor_init,NULL);
     DRIVER_REGISTER_ERROR(SENSOR, sensor, CannotSetup, "can't setup", SENSOR_ERR_CANT_INIT);
     DRIVER_REGISTER_ERROR(SENSOR, sensor, Timeout, "timeout", SENSOR_ERR_TIMEOUT);
     DRIVER_REGISTER_ERROR(SENSOR, sensor, NotEnoughtMemory, "not enough memory", SENSOR_ERR_NOT_ENOUGH_MEMORY);
@@ -88,7 +91,8 @@ DRIVER_REGISTER_BEGIN(SENSOR,sensor,0,NULL,NULL);
     DRIVER_REGISTER_ERROR(SENSOR, sensor, NoCallbacksAlowed, "callbacks not allowed for this sensor", SENSOR_ERR_CALLBACKS_NOT_ALLOWED);
     DRIVER_REGISTER_ERROR(SENSOR, sensor, InvalidValue, "invalid value", SENSOR_ERR_INVALID_VALUE);
     DRIVER_REGISTER_ERROR(SENSOR, sensor, SensorDetached, "sensor detached", SENSOR_ERR_DETACHED);
-DRIVER_REGISTER_END(SENSOR,sensor,0,NULL,NULL);
+    DRIVER_REGISTER_ERROR(SENSOR, sensor, NotScheduled, "sensor is not scheduled", SENSOR_ERR_NOT_SCHEDULED);
+DRIVER_REGISTER_END(SENSOR,sensor,0,sensor_init,NULL);
 
 static xQueueHandle queue = NULL;
 static TaskHandle_t task = NULL;
@@ -99,6 +103,10 @@ static uint8_t counter = 0;
  * Helper functions
  */
 
+static void sensor_init() {
+    sensor_sched_init();
+}
+
 static void sensor_task(void *arg) {
     sensor_deferred_data_t *data;
 
@@ -380,6 +388,20 @@ const sensor_data_t *sensor_get_property(const sensor_t *sensor, const char *pro
     return NULL;
 }
 
+int sensor_data_index(const sensor_t *sensor, const char *id) {
+    int idx;
+
+    for(idx=0;idx < SENSOR_MAX_PROPERTIES;idx++) {
+        if (sensor->data[idx].id) {
+            if (strcmp(sensor->data[idx].id, id) == 0) {
+                return idx;
+            }
+        }
+    }
+
+    return -1;
+}
+
 driver_error_t *sensor_setup(const sensor_t *sensor, sensor_setup_t *setup, sensor_instance_t **unit) {
     driver_error_t *error = NULL;
     sensor_instance_t *instance = NULL;
@@ -395,8 +417,9 @@ driver_error_t *sensor_setup(const sensor_t *sensor, sensor_setup_t *setup, sens
         return driver_error(SENSOR_DRIVER, SENSOR_ERR_NOT_ENOUGH_MEMORY, NULL);
     }
 
-    // Create mutex
+    // Create mutexes
     mtx_init(&instance->mtx, NULL, NULL, 0);
+    mtx_init(&instance->acq_mtx, NULL, NULL, 0);
 
     // Store reference to sensor into instance
     instance->sensor = sensor;
@@ -436,6 +459,7 @@ driver_error_t *sensor_setup(const sensor_t *sensor, sensor_setup_t *setup, sens
     if (instance->sensor->presetup) {
         if ((error = instance->sensor->presetup(instance))) {
             mtx_destroy(&instance->mtx);
+            mtx_destroy(&instance->acq_mtx);
             free(instance);
 
 			#if (CONFIG_LUA_RTOS_POWER_BUS_PIN >= 0)
@@ -471,6 +495,7 @@ driver_error_t *sensor_setup(const sensor_t *sensor, sensor_setup_t *setup, sens
 
     if (error) {
         mtx_destroy(&instance->mtx);
+        mtx_destroy(&instance->acq_mtx);
         free(instance);
 
 		#if (CONFIG_LUA_RTOS_POWER_BUS_PIN >= 0)
@@ -484,6 +509,7 @@ driver_error_t *sensor_setup(const sensor_t *sensor, sensor_setup_t *setup, sens
     if (instance->sensor->setup) {
         if ((error = instance->sensor->setup(instance))) {
             mtx_destroy(&instance->mtx);
+            mtx_destroy(&instance->acq_mtx);
             free(instance);
 
 			#if (CONFIG_LUA_RTOS_POWER_BUS_PIN >= 0)
@@ -502,6 +528,7 @@ driver_error_t *sensor_setup(const sensor_t *sensor, sensor_setup_t *setup, sens
     if (instance->sensor->postsetup) {
         if ((error = instance->sensor->postsetup(instance))) {
             mtx_destroy(&instance->mtx);
+            mtx_destroy(&instance->acq_mtx);
             free(instance);
 
 			#if (CONFIG_LUA_RTOS_POWER_BUS_PIN >= 0)
@@ -519,6 +546,9 @@ driver_error_t *sensor_unsetup(sensor_instance_t *unit) {
     driver_error_t *error;
     int i;
 
+    // Stop periodic sampling, if any
+    sensor_sched_remove(unit);
+
     portDISABLE_INTERRUPTS();
 
     if (attached == 0) {
@@ -578,6 +608,7 @@ driver_error_t *sensor_unsetup(sensor_instance_t *unit) {
     attached--;
 
     mtx_destroy(&unit->mtx);
+    mtx_destroy(&unit->acq_mtx);
     free(unit);
 
 #if (CONFIG_LUA_RTOS_POWER_BUS_PIN >= 0)
@@ -589,10 +620,12 @@ driver_error_t *sensor_unsetup(sensor_instance_t *unit) {
     return NULL;
 }
 
-driver_error_t *sensor_acquire(sensor_instance_t *unit) {
+// Get a sample from the sensor. The caller must hold the unit's acquire lock,
+// as the sensor can be sampled both by the scheduler and from Lua.
+driver_error_t *sensor_fetch(sensor_instance_t *unit, sensor_value_t *value, uint8_t *fetched) {
     driver_error_t *error = NULL;
-    sensor_value_t *value = NULL;
-    int i = 0, j = 0;
+
+    *fetched = 0;
 
     // Check if we can get data
     uint64_t next_available_data = unit->next.tv_sec * 1000000 +unit->next.tv_usec;
@@ -605,70 +638,84 @@ driver_error_t *sensor_acquire(sensor_instance_t *unit) {
         return NULL;
     }
 
-    // Allocate space for sensor data
-    if (!(value = calloc(1, sizeof(sensor_value_t) * SENSOR_MAX_PROPERTIES))) {
-        return driver_error(SENSOR_DRIVER, SENSOR_ERR_NOT_ENOUGH_MEMORY, NULL);
-    }
+    memset(value, 0, sizeof(sensor_value_t) * SENSOR_MAX_PROPERTIES);
 
     // Call to specific acquire function, if any
     if (unit->sensor->acquire) {
         if ((error = unit->sensor->acquire(unit, value))) {
-            free(value);
             return error;
         }
     }
 
+    *fetched = 1;
+
+    return NULL;
+}
+
+void sensor_store(sensor_instance_t *unit, sensor_value_t *value) {
+    int i = 0;
+
+    // Auto acquired sensors store their data by themselves
+    for (i=0;i < SENSOR_MAX_INTERFACES;i++) {
+        if (unit->sensor->interface[i].flags & (SENSOR_FLAG_AUTO_ACQ | SENSOR_FLAG_ON_OFF)) {
+            return;
+        }
+    }
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+
     mtx_lock(&unit->mtx);
 
     // Copy sensor values into instance
     // Note that we only copy raw values as value types are set in sensor_setup from sensor
     // definition
-    uint8_t is_auto;
     for(i=0;i < SENSOR_MAX_PROPERTIES;i++) {
-        is_auto = 0;
+        unit->latch[i].timeout = 0;
+        unit->latch[i].t = now;
+        unit->latch[i].value.raw.value = unit->data[i].raw.value;
+        unit->data[i].raw = value[i].raw;
+    }
 
-        for (j=0;j < SENSOR_MAX_INTERFACES;j++) {
-            is_auto = (
-                (unit->sensor->interface[j].flags & (SENSOR_FLAG_AUTO_ACQ | SENSOR_FLAG_ON_OFF))
-            );
+    mtx_unlock(&unit->mtx);
+}
 
-            if (is_auto) break;
-        }
+driver_error_t *sensor_acquire(sensor_instance_t *unit) {
+    driver_error_t *error;
+    sensor_value_t value[SENSOR_MAX_PROPERTIES];
+    uint8_t fetched;
 
-        if (!is_auto) {
-            unit->latch[i].timeout = 0;
-            unit->latch[i].t = now;
-            unit->latch[i].value.raw.value = unit->data[i].raw.value;
-            unit->data[i].raw = value[i].raw;
-        }
-    }
+    sensor_acquire_lock(unit);
+    error = sensor_fetch(unit, value, &fetched);
+    sensor_acquire_unlock(unit);
 
-    mtx_unlock(&unit->mtx);
+    if (error) {
+        return error;
+    }
 
-    free(value);
+    if (fetched) {
+        sensor_store(unit, value);
+    }
 
     return NULL;
 }
 
 driver_error_t *sensor_read(sensor_instance_t *unit, const char *id, sensor_value_t **value) {
-    int idx = 0;
-
-    mtx_lock(&unit->mtx);
+    return sensor_read_index(unit, sensor_data_index(unit->sensor, id), value);
+}
 
+driver_error_t *sensor_read_index(sensor_instance_t *unit, int idx, sensor_value_t **value) {
     *value = NULL;
-    for(idx=0;idx <  SENSOR_MAX_PROPERTIES;idx++) {
-        if (unit->sensor->data[idx].id) {
-            if (strcmp(unit->sensor->data[idx].id, id) == 0) {
-                *value = &unit->data[idx];
-                mtx_unlock(&unit->mtx);
-                return NULL;
-            }
-        }
+
+    if ((idx < 0) || (idx >= SENSOR_MAX_PROPERTIES) || !unit->sensor->data[idx].id) {
+        return driver_error(SENSOR_DRIVER, SENSOR_ERR_NOT_FOUND, NULL);
     }
 
+    mtx_lock(&unit->mtx);
+    *value = &unit->data[idx];
     mtx_unlock(&unit->mtx);
 
-    return driver_error(SENSOR_DRIVER, SENSOR_ERR_NOT_FOUND, NULL);
+    return NULL;
 }
 
 driver_error_t *sensor_set(sensor_instance_t *unit, const char *id, sensor_value_t *value) {
@@ -907,4 +954,12 @@ void IRAM_ATTR sensor_unlock(sensor_instance_t *unit) {
     mtx_unlock(&unit->mtx);
 }
 
+void sensor_acquire_lock(sensor_instance_t *unit) {
+    mtx_lock(&unit->acq_mtx);
+}
+
+void sensor_acquire_unlock(sensor_instance_t *unit) {
+    mtx_unlock(&unit->acq_mtx);
+}
+
 #endif
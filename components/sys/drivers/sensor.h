@@ -266,6 +266,7 @@ typedef void (*sensor_callback_t)(int, struct sensor_instance *, sensor_value_t
 typedef struct sensor_instance {
     int unit;
     struct mtx mtx;
+    struct mtx acq_mtx; // Serializes the calls to the acquire function
     sensor_value_t data[SENSOR_MAX_PROPERTIES];
     sensor_latch_t latch[SENSOR_MAX_PROPERTIES];
     sensor_value_t properties[SENSOR_MAX_PROPERTIES];
@@ -291,10 +292,14 @@ typedef struct {
 
 const sensor_t *get_sensor(const char *id);
 const sensor_data_t *sensor_get_property(const sensor_t *sensor, const char *property);
+int sensor_data_index(const sensor_t *sensor, const char *id);
 driver_error_t *sensor_setup(const sensor_t *sensor, sensor_setup_t *setup, sensor_instance_t **unit);
 driver_error_t *sensor_unsetup(sensor_instance_t *unit);
 driver_error_t *sensor_acquire(sensor_instance_t *unit);
+driver_error_t *sensor_fetch(sensor_instance_t *unit, sensor_value_t *value, uint8_t *fetched);
+void sensor_store(sensor_instance_t *unit, sensor_value_t *value);
 driver_error_t *sensor_read(sensor_instance_t *unit, const char *id, sensor_value_t **value);
+driver_error_t *sensor_read_index(sensor_instance_t *unit, int idx, sensor_value_t **value);
 driver_error_t *sensor_set(sensor_instance_t *unit, const char *id, sensor_value_t *value);
 driver_error_t *sensor_get(sensor_instance_t *unit, const char *id, sensor_value_t **value);
 driver_error_t *sensor_register_callback(sensor_instance_t *unit, sensor_callback_t callback, int id, uint8_t deferred);
@@ -303,6 +308,8 @@ void sensor_init_data(sensor_instance_t *unit);
 void sensor_update_data(sensor_instance_t *unit, uint8_t from, uint8_t to, sensor_value_t *new_data, uint64_t delay, uint64_t rate, uint8_t ignore, uint64_t ignore_val);
 void IRAM_ATTR sensor_lock(sensor_instance_t *unit);
 void IRAM_ATTR sensor_unlock(sensor_instance_t *unit);
+void sensor_acquire_lock(sensor_instance_t *unit);
+void sensor_acquire_unlock(sensor_instance_t *unit);
 
 // SENSOR errors
 #define SENSOR_ERR_CANT_INIT                (DRIVER_EXCEPTION_BASE(SENSOR_DRIVER_ID)  |  0)
@@ -320,6 +327,7 @@ void IRAM_ATTR sensor_unlock(sensor_instance_t *unit);
 #define SENSOR_ERR_CALLBACKS_NOT_ALLOWED    (DRIVER_EXCEPTION_BASE(SENSOR_DRIVER_ID)  | 12)
 #define SENSOR_ERR_INVALID_VALUE            (DRIVER_EXCEPTION_BASE(SENSOR_DRIVER_ID)  | 13)
 #define SENSOR_ERR_DETACHED                 (DRIVER_EXCEPTION_BASE(SENSOR_DRIVER_ID)  | 14)
+#define SENSOR_ERR_NOT_SCHEDULED            (DRIVER_EXCEPTION_BASE(SENSOR_DRIVER_ID)  | 15)
 #endif
 
 #endif /* _SENSORS_H_ */
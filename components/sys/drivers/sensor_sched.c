@@ -0,0 +1,497 @@
+/*
+ * Copyright (C) 2015 - 2020, IBEROXARXA SERVICIOS INTEGRALES, S.L.
+ * Copyright (C) 2015 - 2020, Jaume Olivé Petrus (jolive@whitecatboard.org)
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *     * The WHITECAT logotype cannot be changed, you can remove it, but you
+ *       cannot change it in any way. The WHITECAT logotype is:
+ *
+ *          /\       /\
+ *         /  \_____/  \
+ *        /_____________\
+ *        W H I T E C A T
+ *
+ *     * Redistributions in binary form must retain all copyright notices printed
+ *       to any local or remote output device. This include any reference to
+ *       Lua RTOS, whitecatboard.org, Lua, and other copyright notices that may
+ *       appear in the future.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Lua RTOS, sensor sampling scheduler
+ *
+ */
+
+#include "sdkconfig.h"
+
+#if CONFIG_LUA_RTOS_LUA_USE_SENSOR
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_timer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/mutex.h>
+#include <sys/driver.h>
+
+#include <drivers/sensor.h>
+#include <drivers/sensor_sched.h>
+#include <drivers/i2c.h>
+
+// Bus key for sensors that don't share their bus
+#define SENSOR_SCHED_NO_BUS 0xffffffff
+
+typedef struct {
+    sensor_instance_t *unit;
+    int64_t due;        ///< Time of the next sample, in usecs since boot
+    uint32_t period;    ///< Sampling period, in usecs
+    uint32_t bus;       ///< Bus key, sensors with the same key share a bus
+    int i2cdevice;      ///< I2C device used to hold the bus, or -1
+    uint8_t props;      ///< Data properties stored on each sample
+    uint16_t depth;     ///< Ring buffer size, in samples
+    uint16_t head;      ///< Ring buffer slot for the next sample
+    uint16_t kept;      ///< Samples in the ring buffer
+    uint32_t written;   ///< Samples stored since the sensor was scheduled
+    uint8_t fetched;    ///< 1 if value holds new data
+    uint8_t pinned;     ///< 1 while the scheduler task samples the sensor
+    uint8_t detached;   ///< 1 if unscheduled while pinned, the task frees it
+    sensor_value_t value[SENSOR_MAX_PROPERTIES]; ///< Data fetched in the current window
+    int64_t sample[SENSOR_MAX_PROPERTIES]; ///< Raw values of the current window
+    int64_t sample_stamp; ///< Time of the current window
+    int64_t *stamp;     ///< Sample times, depth entries
+    int64_t *raw;       ///< Raw values, depth * props entries
+} sensor_sched_t;
+
+static sensor_sched_t *sched[SENSOR_SCHED_MAX];
+static sensor_sched_t *due[SENSOR_SCHED_MAX];  // Entries pinned by the scheduler task
+static int ndue = 0;
+static struct mtx mtx;
+static TaskHandle_t task = NULL;
+
+/*
+ * Helper functions
+ */
+
+static int sensor_sched_find(sensor_instance_t *unit) {
+    int i;
+
+    for(i=0;i < SENSOR_SCHED_MAX;i++) {
+        if (sched[i] && (sched[i]->unit == unit)) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static int sensor_sched_busy(sensor_instance_t *unit) {
+    int i;
+
+    for(i=0;i < ndue;i++) {
+        if (due[i]->unit == unit) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Free an entry that is no longer scheduled, or leave it to the task if it's pinned
+static void sensor_sched_release(sensor_sched_t *entry) {
+    if (entry->pinned) {
+        entry->detached = 1;
+    } else {
+        free(entry);
+    }
+}
+
+static void sensor_sched_bus(sensor_sched_t *entry) {
+    sensor_instance_t *unit = entry->unit;
+    int i;
+
+    entry->bus = SENSOR_SCHED_NO_BUS;
+    entry->i2cdevice = -1;
+
+    for(i=0;i < SENSOR_MAX_INTERFACES;i++) {
+        if (unit->sensor->interface[i].flags & SENSOR_FLAG_CUSTOM_INTERFACE_INIT) {
+            continue;
+        }
+
+        switch (unit->sensor->interface[i].type) {
+            case I2C_INTERFACE:
+                // I2C unit is in the upper byte of the device id
+                entry->bus = (I2C_INTERFACE << 16) | (unit->setup[i].i2c.id & 0xff00);
+                entry->i2cdevice = unit->setup[i].i2c.id;
+                return;
+
+            case OWIRE_INTERFACE:
+                entry->bus = (OWIRE_INTERFACE << 16) | unit->setup[i].owire.owdevice;
+                return;
+
+            default:
+                break;
+        }
+    }
+}
+
+static void sensor_sched_fetch(sensor_sched_t *entry) {
+    driver_error_t *error;
+
+    if ((error = sensor_fetch(entry->unit, entry->value, &entry->fetched))) {
+        entry->fetched = 0;
+        free(error);
+    }
+}
+
+static void sensor_sched_store(sensor_sched_t *entry) {
+    int i;
+
+    if (!entry->fetched) {
+        return;
+    }
+
+    sensor_store(entry->unit, entry->value);
+
+    entry->sample_stamp = esp_timer_get_time();
+
+    sensor_lock(entry->unit);
+    for(i=0;i < entry->props;i++) {
+        entry->sample[i] = entry->unit->data[i].raw.value;
+    }
+    sensor_unlock(entry->unit);
+}
+
+// Copy the current window into the ring buffer. Called with mtx held.
+static void sensor_sched_commit(sensor_sched_t *entry) {
+    if (!entry->fetched) {
+        return;
+    }
+
+    entry->stamp[entry->head] = entry->sample_stamp;
+    memcpy(entry->raw + entry->head * entry->props, entry->sample, entry->props * sizeof(int64_t));
+
+    if (++entry->head == entry->depth) {
+        entry->head = 0;
+    }
+
+    if (entry->kept < entry->depth) {
+        entry->kept++;
+    }
+
+    entry->written++;
+}
+
+static void sensor_sched_task(void *arg) {
+    sensor_sched_t *entry;
+    driver_error_t *error;
+    TickType_t ticks;
+    int64_t now, next;
+    int i, j, k, n;
+    uint8_t locked;
+
+    for(;;) {
+        mtx_lock(&mtx);
+
+        // Get the sensors that are due, sorted by bus
+        now = esp_timer_get_time();
+        n = 0;
+
+        for(i=0;i < SENSOR_SCHED_MAX;i++) {
+            entry = sched[i];
+            if (!entry || (entry->due > now)) {
+                continue;
+            }
+
+            for(j = n;(j > 0) && (due[j - 1]->bus > entry->bus);j--) {
+                due[j] = due[j - 1];
+            }
+
+            due[j] = entry;
+            entry->pinned = 1;
+            n++;
+
+            // If the sensor is late, skip the missed samples
+            entry->due += entry->period;
+            if (entry->due <= now) {
+                entry->due = now + entry->period;
+            }
+        }
+
+        ndue = n;
+
+        // Fetching can take long (a DS18B20 conversion takes 750 ms), so it's done
+        // without mtx. Pinned entries are not freed until they are committed.
+        mtx_unlock(&mtx);
+
+        // Sample them, holding each bus until all its sensors are read. Data is stored
+        // once the bus is released, as the sensor lock is taken before the bus lock
+        // in sensor_set and sensor_get. For the same reason, the acquire locks are
+        // taken before the bus lock, as in sensor_acquire.
+        for(i=0;i < n;i = j) {
+            for(j = i + 1;(j < n) && (due[i]->bus != SENSOR_SCHED_NO_BUS) && (due[j]->bus == due[i]->bus);j++);
+
+            for(k = i;k < j;k++) {
+                sensor_acquire_lock(due[k]->unit);
+            }
+
+            locked = 0;
+            if (due[i]->i2cdevice >= 0) {
+                if ((error = i2c_lock_bus(due[i]->i2cdevice))) {
+                    free(error);
+                } else {
+                    locked = 1;
+                }
+            }
+
+            for(k = i;k < j;k++) {
+                sensor_sched_fetch(due[k]);
+            }
+
+            if (locked) {
+                i2c_unlock_bus(due[i]->i2cdevice);
+            }
+
+            for(k = i;k < j;k++) {
+                sensor_acquire_unlock(due[k]->unit);
+            }
+
+            for(k = i;k < j;k++) {
+                sensor_sched_store(due[k]);
+            }
+        }
+
+        mtx_lock(&mtx);
+
+        for(i=0;i < n;i++) {
+            entry = due[i];
+            entry->pinned = 0;
+
+            if (entry->detached) {
+                free(entry);
+            } else {
+                sensor_sched_commit(entry);
+            }
+        }
+
+        ndue = 0;
+
+        // Sleep until the next sensor is due, or until the schedule changes
+        next = INT64_MAX;
+        for(i=0;i < SENSOR_SCHED_MAX;i++) {
+            if (sched[i] && (sched[i]->due < next)) {
+                next = sched[i]->due;
+            }
+        }
+
+        mtx_unlock(&mtx);
+
+        if (next == INT64_MAX) {
+            ticks = portMAX_DELAY;
+        } else {
+            now = esp_timer_get_time();
+            if (next <= now) {
+                continue;
+            }
+
+            ticks = (((next - now) + 999) / 1000 + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+        }
+
+        ulTaskNotifyTake(pdTRUE, ticks);
+    }
+}
+
+/*
+ * Operation functions
+ */
+
+void sensor_sched_init() {
+    mtx_init(&mtx, NULL, NULL, 0);
+}
+
+driver_error_t *sensor_sched_add(sensor_instance_t *unit, uint32_t period, uint16_t depth) {
+    sensor_sched_t *entry;
+    uint8_t props = 0;
+    int i;
+
+    // Sanity checks
+    if ((period == 0) || (period > UINT32_MAX / 1000) || (depth == 0)) {
+        return driver_error(SENSOR_DRIVER, SENSOR_ERR_INVALID_VALUE, NULL);
+    }
+
+    // Store data properties up to the last one defined by the sensor
+    for(i=0;i < SENSOR_MAX_PROPERTIES;i++) {
+        if (unit->sensor->data[i].id) {
+            props = i + 1;
+        }
+    }
+
+    if (!props) {
+        return driver_error(SENSOR_DRIVER, SENSOR_ERR_INVALID_DATA, NULL);
+    }
+
+    // Allocate the entry and its ring buffer in one block
+    entry = calloc(1, sizeof(sensor_sched_t) + depth * (props + 1) * sizeof(int64_t));
+    if (!entry) {
+        return driver_error(SENSOR_DRIVER, SENSOR_ERR_NOT_ENOUGH_MEMORY, NULL);
+    }
+
+    entry->stamp = (int64_t *)(entry + 1);
+    entry->raw = entry->stamp + depth;
+    entry->unit = unit;
+    entry->period = period * 1000;
+    entry->props = props;
+    entry->depth = depth;
+    entry->due = esp_timer_get_time();
+
+    sensor_sched_bus(entry);
+
+    mtx_lock(&mtx);
+
+    // Create task if needed
+    if (!task) {
+        BaseType_t xReturn;
+
+        xReturn = xTaskCreatePinnedToCore(sensor_sched_task, "sensorsch", CONFIG_LUA_RTOS_LUA_THREAD_STACK_SIZE, NULL, CONFIG_LUA_RTOS_LUA_THREAD_PRIORITY, &task, xPortGetCoreID());
+        if (xReturn != pdPASS) {
+            task = NULL;
+            mtx_unlock(&mtx);
+            free(entry);
+            return driver_error(SENSOR_DRIVER, SENSOR_ERR_NOT_ENOUGH_MEMORY, NULL);
+        }
+    }
+
+    // Replace the current entry, or use a free one
+    if ((i = sensor_sched_find(unit)) >= 0) {
+        sensor_sched_release(sched[i]);
+    } else {
+        for(i=0;(i < SENSOR_SCHED_MAX) && sched[i];i++);
+
+        if (i == SENSOR_SCHED_MAX) {
+            mtx_unlock(&mtx);
+            free(entry);
+            return driver_error(SENSOR_DRIVER, SENSOR_ERR_NOT_ENOUGH_MEMORY, "too many scheduled sensors");
+        }
+    }
+
+    sched[i] = entry;
+
+    mtx_unlock(&mtx);
+
+    xTaskNotifyGive(task);
+
+    return NULL;
+}
+
+void sensor_sched_remove(sensor_instance_t *unit) {
+    int i;
+
+    mtx_lock(&mtx);
+
+    if ((i = sensor_sched_find(unit)) >= 0) {
+        sensor_sched_release(sched[i]);
+        sched[i] = NULL;
+    }
+
+    // Wait until the task is done with the sensor, as the caller may free it next
+    while (sensor_sched_busy(unit)) {
+        mtx_unlock(&mtx);
+        vTaskDelay(1);
+        mtx_lock(&mtx);
+    }
+
+    mtx_unlock(&mtx);
+}
+
+driver_error_t *sensor_sched_seq(sensor_instance_t *unit, uint32_t *seq) {
+    int i;
+
+    mtx_lock(&mtx);
+
+    if ((i = sensor_sched_find(unit)) < 0) {
+        mtx_unlock(&mtx);
+        return driver_error(SENSOR_DRIVER, SENSOR_ERR_NOT_SCHEDULED, NULL);
+    }
+
+    *seq = sched[i]->written;
+
+    mtx_unlock(&mtx);
+
+    return NULL;
+}
+
+driver_error_t *sensor_sched_window(sensor_instance_t *unit, int idx, uint32_t *seq, sensor_value_t *values, int64_t *stamps, int max, int *count) {
+    sensor_sched_t *entry;
+    uint32_t avail, slot;
+    int i, n;
+
+    *count = 0;
+
+    // Sanity checks
+    if ((idx < 0) || (idx >= SENSOR_MAX_PROPERTIES) || !unit->sensor->data[idx].id) {
+        return driver_error(SENSOR_DRIVER, SENSOR_ERR_NOT_FOUND, NULL);
+    }
+
+    mtx_lock(&mtx);
+
+    if ((i = sensor_sched_find(unit)) < 0) {
+        mtx_unlock(&mtx);
+        return driver_error(SENSOR_DRIVER, SENSOR_ERR_NOT_SCHEDULED, NULL);
+    }
+
+    entry = sched[i];
+
+    // Start at the oldest sample kept if the requested ones were overwritten
+    avail = entry->written - *seq;
+    if (avail > entry->kept) {
+        avail = entry->kept;
+        *seq = entry->written - entry->kept;
+    }
+
+    slot = (entry->head >= avail)?(entry->head - avail):(entry->head + entry->depth - avail);
+
+    for(n=0;(n < max) && (n < avail);n++) {
+        values[n].type = unit->sensor->data[idx].type;
+        values[n].raw.value = entry->raw[slot * entry->props + idx];
+
+        if (stamps) {
+            stamps[n] = entry->stamp[slot];
+        }
+
+        if (++slot == entry->depth) {
+            slot = 0;
+        }
+    }
+
+    *seq += n;
+    *count = n;
+
+    mtx_unlock(&mtx);
+
+    return NULL;
+}
+
+#endif
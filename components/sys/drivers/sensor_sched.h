@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2015 - 2020, IBEROXARXA SERVICIOS INTEGRALES, S.L.
+ * Copyright (C) 2015 - 2020, Jaume Olivé Petrus (jolive@whitecatboard.org)
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *     * The WHITECAT logotype cannot be changed, you can remove it, but you
+ *       cannot change it in any way. The WHITECAT logotype is:
+ *
+ *          /\       /\
+ *         /  \_____/  \
+ *        /_____________\
+ *        W H I T E C A T
+ *
+ *     * Redistributions in binary form must retain all copyright notices printed
+ *       to any local or remote output device. This include any reference to
+ *       Lua RTOS, whitecatboard.org, Lua, and other copyright notices that may
+ *       appear in the future.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Lua RTOS, sensor sampling scheduler
+ *
+ */
+
+#ifndef _SENSOR_SCHED_H_
+#define _SENSOR_SCHED_H_
+
+#include "sdkconfig.h"
+
+#if CONFIG_LUA_RTOS_LUA_USE_SENSOR
+
+#include <stdint.h>
+
+#include <sys/driver.h>
+
+#include <drivers/sensor.h>
+
+// Maximum number of sensors that can be sampled at the same time
+#define SENSOR_SCHED_MAX 32
+
+// Default number of samples kept for each sensor
+#define SENSOR_SCHED_DEFAULT_DEPTH 32
+
+/**
+ * @brief Initialize the sensor scheduler. Called once at driver init.
+ */
+void sensor_sched_init();
+
+/**
+ * @brief Sample a sensor every period milliseconds from the scheduler task, and keep
+ *        the last depth samples of all its data properties in a ring buffer. Sensors
+ *        that are due at the same time and share a bus are sampled in a single window,
+ *        holding the bus in between. If the sensor is already scheduled, its period and
+ *        depth are changed, and the samples taken so far are discarded.
+ *
+ * @param unit Sensor instance.
+ * @param period Sampling period, in milliseconds.
+ * @param depth Number of samples to keep.
+ *
+ * @return
+ *     - NULL success
+ *     - Pointer to driver_error_t if some error occurs.
+ *
+ *          SENSOR_ERR_INVALID_VALUE
+ *          SENSOR_ERR_NOT_ENOUGH_MEMORY
+ */
+driver_error_t *sensor_sched_add(sensor_instance_t *unit, uint32_t period, uint16_t depth);
+
+/**
+ * @brief Stop sampling a sensor and free its ring buffer. Does nothing if the sensor
+ *        is not scheduled. If the scheduler task is sampling the sensor, waits until
+ *        it's done, so the sensor instance can be freed on return.
+ *
+ * @param unit Sensor instance.
+ */
+void sensor_sched_remove(sensor_instance_t *unit);
+
+/**
+ * @brief Get the sequence number of the next sample that will be stored for a sensor.
+ *        Samples are numbered from 0 since the sensor was scheduled, and only the last
+ *        depth ones are kept.
+ *
+ * @param unit Sensor instance.
+ * @param seq A pointer to an integer where the sequence number is stored.
+ *
+ * @return
+ *     - NULL success
+ *     - Pointer to driver_error_t if some error occurs.
+ *
+ *          SENSOR_ERR_NOT_SCHEDULED
+ */
+driver_error_t *sensor_sched_seq(sensor_instance_t *unit, uint32_t *seq);
+
+/**
+ * @brief Copy up to max samples of a data property, starting at sample *seq (or at the
+ *        oldest sample kept, if *seq was overwritten). On return *seq holds the sequence
+ *        number of the next sample to read, so the call can be repeated to get the
+ *        samples taken since the last one.
+ *
+ * @param unit Sensor instance.
+ * @param idx Data property index, as returned by sensor_data_index.
+ * @param seq A pointer to the sequence number of the first sample to read.
+ * @param values Array of max elements where the values are stored.
+ * @param stamps Array of max elements where the sample times are stored, in microseconds
+ *               since boot, or NULL.
+ * @param max Number of elements of values and stamps.
+ * @param count A pointer to an integer where the number of samples copied is stored.
+ *
+ * @return
+ *     - NULL success
+ *     - Pointer to driver_error_t if some error occurs.
+ *
+ *          SENSOR_ERR_NOT_FOUND
+ *          SENSOR_ERR_NOT_SCHEDULED
+ */
+driver_error_t *sensor_sched_window(sensor_instance_t *unit, int idx, uint32_t *seq, sensor_value_t *values, int64_t *stamps, int max, int *count);
+
+#endif
+
+#endif /* _SENSOR_SCHED_H_ */
@@ -225,6 +225,17 @@ static driver_error_t *spi_tranfer_sanity_checks(int deviceid) {
     return NULL;
 }
 
+// Wait for the oldest write queued with spi_ll_queue_write
+static void spi_queue_wait_one(spi_device_t *dev) {
+    spi_transaction_t *t;
+    esp_err_t ret;
+
+    ret = spi_device_get_trans_result(dev->h, &t, portMAX_DELAY);
+    assert(ret==ESP_OK);
+
+    dev->queued--;
+}
+
 static void IRAM_ATTR spi_master_op(int deviceid, uint32_t word_size,
         uint32_t len, uint8_t *in, uint8_t *out) {
     int unit = (deviceid & 0xff00) >> 8;
@@ -304,6 +315,11 @@ static void IRAM_ATTR spi_master_op(int deviceid, uint32_t word_size,
         uint8_t *nbin = NULL;
         uint8_t ro = 0;
 
+        // Queued writes must end before, or spi_device_transmit can get their results
+        while (spi_bus[spi_idx(unit)].device[device].queued > 0) {
+            spi_queue_wait_one(&spi_bus[spi_idx(unit)].device[device]);
+        }
+
         // esp-idf driver used DMA, but data in FLASH can't be transferred by DMA, so in this case
         // we copy to RAM
         if (in) {
@@ -760,6 +776,46 @@ int IRAM_ATTR spi_ll_bulk_rw32(int deviceid, uint32_t nelements, uint32_t *data)
     return 0;
 }
 
+void spi_ll_queue_write(int deviceid, uint32_t nbytes, uint8_t *data) {
+    int unit = (deviceid & 0xff00) >> 8;
+    int device = (deviceid & 0x00ff);
+    spi_device_t *dev = &spi_bus[spi_idx(unit)].device[device];
+    spi_transaction_t *t;
+    esp_err_t ret;
+
+    if (!dev->dma) {
+        spi_master_op(deviceid, 1, nbytes, data, NULL);
+        return;
+    }
+
+    assert(nbytes <= SPI_MAX_SIZE);
+
+    if (dev->queued == SPI_QUEUE_DEPTH) {
+        spi_queue_wait_one(dev);
+    }
+
+    t = &dev->trans[dev->next];
+
+    memset(t, 0, sizeof(spi_transaction_t));
+    t->length = nbytes * 8;
+    t->tx_buffer = data;
+
+    ret = spi_device_queue_trans(dev->h, t, portMAX_DELAY);
+    assert(ret==ESP_OK);
+
+    dev->next = (dev->next + 1) % SPI_QUEUE_DEPTH;
+    dev->queued++;
+}
+
+void spi_ll_queue_wait(int deviceid, int pending) {
+    int unit = (deviceid & 0xff00) >> 8;
+    int device = (deviceid & 0x00ff);
+
+    while (spi_bus[spi_idx(unit)].device[device].queued > pending) {
+        spi_queue_wait_one(&spi_bus[spi_idx(unit)].device[device]);
+    }
+}
+
 void IRAM_ATTR spi_ll_select(int deviceid) {
     int unit = (deviceid & 0xff00) >> 8;
     int device = (deviceid & 0x00ff);
@@ -783,6 +839,9 @@ void IRAM_ATTR spi_ll_deselect(int deviceid) {
     int unit = (deviceid & 0xff00) >> 8;
     int device = (deviceid & 0x00ff);
 
+    // Queued writes must end before the device is deselected
+    spi_ll_queue_wait(deviceid, 0);
+
     if (!(spi_bus[spi_idx(unit)].device[device].flags & SPI_FLAG_CS_AUTO)) {
         // Deselect device
         gpio_ll_pin_set(spi_bus[spi_idx(unit)].device[device].cs);
@@ -118,6 +118,9 @@ extern const int spi_error_map;
 #define SPI_FLAG_CS_AUTO (1 << 3)
 #define SPI_FLAG_3WIRE   (1 << 4)
 
+// Number of writes that can be queued with spi_ll_queue_write
+#define SPI_QUEUE_DEPTH  2
+
 typedef struct {
     uint8_t setup;
     int8_t cs;
@@ -126,6 +129,9 @@ typedef struct {
     uint8_t flags;
     uint32_t regs[14];
     spi_device_handle_t h;
+    spi_transaction_t trans[SPI_QUEUE_DEPTH]; // Queued writes
+    uint8_t queued;                           // Number of queued writes
+    uint8_t next;                             // Next free slot in trans
 } spi_device_t;
 
 typedef struct {
@@ -314,6 +320,34 @@ void spi_ll_bulk_read32(int deviceid, uint32_t nelements, uint32_t *data);
  */
 int spi_ll_bulk_rw32(int deviceid, uint32_t nelements, uint32_t *data);
 
+/**
+ * @brief Queue a write of a chunk of 8-bit data to the device, and return without
+ *        waiting for the transfer to end. Device must be selected before calling this
+ *        function (use spi_ll_select for that). If SPI_QUEUE_DEPTH writes are already
+ *        queued, waits for the oldest one. Queued writes are always finished before
+ *        the device is deselected. If the device doesn't use DMA the write is done
+ *        immediately. No sanity checks are done (use only in driver develop).
+ *
+ * @param deviceid Device identifier.
+ * @param nbytes Number of bytes to transfer, up to SPI_MAX_SIZE.
+ * @param data A pointer to the buffer to transfer. The buffer must be in DMA capable
+ *        memory, and must not be changed until the write ends (see spi_ll_queue_wait).
+ *
+ */
+void spi_ll_queue_write(int deviceid, uint32_t nbytes, uint8_t *data);
+
+/**
+ * @brief Wait until no more than pending writes queued with spi_ll_queue_write remain
+ *        queued. Writes end in the same order they are queued, so after waiting with
+ *        pending = 1 the buffer of all the writes but the last one can be reused.
+ *        No sanity checks are done (use only in driver develop).
+ *
+ * @param deviceid Device identifier.
+ * @param pending Number of writes that can remain queued. Use 0 to wait for all.
+ *
+ */
+void spi_ll_queue_wait(int deviceid, int pending);
+
 /**
  * @brief Change the SPI pin map. Pin map is hard coded in Kconfig, but it can be
  *        change in development environments. This function is thread safe.
@@ -71,6 +71,8 @@
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
 #include "freertos/timers.h"
 #include "freertos/xtensa_api.h"
 
@@ -85,6 +87,7 @@
 #include "driver/gpio.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
 #include <signal.h>
@@ -95,6 +98,7 @@
 #include <sys/syslog.h>
 #include <sys/delay.h>
 #include <sys/_signal.h>
+#include <sys/ringbuf.h>
 
 #include <pthread.h>
 #include <drivers/uart.h>
@@ -134,16 +138,25 @@ static const char * const names[] = {
 // UART array
 struct uart uart[NUART] = {
     {
-        0, NULL, 0, 115200, PTHREAD_MUTEX_INITIALIZER, CONFIG_LUA_RTOS_UART0_RX,CONFIG_LUA_RTOS_UART0_TX,
+        .brg = 115200, .mtx = PTHREAD_MUTEX_INITIALIZER, .rx = CONFIG_LUA_RTOS_UART0_RX, .tx = CONFIG_LUA_RTOS_UART0_TX,
     },
     {
-        0, NULL, 0, 115200, PTHREAD_MUTEX_INITIALIZER, CONFIG_LUA_RTOS_UART1_RX,CONFIG_LUA_RTOS_UART1_TX,
+        .brg = 115200, .mtx = PTHREAD_MUTEX_INITIALIZER, .rx = CONFIG_LUA_RTOS_UART1_RX, .tx = CONFIG_LUA_RTOS_UART1_TX,
     },
     {
-        0, NULL, 0, 115200, PTHREAD_MUTEX_INITIALIZER, CONFIG_LUA_RTOS_UART2_RX,CONFIG_LUA_RTOS_UART2_TX,
+        .brg = 115200, .mtx = PTHREAD_MUTEX_INITIALIZER, .rx = CONFIG_LUA_RTOS_UART2_RX, .tx = CONFIG_LUA_RTOS_UART2_TX,
     },
 };
 
+// Protects the INT_ENA register, and the ring buffers while they are replaced
+static portMUX_TYPE uart_mux[NUART] = {
+    portMUX_INITIALIZER_UNLOCKED, portMUX_INITIALIZER_UNLOCKED, portMUX_INITIALIZER_UNLOCKED
+};
+
+#ifndef CONFIG_LUA_RTOS_UART_TX_BUFFER_LEN
+#define CONFIG_LUA_RTOS_UART_TX_BUFFER_LEN 0
+#endif
+
 /*
  * This is for process deferred process for CONSOLE interrupt handler
  */
@@ -181,8 +194,16 @@ static void uart_deferred_intr_handler(void *args) {
  * Helper functions
  */
 
+// Wait until the TX ring is empty, and then until the TX FIFO is empty
+static void uart_tx_drain(int8_t unit) {
+	while (uart[unit].tx_buf && (ringbuf_count(&uart[unit].tx_ring) > 0)) {
+		delay(1);
+	}
+}
+
 // Configure the UART comm parameters
 static void uart_comm_param_config(int8_t unit, UartBautRate brg, UartBitsNum4Char data, UartParityMode parity, UartStopBitsNum stop) {
+	uart_tx_drain(unit);
 	wait_tx_empty(unit);
 
 	uart_set_baudrate(unit, brg);
@@ -199,6 +220,7 @@ static void uart_comm_param_config(int8_t unit, UartBautRate brg, UartBitsNum4Ch
 
 // Configure the UART pins
 static void uart_pin_config(int8_t unit, uint8_t flags) {
+	uart_tx_drain(unit);
 	wait_tx_empty(unit);
 
 	int tx_sig, rx_sig;
@@ -322,13 +344,100 @@ void IRAM_ATTR uart_ll_set_raw(uint8_t raw) {
 	console_raw = raw;
 }
 
+// Move all the bytes in the RX FIFO to the RX ring, in spans. Console control
+// characters are filtered out here, the other bytes are queued or dropped as a whole.
+static void IRAM_ATTR uart_rx_fifo(int unit, BaseType_t *xHigherPriorityTaskWoken) {
+    uart_deferred_data data;
+    uint8_t buf[UART_FIFO_LEN];
+    uint8_t status;
+    int signal = 0;
+    int received = 0;
+    int accept, cnt, i, j;
+
+    while ((cnt = (READ_PERI_REG(UART_STATUS_REG(unit)) >> UART_RXFIFO_CNT_S) & UART_RXFIFO_CNT) > 0) {
+        if (cnt > (int)sizeof(buf)) {
+            cnt = sizeof(buf);
+        }
+
+        for (i = 0; i < cnt; i++) {
+            buf[i] = READ_PERI_REG(UART_FIFO_REG(unit)) & 0xFF;
+        }
+
+        accept = status_get(STATUS_LUA_RUNNING) || console_raw;
+
+        if ((unit == CONSOLE_UART) && !console_raw) {
+            for (i = 0, j = 0; i < cnt; i++) {
+                if ((buf[i] != 0x03) && (buf[i] != 0x04)) {
+                    if (accept) {
+                        buf[j++] = buf[i];
+                    }
+                } else if (queue_byte(unit, buf[i], &status, &signal)) {
+                    buf[j++] = buf[i];
+                } else {
+                    if (signal) {
+                        data.type = 0;
+                        data.data = signal;
+
+                        xQueueSendFromISR(deferred_q, &data, xHigherPriorityTaskWoken);
+                    }
+
+                    if (status) {
+                        data.type = 1;
+                        data.data = status;
+
+                        xQueueSendFromISR(deferred_q, &data, xHigherPriorityTaskWoken);
+                    }
+                }
+            }
+
+            cnt = j;
+        } else if (!accept) {
+            cnt = 0;
+        }
+
+        // Bytes that don't fit in the ring are lost, as when the queue was full
+        portENTER_CRITICAL_ISR(&uart_mux[unit]);
+        if ((cnt > 0) && uart[unit].rx_buf) {
+            ringbuf_write(&uart[unit].rx_ring, buf, cnt);
+            received = 1;
+        }
+        portEXIT_CRITICAL_ISR(&uart_mux[unit]);
+    }
+
+    if (received) {
+        xSemaphoreGiveFromISR(uart[unit].rx_sem, xHigherPriorityTaskWoken);
+    }
+}
+
+// Refill the TX FIFO from the TX ring. The interrupt is disabled when the ring is
+// empty, and enabled again by the writers when they put more bytes in it.
+static void IRAM_ATTR uart_tx_fifo(int unit, BaseType_t *xHigherPriorityTaskWoken) {
+    uint8_t buf[UART_FIFO_LEN];
+    int room, cnt, i;
+
+    room = 126 - ((READ_PERI_REG(UART_STATUS_REG(unit)) >> UART_TXFIFO_CNT_S) & UART_TXFIFO_CNT);
+    if (room > 0) {
+        cnt = ringbuf_read(&uart[unit].tx_ring, buf, room);
+        for (i = 0; i < cnt; i++) {
+            WRITE_PERI_REG(UART_FIFO_REG(unit), buf[i]);
+        }
+
+        if (cnt > 0) {
+            xSemaphoreGiveFromISR(uart[unit].tx_sem, xHigherPriorityTaskWoken);
+        }
+    }
+
+    portENTER_CRITICAL_ISR(&uart_mux[unit]);
+    if (ringbuf_count(&uart[unit].tx_ring) == 0) {
+        CLEAR_PERI_REG_MASK(UART_INT_ENA_REG(unit), UART_TXFIFO_EMPTY_INT_ENA_M);
+    }
+    portEXIT_CRITICAL_ISR(&uart_mux[unit]);
+}
+
 void IRAM_ATTR uart_rx_intr_handler(void *args) {
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
     uint32_t uart_intr_status = 0;
-    uart_deferred_data data;
 
-	uint8_t byte, status;
-	int signal = 0;
 	int unit = (int)args;
 
 	uart_intr_status = READ_PERI_REG(UART_INT_ST_REG(unit));
@@ -338,52 +447,13 @@ void IRAM_ATTR uart_rx_intr_handler(void *args) {
 			WRITE_PERI_REG(UART_INT_CLR_REG(unit), UART_FRM_ERR_INT_CLR);
 		} else if (UART_RXFIFO_FULL_INT_ST == (uart_intr_status & UART_RXFIFO_FULL_INT_ST)) {
 			WRITE_PERI_REG(UART_INT_CLR_REG(unit), UART_RXFIFO_FULL_INT_CLR);
-
-			while ((READ_PERI_REG(UART_STATUS_REG(unit)) >> UART_RXFIFO_CNT_S)&UART_RXFIFO_CNT) {
-				byte = READ_PERI_REG(UART_FIFO_REG(unit)) & 0xFF;
-				if (queue_byte(unit, byte, &status, &signal)) {
-					// Put byte to UART queue
-					xQueueSendFromISR(uart[unit].q, &byte, &xHigherPriorityTaskWoken);
-				} else {
-					if (signal) {
-						data.type = 0;
-						data.data = signal;
-
-						xQueueSendFromISR(deferred_q, &data, &xHigherPriorityTaskWoken);
-					}
-
-					if (status) {
-						data.type = 1;
-						data.data = status;
-
-						xQueueSendFromISR(deferred_q, &data, &xHigherPriorityTaskWoken);
-					}
-				}
-			}
+			uart_rx_fifo(unit, &xHigherPriorityTaskWoken);
 		} else if (UART_RXFIFO_TOUT_INT_ST == (uart_intr_status & UART_RXFIFO_TOUT_INT_ST)) {
 			WRITE_PERI_REG(UART_INT_CLR_REG(unit), UART_RXFIFO_TOUT_INT_CLR);
-
-			while ((READ_PERI_REG(UART_STATUS_REG(unit)) >> UART_RXFIFO_CNT_S)&UART_RXFIFO_CNT) {
-				byte = READ_PERI_REG(UART_FIFO_REG(unit)) & 0xFF;
-				if (queue_byte(unit, byte, &status, &signal)) {
-					// Put byte to UART queue
-					xQueueSendFromISR(uart[unit].q, &byte, &xHigherPriorityTaskWoken);
-				} else {
-					if (signal) {
-						data.type = 0;
-						data.data = signal;
-
-						xQueueSendFromISR(deferred_q, &data, &xHigherPriorityTaskWoken);
-					}
-
-					if (status) {
-						data.type = 1;
-						data.data = status;
-
-						xQueueSendFromISR(deferred_q, &data, &xHigherPriorityTaskWoken);
-					}
-				}
-			}
+			uart_rx_fifo(unit, &xHigherPriorityTaskWoken);
+		} else if (UART_TXFIFO_EMPTY_INT_ST == (uart_intr_status & UART_TXFIFO_EMPTY_INT_ST)) {
+			uart_tx_fifo(unit, &xHigherPriorityTaskWoken);
+			WRITE_PERI_REG(UART_INT_CLR_REG(unit), UART_TXFIFO_EMPTY_INT_CLR);
 		}
 
 		uart_intr_status = READ_PERI_REG(UART_INT_ST_REG(unit));
@@ -501,6 +571,11 @@ driver_error_t *uart_init(int8_t unit, uint32_t brg, uint8_t databits, uint8_t p
     		return driver_error(UART_DRIVER, UART_ERR_INVALID_STOP_BITS, NULL);
     }
 
+    // The RX ring size is rounded up to a power of 2
+    if (qs > UART_MAX_RX_RING) {
+        return driver_error(UART_DRIVER, UART_ERR_NOT_ENOUGH_MEMORY, "buffer too large");
+    }
+
 #if CONFIG_LUA_RTOS_USE_HARDWARE_LOCKS
     // Lock resources
     driver_error_t *error;
@@ -519,17 +594,43 @@ driver_error_t *uart_init(int8_t unit, uint32_t brg, uint8_t databits, uint8_t p
     	case 2: periph_module_enable(PERIPH_UART2_MODULE); break;
     }
 
-    // If the requested queue size is greater than current queue size,
-	// delete it and create a new one
+    // Create the semaphores used to wait for the rings, if needed
+    if (!uart[unit].rx_sem) {
+        uart[unit].rx_sem = xSemaphoreCreateBinary();
+        uart[unit].rx_mtx = xSemaphoreCreateMutex();
+        uart[unit].tx_sem = xSemaphoreCreateBinary();
+        uart[unit].tx_mtx = xSemaphoreCreateMutex();
+
+        if (!uart[unit].rx_sem || !uart[unit].rx_mtx || !uart[unit].tx_sem || !uart[unit].tx_mtx) {
+            return driver_error(UART_DRIVER, UART_ERR_NOT_ENOUGH_MEMORY, NULL);
+        }
+    }
+
+    // If the requested RX ring size is greater than current ring size,
+	// replace it by a new one
+    qs = ringbuf_size(qs);
     if (qs > uart[unit].qs) {
-		if (uart[unit].q) {
-			vQueueDelete(uart[unit].q);
-		}
+        uint8_t *old = uart[unit].rx_buf;
+        uint8_t *buf = malloc(qs);
 
-		uart[unit].q  = xQueueCreate(qs, sizeof(uint8_t));
-		if (!uart[unit].q) {
-			driver_error(UART_DRIVER, UART_ERR_NOT_ENOUGH_MEMORY, NULL);
-		}
+        if (!buf) {
+            return driver_error(UART_DRIVER, UART_ERR_NOT_ENOUGH_MEMORY, NULL);
+        }
+
+        // Readers only copy from the ring with rx_mtx held, so once it's taken
+        // none of them is using the old buffer
+        xSemaphoreTake(uart[unit].rx_mtx, portMAX_DELAY);
+
+        portENTER_CRITICAL(&uart_mux[unit]);
+        ringbuf_init(&uart[unit].rx_ring, buf, qs);
+        uart[unit].rx_buf = buf;
+        portEXIT_CRITICAL(&uart_mux[unit]);
+
+        xSemaphoreGive(uart[unit].rx_mtx);
+
+        free(old);
+	} else {
+		qs = uart[unit].qs;
 	}
 
     // Init mutex, if needed
@@ -591,6 +692,17 @@ driver_error_t *uart_setup_interrupts(int8_t unit) {
     uint32_t reg_val = 0;
 	uint32_t mask = UART_RXFIFO_TOUT_INT_ENA_M | UART_FRM_ERR_INT_ENA_M | UART_RXFIFO_FULL_INT_ENA_M;
 
+	// Allocate the TX ring. The TX FIFO empty interrupt is only enabled while it has data.
+	if ((CONFIG_LUA_RTOS_UART_TX_BUFFER_LEN > 0) && !uart[unit].tx_buf) {
+		uint32_t size = ringbuf_size(CONFIG_LUA_RTOS_UART_TX_BUFFER_LEN);
+		uint8_t *buf = malloc(size);
+
+		if (buf) {
+			ringbuf_init(&uart[unit].tx_ring, buf, size);
+			uart[unit].tx_buf = buf;
+		}
+	}
+
 	esp_intr_alloc(UART_INTR_SOURCE(unit), ESP_INTR_FLAG_IRAM, uart_rx_intr_handler, (void *)((uint32_t)unit), NULL);
 
 	WRITE_PERI_REG(UART_INT_CLR_REG(unit), 0x1ff);
@@ -619,37 +731,158 @@ driver_error_t *uart_setup_interrupts(int8_t unit) {
 	return NULL;
 }
 
+// Writes len bytes straight to the TX FIFO, filling it in bursts
+static void IRAM_ATTR uart_fifo_writen(int8_t unit, const char *buf, int len) {
+    int room;
+
+    while (len > 0) {
+        do {
+            room = 126 - ((READ_PERI_REG(UART_STATUS_REG(unit)) >> UART_TXFIFO_CNT_S) & UART_TXFIFO_CNT);
+        } while (room <= 0);
+
+        if (room > len) {
+            room = len;
+        }
+
+        len -= room;
+
+        while (room--) {
+            WRITE_PERI_REG(UART_FIFO_REG(unit), *buf++);
+        }
+    }
+}
+
+// The TX ring is used once interrupts are enabled, and only from tasks, as
+// writers can block waiting for room
+static int IRAM_ATTR uart_tx_ring_ready(int8_t unit) {
+    return (
+        uart[unit].tx_buf && (uart[unit].flags & UART_FLAG_IRQ_INIT) &&
+        !xPortInIsrContext() && (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+    );
+}
+
+// Waits until there are bytes in the RX ring, or until ticks expire
+static int IRAM_ATTR uart_rx_wait_ticks(int8_t unit, TickType_t ticks) {
+    TimeOut_t timeout;
+
+    if (!uart[unit].rx_buf) {
+        return 0;
+    }
+
+    vTaskSetTimeOutState(&timeout);
+
+    while (ringbuf_count(&uart[unit].rx_ring) == 0) {
+        if (xTaskCheckForTimeOut(&timeout, &ticks) == pdTRUE) {
+            return 0;
+        }
+
+        xSemaphoreTake(uart[unit].rx_sem, ticks);
+    }
+
+    // Pass the wake up to any other task waiting for the same bytes
+    xSemaphoreGive(uart[unit].rx_sem);
+
+    return 1;
+}
+
+static TickType_t IRAM_ATTR uart_ticks(uint32_t timeout) {
+    if (timeout != portMAX_DELAY) {
+        timeout = timeout / portTICK_PERIOD_MS;
+    }
+
+    return (TickType_t)timeout;
+}
+
+// Writes len bytes to the UART. Bytes are copied to the TX ring, and the caller
+// only waits when the ring is full.
+void IRAM_ATTR uart_writen(int8_t unit, const char *buf, int len) {
+    int n;
+
+    if (!uart_tx_ring_ready(unit)) {
+        uart_fifo_writen(unit, buf, len);
+        return;
+    }
+
+    xSemaphoreTake(uart[unit].tx_mtx, portMAX_DELAY);
+
+    while (len > 0) {
+        n = ringbuf_write(&uart[unit].tx_ring, (const uint8_t *)buf, len);
+        buf += n;
+        len -= n;
+
+        portENTER_CRITICAL(&uart_mux[unit]);
+        SET_PERI_REG_MASK(UART_INT_ENA_REG(unit), UART_TXFIFO_EMPTY_INT_ENA_M);
+        portEXIT_CRITICAL(&uart_mux[unit]);
+
+        if (len > 0) {
+            xSemaphoreTake(uart[unit].tx_sem, portMAX_DELAY);
+        }
+    }
+
+    xSemaphoreGive(uart[unit].tx_mtx);
+}
+
 // Writes a byte to the UART
 void IRAM_ATTR uart_write(int8_t unit, char byte) {
-    while (((READ_PERI_REG(UART_STATUS_REG(unit)) & (UART_TXFIFO_CNT << UART_TXFIFO_CNT_S)) >> UART_TXFIFO_CNT_S & UART_TXFIFO_CNT) >= 126);
-    WRITE_PERI_REG(UART_FIFO_REG(unit), byte);
+    uart_writen(unit, &byte, 1);
 }
 
 // Writes a null-terminated string to the UART
 void IRAM_ATTR uart_writes(int8_t unit, char *s) {
-    while (*s) {
-	    while (((READ_PERI_REG(UART_STATUS_REG(unit)) & (UART_TXFIFO_CNT << UART_TXFIFO_CNT_S)) >> UART_TXFIFO_CNT_S & UART_TXFIFO_CNT) >= 126);
-	    WRITE_PERI_REG(UART_FIFO_REG(unit) , *s++);
-   }
+    uart_writen(unit, s, strlen(s));
 }
 
-// Reads a byte from uart
-uint8_t IRAM_ATTR uart_read(int8_t unit, char *c, uint32_t timeout) {
-    if (timeout != portMAX_DELAY) {
-        timeout = timeout / portTICK_PERIOD_MS;
+// Gets the number of bytes that can be written without waiting
+int uart_tx_space(int8_t unit) {
+    if (!uart[unit].tx_buf) {
+        return 126 - ((READ_PERI_REG(UART_STATUS_REG(unit)) >> UART_TXFIFO_CNT_S) & UART_TXFIFO_CNT);
     }
-	
-    if (xQueueReceive(uart[unit].q, c, (TickType_t)(timeout)) == pdTRUE) {
-        return 1;
-    } else {
+
+    return ringbuf_space(&uart[unit].tx_ring);
+}
+
+// Waits timeout milliseconds for received bytes, without reading them
+int uart_rx_wait(int8_t unit, uint32_t timeout) {
+    return uart_rx_wait_ticks(unit, uart_ticks(timeout));
+}
+
+// Reads up to len bytes from uart, waiting timeout milliseconds for the first one.
+// rx_mtx is only held while copying from the ring, not while waiting, so uart_init
+// can replace the ring while a reader waits.
+int IRAM_ATTR uart_readn(int8_t unit, char *buf, int len, uint32_t timeout) {
+    TickType_t ticks = uart_ticks(timeout);
+    TimeOut_t start;
+    int bytes = 0;
+
+    if ((len <= 0) || !uart[unit].rx_mtx) {
         return 0;
     }
+
+    vTaskSetTimeOutState(&start);
+
+    for(;;) {
+        xSemaphoreTake(uart[unit].rx_mtx, portMAX_DELAY);
+        if (uart[unit].rx_buf) {
+            bytes = ringbuf_read(&uart[unit].rx_ring, (uint8_t *)buf, len);
+        }
+        xSemaphoreGive(uart[unit].rx_mtx);
+
+        // Another reader can take the bytes between the wait and the read
+        if ((bytes > 0) || (xTaskCheckForTimeOut(&start, &ticks) == pdTRUE) || !uart_rx_wait_ticks(unit, ticks)) {
+            break;
+        }
+    }
+
+    return bytes;
+}
+
+// Reads a byte from uart
+uint8_t IRAM_ATTR uart_read(int8_t unit, char *c, uint32_t timeout) {
+    return (uart_readn(unit, c, 1, timeout) == 1);
 }
 
 // Consume all received bytes, and do not nothing with them
 driver_error_t *uart_consume(int8_t unit) {
-    char tmp;
-
 	// Sanity checks
 	if ((unit > CPU_LAST_UART) || (unit < CPU_FIRST_UART)) {
 		return driver_error(UART_DRIVER, UART_ERR_INVALID_UNIT, NULL);
@@ -659,7 +892,14 @@ driver_error_t *uart_consume(int8_t unit) {
 		return driver_error(UART_DRIVER, UART_ERR_IS_NOT_SETUP, NULL);
 	}
 
-    while(uart_read(unit,&tmp,1));
+    // Discard until no more bytes arrive in 1 millisecond
+    xSemaphoreTake(uart[unit].rx_mtx, portMAX_DELAY);
+
+    do {
+        ringbuf_flush(&uart[unit].rx_ring);
+    } while (uart_rx_wait_ticks(unit, uart_ticks(1)));
+
+    xSemaphoreGive(uart[unit].rx_mtx);
 
 	return NULL;
 } 
@@ -797,11 +1037,6 @@ const char *uart_name(int8_t unit) {
     return names[unit - 1];
 }
 
-// Gets the UART queue
-QueueHandle_t *uart_get_queue(int8_t unit) {
-    return  uart[unit].q;
-}
-
 int uart_get_br(int unit) {
 //    int divisor;
 //    unit--;
@@ -71,7 +71,7 @@
 #define __UART_H__
 
 #include "freertos/FreeRTOS.h"
-#include "freertos/queue.h"
+#include "freertos/semphr.h"
 
 #include "rom/uart.h"
 #include "rom/ets_sys.h"
@@ -81,15 +81,26 @@
 #include <stdint.h>
 #include <pthread.h>
 #include <sys/driver.h>
+#include <sys/ringbuf.h>
+
+// Maximum RX ring size
+#define UART_MAX_RX_RING (64 * 1024)
 
 struct uart {
-    uint8_t          flags;
-    QueueHandle_t    q;         // RX queue
-    uint16_t         qs;        // Queue size
-    uint32_t         brg;       // Baud rate
-    pthread_mutex_t  mtx;		// Mutex
-    int8_t           rx;
-    int8_t           tx;
+    uint8_t           flags;
+    ringbuf_t         rx_ring;   // RX ring, filled from the RX FIFO interrupt
+    uint8_t          *rx_buf;
+    uint32_t          qs;        // RX ring size
+    SemaphoreHandle_t rx_sem;    // Given from the interrupt when bytes are received
+    SemaphoreHandle_t rx_mtx;    // Serializes the reads from the RX ring
+    ringbuf_t         tx_ring;   // TX ring, drained from the TX FIFO empty interrupt
+    uint8_t          *tx_buf;
+    SemaphoreHandle_t tx_sem;    // Given from the interrupt when the TX ring has room
+    SemaphoreHandle_t tx_mtx;    // Serializes writers
+    uint32_t          brg;       // Baud rate
+    pthread_mutex_t   mtx;		 // Mutex
+    int8_t            rx;
+    int8_t            tx;
 };
 
 // Resources used by the UART
@@ -137,7 +148,9 @@ void uart_ll_set_raw(uint8_t raw);
 driver_error_t *uart_pin_map(int unit, int rx, int tx);
 void     uart_write(int8_t unit, char byte);
 void     uart_writes(int8_t unit, char *s);
+void     uart_writen(int8_t unit, const char *buf, int len);
 uint8_t uart_read(int8_t unit, char *c, uint32_t timeout);
+int      uart_readn(int8_t unit, char *buf, int len, uint32_t timeout);
 uint8_t  uart_reads(int8_t unit, char *buff, uint8_t crlf, uint32_t timeout);
 uint8_t  uart_wait_response(int8_t unit, char *command, uint8_t echo, char *ret, uint8_t substring, uint32_t timeout, int nargs, ...);
 uint8_t  uart_send_command(int8_t unit, char *command, uint8_t echo, uint8_t crlf, char *ret, uint8_t substring, uint32_t timeout, int nargs, ...);
@@ -145,7 +158,8 @@ const char  *uart_name(int8_t unit);
 int      uart_get_br(int unit);
 int      uart_is_setup(int unit);
 void     uart_stop(int unit);
-QueueHandle_t *uart_get_queue(int8_t unit);
+int      uart_rx_wait(int8_t unit, uint32_t timeout);
+int      uart_tx_space(int8_t unit);
 driver_error_t *uart_lock_resources(int unit, uint8_t flags, void *resources);
 
 #endif
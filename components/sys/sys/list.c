@@ -52,234 +52,299 @@
 #include <sys/list.h>
 #include <sys/mutex.h>
 
-void lstinit(struct list *list, int first_index, uint8_t flags) {
-    // Create the mutex
-    mtx_init(&list->mutex, NULL, NULL, 0);
+/*
+ * Writers are serialized by the list mutex. Readers don't take the mutex: they
+ * read the list optimistically, and check that the list sequence number didn't
+ * change during the read. If it changed, or if a writer is in progress, the read
+ * is done again with the mutex taken.
+ */
 
-    mtx_lock(&list->mutex);
+#define LIST_MAX_SLOTS (LIST_SEGMENT_BASE * ((1 << LIST_SEGMENTS) - 1))
+
+// Slot tag
+#define LIST_TAG_USED      1
+#define LIST_TAG_GEN_MASK  0x7fff
+#define LIST_TAG_GEN(tag)  (((tag) >> 1) & LIST_TAG_GEN_MASK)
+
+// Tagged indexes: slot in bits 0 - 15, generation in bits 16 - 30
+#define LIST_TAGGED_SLOT_BITS 16
+#define LIST_TAGGED_SLOT_MASK ((1 << LIST_TAGGED_SLOT_BITS) - 1)
+
+#define LIST_READ(list, res, expr) \
+    do { \
+        uint32_t __seq = (list)->seq; \
+        __sync_synchronize(); \
+        if (!(__seq & 1)) { \
+            res = expr; \
+            __sync_synchronize(); \
+            if ((list)->seq == __seq) { \
+                break; \
+            } \
+        } \
+        mtx_lock(&(list)->mutex); \
+        res = expr; \
+        mtx_unlock(&(list)->mutex); \
+    } while (0)
+
+static inline void write_begin(struct list *list) {
+    list->seq++;
+    __sync_synchronize();
+}
 
-    list->indexes = 0;
-    list->free = NULL;
-    list->index = NULL;
-    list->last = NULL;
-    list->first_index = first_index;
-    list->flags = flags;
-    list->init = 1;
+static inline void write_end(struct list *list) {
+    __sync_synchronize();
+    list->seq++;
+}
 
-    mtx_unlock(&list->mutex);
+static inline int segment_of(int slot) {
+    return 31 - __builtin_clz((slot / LIST_SEGMENT_BASE) + 1);
 }
 
-int lstadd(struct list *list, void *item, int *item_index) {
-    struct lstindex *index = NULL;
-    struct lstindex *indexa = NULL;
-    int grow = 0;
+static inline struct lstindex *get_slot(struct list *list, int slot) {
+    int segment = segment_of(slot);
+    struct lstindex *base;
 
-    mtx_lock(&list->mutex);
+    if ((slot < 0) || (slot >= list->indexes) || (segment >= LIST_SEGMENTS)) {
+        return NULL;
+    }
 
-    if (list->flags & LIST_DEFAULT) {
-        // Get an index
-        if (list->free) {
-            // Get first free element
-            index = list->free;
-            list->free = index->next;
-        } else {
-            // Must grow index array
-            grow = 1;
-        }
+    base = list->segment[segment];
+    if (!base) {
+        return NULL;
+    }
 
-        if (grow) {
-            // Increment index count
-            list->indexes++;
+    return &base[slot - LIST_SEGMENT_BASE * ((1 << segment) - 1)];
+}
 
-            // Create a new index array for allocate new index
-            indexa = (struct lstindex *)malloc(sizeof(struct lstindex) * list->indexes);
-            if (!indexa) {
-                mtx_unlock(&list->mutex);
-                return ENOMEM;
-            }
+static inline int hash_of(void *item) {
+    uint32_t h = ((uint32_t)item) >> 2;
+
+    return (h ^ (h >> 4) ^ (h >> 8)) & (LIST_HASH_BUCKETS - 1);
+}
+
+// Convert a slot to an index
+static inline int index_of(struct list *list, int slot, struct lstindex *cindex) {
+    if (list->flags & LIST_NOT_INDEXED) {
+        return (int)cindex->item;
+    }
+
+    if (list->flags & LIST_TAGGED) {
+        return ((LIST_TAG_GEN(cindex->tag) << LIST_TAGGED_SLOT_BITS) | slot) + list->first_index;
+    }
+
+    return slot + list->first_index;
+}
 
-            if (list->index) {
-                // Copy current index array to new created
-                bcopy(list->index, indexa, sizeof(struct lstindex) * (list->indexes - 1));
+// Find the slot of an item in a LIST_NOT_INDEXED list
+static int IRAM_ATTR find_item(struct list *list, void *item) {
+    struct lstindex *cindex;
+    int slot, steps;
 
-                // Free current index array
-                free(list->index);
+    if (!list->bucket) {
+        for(slot = 0;slot < list->indexes;slot++) {
+            cindex = get_slot(list, slot);
+            if (cindex && (cindex->tag & LIST_TAG_USED) && (cindex->item == item)) {
+                return slot;
             }
+        }
+
+        return -1;
+    }
 
-            // Store new index array
-            list->index = indexa;
+    slot = list->bucket[hash_of(item)];
 
-            // Current index
-            index = list->index + list->indexes - 1;
+    // Number of steps is limited, to protect optimistic readers from a chain
+    // that is being changed
+    for(steps = 0;(slot >= 0) && (steps <= list->indexes);steps++) {
+        cindex = get_slot(list, slot);
+        if (!cindex) {
+            return -1;
+        }
 
-            // Initialize new index
-            index->index = list->indexes - 1;
+        if ((cindex->tag & LIST_TAG_USED) && (cindex->item == item)) {
+            return slot;
         }
 
-        index->next = NULL;
-        index->item = item;
-        index->deleted = 0;
+        slot = cindex->next;
+    }
+
+    return -1;
+}
+
+// Convert an index to a slot. Returns -1 if index is not valid.
+static int IRAM_ATTR slot_of(struct list *list, int index, int check_gen) {
+    struct lstindex *cindex;
+    int slot;
+
+    if (list->flags & LIST_NOT_INDEXED) {
+        return find_item(list, (void *)index);
+    }
+
+    slot = index - list->first_index;
+    if (slot < 0) {
+        return -1;
+    }
 
-        // Return index
-        if (item_index) {
-                *item_index = index->index + list->first_index;
+    if (list->flags & LIST_TAGGED) {
+        cindex = get_slot(list, slot & LIST_TAGGED_SLOT_MASK);
+        if (!cindex) {
+            return -1;
         }
-    } else if (list->flags & LIST_NOT_INDEXED) {
-            // Create a new element
-            index = (struct lstindex *)calloc(1, sizeof(struct lstindex));
-            if (!index) {
-                return ENOMEM;
-            }
 
-        index->item = item;
+        if (check_gen && (LIST_TAG_GEN(cindex->tag) != (slot >> LIST_TAGGED_SLOT_BITS))) {
+            return -1;
+        }
 
-        if ((list->index == NULL) && (list->last == NULL)) {
-                // First element
-                list->index = index;
-            } else {
-                // Almost there is one element in list
-                assert(list->last != NULL);
+        slot &= LIST_TAGGED_SLOT_MASK;
+    }
 
-                list->last->next = index;
-                index->previous = list->last;
-            }
+    cindex = get_slot(list, slot);
+    if (!cindex || !(cindex->tag & LIST_TAG_USED)) {
+        return -1;
+    }
+
+    return slot;
+}
 
-            list->last = index;
+static int IRAM_ATTR get_item(struct list *list, int index, void **item) {
+    struct lstindex *cindex;
+    int slot = slot_of(list, index, 1);
 
-             if (item_index) {
-                 *item_index = (int)item;
-             }
+    if (slot < 0) {
+        return EINVAL;
     }
 
-    mtx_unlock(&list->mutex);
+    // In an optimistic read the slot can go away before it is read again, if
+    // the list is destroyed meanwhile
+    cindex = get_slot(list, slot);
+    if (!cindex) {
+        return EINVAL;
+    }
+
+    *item = cindex->item;
 
     return 0;
 }
 
-int IRAM_ATTR lstget(struct list *list, int index, void **item) {
-    struct lstindex *cindex = NULL;
-    int iindex;
-
-    mtx_lock(&list->mutex);
+// Get the index of the first used slot starting from a slot, searching forward or backward
+static int IRAM_ATTR scan(struct list *list, int slot, int step) {
+    struct lstindex *cindex;
 
-    if (list->flags & LIST_DEFAULT) {
-        if (!list->indexes) {
-            mtx_unlock(&list->mutex);
-            return EINVAL;
+    for(;(slot >= 0) && (slot < list->indexes);slot += step) {
+        cindex = get_slot(list, slot);
+        if (cindex && (cindex->tag & LIST_TAG_USED)) {
+            return index_of(list, slot, cindex);
         }
+    }
 
-        // Check index
-        if (index < list->first_index) {
-            mtx_unlock(&list->mutex);
-            return EINVAL;
-        }
+    return -1;
+}
 
-        // Get new internal index
-        iindex = index - list->first_index;
+static int IRAM_ATTR next_index(struct list *list, int index) {
+    int slot;
 
-        // Test for a valid index
-        if (iindex > list->indexes) {
-            mtx_unlock(&list->mutex);
-            return EINVAL;
+    if (list->flags & LIST_NOT_INDEXED) {
+        slot = find_item(list, (void *)index);
+    } else {
+        slot = index - list->first_index;
+        if (list->flags & LIST_TAGGED) {
+            slot &= LIST_TAGGED_SLOT_MASK;
         }
+    }
 
-        cindex = list->index + iindex;
+    if (slot < 0) {
+        return -1;
+    }
 
-        if (cindex->deleted) {
-            mtx_unlock(&list->mutex);
-            return EINVAL;
-        }
-    } else if (list->flags & LIST_NOT_INDEXED) {
-            cindex = list->index;
+    return scan(list, slot + 1, 1);
+}
 
-            while (cindex) {
-                if (cindex->item == (void *)index) {
-                    *item = cindex->item;
-                    break;
-                }
+void lstinit(struct list *list, int first_index, uint8_t flags) {
+    int i;
 
-                cindex = cindex->next;
-            }
+    // Create the mutex
+    mtx_init(&list->mutex, NULL, NULL, 0);
 
-            if (!cindex) {
-                mtx_unlock(&list->mutex);
-                return EINVAL;
+    mtx_lock(&list->mutex);
+
+    memset(list->segment, 0, sizeof(list->segment));
+
+    list->bucket = NULL;
+    list->seq = 0;
+    list->indexes = 0;
+    list->free = -1;
+    list->first_index = first_index;
+    list->flags = flags;
+    list->init = 1;
+
+    if (flags & LIST_NOT_INDEXED) {
+        // If buckets can't be allocated, items are found with a linear search
+        list->bucket = (int *)malloc(sizeof(int) * LIST_HASH_BUCKETS);
+        if (list->bucket) {
+            for(i = 0;i < LIST_HASH_BUCKETS;i++) {
+                list->bucket[i] = -1;
             }
+        }
     }
 
-    *item = cindex->item;
-
     mtx_unlock(&list->mutex);
-
-    return 0;
 }
 
-int lstremovec(struct list *list, int index, int destroy, bool compact) {
-    struct lstindex *cindex = NULL;
-    int iindex;
+int lstadd(struct list *list, void *item, int *item_index) {
+    struct lstindex *cindex;
+    int segment;
+    int slot;
 
     mtx_lock(&list->mutex);
 
-    if (list->flags & LIST_DEFAULT) {
-        // Check index
-        if (index < list->first_index) {
-            mtx_unlock(&list->mutex);
-            return EINVAL;
-        }
+    if (list->free >= 0) {
+        // Get first free slot
+        slot = list->free;
+        cindex = get_slot(list, slot);
 
-        // Get new internal index
-        iindex = index - list->first_index;
+        list->free = cindex->next;
+    } else {
+        // Get a new slot
+        slot = list->indexes;
 
-        // Test for a valid index
-        if ((iindex < 0) || (iindex > list->indexes)) {
+        if ((slot >= LIST_MAX_SLOTS) || ((list->flags & LIST_TAGGED) && (slot > LIST_TAGGED_SLOT_MASK))) {
             mtx_unlock(&list->mutex);
-            return EINVAL;
-        }
-
-        cindex = &list->index[iindex];
-
-        if (destroy) {
-            free(cindex->item);
+            return ENOMEM;
         }
 
-        if (compact) {
-            bcopy(&list->index[iindex+1], &list->index[iindex], sizeof(struct lstindex) * (list->indexes - iindex - 1));
-            iindex = list->indexes-1;
-            cindex = &list->index[iindex];
+        // Allocate the segment for the slot, if needed
+        segment = segment_of(slot);
+        if (!list->segment[segment]) {
+            list->segment[segment] = (struct lstindex *)calloc(LIST_SEGMENT_BASE << segment, sizeof(struct lstindex));
+            if (!list->segment[segment]) {
+                mtx_unlock(&list->mutex);
+                return ENOMEM;
+            }
         }
 
-        cindex->next = list->free;
-        cindex->deleted = 1;
-        list->free = cindex;
-    } else if (list->flags & LIST_NOT_INDEXED) {
-            cindex = list->index;
+        __sync_synchronize();
 
-            while (cindex) {
-                if (cindex->item == (void *)index) {
-                    if (cindex->next) {
-                        cindex->next->previous = cindex->previous;
-                    } else {
-                        list->last = cindex->previous;
-                    }
+        list->indexes++;
 
-                    if (cindex->previous) {
-                        cindex->previous->next = cindex->next;
-                    } else {
-                        list->index = cindex->next;
-                    }
+        cindex = get_slot(list, slot);
+    }
 
-                    if (destroy) {
-                        free(cindex->item);
-                    }
+    write_begin(list);
 
-                    free(cindex);
+    cindex->item = item;
+    cindex->tag |= LIST_TAG_USED;
+    cindex->next = -1;
 
-                    break;
-                }
+    if ((list->flags & LIST_NOT_INDEXED) && list->bucket) {
+        cindex->next = list->bucket[hash_of(item)];
+        list->bucket[hash_of(item)] = slot;
+    }
 
-                cindex = cindex->next;
-            }
+    write_end(list);
 
+    // Return index
+    if (item_index) {
+        *item_index = index_of(list, slot, cindex);
     }
 
     mtx_unlock(&list->mutex);
@@ -287,139 +352,130 @@ int lstremovec(struct list *list, int index, int destroy, bool compact) {
     return 0;
 }
 
-int lstremove(struct list *list, int index, int destroy) {
-    return lstremovec(list, index, destroy, false);
+int IRAM_ATTR lstget(struct list *list, int index, void **item) {
+    int res;
+
+    LIST_READ(list, res, get_item(list, index, item));
+
+    return res;
 }
 
-int IRAM_ATTR lstfirst(struct list *list) {
-    int index;
-    int res = -1;
+int lstremovec(struct list *list, int index, int destroy, bool compact) {
+    struct lstindex *cindex;
+    struct lstindex *pindex;
+    void *item;
+    int *link;
+    int slot;
+
+    // Indexes are stable, so compact is not supported anymore
+    (void)compact;
 
     mtx_lock(&list->mutex);
 
-    if (list->flags & LIST_DEFAULT) {
-        for(index=0;index < list->indexes;index++) {
-            if (!list->index[index].deleted) {
-                res = index + list->first_index;
-                break;
-            }
-        }
-    } else if (list->flags & LIST_NOT_INDEXED) {
-            if ((list->index != NULL) && (list->last != NULL)) {
-                res = (int)list->index;
-            }
+    slot = slot_of(list, index, 1);
+    if (slot < 0) {
+        mtx_unlock(&list->mutex);
+        return EINVAL;
     }
 
-    mtx_unlock(&list->mutex);
+    cindex = get_slot(list, slot);
+    item = cindex->item;
 
-    return res;
-}
+    write_begin(list);
 
-int IRAM_ATTR lstlast(struct list *list) {
-    int index;
-    int res = -1;
+    if ((list->flags & LIST_NOT_INDEXED) && list->bucket) {
+        // Remove slot from its hash bucket
+        link = &list->bucket[hash_of(item)];
+        while (*link != slot) {
+            pindex = get_slot(list, *link);
+            link = &pindex->next;
+        }
 
-    mtx_lock(&list->mutex);
+        *link = cindex->next;
+    }
 
-    if (list->flags & LIST_DEFAULT) {
-        for(index = list->indexes - 1;index >= 0;index--) {
-            if (!list->index[index].deleted) {
-                res = index + list->first_index;
-                break;
-            }
-        }
-    } else if (list->flags & LIST_NOT_INDEXED) {
-            if ((list->index != NULL) && (list->last != NULL)) {
-                res = (int)list->last;
-            }
+    // Free slot, and increment its generation
+    cindex->tag = ((LIST_TAG_GEN(cindex->tag) + 1) & LIST_TAG_GEN_MASK) << 1;
+    cindex->item = NULL;
+    cindex->next = list->free;
+    list->free = slot;
+
+    write_end(list);
+
+    if (destroy) {
+        free(item);
     }
 
     mtx_unlock(&list->mutex);
 
-    return res;
+    return 0;
 }
 
-int IRAM_ATTR lstnext(struct list *list, int index) {
-    int res = -1;
-    int iindex;
-
-    mtx_lock(&list->mutex);
+int lstremove(struct list *list, int index, int destroy) {
+    return lstremovec(list, index, destroy, false);
+}
 
-    if (list->flags & LIST_DEFAULT) {
-        // Check index
-        if (index < list->first_index) {
-            mtx_unlock(&list->mutex);
-            return -1;
-        }
+int IRAM_ATTR lstfirst(struct list *list) {
+    int res;
 
-        // Get new internal index
-        iindex = index - list->first_index + 1;
+    LIST_READ(list, res, scan(list, 0, 1));
 
-        // Get next non deleted item on list
-        for(;iindex < list->indexes;iindex++) {
-            if (!list->index[iindex].deleted) {
-               res = iindex + list->first_index;
-               break;
-            }
-        }
-    } else if (list->flags & LIST_NOT_INDEXED) {
-            struct lstindex *cindex = NULL;
+    return res;
+}
 
-            cindex = list->index;
+int IRAM_ATTR lstlast(struct list *list) {
+    int res;
 
-            while (cindex) {
-                if (cindex->item == (void *)index) {
-                    if (cindex->next) {
-                        res = (int)cindex->next;
-                    }
+    LIST_READ(list, res, scan(list, list->indexes - 1, -1));
 
-                    break;
-                }
+    return res;
+}
 
-                cindex = cindex->next;
-            }
-    }
+int IRAM_ATTR lstnext(struct list *list, int index) {
+    int res;
 
-    mtx_unlock(&list->mutex);
+    LIST_READ(list, res, next_index(list, index));
 
     return res;
 }
 
 void lstdestroy(struct list *list, int items) {
-    int index;
+    struct lstindex *cindex;
+    int slot;
+    int segment;
 
     if (!list->init) return;
 
     mtx_lock(&list->mutex);
 
-    if (list->flags & LIST_DEFAULT) {
-        if (items) {
-            for(index=0;index < list->indexes;index++) {
-                if (!list->index[index].deleted) {
-                    free(list->index[index].item);
-                }
-            }
-        }
+    write_begin(list);
 
-        if (0 != list->index) {
-            free(list->index);
-            list->index = 0;
+    if (items) {
+        for(slot = 0;slot < list->indexes;slot++) {
+            cindex = get_slot(list, slot);
+            if (cindex && (cindex->tag & LIST_TAG_USED)) {
+                free(cindex->item);
+            }
         }
+    }
 
-    } else if (list->flags & LIST_NOT_INDEXED) {
-        struct lstindex *cindex = NULL;
-        struct lstindex *pindex = NULL;
-
-        cindex = list->index;
-
-        while (cindex) {
-            pindex = cindex;
-            cindex = cindex->next;
+    list->indexes = 0;
+    list->free = -1;
 
-            free(pindex);
+    for(segment = 0;segment < LIST_SEGMENTS;segment++) {
+        if (list->segment[segment]) {
+            free(list->segment[segment]);
+            list->segment[segment] = NULL;
         }
     }
 
+    if (list->bucket) {
+        free(list->bucket);
+        list->bucket = NULL;
+    }
+
+    write_end(list);
+
     list->init = 0;
 
     mtx_unlock(&list->mutex);
@@ -47,30 +47,44 @@
 #define	_LIST_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <sys/mutex.h>
 
+// Slots are stored in segments that are allocated on demand. Segment n has
+// LIST_SEGMENT_BASE << n slots, so the list grows geometrically, and slots are
+// never moved, so they can be read without taking the list mutex.
+#define LIST_SEGMENTS     12
+#define LIST_SEGMENT_BASE 8
+
+// Number of hash buckets used to find items in LIST_NOT_INDEXED lists
+#define LIST_HASH_BUCKETS 16
+
 struct list {
-    struct mtx mutex;
-    struct lstindex *index;
-    struct lstindex *free;
-    struct lstindex *last;
-    uint8_t indexes;
-    uint8_t first_index;
+    struct mtx mutex;                        // Serializes writers
+    struct lstindex *segment[LIST_SEGMENTS]; // Slot segments
+    int *bucket;                             // Hash buckets (LIST_NOT_INDEXED)
+    volatile uint32_t seq;                   // Odd while the list is being modified
+    int indexes;                             // Number of slots used so far
+    int free;                                // First free slot, -1 if there are not free slots
+    int first_index;
     uint8_t flags;
     uint8_t init;
 };
 
 struct lstindex {
     void *item;
-    uint8_t index;
-    uint8_t deleted;
-    struct lstindex *next;
-    struct lstindex *previous;
+    volatile uint32_t tag; // Bit 0: slot in use, bits 1 - 15: slot generation
+    int next;              // Next free slot, or next slot in the same hash bucket
 };
 
 #define LIST_DEFAULT 	(1 << 0)
 #define LIST_NOT_INDEXED (1 << 1)
 
+// Indexes include the generation of the slot, so an index of a removed item is never
+// valid again, even if its slot is reused. Tagged indexes are not small integers, so
+// they can't be used, for example, as file descriptors.
+#define LIST_TAGGED      (1 << 2)
+
 void lstinit(struct list *list, int first_index, uint8_t flags);
 int lstadd(struct list *list, void *item, int *item_index);
 int lstget(struct list *list, int index, void **item);
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2015 - 2020, IBEROXARXA SERVICIOS INTEGRALES, S.L.
+ * Copyright (C) 2015 - 2020, Jaume Olivé Petrus (jolive@whitecatboard.org)
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *     * The WHITECAT logotype cannot be changed, you can remove it, but you
+ *       cannot change it in any way. The WHITECAT logotype is:
+ *
+ *          /\       /\
+ *         /  \_____/  \
+ *        /_____________\
+ *        W H I T E C A T
+ *
+ *     * Redistributions in binary form must retain all copyright notices printed
+ *       to any local or remote output device. This include any reference to
+ *       Lua RTOS, whitecatboard.org, Lua, and other copyright notices that may
+ *       appear in the future.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Lua RTOS, single producer / single consumer ring buffer
+ *
+ * The producer only writes head and the consumer only writes tail, so one
+ * side can be an interrupt handler and the other one a task without any
+ * lock. head and tail are free running, and the size is a power of 2, so
+ * the number of used bytes is always head - tail.
+ *
+ */
+
+#ifndef _SYS_RINGBUF_H_
+#define _SYS_RINGBUF_H_
+
+#include <stdint.h>
+#include <string.h>
+
+typedef struct {
+    uint8_t *buf;
+    uint32_t mask;           // size - 1
+    volatile uint32_t head;  // Written by the producer
+    volatile uint32_t tail;  // Written by the consumer
+} ringbuf_t;
+
+// Smallest power of 2 greater or equal than size, or 0 if it doesn't fit in 32 bits
+static inline uint32_t ringbuf_size(uint32_t size) {
+    uint32_t pow2 = 1;
+
+    if (size > 0x80000000) {
+        return 0;
+    }
+
+    while (pow2 < size) {
+        pow2 <<= 1;
+    }
+
+    return pow2;
+}
+
+// Init the ring buffer over buf, which has size bytes (a power of 2)
+static inline void ringbuf_init(ringbuf_t *rb, uint8_t *buf, uint32_t size) {
+    rb->buf = buf;
+    rb->mask = size - 1;
+    rb->head = 0;
+    rb->tail = 0;
+}
+
+// Number of bytes that can be read
+static inline uint32_t ringbuf_count(const ringbuf_t *rb) {
+    return __atomic_load_n(&rb->head, __ATOMIC_ACQUIRE) - rb->tail;
+}
+
+// Number of bytes that can be written
+static inline uint32_t ringbuf_space(const ringbuf_t *rb) {
+    return rb->mask + 1 - (rb->head - __atomic_load_n(&rb->tail, __ATOMIC_ACQUIRE));
+}
+
+// Producer side: copy up to len bytes into the ring, returns the bytes copied
+static inline uint32_t ringbuf_write(ringbuf_t *rb, const uint8_t *data, uint32_t len) {
+    uint32_t head = rb->head;
+    uint32_t space = rb->mask + 1 - (head - __atomic_load_n(&rb->tail, __ATOMIC_ACQUIRE));
+    uint32_t off = head & rb->mask;
+    uint32_t first;
+
+    if (len > space) {
+        len = space;
+    }
+
+    // The span can wrap around the end of the buffer
+    first = rb->mask + 1 - off;
+    if (first > len) {
+        first = len;
+    }
+
+    memcpy(rb->buf + off, data, first);
+    memcpy(rb->buf, data + first, len - first);
+
+    __atomic_store_n(&rb->head, head + len, __ATOMIC_RELEASE);
+
+    return len;
+}
+
+// Consumer side: copy up to len bytes out of the ring, returns the bytes copied
+static inline uint32_t ringbuf_read(ringbuf_t *rb, uint8_t *data, uint32_t len) {
+    uint32_t tail = rb->tail;
+    uint32_t count = __atomic_load_n(&rb->head, __ATOMIC_ACQUIRE) - tail;
+    uint32_t off = tail & rb->mask;
+    uint32_t first;
+
+    if (len > count) {
+        len = count;
+    }
+
+    first = rb->mask + 1 - off;
+    if (first > len) {
+        first = len;
+    }
+
+    memcpy(data, rb->buf + off, first);
+    memcpy(data + first, rb->buf, len - first);
+
+    __atomic_store_n(&rb->tail, tail + len, __ATOMIC_RELEASE);
+
+    return len;
+}
+
+// Consumer side: get the next byte without removing it, returns 0 if the ring is empty
+static inline int ringbuf_peek(const ringbuf_t *rb, uint8_t *byte) {
+    if (ringbuf_count(rb) == 0) {
+        return 0;
+    }
+
+    *byte = rb->buf[rb->tail & rb->mask];
+
+    return 1;
+}
+
+// Consumer side: discard all the bytes in the ring
+static inline void ringbuf_flush(ringbuf_t *rb) {
+    __atomic_store_n(&rb->tail, __atomic_load_n(&rb->head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+}
+
+#endif /* !_SYS_RINGBUF_H_ */
@@ -173,5 +173,25 @@ void syslog(int, const char *, ...);
 void vsyslog(int, const char *, va_list);
 int getlogmask();
 int getlogstat();
+
+#ifndef _SYSLOG_STATS_DEFINED
+#define _SYSLOG_STATS_DEFINED
+
+#include <stdint.h>
+
+/*
+ * Statistics of the syslog record buffer
+ */
+typedef struct {
+    uint32_t logged;    /* records queued to the drain task */
+    uint32_t dropped;   /* records lost because the buffer was full */
+    uint32_t truncated; /* records cut to the record size */
+    uint32_t hwm;       /* maximum number of records waiting in the buffer */
+    uint32_t size;      /* buffer capacity, in records */
+} syslog_stats_t;
+#endif
+
+void syslog_flush();
+void syslog_stats(syslog_stats_t *stats);
 const char *syslog_setloghost (const char *host);
 const char *syslog_getloghost ();
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2015 - 2020, IBEROXARXA SERVICIOS INTEGRALES, S.L.
+ * Copyright (C) 2015 - 2020, Jaume Olivé Petrus (jolive@whitecatboard.org)
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *     * The WHITECAT logotype cannot be changed, you can remove it, but you
+ *       cannot change it in any way. The WHITECAT logotype is:
+ *
+ *          /\       /\
+ *         /  \_____/  \
+ *        /_____________\
+ *        W H I T E C A T
+ *
+ *     * Redistributions in binary form must retain all copyright notices printed
+ *       to any local or remote output device. This include any reference to
+ *       Lua RTOS, whitecatboard.org, Lua, and other copyright notices that may
+ *       appear in the future.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Lua RTOS, tile based dirty region tracking
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/tiles.h>
+
+int tiles_init(tiles_t *tiles, int width, int height, uint8_t shift) {
+    tiles->width = width;
+    tiles->height = height;
+    tiles->shift = shift;
+    tiles->cols = (width + (1 << shift) - 1) >> shift;
+    tiles->rows = (height + (1 << shift) - 1) >> shift;
+    tiles->words = (tiles->cols + 31) >> 5;
+    tiles->dirty = 0;
+
+    tiles->map = calloc(tiles->rows * tiles->words, sizeof(uint32_t));
+    if (!tiles->map) {
+        return -1;
+    }
+
+    return 0;
+}
+
+void tiles_destroy(tiles_t *tiles) {
+    free(tiles->map);
+
+    tiles->map = NULL;
+    tiles->dirty = 0;
+}
+
+void tiles_mark(tiles_t *tiles, int x0, int y0, int x1, int y1) {
+    int row, col;
+
+    // Clip
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 >= tiles->width) x1 = tiles->width - 1;
+    if (y1 >= tiles->height) y1 = tiles->height - 1;
+
+    if ((x0 > x1) || (y0 > y1)) {
+        return;
+    }
+
+    x0 >>= tiles->shift;
+    x1 >>= tiles->shift;
+    y0 >>= tiles->shift;
+    y1 >>= tiles->shift;
+
+    for(row = y0;row <= y1;row++) {
+        uint32_t *words = &tiles->map[row * tiles->words];
+
+        for(col = x0;col <= x1;col++) {
+            words[col >> 5] |= (1u << (col & 31));
+        }
+    }
+
+    tiles->dirty = 1;
+}
+
+void tiles_clear(tiles_t *tiles) {
+    memset(tiles->map, 0, tiles->rows * tiles->words * sizeof(uint32_t));
+    tiles->dirty = 0;
+}
+
+static inline int tile_is_dirty(uint32_t *words, int col) {
+    return (words[col >> 5] >> (col & 31)) & 1;
+}
+
+static inline int rect_area(int x0, int y0, int x1, int y1) {
+    return (x1 - x0 + 1) * (y1 - y0 + 1);
+}
+
+// Add the run of tiles c0..c1 of a row to the rectangles, in tile units
+static int add_run(tiles_rect_t *rects, int n, int max, int row, int c0, int c1) {
+    int best = -1, best_growth = 0;
+    int i;
+
+    for(i = 0;i < n;i++) {
+        tiles_rect_t *r = &rects[i];
+
+        // Already covered by a merged rectangle
+        if ((r->x0 <= c0) && (r->x1 >= c1) && (r->y0 <= row) && (r->y1 >= row)) {
+            return n;
+        }
+
+        // Same columns as a rectangle that ends in the row above
+        if ((r->y1 == row - 1) && (r->x0 == c0) && (r->x1 == c1)) {
+            r->y1 = row;
+            return n;
+        }
+    }
+
+    if (n < max) {
+        rects[n].x0 = c0;
+        rects[n].y0 = row;
+        rects[n].x1 = c1;
+        rects[n].y1 = row;
+
+        return n + 1;
+    }
+
+    // No room for a new rectangle, grow the one that grows less
+    for(i = 0;i < n;i++) {
+        tiles_rect_t *r = &rects[i];
+        int growth;
+
+        growth = rect_area(
+            (c0 < r->x0)?c0:r->x0, (row < r->y0)?row:r->y0,
+            (c1 > r->x1)?c1:r->x1, (row > r->y1)?row:r->y1
+        ) - rect_area(r->x0, r->y0, r->x1, r->y1);
+
+        if ((best < 0) || (growth < best_growth)) {
+            best = i;
+            best_growth = growth;
+        }
+    }
+
+    if (c0 < rects[best].x0) rects[best].x0 = c0;
+    if (c1 > rects[best].x1) rects[best].x1 = c1;
+    if (row < rects[best].y0) rects[best].y0 = row;
+    if (row > rects[best].y1) rects[best].y1 = row;
+
+    return n;
+}
+
+int tiles_coalesce(tiles_t *tiles, tiles_rect_t *rects, int max) {
+    int n = 0;
+    int row, col, c0;
+    int i;
+
+    if (!tiles->dirty || (max <= 0)) {
+        return 0;
+    }
+
+    for(row = 0;row < tiles->rows;row++) {
+        uint32_t *words = &tiles->map[row * tiles->words];
+
+        col = 0;
+        while (col < tiles->cols) {
+            // Skip clean words at once
+            if (((col & 31) == 0) && (words[col >> 5] == 0)) {
+                col += 32;
+                continue;
+            }
+
+            if (!tile_is_dirty(words, col)) {
+                col++;
+                continue;
+            }
+
+            c0 = col;
+            while ((col < tiles->cols) && tile_is_dirty(words, col)) {
+                col++;
+            }
+
+            n = add_run(rects, n, max, row, c0, col - 1);
+        }
+    }
+
+    tiles_clear(tiles);
+
+    // Tile units to pixels
+    for(i = 0;i < n;i++) {
+        rects[i].x0 <<= tiles->shift;
+        rects[i].y0 <<= tiles->shift;
+        rects[i].x1 = ((rects[i].x1 + 1) << tiles->shift) - 1;
+        rects[i].y1 = ((rects[i].y1 + 1) << tiles->shift) - 1;
+
+        if (rects[i].x1 >= tiles->width) rects[i].x1 = tiles->width - 1;
+        if (rects[i].y1 >= tiles->height) rects[i].y1 = tiles->height - 1;
+    }
+
+    return n;
+}
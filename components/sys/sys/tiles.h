@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2015 - 2020, IBEROXARXA SERVICIOS INTEGRALES, S.L.
+ * Copyright (C) 2015 - 2020, Jaume Olivé Petrus (jolive@whitecatboard.org)
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *     * The WHITECAT logotype cannot be changed, you can remove it, but you
+ *       cannot change it in any way. The WHITECAT logotype is:
+ *
+ *          /\       /\
+ *         /  \_____/  \
+ *        /_____________\
+ *        W H I T E C A T
+ *
+ *     * Redistributions in binary form must retain all copyright notices printed
+ *       to any local or remote output device. This include any reference to
+ *       Lua RTOS, whitecatboard.org, Lua, and other copyright notices that may
+ *       appear in the future.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Lua RTOS, tile based dirty region tracking
+ *
+ * An area of width x height pixels is split in square tiles of
+ * 1 << shift pixels, and each tile has one bit in a bitmap that is set
+ * when any pixel of the tile changes. When the area is updated, the dirty
+ * tiles are coalesced into a short list of rectangles, so two small
+ * changes in opposite corners don't end in an update of the whole area.
+ *
+ */
+
+#ifndef _SYS_TILES_H_
+#define _SYS_TILES_H_
+
+#include <stdint.h>
+
+typedef struct {
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+} tiles_rect_t;
+
+typedef struct {
+    uint32_t *map;   // Dirty bitmap, one row of words per row of tiles
+    int width;       // Area width, in pixels
+    int height;      // Area height, in pixels
+    int cols;        // Number of tile columns
+    int rows;        // Number of tile rows
+    int words;       // Words per row in map
+    uint8_t shift;   // Tile size is 1 << shift pixels
+    uint8_t dirty;   // Some tile is dirty
+} tiles_t;
+
+/**
+ * @brief Init the tile map for an area of width x height pixels.
+ *
+ * @param tiles Tile map.
+ * @param width Area width, in pixels.
+ * @param height Area height, in pixels.
+ * @param shift Tile size is 1 << shift pixels.
+ *
+ * @return 0 on success, -1 if there is not enough memory.
+ */
+int tiles_init(tiles_t *tiles, int width, int height, uint8_t shift);
+
+/**
+ * @brief Free the memory used by a tile map.
+ *
+ * @param tiles Tile map.
+ */
+void tiles_destroy(tiles_t *tiles);
+
+/**
+ * @brief Mark the tiles that overlap a rectangle as dirty. The rectangle is
+ *        clipped to the area, and coordinates are inclusive.
+ *
+ * @param tiles Tile map.
+ * @param x0 Left coordinate.
+ * @param y0 Top coordinate.
+ * @param x1 Right coordinate.
+ * @param y1 Bottom coordinate.
+ */
+void tiles_mark(tiles_t *tiles, int x0, int y0, int x1, int y1);
+
+/**
+ * @brief Mark the tile that contains a pixel as dirty.
+ *
+ * @param tiles Tile map.
+ * @param x Pixel x coordinate.
+ * @param y Pixel y coordinate.
+ */
+static inline void tiles_mark_pixel(tiles_t *tiles, int x, int y) {
+    if ((x < 0) || (y < 0) || (x >= tiles->width) || (y >= tiles->height)) {
+        return;
+    }
+
+    x >>= tiles->shift;
+    y >>= tiles->shift;
+
+    tiles->map[y * tiles->words + (x >> 5)] |= (1u << (x & 31));
+    tiles->dirty = 1;
+}
+
+/**
+ * @brief Clear all the tiles.
+ *
+ * @param tiles Tile map.
+ */
+void tiles_clear(tiles_t *tiles);
+
+/**
+ * @brief Coalesce the dirty tiles into rectangles, and clear them.
+ *
+ *        Runs of dirty tiles in a row are merged with the rectangle of the
+ *        row above that has the same columns. If there are more rectangles
+ *        than max, a run is merged into the rectangle that grows less. The
+ *        rectangles are returned in pixels, clipped to the area.
+ *
+ * @param tiles Tile map.
+ * @param rects Where to store the rectangles.
+ * @param max Size of rects.
+ *
+ * @return The number of rectangles stored in rects.
+ */
+int tiles_coalesce(tiles_t *tiles, tiles_rect_t *rects, int max);
+
+#endif /* _SYS_TILES_H_ */
@@ -49,15 +49,21 @@
 #include <reent.h>
 
 int __garbage_collector();
+int __garbage_collector_step();
 extern int __real__malloc_r(struct _reent *r, size_t size);
 
 int IRAM_ATTR __wrap__malloc_r(struct _reent *r, size_t size) {
     int res;
 
     if (!(res = __real__malloc_r(r, size))) {
-        // If there is not enough memory, try to execute the garbage collector
-        // and try again
-        if (__garbage_collector() == 0) {
+        // If there is not enough memory, try to execute an incremental step of
+        // the garbage collector and try again, and if it is not enough, execute
+        // a full garbage collection and try again
+        if (__garbage_collector_step() == 0) {
+            res = __real__malloc_r(r, size);
+        }
+
+        if (!res && (__garbage_collector() == 0)) {
             res = __real__malloc_r(r, size);
         }
     }
@@ -49,15 +49,21 @@
 #include <reent.h>
 
 int __garbage_collector();
+int __garbage_collector_step();
 extern int __real__realloc_r(struct _reent *r, void *ptr, size_t size);
 
 int IRAM_ATTR __wrap__realloc_r(struct _reent *r, void *ptr, size_t size) {
     int res;
 
     if (!(res = __real__realloc_r(r, ptr,size))) {
-        // If there is not enough memory, try to execute the garbage collector
-        // and try again
-        if (__garbage_collector() == 0) {
+        // If there is not enough memory, try to execute an incremental step of
+        // the garbage collector and try again, and if it is not enough, execute
+        // a full garbage collection and try again
+        if (__garbage_collector_step() == 0) {
+            res = __real__realloc_r(r, ptr, size);
+        }
+
+        if (!res && (__garbage_collector() == 0)) {
             res = __real__realloc_r(r, ptr, size);
         }
     }
@@ -76,3 +76,25 @@ int __garbage_collector() {
 
     return 0;
 }
+
+int __garbage_collector_step() {
+    if (xPortInIsrContext()) {
+        return -1;
+    }
+
+    // Get the thread's Lua state
+    lua_State *L = pvGetLuaState();
+    if (L) {
+        // Lua thread
+        // Execute a bounded amount of incremental work, that is cheaper
+        // than a full collection when the collector is sweeping
+        if (!luaC_emergencystep(L)) {
+            return -1;
+        }
+    } else {
+        // Not a Lua thread
+        return -1;
+    }
+
+    return 0;
+}
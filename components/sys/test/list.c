@@ -0,0 +1,276 @@
+/*
+ * Copyright (C) 2015 - 2020, IBEROXARXA SERVICIOS INTEGRALES, S.L.
+ * Copyright (C) 2015 - 2020, Jaume Olivé Petrus (jolive@whitecatboard.org)
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *     * The WHITECAT logotype cannot be changed, you can remove it, but you
+ *       cannot change it in any way. The WHITECAT logotype is:
+ *
+ *          /\       /\
+ *         /  \_____/  \
+ *        /_____________\
+ *        W H I T E C A T
+ *
+ *     * Redistributions in binary form must retain all copyright notices printed
+ *       to any local or remote output device. This include any reference to
+ *       Lua RTOS, whitecatboard.org, Lua, and other copyright notices that may
+ *       appear in the future.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Lua RTOS, sys list test cases
+ *
+ */
+
+#include "sdkconfig.h"
+
+#include "unity.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include <sys/list.h>
+
+#define LIST_TEST_ITEMS 300
+
+static struct list list;
+
+// Items are not dereferenced, so they are just tagged integers
+#define ITEM(n) ((void *)(((n) << 2) | 1))
+
+TEST_CASE("list add, get, remove", "[list]") {
+    int index[LIST_TEST_ITEMS];
+    void *item;
+    int i, n;
+
+    lstinit(&list, 1, LIST_DEFAULT);
+
+    // More items than the old 255 limit, spread over several segments
+    for (i = 0; i < LIST_TEST_ITEMS; i++) {
+        TEST_ASSERT(lstadd(&list, ITEM(i), &index[i]) == 0);
+        TEST_ASSERT(index[i] == i + 1);
+    }
+
+    for (i = 0; i < LIST_TEST_ITEMS; i++) {
+        TEST_ASSERT(lstget(&list, index[i], &item) == 0);
+        TEST_ASSERT(item == ITEM(i));
+    }
+
+    TEST_ASSERT(lstget(&list, 0, &item) == EINVAL);
+    TEST_ASSERT(lstget(&list, LIST_TEST_ITEMS + 1, &item) == EINVAL);
+
+    // Remove the even items
+    for (i = 0; i < LIST_TEST_ITEMS; i += 2) {
+        TEST_ASSERT(lstremove(&list, index[i], 0) == 0);
+        TEST_ASSERT(lstget(&list, index[i], &item) == EINVAL);
+        TEST_ASSERT(lstremove(&list, index[i], 0) == EINVAL);
+    }
+
+    // Iterate, only the odd items are left
+    n = 0;
+    for (i = lstfirst(&list); i >= 0; i = lstnext(&list, i)) {
+        TEST_ASSERT(lstget(&list, i, &item) == 0);
+        TEST_ASSERT(item == ITEM(i - 1));
+        TEST_ASSERT((i - 1) & 1);
+        n++;
+    }
+
+    TEST_ASSERT(n == LIST_TEST_ITEMS / 2);
+    TEST_ASSERT(lstlast(&list) == LIST_TEST_ITEMS);
+
+    // Free slots are reused, and indexes are stable
+    TEST_ASSERT(lstadd(&list, ITEM(1000), &n) == 0);
+    TEST_ASSERT(((n - 1) & 1) == 0);
+    TEST_ASSERT(lstget(&list, index[1], &item) == 0);
+    TEST_ASSERT(item == ITEM(1));
+
+    lstdestroy(&list, 0);
+
+    // A destroyed list has no items
+    TEST_ASSERT(lstget(&list, index[1], &item) == EINVAL);
+    TEST_ASSERT(lstfirst(&list) < 0);
+}
+
+TEST_CASE("list tagged indexes", "[list]") {
+    void *item;
+    int a, b;
+
+    lstinit(&list, 0, LIST_TAGGED);
+
+    TEST_ASSERT(lstadd(&list, ITEM(1), &a) == 0);
+    TEST_ASSERT(lstremove(&list, a, 0) == 0);
+
+    // The slot is reused, but the stale index is rejected
+    TEST_ASSERT(lstadd(&list, ITEM(2), &b) == 0);
+    TEST_ASSERT(a != b);
+    TEST_ASSERT(lstget(&list, a, &item) == EINVAL);
+    TEST_ASSERT(lstremove(&list, a, 0) == EINVAL);
+    TEST_ASSERT(lstget(&list, b, &item) == 0);
+    TEST_ASSERT(item == ITEM(2));
+
+    TEST_ASSERT(lstfirst(&list) == b);
+    TEST_ASSERT(lstnext(&list, b) < 0);
+
+    lstdestroy(&list, 0);
+}
+
+TEST_CASE("list not indexed", "[list]") {
+    void *item;
+    int i, n;
+
+    lstinit(&list, 0, LIST_NOT_INDEXED);
+
+    for (i = 0; i < LIST_TEST_ITEMS; i++) {
+        TEST_ASSERT(lstadd(&list, ITEM(i), &n) == 0);
+        TEST_ASSERT(n == (int)ITEM(i));
+    }
+
+    // Items are found by their value
+    for (i = 0; i < LIST_TEST_ITEMS; i++) {
+        TEST_ASSERT(lstget(&list, (int)ITEM(i), &item) == 0);
+        TEST_ASSERT(item == ITEM(i));
+    }
+
+    TEST_ASSERT(lstget(&list, (int)ITEM(LIST_TEST_ITEMS), &item) == EINVAL);
+
+    for (i = 0; i < LIST_TEST_ITEMS; i += 3) {
+        TEST_ASSERT(lstremove(&list, (int)ITEM(i), 0) == 0);
+    }
+
+    for (i = 0; i < LIST_TEST_ITEMS; i++) {
+        TEST_ASSERT(lstget(&list, (int)ITEM(i), &item) == ((i % 3) ? 0 : EINVAL));
+    }
+
+    n = 0;
+    for (i = lstfirst(&list); i >= 0; i = lstnext(&list, i)) {
+        n++;
+    }
+
+    TEST_ASSERT(n == LIST_TEST_ITEMS - (LIST_TEST_ITEMS + 2) / 3);
+
+    lstdestroy(&list, 0);
+}
+
+static volatile int readers_stop;
+static volatile int readers_errors;
+
+// Items are stored at the slot that matches their value, so a reader can check
+// that it never gets an item of other index
+static void *reader(void *arg) {
+    void *item;
+    int i;
+
+    while (!readers_stop) {
+        for (i = 1; i <= 64; i++) {
+            if ((lstget(&list, i, &item) == 0) && (item != ITEM(i))) {
+                readers_errors++;
+            }
+        }
+
+        for (i = lstfirst(&list); i >= 0; i = lstnext(&list, i)) {
+            if ((i < 1) || (i > 64)) {
+                readers_errors++;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+TEST_CASE("list concurrent readers", "[list]") {
+    pthread_t thread;
+    int i, j, index;
+
+    lstinit(&list, 1, LIST_DEFAULT);
+
+    for (i = 1; i <= 64; i++) {
+        TEST_ASSERT(lstadd(&list, ITEM(i), &index) == 0);
+    }
+
+    readers_stop = 0;
+    readers_errors = 0;
+
+    TEST_ASSERT(pthread_create(&thread, NULL, reader, NULL) == 0);
+
+    // Remove and add again each item, so it gets the same slot
+    for (j = 0; j < 200; j++) {
+        for (i = 1; i <= 64; i++) {
+            TEST_ASSERT(lstremove(&list, i, 0) == 0);
+            TEST_ASSERT(lstadd(&list, ITEM(i), &index) == 0);
+            TEST_ASSERT(index == i);
+        }
+    }
+
+    readers_stop = 1;
+    TEST_ASSERT(pthread_join(thread, NULL) == 0);
+    TEST_ASSERT(readers_errors == 0);
+
+    lstdestroy(&list, 0);
+}
+
+static int64_t list_us(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+TEST_CASE("list throughput", "[list][bench]") {
+    static int index[LIST_TEST_ITEMS];
+    int64_t t0, t_add, t_get, t_remove;
+    void *item;
+    int i, j;
+
+    lstinit(&list, 1, LIST_TAGGED);
+
+    t_add = t_get = t_remove = 0;
+
+    for (j = 0; j < 10; j++) {
+        t0 = list_us();
+        for (i = 0; i < LIST_TEST_ITEMS; i++) {
+            TEST_ASSERT(lstadd(&list, ITEM(i), &index[i]) == 0);
+        }
+        t_add += list_us() - t0;
+
+        t0 = list_us();
+        for (i = 0; i < LIST_TEST_ITEMS; i++) {
+            lstget(&list, index[i], &item);
+        }
+        t_get += list_us() - t0;
+
+        t0 = list_us();
+        for (i = 0; i < LIST_TEST_ITEMS; i++) {
+            lstremove(&list, index[i], 0);
+        }
+        t_remove += list_us() - t0;
+    }
+
+    lstdestroy(&list, 0);
+
+    printf("list: %d ops each, add %lld us, get %lld us, remove %lld us\n", 10 * LIST_TEST_ITEMS, t_add, t_get, t_remove);
+}
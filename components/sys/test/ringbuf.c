@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2015 - 2020, IBEROXARXA SERVICIOS INTEGRALES, S.L.
+ * Copyright (C) 2015 - 2020, Jaume Olivé Petrus (jolive@whitecatboard.org)
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *     * The WHITECAT logotype cannot be changed, you can remove it, but you
+ *       cannot change it in any way. The WHITECAT logotype is:
+ *
+ *          /\       /\
+ *         /  \_____/  \
+ *        /_____________\
+ *        W H I T E C A T
+ *
+ *     * Redistributions in binary form must retain all copyright notices printed
+ *       to any local or remote output device. This include any reference to
+ *       Lua RTOS, whitecatboard.org, Lua, and other copyright notices that may
+ *       appear in the future.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Lua RTOS, sys ring buffer test cases
+ *
+ */
+
+#include "sdkconfig.h"
+
+#include "unity.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <sys/ringbuf.h>
+
+TEST_CASE("sys", "[ringbuf]") {
+    ringbuf_t rb;
+    uint8_t mem[16];
+    uint8_t in[64], out[64];
+    uint32_t wr = 0, rd = 0;
+    int i, n;
+
+    TEST_ASSERT(ringbuf_size(0) == 1);
+    TEST_ASSERT(ringbuf_size(16) == 16);
+    TEST_ASSERT(ringbuf_size(17) == 32);
+    TEST_ASSERT(ringbuf_size(65537) == 131072);
+    TEST_ASSERT(ringbuf_size(0x80000000) == 0x80000000);
+    TEST_ASSERT(ringbuf_size(0x80000001) == 0);
+
+    ringbuf_init(&rb, mem, sizeof(mem));
+    TEST_ASSERT(ringbuf_count(&rb) == 0);
+    TEST_ASSERT(ringbuf_space(&rb) == sizeof(mem));
+    TEST_ASSERT(ringbuf_peek(&rb, out) == 0);
+
+    for (i = 0; i < sizeof(in); i++) {
+        in[i] = i;
+    }
+
+    // Writes are truncated to the free space
+    TEST_ASSERT(ringbuf_write(&rb, in, sizeof(in)) == sizeof(mem));
+    TEST_ASSERT(ringbuf_space(&rb) == 0);
+    TEST_ASSERT(ringbuf_write(&rb, in, 1) == 0);
+    TEST_ASSERT(ringbuf_read(&rb, out, sizeof(out)) == sizeof(mem));
+    TEST_ASSERT(memcmp(in, out, sizeof(mem)) == 0);
+    TEST_ASSERT(ringbuf_read(&rb, out, 1) == 0);
+
+    // Spans of every length, wrapping around the end of the buffer, and the
+    // indexes wrapping around 2^32
+    rb.head = rb.tail = 0xfffffff0;
+    for (n = 1; n < 200; n++) {
+        uint32_t len = (n * 7) % 13;
+        uint32_t i;
+
+        for (i = 0; i < len; i++) {
+            in[i] = (uint8_t)(wr + i);
+        }
+        wr += ringbuf_write(&rb, in, len);
+
+        len = ringbuf_read(&rb, out, (n * 5) % 11);
+        for (i = 0; i < len; i++) {
+            TEST_ASSERT(out[i] == (uint8_t)(rd + i));
+        }
+        rd += len;
+
+        TEST_ASSERT(ringbuf_count(&rb) == wr - rd);
+        TEST_ASSERT(ringbuf_count(&rb) + ringbuf_space(&rb) == sizeof(mem));
+    }
+
+    TEST_ASSERT(ringbuf_peek(&rb, out) == (wr != rd));
+    ringbuf_flush(&rb);
+    TEST_ASSERT(ringbuf_count(&rb) == 0);
+    TEST_ASSERT(ringbuf_space(&rb) == sizeof(mem));
+}
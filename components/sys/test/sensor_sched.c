@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2015 - 2020, IBEROXARXA SERVICIOS INTEGRALES, S.L.
+ * Copyright (C) 2015 - 2020, Jaume Olivé Petrus (jolive@whitecatboard.org)
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *     * The WHITECAT logotype cannot be changed, you can remove it, but you
+ *       cannot change it in any way. The WHITECAT logotype is:
+ *
+ *          /\       /\
+ *         /  \_____/  \
+ *        /_____________\
+ *        W H I T E C A T
+ *
+ *     * Redistributions in binary form must retain all copyright notices printed
+ *       to any local or remote output device. This include any reference to
+ *       Lua RTOS, whitecatboard.org, Lua, and other copyright notices that may
+ *       appear in the future.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Lua RTOS, sensor scheduler tests
+ *
+ */
+
+#include "sdkconfig.h"
+
+#if CONFIG_LUA_RTOS_LUA_USE_SENSOR
+
+#include "unity.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <stdlib.h>
+
+#include <sys/driver.h>
+
+#include <drivers/sensor.h>
+#include <drivers/sensor_sched.h>
+
+// Samples taken by the test sensor before it starts failing
+#define SENSOR_SCHED_TEST_SAMPLES 10
+
+static int acquired;
+
+// Returns 1, 2, 3 ... so the samples kept show which ones were overwritten
+static driver_error_t *test_acquire(sensor_instance_t *unit, sensor_value_t *values) {
+    if (acquired == SENSOR_SCHED_TEST_SAMPLES) {
+        return driver_error(SENSOR_DRIVER, SENSOR_ERR_TIMEOUT, NULL);
+    }
+
+    values[0].integerd.value = ++acquired;
+
+    return NULL;
+}
+
+static const sensor_t test_sensor = {
+    .id = "TEST",
+    .interface = {
+        {.type = INTERNAL_INTERFACE},
+    },
+    .data = {
+        {.id = "value", .type = SENSOR_DATA_INT},
+    },
+    .acquire = test_acquire,
+};
+
+// Schedule the test sensor and wait until it stops sampling
+static sensor_instance_t *test_schedule(uint16_t depth) {
+    sensor_setup_t setup[SENSOR_MAX_INTERFACES] = {{0}};
+    sensor_instance_t *unit;
+    uint32_t seq = 0;
+    int tries;
+
+    acquired = 0;
+
+    TEST_ASSERT(sensor_setup(&test_sensor, setup, &unit) == NULL);
+    TEST_ASSERT(sensor_sched_add(unit, 1, depth) == NULL);
+
+    for(tries = 0;(tries < 100) && (seq < SENSOR_SCHED_TEST_SAMPLES);tries++) {
+        vTaskDelay(10 / portTICK_PERIOD_MS);
+        TEST_ASSERT(sensor_sched_seq(unit, &seq) == NULL);
+    }
+
+    TEST_ASSERT(seq == SENSOR_SCHED_TEST_SAMPLES);
+
+    return unit;
+}
+
+static void test_unschedule(sensor_instance_t *unit) {
+    driver_error_t *error;
+    uint32_t seq;
+
+    sensor_sched_remove(unit);
+
+    error = sensor_sched_seq(unit, &seq);
+    TEST_ASSERT(error != NULL);
+    free(error);
+
+    TEST_ASSERT(sensor_unsetup(unit) == NULL);
+}
+
+TEST_CASE("sensor sched window, ring not full", "[sensor_sched]") {
+    sensor_instance_t *unit = test_schedule(16);
+    sensor_value_t values[16];
+    int64_t stamps[16];
+    uint32_t seq = 0;
+    int i, count;
+
+    TEST_ASSERT(sensor_sched_window(unit, 0, &seq, values, stamps, 16, &count) == NULL);
+    TEST_ASSERT(count == SENSOR_SCHED_TEST_SAMPLES);
+    TEST_ASSERT(seq == SENSOR_SCHED_TEST_SAMPLES);
+
+    for(i = 0;i < count;i++) {
+        TEST_ASSERT(values[i].type == SENSOR_DATA_INT);
+        TEST_ASSERT(values[i].integerd.value == i + 1);
+        TEST_ASSERT((i == 0) || (stamps[i] >= stamps[i - 1]));
+    }
+
+    // Nothing new since the last read
+    TEST_ASSERT(sensor_sched_window(unit, 0, &seq, values, NULL, 16, &count) == NULL);
+    TEST_ASSERT(count == 0);
+    TEST_ASSERT(seq == SENSOR_SCHED_TEST_SAMPLES);
+
+    test_unschedule(unit);
+}
+
+TEST_CASE("sensor sched window, wraparound and overwrite", "[sensor_sched]") {
+    sensor_instance_t *unit = test_schedule(4);
+    sensor_value_t values[8];
+    int64_t stamps[8];
+    uint32_t seq;
+    int i, count;
+
+    // 10 samples in a 4 slot ring: head wrapped twice, 1 to 6 were overwritten,
+    // so reading from 0 starts at the oldest sample kept
+    seq = 0;
+    TEST_ASSERT(sensor_sched_window(unit, 0, &seq, values, stamps, 8, &count) == NULL);
+    TEST_ASSERT(count == 4);
+    TEST_ASSERT(seq == SENSOR_SCHED_TEST_SAMPLES);
+
+    for(i = 0;i < count;i++) {
+        TEST_ASSERT(values[i].integerd.value == SENSOR_SCHED_TEST_SAMPLES - 3 + i);
+        TEST_ASSERT((i == 0) || (stamps[i] >= stamps[i - 1]));
+    }
+
+    // Read the samples kept in chunks, crossing the end of the ring
+    seq = 7;
+    TEST_ASSERT(sensor_sched_window(unit, 0, &seq, values, NULL, 2, &count) == NULL);
+    TEST_ASSERT(count == 2);
+    TEST_ASSERT(seq == 9);
+    TEST_ASSERT(values[0].integerd.value == 8);
+    TEST_ASSERT(values[1].integerd.value == 9);
+
+    TEST_ASSERT(sensor_sched_window(unit, 0, &seq, values, NULL, 2, &count) == NULL);
+    TEST_ASSERT(count == 1);
+    TEST_ASSERT(seq == SENSOR_SCHED_TEST_SAMPLES);
+    TEST_ASSERT(values[0].integerd.value == SENSOR_SCHED_TEST_SAMPLES);
+
+    // A sequence number just overwritten
+    seq = 5;
+    TEST_ASSERT(sensor_sched_window(unit, 0, &seq, values, NULL, 1, &count) == NULL);
+    TEST_ASSERT(count == 1);
+    TEST_ASSERT(seq == 7);
+    TEST_ASSERT(values[0].integerd.value == 7);
+
+    test_unschedule(unit);
+}
+
+TEST_CASE("sensor sched window, invalid property", "[sensor_sched]") {
+    sensor_instance_t *unit = test_schedule(4);
+    driver_error_t *error;
+    sensor_value_t values[1];
+    uint32_t seq = 0;
+    int count;
+
+    error = sensor_sched_window(unit, 1, &seq, values, NULL, 1, &count);
+    TEST_ASSERT(error != NULL);
+    TEST_ASSERT(count == 0);
+    free(error);
+
+    test_unschedule(unit);
+}
+
+#endif
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2015 - 2020, IBEROXARXA SERVICIOS INTEGRALES, S.L.
+ * Copyright (C) 2015 - 2020, Jaume Olivé Petrus (jolive@whitecatboard.org)
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the <organization> nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *     * The WHITECAT logotype cannot be changed, you can remove it, but you
+ *       cannot change it in any way. The WHITECAT logotype is:
+ *
+ *          /\       /\
+ *         /  \_____/  \
+ *        /_____________\
+ *        W H I T E C A T
+ *
+ *     * Redistributions in binary form must retain all copyright notices printed
+ *       to any local or remote output device. This include any reference to
+ *       Lua RTOS, whitecatboard.org, Lua, and other copyright notices that may
+ *       appear in the future.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Lua RTOS, sys tile map test cases
+ *
+ */
+
+#include "sdkconfig.h"
+
+#include "unity.h"
+
+#include <stdint.h>
+
+#include <sys/tiles.h>
+
+// Check that every pixel of the area that is inside a marked rectangle is
+// inside some of the coalesced rectangles
+static int covered(tiles_rect_t *rects, int n, int x, int y) {
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if ((x >= rects[i].x0) && (x <= rects[i].x1) && (y >= rects[i].y0) && (y <= rects[i].y1)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+TEST_CASE("sys", "[tiles]") {
+    tiles_t tiles;
+    tiles_rect_t rects[4];
+    int n, x, y;
+
+    // 100 x 50 pixels, 16 x 16 pixel tiles: 7 x 4 tiles, the last ones clipped
+    TEST_ASSERT(tiles_init(&tiles, 100, 50, 4) == 0);
+    TEST_ASSERT(tiles.cols == 7);
+    TEST_ASSERT(tiles.rows == 4);
+    TEST_ASSERT(tiles_coalesce(&tiles, rects, 4) == 0);
+
+    // Two small changes in opposite corners are two small rectangles
+    tiles_mark_pixel(&tiles, 1, 1);
+    tiles_mark(&tiles, 97, 49, 120, 60);
+    n = tiles_coalesce(&tiles, rects, 4);
+    TEST_ASSERT(n == 2);
+    TEST_ASSERT((rects[0].x0 == 0) && (rects[0].y0 == 0) && (rects[0].x1 == 15) && (rects[0].y1 == 15));
+    TEST_ASSERT((rects[1].x0 == 96) && (rects[1].y0 == 48) && (rects[1].x1 == 99) && (rects[1].y1 == 49));
+
+    // Coalescing clears the map
+    TEST_ASSERT(!tiles.dirty);
+    TEST_ASSERT(tiles_coalesce(&tiles, rects, 4) == 0);
+
+    // Rows with the same columns are merged in one rectangle
+    tiles_mark(&tiles, 20, 5, 40, 40);
+    n = tiles_coalesce(&tiles, rects, 4);
+    TEST_ASSERT(n == 1);
+    TEST_ASSERT((rects[0].x0 == 16) && (rects[0].y0 == 0) && (rects[0].x1 == 47) && (rects[0].y1 == 47));
+
+    // Out of the area
+    tiles_mark(&tiles, 200, 200, 300, 300);
+    tiles_mark_pixel(&tiles, -1, 0);
+    TEST_ASSERT(tiles_coalesce(&tiles, rects, 4) == 0);
+
+    // More runs than rectangles: all the dirty pixels must be covered
+    for (y = 0; y < 50; y += 16) {
+        for (x = (y & 16); x < 100; x += 32) {
+            tiles_mark_pixel(&tiles, x, y);
+        }
+    }
+
+    n = tiles_coalesce(&tiles, rects, 4);
+    TEST_ASSERT(n == 4);
+
+    for (y = 0; y < 50; y += 16) {
+        for (x = (y & 16); x < 100; x += 32) {
+            TEST_ASSERT(covered(rects, n, x, y));
+        }
+    }
+
+    tiles_destroy(&tiles);
+    TEST_ASSERT(tiles.map == NULL);
+}
@@ -66,6 +66,9 @@ static char sccsid[] = "@(#)syslog.c	8.5 (Berkeley) 4/29/95";
 #include <drivers/net.h>
 #include "esp_log.h"
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
 #include <stdlib.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -76,6 +79,8 @@ static char sccsid[] = "@(#)syslog.c	8.5 (Berkeley) 4/29/95";
 #include <unistd.h>
 #include <limits.h>
 
+#include <sys/lock.h>
+
 #if __STDC__
 #include <stdarg.h>
 #else
@@ -84,6 +89,43 @@ static char sccsid[] = "@(#)syslog.c	8.5 (Berkeley) 4/29/95";
 
 #define MAX_BUFF 512
 
+// Destinations of a log record
+#define SYSLOG_SINK_LOCAL  0x01	/* console and messages file */
+#define SYSLOG_SINK_REMOTE 0x02	/* rsyslog server */
+
+// Console output is gathered and written in chunks of this size
+#define SYSLOG_BATCH_SIZE 512
+
+#if CONFIG_LUA_RTOS_SYSLOG_ASYNC
+#define SYSLOG_RECORDS     CONFIG_LUA_RTOS_SYSLOG_RECORDS
+#define SYSLOG_RECORD_SIZE CONFIG_LUA_RTOS_SYSLOG_RECORD_SIZE
+
+#if (SYSLOG_RECORDS & (SYSLOG_RECORDS - 1)) != 0
+#error "CONFIG_LUA_RTOS_SYSLOG_RECORDS must be a power of 2"
+#endif
+
+#define SYSLOG_TASK_STACK_SIZE 3072
+#define SYSLOG_TASK_PRIORITY   (tskIDLE_PRIORITY + 1)
+
+/*
+ * Log records are queued in a ring of fixed size slots. Producers reserve
+ * a slot by advancing head with a compare and swap, format the message in
+ * place, and publish it by storing its sequence number. The drain task
+ * consumes the published slots in order and advances tail.
+ */
+typedef struct {
+	volatile uint32_t seq;	/* index + 1 once the record is complete */
+	uint16_t len;
+	uint8_t sinks;
+	char msg[SYSLOG_RECORD_SIZE];
+} syslog_record_t;
+
+static syslog_record_t records[SYSLOG_RECORDS];
+static volatile uint32_t head = 0;	/* next slot to reserve */
+static volatile uint32_t tail = 0;	/* next slot to drain */
+static TaskHandle_t drain_task = NULL;
+#endif
+
 #if CONFIG_LUA_RTOS_USE_RSYSLOG
 static int   logSock = 0;
 static char *logHost = NULL;
@@ -95,8 +137,167 @@ static int	 logStat = 0;		/* status bits, set by openlog() */
 static int	logFacility = LOG_USER;	/* default facility code */
 static int	logMask = 0b11111111;		/* mask of priorities to be logged */
 
+static _lock_t sink_lock;	/* protects the sinks */
+static char cons_buf[SYSLOG_BATCH_SIZE];
+static int  cons_len = 0;
+static volatile syslog_stats_t stats = {0};
+
 void vsyslog(int pri, register const char *fmt, va_list app);
 
+static void console_flush() {
+	if (cons_len > 0) {
+		(void)write(fileno(_GLOBAL_REENT->_stdout), cons_buf, cons_len);
+		cons_len = 0;
+	}
+}
+
+static void console_put(const char *data, int len) {
+	if (cons_len + len > sizeof(cons_buf)) {
+		console_flush();
+	}
+
+	if (len > sizeof(cons_buf)) {
+		(void)write(fileno(_GLOBAL_REENT->_stdout), data, len);
+		return;
+	}
+
+	memcpy(cons_buf + cons_len, data, len);
+	cons_len += len;
+}
+
+/*
+ * Send a formatted record to its sinks. Output may be buffered until
+ * sinks_flush is called. Must be called with sink_lock held.
+ */
+static void sinks_output(const char *msg, int len, int sinks) {
+	const char *body = msg;
+	const char *p;
+
+	// Remove end \r | \n, each sink adds its own line ending
+	while ((len > 0) && ((msg[len - 1] == '\r') || (msg[len - 1] == '\n'))) {
+		len--;
+	}
+
+	if (sinks & SYSLOG_SINK_LOCAL) {
+		// Skip the <pri> header
+		if ((*msg == '<') && (p = memchr(msg, '>', len))) {
+			body = p + 1;
+		}
+
+		if (logStat & LOG_CONS) {
+			console_put(body, len - (body - msg));
+			console_put("\r\n", 2);
+		}
+
+		if (NULL != logFile) {
+			fwrite(body, len - (body - msg), 1, logFile);
+			fwrite("\n", 1, 1, logFile);
+		}
+	}
+
+#if CONFIG_LUA_RTOS_USE_RSYSLOG
+	if ((sinks & SYSLOG_SINK_REMOTE) && (0 != logSock)) {
+		LOCK_TCPIP_CORE()
+		sendto(logSock,msg,len,0,(struct sockaddr *)&logAddr,sizeof(logAddr));
+		UNLOCK_TCPIP_CORE()
+	}
+#endif
+}
+
+static void sinks_flush() {
+	console_flush();
+
+	if (NULL != logFile) {
+		fflush(logFile);
+	}
+}
+
+static int syslog_format(char *buf, int size, int pri, const char *fmt, va_list ap) {
+	char *p;
+	int cnt;
+
+	p = buf + snprintf(buf, size, "<%d>", pri);
+	if (logStat & LOG_PID) {
+		p += snprintf(p, size - (p - buf), "[%d]", getpid());
+	}
+
+	cnt = vsnprintf(p, size - (p - buf), fmt, ap);
+	if (cnt >= size - (p - buf)) {
+		__sync_fetch_and_add(&stats.truncated, 1);
+		p = buf + size - 1;
+	} else {
+		p += cnt;
+	}
+
+	return p - buf;
+}
+
+#if CONFIG_LUA_RTOS_SYSLOG_ASYNC
+// Reserve a record, or return NULL if the ring is full
+static syslog_record_t *record_reserve(uint32_t *index) {
+	uint32_t h, used, hwm;
+
+	do {
+		h = head;
+		used = h - tail;
+		if (used >= SYSLOG_RECORDS) {
+			__sync_fetch_and_add(&stats.dropped, 1);
+			return NULL;
+		}
+	} while (!__sync_bool_compare_and_swap(&head, h, h + 1));
+
+	used++;
+	while (((hwm = stats.hwm) < used) && !__sync_bool_compare_and_swap(&stats.hwm, hwm, used));
+
+	*index = h;
+
+	return &records[h & (SYSLOG_RECORDS - 1)];
+}
+
+static void record_commit(syslog_record_t *rec, uint32_t index) {
+	__sync_synchronize();
+	rec->seq = index + 1;
+
+	__sync_fetch_and_add(&stats.logged, 1);
+	xTaskNotifyGive(drain_task);
+}
+
+// Write all the published records to the sinks, in order
+static void records_drain() {
+	syslog_record_t *rec;
+	int drained = 0;
+
+	_lock_acquire_recursive(&sink_lock);
+
+	for(;;) {
+		rec = &records[tail & (SYSLOG_RECORDS - 1)];
+		if (rec->seq != tail + 1) {
+			break;
+		}
+
+		__sync_synchronize();
+		sinks_output(rec->msg, rec->len, rec->sinks);
+		__sync_synchronize();
+
+		tail++;
+		drained++;
+	}
+
+	if (drained > 0) {
+		sinks_flush();
+	}
+
+	_lock_release_recursive(&sink_lock);
+}
+
+static void syslog_task(void *arg) {
+	for(;;) {
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		records_drain();
+	}
+}
+#endif
+
 /*
  * syslog, vsyslog --
  *	print message on log file; output is intended for syslogd(8).
@@ -130,12 +331,8 @@ vsyslog(pri, fmt, ap)
 	register const char *fmt;
 	va_list ap;
 {
-	register int cnt;
-	register char *p;
 	char *tbuf;
-	time_t now;
-	int fd;
-	int has_cr_lf = 0;
+	int cnt;
 
 	#define	INTERNALLOG LOG_ERR|LOG_CONS|LOG_PERROR|LOG_PID
 
@@ -150,95 +347,118 @@ vsyslog(pri, fmt, ap)
 	if (!(LOG_MASK(LOG_PRI(pri)) & logMask))
 		return;
 
-	// Allocate space
-	tbuf = (char *)malloc(MAX_BUFF + 3);
-	if (!tbuf) return;
-
 	/* Set default facility if none specified. */
 	if ((pri & LOG_FACMASK) == 0)
 		pri |= logFacility;
 
-	/* Build the message. */
-
-	(void)time(&now);
-	p = tbuf + snprintf(tbuf, MAX_BUFF, "<%d>", pri);
-	if (logStat & LOG_PID) {
-		p += snprintf(p, MAX_BUFF - (p - tbuf), "[%d]", getpid());
-	}
-	cnt = vsnprintf(p, MAX_BUFF - (p - tbuf), fmt, ap);
-	if (cnt > MAX_BUFF - (p - tbuf)) {
-		p += (MAX_BUFF - (p - tbuf)) - 1;
-	}
-	else {
-		p += cnt;
-	}
-
-	cnt = p - tbuf;
-	has_cr_lf = ((tbuf[cnt-1] == '\n') && (tbuf[cnt-2] == '\r'));
-
-	if (logStat & LOG_CONS) {
-		fd = fileno(_GLOBAL_REENT->_stdout);
-		if (!has_cr_lf) {
-			while(cnt && tbuf[cnt-1] == '\n') cnt--;
+#if CONFIG_LUA_RTOS_SYSLOG_ASYNC
+	if (drain_task) {
+		syslog_record_t *rec;
+		uint32_t index;
 
-			(void)strcat(tbuf, "\r\n");
-			cnt += 2;
-			has_cr_lf = 1;
+		/* Build the message in place, the drain task writes it. */
+		if ((rec = record_reserve(&index))) {
+			rec->len = syslog_format(rec->msg, sizeof(rec->msg), pri, fmt, ap);
+			rec->sinks = SYSLOG_SINK_LOCAL | SYSLOG_SINK_REMOTE;
+			record_commit(rec, index);
 		}
 
-		p = index(tbuf, '>') + 1;
-		(void)write(fd, p, cnt - (p - tbuf));
+		return;
 	}
+#endif
 
-	if (NULL != logFile) {
-		char *t = tbuf + strlen(tbuf);
+	// Allocate space
+	tbuf = (char *)malloc(MAX_BUFF);
+	if (!tbuf) return;
 
-		// Remove end \r | \n
-		while ((*t == '\r') || (*t == '\n')) {
-			*t = '\0';
-			t--;
-			cnt--;
-		}
+	/* Build the message. */
+	cnt = syslog_format(tbuf, MAX_BUFF, pri, fmt, ap);
 
-		(void)strcat(tbuf, "\n");
-		cnt += 1;
-		p = index(tbuf, '>') + 1;
+	_lock_acquire_recursive(&sink_lock);
+	sinks_output(tbuf, cnt, SYSLOG_SINK_LOCAL | SYSLOG_SINK_REMOTE);
+	sinks_flush();
+	_lock_release_recursive(&sink_lock);
 
-		fwrite(p, cnt - (p - tbuf), 1, logFile);
-		fflush(logFile);
-	}
+	free(tbuf);
+}
 
-#if CONFIG_LUA_RTOS_USE_RSYSLOG
-	if (0 != logSock) {
-		LOCK_TCPIP_CORE()
-		sendto(logSock,tbuf,cnt,0,(struct sockaddr *)&logAddr,sizeof(logAddr));
-		UNLOCK_TCPIP_CORE()
+/* syslog_flush -- write the queued records before returning */
+void syslog_flush() {
+#if CONFIG_LUA_RTOS_SYSLOG_ASYNC
+	if (drain_task) {
+		records_drain();
 	}
 #endif
+}
 
-	free(tbuf);
+void syslog_stats(syslog_stats_t *s) {
+	s->logged = stats.logged;
+	s->dropped = stats.dropped;
+	s->truncated = stats.truncated;
+	s->hwm = stats.hwm;
+#if CONFIG_LUA_RTOS_SYSLOG_ASYNC
+	s->size = SYSLOG_RECORDS;
+#else
+	s->size = 0;
+#endif
 }
 
 #if CONFIG_LUA_RTOS_USE_RSYSLOG
 static int syslog_logging_vprintf( const char *str, va_list l ) {
+	va_list ap;
+
+	va_copy(ap, l);
+
+#if CONFIG_LUA_RTOS_SYSLOG_ASYNC
+	if (drain_task) {
+		syslog_record_t *rec;
+		uint32_t index;
+
+		if ((rec = record_reserve(&index))) {
+			int len = vsnprintf(rec->msg, sizeof(rec->msg), str, ap);
+			if (len >= sizeof(rec->msg)) {
+				__sync_fetch_and_add(&stats.truncated, 1);
+				len = sizeof(rec->msg) - 1;
+			}
+
+			rec->len = len;
+			rec->sinks = SYSLOG_SINK_REMOTE;
+			record_commit(rec, index);
+		}
+
+		va_end(ap);
+		return vprintf( str, l );
+	}
+#endif
+
 	// Allocate space
 	char* tbuf = (char *)malloc(MAX_BUFF+1);
 	if (tbuf) {
-		int len = vsnprintf((char*)tbuf, MAX_BUFF, str, l);
-
-		if (0 != logSock) {
-			LOCK_TCPIP_CORE()
-			sendto(logSock,tbuf,len,0,(struct sockaddr *)&logAddr,sizeof(logAddr));
-			UNLOCK_TCPIP_CORE()
+		int len = vsnprintf((char*)tbuf, MAX_BUFF, str, ap);
+		if (len >= MAX_BUFF) {
+			len = MAX_BUFF - 1;
 		}
 
+		_lock_acquire_recursive(&sink_lock);
+		sinks_output(tbuf, len, SYSLOG_SINK_REMOTE);
+		_lock_release_recursive(&sink_lock);
+
 		free(tbuf);
 	}
 
+	va_end(ap);
 	return vprintf( str, l );
 }
 
+static void _reconnect_syslog();
+
 static void reconnect_syslog() {
+	_lock_acquire_recursive(&sink_lock);
+	_reconnect_syslog();
+	_lock_release_recursive(&sink_lock);
+}
+
+static void _reconnect_syslog() {
 	if (0 != logSock) {
 		close(logSock);
 	}
@@ -305,6 +525,10 @@ static void syslog_net_callback(system_event_t *event){
 int openlog(logstat, logfac)
 	int logstat, logfac;
 {
+	syslog_flush();
+
+	_lock_acquire_recursive(&sink_lock);
+
 	logStat = logstat;
 	if (logfac != 0 && (logfac &~ LOG_FACMASK) == 0)
 		logFacility = logfac;
@@ -327,9 +551,19 @@ int openlog(logstat, logfac)
 		fflush(logFile);
 	}
 
+#if CONFIG_LUA_RTOS_SYSLOG_ASYNC
+	if (!drain_task) {
+		xTaskCreatePinnedToCore(syslog_task, "syslog", SYSLOG_TASK_STACK_SIZE, NULL, SYSLOG_TASK_PRIORITY, &drain_task, xPortGetCoreID());
+	}
+#endif
+
 #if CONFIG_LUA_RTOS_USE_RSYSLOG
-	reconnect_syslog();
+	_reconnect_syslog();
+#endif
+
+	_lock_release_recursive(&sink_lock);
 
+#if CONFIG_LUA_RTOS_USE_RSYSLOG
 	driver_error_t *error;
 	if ((error = net_event_register_callback(syslog_net_callback))) {
 		printf("couldn't register net callback, please restart syslog service from lua using after changing connectivity\n");
@@ -341,6 +575,10 @@ int openlog(logstat, logfac)
 }
 
 void closelog() {
+	syslog_flush();
+
+	_lock_acquire_recursive(&sink_lock);
+
 	if (NULL != logFile) {
 		fclose(logFile);
 	}
@@ -351,7 +589,11 @@ void closelog() {
 		close(logSock);
 	}
 	logSock = 0;
+#endif
 
+	_lock_release_recursive(&sink_lock);
+
+#if CONFIG_LUA_RTOS_USE_RSYSLOG
 	driver_error_t *error;
 	if ((error = net_event_unregister_callback(syslog_net_callback))) {
 		printf("couldn't unregister net callback\n");
@@ -59,7 +59,21 @@
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+// Size of each direction's ring buffer
+#define PTY_BUFFER_SIZE 1024
+
+// Byte ring buffer, with one reader and any number of writers
+typedef struct {
+    char buf[PTY_BUFFER_SIZE];
+    int head;  // Next position to read
+    int count; // Bytes in the buffer
+    portMUX_TYPE mux;
+    SemaphoreHandle_t writer;   // Serializes the writers
+    SemaphoreHandle_t readable; // Given when bytes are put into the buffer
+    SemaphoreHandle_t writable; // Given when bytes are taken from the buffer
+} pty_ring_t;
 
 typedef struct {
     // Number of opened vfs_pty->masters and vfs_pty->slaves
@@ -71,8 +85,8 @@ typedef struct {
     vfs_fd_local_storage_t *slave_local_storage;
     vfs_fd_local_storage_t *master_local_storage;
 
-    xQueueHandle slave_q;
-    xQueueHandle master_q;
+    pty_ring_t *slave_q;  // Written by the master, read by the slave
+    pty_ring_t *master_q; // Written by the slave, read by the master
 } vfs_pty_t;
 
 // Register master functions
@@ -88,6 +102,157 @@ static int vfs_ptm_ioctl(int fd, int request, va_list args);
 static int registered = 0;
 static vfs_pty_t *vfs_pty;
 
+static pty_ring_t *ring_create() {
+    pty_ring_t *ring = calloc(1, sizeof(pty_ring_t));
+    assert(ring != NULL);
+
+    vPortCPUInitializeMutex(&ring->mux);
+
+    ring->writer = xSemaphoreCreateMutex();
+    assert(ring->writer != NULL);
+
+    ring->readable = xSemaphoreCreateBinary();
+    assert(ring->readable != NULL);
+
+    ring->writable = xSemaphoreCreateBinary();
+    assert(ring->writable != NULL);
+
+    return ring;
+}
+
+static void ring_reset(pty_ring_t *ring) {
+    // Don't reset while a writer is copying
+    xSemaphoreTake(ring->writer, portMAX_DELAY);
+
+    portENTER_CRITICAL(&ring->mux);
+    ring->head = 0;
+    ring->count = 0;
+    portEXIT_CRITICAL(&ring->mux);
+
+    xSemaphoreGive(ring->writer);
+
+    // Unblock a writer waiting for room
+    xSemaphoreGive(ring->writable);
+}
+
+static int ring_used(pty_ring_t *ring) {
+    return ring->count;
+}
+
+static int ring_free(pty_ring_t *ring) {
+    return PTY_BUFFER_SIZE - ring->count;
+}
+
+// Wait until the ring has bytes, at most ticks
+static int ring_wait(pty_ring_t *ring, TickType_t ticks) {
+    while (ring_used(ring) == 0) {
+        if (xSemaphoreTake(ring->readable, ticks) != pdTRUE) {
+            return (ring_used(ring) > 0);
+        }
+    }
+
+    return 1;
+}
+
+// Take up to len bytes from the ring. Only the reader moves head, so the
+// copy is done outside the critical section, in at most two spans.
+static int ring_get(pty_ring_t *ring, char *buf, int len) {
+    int head, bytes, span;
+
+    portENTER_CRITICAL(&ring->mux);
+    head = ring->head;
+    bytes = ring->count;
+    portEXIT_CRITICAL(&ring->mux);
+
+    if (bytes > len) {
+        bytes = len;
+    }
+
+    if (bytes == 0) {
+        return 0;
+    }
+
+    span = PTY_BUFFER_SIZE - head;
+    if (span > bytes) {
+        span = bytes;
+    }
+
+    memcpy(buf, ring->buf + head, span);
+    memcpy(buf + span, ring->buf, bytes - span);
+
+    portENTER_CRITICAL(&ring->mux);
+    ring->head = (head + bytes) % PTY_BUFFER_SIZE;
+    ring->count -= bytes;
+    portEXIT_CRITICAL(&ring->mux);
+
+    xSemaphoreGive(ring->writable);
+
+    return bytes;
+}
+
+// Put len bytes into the ring, blocking while it is full. Writers are
+// serialized, and the reader never touches the free space, so the copy is
+// done outside the critical section, as in ring_get.
+static void ring_put(pty_ring_t *ring, const char *buf, int len) {
+    int tail, bytes, span;
+
+    while (len > 0) {
+        xSemaphoreTake(ring->writer, portMAX_DELAY);
+
+        portENTER_CRITICAL(&ring->mux);
+        tail = (ring->head + ring->count) % PTY_BUFFER_SIZE;
+        bytes = PTY_BUFFER_SIZE - ring->count;
+        portEXIT_CRITICAL(&ring->mux);
+
+        if (bytes > len) {
+            bytes = len;
+        }
+
+        span = PTY_BUFFER_SIZE - tail;
+        if (span > bytes) {
+            span = bytes;
+        }
+
+        memcpy(ring->buf + tail, buf, span);
+        memcpy(ring->buf, buf + span, bytes - span);
+
+        portENTER_CRITICAL(&ring->mux);
+        ring->count += bytes;
+        portEXIT_CRITICAL(&ring->mux);
+
+        xSemaphoreGive(ring->writer);
+
+        if (bytes > 0) {
+            xSemaphoreGive(ring->readable);
+
+            buf += bytes;
+            len -= bytes;
+        } else {
+            xSemaphoreTake(ring->writable, portMAX_DELAY);
+        }
+    }
+}
+
+static int ring_read(pty_ring_t *ring, char *buf, int len, int to) {
+    if (to != portMAX_DELAY) {
+        to = to / portTICK_PERIOD_MS;
+    }
+
+    if (!ring_wait(ring, (TickType_t)to)) {
+        return 0;
+    }
+
+    return ring_get(ring, buf, len);
+}
+
+static int ring_has_bytes(pty_ring_t *ring, int to) {
+    if (to != portMAX_DELAY) {
+        to = to / portTICK_PERIOD_MS;
+    }
+
+    return ring_wait(ring, (TickType_t)to);
+}
+
 static void init() {
     if (!vfs_pty) {
         vfs_pty = calloc(1, sizeof(vfs_pty_t));
@@ -100,12 +265,9 @@ static void init() {
     vfs_pty->master_local_storage = vfs_create_fd_local_storage(1);
     assert(vfs_pty->master_local_storage != NULL);
 
-    // Create the slave and master queues
-    vfs_pty->slave_q = xQueueCreate(1024, sizeof(char));
-    assert(vfs_pty->slave_q != NULL);
-
-    vfs_pty->master_q = xQueueCreate(1024, sizeof(char));
-    assert(vfs_pty->master_q != NULL);
+    // Create the slave and master ring buffers
+    vfs_pty->slave_q = ring_create();
+    vfs_pty->master_q = ring_create();
 }
 
 static void register_master() {
@@ -162,25 +324,19 @@ void vfs_pty_register() {
 
 // Master functions
 static int master_has_bytes(int fd, int to) {
-    char c;
-
-    if (to != portMAX_DELAY) {
-        to = to / portTICK_PERIOD_MS;
-    }
-
-    return (xQueuePeek(vfs_pty->master_q, &c, (BaseType_t)to) == pdTRUE);
+    return ring_has_bytes(vfs_pty->master_q, to);
 }
 
 static int master_free(int fd) {
-    return uxQueueSpacesAvailable(vfs_pty->master_q);
+    return ring_free(vfs_pty->slave_q);
 }
 
-static int master_get(int fd, char *c) {
-    return xQueueReceive(vfs_pty->master_q, c, portMAX_DELAY);
+static int master_get(int fd, char *buf, int len, int to) {
+    return ring_read(vfs_pty->master_q, buf, len, to);
 }
 
-static void master_put(int fd, char *c) {
-    xQueueSend(vfs_pty->slave_q, c, portMAX_DELAY);
+static void master_put(int fd, const char *buf, int len) {
+    ring_put(vfs_pty->slave_q, buf, len);
 }
 
 static int vfs_ptm_open(const char *path, int flags, int mode) {
@@ -209,7 +365,7 @@ static int vfs_ptm_close(int fd) {
     }
 
     if (vfs_pty->master_q) {
-        xQueueReset(vfs_pty->master_q);
+        ring_reset(vfs_pty->master_q);
     }
 
     return 0;
@@ -220,7 +376,7 @@ static ssize_t vfs_ptm_read(int fd, void * dst, size_t size) {
         init();
     }
 
-    return vfs_generic_read(vfs_pty->master_local_storage, master_has_bytes, master_get, fd, dst, size);
+    return vfs_generic_read(vfs_pty->master_local_storage, master_get, fd, dst, size);
 }
 
 static ssize_t vfs_ptm_write(int fd, const void *data, size_t size) {
@@ -261,25 +417,19 @@ static int vfs_ptm_ioctl(int fd, int request, va_list args) {
 
 // Slave functions
 static int slave_has_bytes(int fd, int to) {
-    char c;
-
-    if (to != portMAX_DELAY) {
-        to = to / portTICK_PERIOD_MS;
-    }
-
-    return (xQueuePeek(vfs_pty->slave_q, &c, (BaseType_t)to) == pdTRUE);
+    return ring_has_bytes(vfs_pty->slave_q, to);
 }
 
 static int slave_free(int fd) {
-    return uxQueueSpacesAvailable(vfs_pty->slave_q);
+    return ring_free(vfs_pty->master_q);
 }
 
-static int slave_get(int fd, char *c) {
-    return xQueueReceive(vfs_pty->slave_q, c, portMAX_DELAY);
+static int slave_get(int fd, char *buf, int len, int to) {
+    return ring_read(vfs_pty->slave_q, buf, len, to);
 }
 
-static void slave_put(int fd, char *c) {
-    xQueueSend(vfs_pty->master_q, c, portMAX_DELAY);
+static void slave_put(int fd, const char *buf, int len) {
+    ring_put(vfs_pty->master_q, buf, len);
 }
 
 static int vfs_pts_open(const char *path, int flags, int mode) {
@@ -309,7 +459,7 @@ static int vfs_pts_close(int fd) {
     }
 
     if (vfs_pty->slave_q) {
-        xQueueReset(vfs_pty->slave_q);
+        ring_reset(vfs_pty->slave_q);
     }
 
     return 0;
@@ -328,7 +478,7 @@ static ssize_t vfs_pts_read(int fd, void * dst, size_t size) {
         init();
     }
 
-    return vfs_generic_read(vfs_pty->slave_local_storage, slave_has_bytes, slave_get, fd, dst, size);
+    return vfs_generic_read(vfs_pty->slave_local_storage, slave_get, fd, dst, size);
 }
 
 static ssize_t vfs_pts_writev(int fd, const struct iovec *iov, int iovcnt) {
@@ -583,6 +583,11 @@ int vfs_ramfs_mount(const char *target) {
 
     config.size = CONFIG_LUA_RTOS_RAM_FS_SIZE;
     config.block_size = CONFIG_LUA_RTOS_RAM_FS_BLOCK_SIZE;
+#if CONFIG_LUA_RTOS_RAM_FS_BLOCK_INDEX
+    config.block_index = 1;
+#else
+    config.block_index = 0;
+#endif
 
     syslog(LOG_INFO, "ramfs size %d Kb, block size %d bytes", config.size / 1024, config.block_size);
 
@@ -60,39 +60,23 @@ extern FILE *lua_stdout_file;
 // Local storage for file descriptors
 static vfs_fd_local_storage_t *local_storage;
 
-static int has_bytes(int fd, int to) {
-	char c;
-
-	if (to != portMAX_DELAY) {
-		to = to / portTICK_PERIOD_MS;
-	}
-
-	return (xQueuePeek(uart_get_queue(fd), &c, (BaseType_t)to) == pdTRUE);
-}
-
-static int get(int fd, char *c) {
-	return uart_read(fd, c, portMAX_DELAY);
+static int get(int fd, char *buf, int len, int to) {
+	return uart_readn(fd, buf, len, to);
 }
 
-static void put(int fd, char *c) {
-    uart_write(fd, *c);
+static void put(int fd, const char *buf, int len) {
+    uart_writen(fd, buf, len);
     if (lua_stdout_file) {
-    	fwrite(c, 1, 1, lua_stdout_file);
+    	fwrite(buf, 1, len, lua_stdout_file);
     }
 }
 
 static int tty_has_bytes(int fd, int to) {
-    char c;
-
-    if (to != portMAX_DELAY) {
-        to = to / portTICK_PERIOD_MS;
-    }
-
-    return (xQueuePeek(uart_get_queue(fd), &c, (BaseType_t)to) == pdTRUE);
+    return uart_rx_wait(fd, to);
 }
 
 static int tty_free(int fd) {
-    return uxQueueSpacesAvailable(uart_get_queue(fd));
+    return uart_tx_space(fd);
 }
 
 static int vfs_tty_select(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptset, struct timeval *timeout) {
@@ -135,7 +119,7 @@ static ssize_t vfs_tty_write(int fd, const void *data, size_t size) {
 }
 
 static ssize_t vfs_tty_read(int fd, void * dst, size_t size) {
-	return vfs_generic_read(local_storage, has_bytes, get, fd, dst, size);
+	return vfs_generic_read(local_storage, get, fd, dst, size);
 }
 
 static int vfs_tty_fstat(int fd, struct stat * st) {
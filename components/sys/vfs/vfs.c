@@ -49,6 +49,9 @@
 #include <stdarg.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
 
 #if CONFIG_LUA_RTOS_USE_SPIFFS
 #include <spiffs.h>
@@ -205,77 +208,72 @@ int vfs_generic_fcntl(vfs_fd_local_storage_t *local_storage, int fd, int cmd, va
     return result;
 }
 
-ssize_t vfs_generic_read(vfs_fd_local_storage_t *local_storage, vfs_has_bytes has_bytes, vfs_get_byte get, int fd, void * dst, size_t size) {
-    char *c = (char *)dst;
-    int bytes = 0;
+ssize_t vfs_generic_read(vfs_fd_local_storage_t *local_storage, vfs_get_bytes get, int fd, void * dst, size_t size) {
+    int bytes;
 
-    while (size) {
-        if (local_storage && (local_storage[fd].flags & O_NONBLOCK)) {
-            if (!has_bytes(fd, 0)) {
-                if (bytes > 0) {
-                    return bytes;
-                }
+    if (size == 0) {
+        return 0;
+    }
 
-                errno = EAGAIN;
-                return -1;
-            }
-        } else {
-            if (!has_bytes(fd, 0) && (bytes > 0)) {
-                return bytes;
-            }
+    if (local_storage && (local_storage[fd].flags & O_NONBLOCK)) {
+        // Only take what is already there
+        bytes = get(fd, (char *)dst, size, 0);
+        if (bytes <= 0) {
+            errno = EAGAIN;
+            return -1;
         }
-
-        if (!get(fd, c)) {
+    } else {
+        // Wait for the first byte, and then take what is available
+        bytes = get(fd, (char *)dst, size, portMAX_DELAY);
+        if (bytes <= 0) {
             errno = EIO;
             return -1;
         }
-
-        c++;
-        size--;
-        bytes++;
     }
 
     return bytes;
 }
 
-ssize_t vfs_generic_write(vfs_fd_local_storage_t *local_storage, vfs_put_byte put, int fd, const void *data, size_t size) {
-    char *c = (char *)data;
-    int bytes = 0;
+ssize_t vfs_generic_write(vfs_fd_local_storage_t *local_storage, vfs_put_bytes put, int fd, const void *data, size_t size) {
+    const char *c = (const char *)data;
 
-    while (size) {
 #if CONFIG_NEWLIB_STDOUT_LINE_ENDING_LF
-        char n;
+    const char *end = c + size;
+    const char *nl;
+
+    // Put the spans between new lines, translating each \n to \r\n
+    while (c < end) {
+        nl = memchr(c, '\n', end - c);
+        if (!nl) {
+            put(fd, c, end - c);
+            break;
+        }
 
-        if (*c=='\n') {
-            n = '\r';
-            put(fd, &n);
+        if (nl > c) {
+            put(fd, c, nl - c);
         }
-#endif
 
-        put(fd, c);
-        c++;
-        size--;
-        bytes++;
+        put(fd, "\r\n", 2);
+        c = nl + 1;
     }
+#else
+    if (size > 0) {
+        put(fd, c, size);
+    }
+#endif
 
-    return bytes;
+    return size;
 }
 
-ssize_t vfs_generic_writev(vfs_fd_local_storage_t *local_storage, vfs_put_byte put, int fd, const struct iovec *iov, int iovcnt) {
+ssize_t vfs_generic_writev(vfs_fd_local_storage_t *local_storage, vfs_put_bytes put, int fd, const struct iovec *iov, int iovcnt) {
     int bytes = 0;
-    int len = 0;
-    char *c;
 
     while (iovcnt) {
-        c = (char *)iov->iov_base;
-        len = iov->iov_len;
-
-        while (len) {
-            put(fd, c);
-            c++;
-            len--;
-            bytes++;
+        if (iov->iov_len > 0) {
+            put(fd, (const char *)iov->iov_base, iov->iov_len);
+            bytes += iov->iov_len;
         }
+
         iov++;
         iovcnt--;
     }
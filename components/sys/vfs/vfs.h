@@ -81,13 +81,14 @@ typedef int(*vfs_has_bytes)(int, int);
 // This function is non blocking.
 typedef int(*vfs_free_bytes)(int);
 
-// Get one byte from the file descriptor.
-// This functions is blocking.
-typedef int(*vfs_get_byte)(int,char *);
+// Get up to len bytes from the file descriptor, waiting at most to milliseconds
+// for the first one. Bytes that are already available are copied without waiting.
+// Returns the number of bytes copied, 0 on timeout.
+typedef int(*vfs_get_bytes)(int, char *, int, int);
 
-// Put one byte to the file descriptor.
+// Put len bytes to the file descriptor.
 // This function is blocking.
-typedef void(*vfs_put_byte)(int,char *);
+typedef void(*vfs_put_bytes)(int, const char *, int);
 
 int vfs_fat_mount(const char *target);
 int vfs_fat_umount(const char *target);
@@ -114,9 +115,9 @@ int vfs_romfs_umount(const char *target);
 int vfs_romfs_fsstat(const char *target, u32_t *total, u32_t *used);
 
 int vfs_generic_fcntl(vfs_fd_local_storage_t *local_storage, int fd, int cmd, va_list args);
-ssize_t vfs_generic_read(vfs_fd_local_storage_t *local_storage, vfs_has_bytes has_bytes, vfs_get_byte get, int fd, void * dst, size_t size);
-ssize_t vfs_generic_write(vfs_fd_local_storage_t *local_storage, vfs_put_byte put, int fd, const void *data, size_t size);
-ssize_t vfs_generic_writev(vfs_fd_local_storage_t *local_storage, vfs_put_byte put, int fd, const struct iovec *iov, int iovcnt);
+ssize_t vfs_generic_read(vfs_fd_local_storage_t *local_storage, vfs_get_bytes get, int fd, void * dst, size_t size);
+ssize_t vfs_generic_write(vfs_fd_local_storage_t *local_storage, vfs_put_bytes put, int fd, const void *data, size_t size);
+ssize_t vfs_generic_writev(vfs_fd_local_storage_t *local_storage, vfs_put_bytes put, int fd, const struct iovec *iov, int iovcnt);
 int vfs_generic_select(vfs_fd_local_storage_t *local_storage, vfs_has_bytes has_bytes, vfs_free_bytes free, int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptset, struct timeval *timeout);
 
 vfs_dir_t *vfs_allocate_dir(const char *vfs, const char *name);